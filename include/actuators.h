@@ -3,15 +3,21 @@
 #define __ACTUATORS_H__
 
 #include <Arduino.h>
+#include "config.h"
 
 
 typedef struct actuatorQueueItem
 {
-  uint8_t data;        // every bit corresponds with an actuator
+  uint16_t data;       // every bit corresponds with an actuator
+#if (CFG_TELEMETRY_LATENCY == true)
+  uint32_t stampUs;    // enqueue time (telemetry), set by actuatorsQueueSend
+#endif
 } actuatorQueueItem_t;
 
 extern int actuatorsQueueSend(actuatorQueueItem_t *, TickType_t);
 extern void powerUpActuators(void);
+extern uint16_t getActuatorsActual(void);
+extern void actuatorsReport(void);
 extern void initActuators(void);
 
 #endif
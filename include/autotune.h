@@ -0,0 +1,229 @@
+//
+// autotune
+//
+
+#ifndef __AUTOTUNE_H__
+#define __AUTOTUNE_H__
+
+#include <stdint.h>
+#include <math.h>
+
+// Relay auto-tuner (Astrom-Hagglund) for the PID gains (see pid.h).
+//
+// A relay (heating or cooling) is switched around the set-point with a small
+// hysteresis, which makes the temperature oscillate in a limit cycle:
+//
+//   heating : on when temperature <= set-point - hysteresis
+//             off when temperature >= set-point + hysteresis
+//   cooling : the other way round
+//
+// Each cycle (relay on to relay on) gives the period Tu and the amplitude a
+// of the temperature. The first cycle (start-up transient) is not used, the
+// experiment ends when two cycles agree within tolerancePercent. The relay
+// swings the output 0 .. PID_OUTPUT_MAX, so d = PID_OUTPUT_MAX / 2 and
+//
+//   Ku = 4 d / (pi * sqrt(a^2 - hysteresis^2))
+//
+// Gains by the Tyreus-Luyben rule (less overshoot than Ziegler-Nichols,
+// suits slow thermal processes) : Kp = Ku / 2.2, Ti = 2.2 Tu, Td = Tu / 6.3.
+//
+// The relay stays off at least minOffMs, the same as the compressor on-delay
+// of the actuators task, so the requested relay state is the actual state.
+// The experiment fails when the temperature leaves set-point +- maxDeviation,
+// or it does not converge within maxCycles / maxDurationMs.
+//
+// Temperatures are degrees * 10.
+
+#define AUTOTUNE_RELAY_AMPLITUDE  500.0f    // d, per mille (relay 0 .. 1000)
+
+typedef enum : uint8_t
+{
+  e_autotune_idle,
+  e_autotune_running,
+  e_autotune_done,
+  e_autotune_failed
+} autoTuneState_t;
+
+typedef struct
+{
+  int16_t hysteresis_x10;       // above sensor noise
+  int16_t maxDeviation_x10;
+  uint32_t minOffMs;            // compressor protection
+  uint32_t maxDurationMs;
+  uint8_t maxCycles;
+  uint8_t tolerancePercent;
+} autoTuneParams_t;
+
+class RelayAutoTune
+{
+private:
+  autoTuneParams_t params;
+  autoTuneState_t state;
+  int16_t setPoint_x10;
+  bool cooling;
+  bool relayOn;
+  uint32_t startMs;
+  uint32_t switchMs;            // last relay switch
+  uint32_t cycleStartMs;        // last relay on
+  bool cycleStarted;
+  int16_t cycleMax_x10;
+  int16_t cycleMin_x10;
+  uint8_t cycles;               // completed cycles
+  float periodMs[2];            // last two cycles
+  float amplitude_x10[2];
+
+  static bool near(float a, float b, uint8_t percent)
+  {
+    return fabsf(a - b) <= fabsf(b) * percent / 100.0f;
+  }
+
+  void finishCycle(uint32_t nowMs)
+  {
+    periodMs[0] = periodMs[1];
+    amplitude_x10[0] = amplitude_x10[1];
+    periodMs[1] = (float)(nowMs - cycleStartMs);
+    amplitude_x10[1] = (cycleMax_x10 - cycleMin_x10) / 2.0f;
+    cycles++;
+
+    // first cycle is the start-up transient
+    if ((cycles >= 3) &&
+        near(periodMs[1], periodMs[0], params.tolerancePercent) &&
+        near(amplitude_x10[1], amplitude_x10[0], params.tolerancePercent) &&
+        (amplitude_x10[1] > params.hysteresis_x10))
+    {
+      state = e_autotune_done;
+      relayOn = false;
+    }
+    else if (cycles >= params.maxCycles)
+    {
+      state = e_autotune_failed;
+      relayOn = false;
+    }
+  }
+
+public:
+  RelayAutoTune(const autoTuneParams_t &autoTuneParams)
+  {
+    params = autoTuneParams;
+    state = e_autotune_idle;
+    relayOn = false;
+  }
+
+  void start(uint32_t nowMs, int16_t setPointx10, bool coolingRelay)
+  {
+    state = e_autotune_running;
+    setPoint_x10 = setPointx10;
+    cooling = coolingRelay;
+    relayOn = false;
+    startMs = nowMs;
+    // relay may have been on just before : wait minOffMs before switching on
+    switchMs = nowMs;
+    cycleStarted = false;
+    cycles = 0;
+  }
+
+  void stop(void)
+  {
+    state = e_autotune_idle;
+    relayOn = false;
+  }
+
+  // new temperature reading : relay state to apply
+  bool update(uint32_t nowMs, int16_t temperature_x10)
+  {
+    int16_t error_x10;
+
+    if (state != e_autotune_running)
+    {
+      return false;
+    }
+
+    if ((temperature_x10 > setPoint_x10 + params.maxDeviation_x10) ||
+        (temperature_x10 < setPoint_x10 - params.maxDeviation_x10) ||
+        (nowMs - startMs > params.maxDurationMs))
+    {
+      state = e_autotune_failed;
+      relayOn = false;
+      return relayOn;
+    }
+
+    if (temperature_x10 > cycleMax_x10)
+    {
+      cycleMax_x10 = temperature_x10;
+    }
+    if (temperature_x10 < cycleMin_x10)
+    {
+      cycleMin_x10 = temperature_x10;
+    }
+
+    // distance to set-point in the direction the relay drives
+    error_x10 = cooling ? temperature_x10 - setPoint_x10 : setPoint_x10 - temperature_x10;
+
+    if (!relayOn && (error_x10 >= params.hysteresis_x10) && (nowMs - switchMs >= params.minOffMs))
+    {
+      relayOn = true;
+      switchMs = nowMs;
+
+      if (cycleStarted)
+      {
+        finishCycle(nowMs);
+      }
+      cycleStarted = true;
+      cycleStartMs = nowMs;
+      cycleMax_x10 = temperature_x10;
+      cycleMin_x10 = temperature_x10;
+    }
+    else if (relayOn && (error_x10 <= -params.hysteresis_x10))
+    {
+      relayOn = false;
+      switchMs = nowMs;
+    }
+
+    return relayOn;
+  }
+
+  autoTuneState_t getState(void)
+  {
+    return state;
+  }
+
+  uint8_t getCycles(void)
+  {
+    return cycles;
+  }
+
+  // result of the last cycle, false if not done
+  bool getUltimate(float &ku, float &tuMs)
+  {
+    float a_x10 = amplitude_x10[1];
+    float h_x10 = params.hysteresis_x10;
+
+    if (state != e_autotune_done)
+    {
+      return false;
+    }
+
+    ku = 4.0f * AUTOTUNE_RELAY_AMPLITUDE / ((float)M_PI * sqrtf(a_x10 * a_x10 - h_x10 * h_x10));
+    tuMs = periodMs[1];
+    return true;
+  }
+
+  // PID gains for pid.h at samplePeriodMs, false if not done
+  bool getGains(uint32_t samplePeriodMs, float &kp, float &ki, float &kd)
+  {
+    float ku;
+    float tuMs;
+
+    if (!getUltimate(ku, tuMs))
+    {
+      return false;
+    }
+
+    kp = ku / 2.2f;
+    ki = kp * samplePeriodMs / (2.2f * tuMs);
+    kd = kp * (tuMs / 6.3f) / samplePeriodMs;
+    return true;
+  }
+};
+
+#endif
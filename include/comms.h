@@ -2,6 +2,7 @@
 #ifndef __COMMS_H__
 #define __COMMS_H__
 
+#include "config.h"
 
 typedef enum
 {
@@ -14,10 +15,12 @@ typedef enum
 typedef struct commsQueueItem
 {
   bool valid;
-  commsyQueueDataType_t type;
-  uint16_t temperature_x10;
+  commsyQueueDataType_t type;                         // temperatures : see statestore.h
   uint16_t SG_x1000;
   uint16_t battteryLevel_x1000;
+#if (CFG_TELEMETRY_LATENCY == true)
+  uint32_t stampUs;                                   // enqueue time (telemetry), set by communicationQueueSend
+#endif
 } commsQueueItem_t;
 
 
@@ -18,6 +18,7 @@
 #define CFG_TEMP_SENSOR_TYPE_DS18B20_ENABLED    false
 #define CFG_TEMP_SENSOR_TYPE_SHT3X_ENABLED      false
 #define CFG_TEMP_SENSOR_TYPE_SHT4X_ENABLED      false
+#define CFG_TEMP_SENSOR_TYPE_NTC_ENABLED        false
 
 // SENSOR SPECIFIC OPTIONS
 #define CFG_TEMP_SENSOR_SCAN_I2C                          false
@@ -29,6 +30,114 @@
 //#define CFG_TEMP_IN_FARENHEID          true
 #define CFG_TEMP_SMOOTH_NUM_SAMPLES     7             // must be odd number
 #define CFG_TEMP_SMOOTH_MAX_DEVIATION   10            // 1 degree * 10
+#define CFG_HUMIDITY_SMOOTH_MAX_DEVIATION 30          // 3 %RH * 10 (SHT3x / SHT4x)
+#define CFG_TEMP_SAMPLE_PERIOD_MS       1000          // sample period of default profile (conversion is pipelined)
+#define CFG_TEMP_SENSOR_PROFILE         e_sensors_profile_default  // sampling profile at boot (see sensors.h)
+#define CFG_TEMP_REPORT_DEADBAND        1             // 0.1 degree * 10, smaller changes are not reported
+#define CFG_TEMP_REPORT_MIN_INTERVAL_MS 1000          // changes are reported at most this often
+#define CFG_TEMP_REPORT_HEARTBEAT_MS    30000         // unchanged values are reported after this time
+#define CFG_TEMP_DS18B20_MAX_RESOLUTION 12            // 9..12 bits, lowered when conversion does not fit in sample period
+#define CFG_TEMP_MAX_NR_SENSORS         4             // probes on the sensor bus, each reported with its own sensor-id
+#define CFG_TEMP_SENSOR_MAX_ERRORS      3             // consecutive failed reads before a probe is reported as failed
+#define CFG_TEMP_DS18B20_USE_RMT        false         // 1-Wire timing by RMT peripheral instead of bit-banging
+#define CFG_TEMP_RMT_TX_CHANNEL         0             // RMT channels used by 1-Wire (S3 : TX 0..3, RX 4..7)
+#define CFG_TEMP_RMT_RX_CHANNEL         4
+#define CFG_TEMP_STATS_INTERVAL         60            // log sensor read statistics every .. scans (0 = off)
+
+// NTC : voltage divider, series resistor to CFG_NTC_SUPPLY_MV, NTC to ground
+// ADC1 channels are sampled continuously (DMA), all samples of a sample period are averaged
+#define CFG_NTC_NR_CHANNELS             2             // <= CFG_TEMP_MAX_NR_SENSORS
+#define CFG_NTC_ADC_CHANNELS            { ADC1_CHANNEL_0, ADC1_CHANNEL_1 }  // GPIO 1, 2
+#define CFG_NTC_SAMPLE_FREQ_HZ          1000          // ADC conversions per second, all channels
+#define CFG_NTC_SUPPLY_MV               3300
+#define CFG_NTC_SERIES_OHM              10000.0
+#define CFG_NTC_SH_A                    1.009249522e-3  // Steinhart-Hart coefficients (10K NTC)
+#define CFG_NTC_SH_B                    2.378405444e-4
+#define CFG_NTC_SH_C                    2.019202697e-7
+#define CFG_NTC_LUT_SEGMENTS_LOG2       7             // 128 segments, < 0.15 degree interpolation error
+
+// SIMULATION : fermentation chamber model, driven by the actual relay states
+#define CFG_SIM_SEED                    1             // same seed & relay sequence -> same readings
+#define CFG_SIM_START_TEMP              20.0f
+#define CFG_SIM_AMBIENT_TEMP            20.0f
+#define CFG_SIM_WORT_KG                 20.0f
+#define CFG_SIM_CHAMBER_J_PER_K         20000.0f      // air, walls & shelves
+#define CFG_SIM_WORT_CHAMBER_W_PER_K    8.0f
+#define CFG_SIM_CHAMBER_AMBIENT_W_PER_K 1.5f
+#define CFG_SIM_COOLING_W               150.0f
+#define CFG_SIM_HEATING_W               60.0f
+#define CFG_SIM_COMPRESSOR_TAU_S        120.0f
+#define CFG_SIM_HEATER_TAU_S            30.0f
+#define CFG_SIM_FERMENTATION_W          3.0f
+#define CFG_SIM_SENSOR_NOISE            0.05f         // degrees
+#define CFG_SIM_COOL_RELAY              0
+#define CFG_SIM_HEAT_RELAY              1
+
+// CONTROLLER : jobs (API calls, NTP, display time, hydrometer) are run by the controller task
+#define CFG_CTRL_SCHED_COALESCE_MS      20            // jobs due within this window run in one wakeup
+#define CFG_CTRL_SCHED_DUMP_INTERVAL_S  600           // log upcoming job deadlines every .. seconds (0 = off)
+#define CFG_TELEMETRY_INTERVAL_S        60            // log task, queue & idle telemetry every .. seconds (0 = off)
+#define CFG_TELEMETRY_ON_DISPLAY        false         // also show a telemetry summary on the status bar (10 s)
+#define CFG_TELEMETRY_LATENCY           true          // queue items carry their enqueue time : +4 bytes per item (see telemetry.h)
+#define CFG_TELEMETRY_STACK_WARN        512           // warn when a task has less stack never used (bytes)
+#define CFG_CTRL_LANE_SAFETY_LENGTH     4             // controller queue lanes (messages), see controllerPolicies
+#define CFG_CTRL_LANE_NORMAL_LENGTH     6
+#define CFG_CTRL_LANE_BULK_LENGTH       4
+#define CFG_CTRL_BLOCK_MS               50            // senders of must-deliver messages wait at most this long for room
+
+// FALLBACK : local thermostat while the backend is unreachable (see fallback.h)
+#define CFG_FALLBACK_TIMEOUT_S          300           // no valid IoT API response for .. seconds : take over
+#define CFG_FALLBACK_HYSTERESIS_X10     5             // 0.5 degree * 10
+#define CFG_FALLBACK_SENSOR             0             // sensor-id used for control
+#define CFG_FALLBACK_COOL_RELAY         0             // relay number, -1 = none
+#define CFG_FALLBACK_HEAT_RELAY         1             // relay number, -1 = none
+
+// PID : heating elements through SSRs, time-proportioned output (see pid.h, ssr.h)
+#define CFG_PID_ENABLE                  false
+#define CFG_PID_PERIOD_MS               2000          // sample period (one SSR window), gains are per sample
+#define CFG_PID_KP                      40.0f         // per mille per 0.1 degree
+#define CFG_PID_KI                      0.2f          // per mille per 0.1 degree, per sample
+#define CFG_PID_KD                      100.0f        // per mille per 0.1 degree change, per sample
+#define CFG_PID_DERIVATIVE_SHIFT        4             // derivative low-pass over 2^n samples
+#define CFG_PID_SENSOR                  0             // sensor-id used for control
+#define CFG_PID_SETPOINT_LOCAL          false         // true : CFG_PID_SETPOINT_X10, false : PRO API targetState.tempCelsius
+#define CFG_PID_SETPOINT_X10            650           // 65.0 degree * 10
+#define CFG_SSR_NR_CHANNELS             2             // elements, all driven with the same duty
+#define CFG_SSR_PINS                    { GPIO_NUM_5, GPIO_NUM_6 }
+#define CFG_SSR_ON_LEVEL                1
+#define CFG_SSR_WINDOW_MS               2000          // time-proportioning window
+#define CFG_SSR_MIN_PULSE_MS            20            // shorter on/off times are skipped (one mains cycle)
+
+// AUTO-TUNE : relay experiment for the PID gains (see autotune.h), results in Preferences
+#define CFG_AUTOTUNE_RELAY              1             // relay number driven by the experiment
+#define CFG_AUTOTUNE_COOLING            false         // true : relay cools (respects CFG_RELAY0_ON_DELAY)
+#define CFG_AUTOTUNE_HYSTERESIS_X10     2             // 0.2 degree * 10, above sensor noise
+#define CFG_AUTOTUNE_MAX_DEVIATION_X10  50            // abort when 5 degrees from set-point
+#define CFG_AUTOTUNE_MAX_CYCLES         12
+#define CFG_AUTOTUNE_MAX_DURATION_H     24
+#define CFG_AUTOTUNE_TOLERANCE_PERCENT  10            // two cycles agree within .. % : done
+
+// MPC : compressor scheduled locally on an identified model (see mpc.h), the
+// backend only provides the set-point. Minimum off time is the relay on-delay.
+#define CFG_MPC_ENABLE                  false
+#define CFG_MPC_COOL_RELAY              0             // compressor relay number, backend & fallback drive the others
+#define CFG_MPC_HEAT_RELAY              1             // relay kept off while the compressor runs, -1 = none
+#define CFG_MPC_SENSOR                  0             // sensor-id used for control (wort)
+#define CFG_MPC_SAMPLE_MS               10000         // temperature sample period
+#define CFG_MPC_SAMPLES_PER_STEP        12            // model step : 120 s
+#define CFG_MPC_HORIZON                 40            // steps (80 minutes), about one compressor cycle
+#define CFG_MPC_SWITCH_COST             300.0f        // per compressor switch, in (0.1 degree)^2 steps
+#define CFG_MPC_MIN_ON_S                180           // minimum compressor run time
+#define CFG_MPC_MODEL_H                 6             // identification before the model is used
+#define CFG_MPC_HYSTERESIS_X10          3             // 0.3 degree * 10, thermostat until then
+#define CFG_MPC_FORGETTING              0.998f        // RLS, memory about 500 steps
+
+// PROFILE : local set-point schedule from LittleFS (see profile.h, profile.cpp)
+#define CFG_PROFILE_ENABLE              false
+#define CFG_PROFILE_PATH                "/profile.json"
+#define CFG_PROFILE_TICK_MS             CFG_TEMP_SAMPLE_PERIOD_MS   // set-point interpolation & step transitions
+#define CFG_PROFILE_AUTOSTART           false         // start the profile at boot (a running profile always resumes)
+#define CFG_PROFILE_SAVE_S              600           // progress saved (Preferences) at least this often
 
 // HYDROBRICK
 // CFG_HYDRO_ENABLE is defines in platformio.ini file
@@ -45,6 +154,8 @@
 
 #define CFG_RELAY_TYPE_GPIO             true
 #define CFG_RELAY_TYPE_IOEXP            false
+#define CFG_RELAY_COUNT                 2             // CFG_RELAY<n>_* below for n = 0 .. count-1, max 16
+#define CFG_RELAY_RETAIN                true          // on-delays continue over a warm reset (RTC memory), else restart at boot
 
 #if (CFG_RELAY_TYPE_GPIO == true)
 //#define CFG_RELAY0_PIN                  GPIO_NUM_17
@@ -52,7 +163,7 @@
 #define CFG_RELAY0_ON_LEVEL             0
 #define CFG_RELAY0_OUTPUT_TYPE          OUTPUT_OPEN_DRAIN     // or OUTPUT
 #define CFG_RELAY0_ON_DELAY             200                   // compressor-delay in seconds
-#define CFG_RELAY0_OFF_DELAY            0
+#define CFG_RELAY0_OFF_DELAY            0                     // minimum run time in seconds
 #define CFG_RELAY0_LABEL                "Cool"
 
 // #define CFG_RELAY1_PIN                  GPIO_NUM_4
@@ -68,7 +179,7 @@
 #define CFG_RELAY0_PIN                  0
 #define CFG_RELAY0_ON_LEVEL             1
 #define CFG_RELAY0_ON_DELAY             200                   // compressor-delay in seconds
-#define CFG_RELAY0_OFF_DELAY            0
+#define CFG_RELAY0_OFF_DELAY            0                     // minimum run time in seconds
 #define CFG_RELAY0_LABEL                "Cool"
 
 #define CFG_RELAY1_PIN                  1
@@ -110,6 +221,7 @@
 #define CFG_COMM_HOSTNAME               "bookesbrick"
 
 #define CFG_ENABLE_SCREENSHOT           false
+#define CFG_DISPLAY_LVGL_PERIOD_MS      100           // LVGL (refresh, touch) runs at most this often when idle
 
 //=============================================
 
@@ -119,6 +231,13 @@
 #define BBPREFS_SSID                    "bbPrSSID"
 #define BBPREFS_PASSWD                  "bbPrPasswd"
 #define BBPREFS_HOSTNAME                "bbPrHostname"
+#define BBPREFS_FALLBACK_SETPOINT       "bbPrFbSetPt"
+#define BBPREFS_PID_KP                  "bbPrPidKp"
+#define BBPREFS_PID_KI                  "bbPrPidKi"
+#define BBPREFS_PID_KD                  "bbPrPidKd"
+#define BBPREFS_PROFILE_RUN             "bbPrPfRun"
+#define BBPREFS_PROFILE_STEP            "bbPrPfStep"
+#define BBPREFS_PROFILE_ELAPSED         "bbPrPfElapsed"
 
 #define BBDRDTIMEOUT                    10
 // #define BBPINGURL                    CFG_COMM_BBURL_API_SERVER
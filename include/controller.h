@@ -3,28 +3,12 @@
 #define __CONTROLLER_H__
 
 #include "config.h"
+#include "msgpool.h"
+#include "lanes.h"
 
-// ====================================
-// CONTROLLER 
-// ====================================
-
-typedef enum 
-{
-#if (CFG_HYDRO_ENABLE == true)  
-    e_msg_timer_hydro,
-#endif    
-    e_msg_timer_iotapi,
-    e_msg_timer_proapi,
-    e_msg_timer_ntp, 
-    e_msg_timer_time
-} controllerQTimerMesgType_t;
-
-typedef struct 
-{
-  controllerQTimerMesgType_t mesgId;
-  uint8_t data;
-} controllerQTimerMesg_t;
-
+// Controller-Q messages are small fixed size items (all enums are 1 byte).
+// Large or rare payloads travel through the message pool (see msgpool.h),
+// only their pool-handle is copied into the queue.
 
 // ====================================
 // BUTTON 
@@ -48,17 +32,20 @@ typedef struct
 // SENSOR
 // ====================================
 
-typedef enum 
+typedef enum : uint8_t
 {
     e_msg_sensor_unknown,
     e_msg_sensor_numSensors,
-    e_msg_sensor_temperature
+    e_msg_sensor_temperature,
+    e_msg_sensor_humidity,
+    e_msg_sensor_profile         // request : switch sampling profile (data = sensorsProfile_t)
 } controllerQSensorMesgType_t;
 
 typedef struct 
 {
   controllerQSensorMesgType_t mesgId;
-  int16_t data;                // temperature multiplied by 10 | number of sensors
+  uint8_t number;              // sensor-id
+  int16_t data;                // temperature | humidity multiplied by 10 | number of sensors | profile
 } controllerQSensorMesg_t;
 
 
@@ -66,7 +53,7 @@ typedef struct
 // BACKEND : actuators / relays
 // ====================================
 
-typedef enum 
+typedef enum : uint8_t
 {
     e_msg_backend_unknown,
     e_msg_backend_actuators,
@@ -76,7 +63,9 @@ typedef enum
     e_msg_backend_device_name,
     e_msg_backend_time_update,
     e_msg_backend_next_IOTAPIcall_ms,
-    e_msg_backend_next_PROAPIcall_ms
+    e_msg_backend_next_PROAPIcall_ms,
+    e_msg_backend_autotune,        // request : start relay auto-tune (data16 = set-point * 10), valid = false : stop
+    e_msg_backend_profile          // request : start local profile at step data16, valid = false : stop
 } controllerQBackendMesgType_t;
 
 typedef struct 
@@ -84,16 +73,19 @@ typedef struct
   controllerQBackendMesgType_t mesgId;
   bool valid;
   uint8_t number;
-  int16_t data16;
-  uint32_t data32;
-  String * stringPtr;
+  union
+  {
+    int16_t data16;
+    uint32_t data32;
+    msgPoolHandle_t poolHandle;   // e_msg_backend_device_name : zero terminated name
+  };
 } controllerQBackendMesg_t;
 
 // ====================================
 // WiFi
 // ====================================
 
-typedef enum 
+typedef enum : uint8_t
 {
     e_msg_wifi_unknown,
     e_msg_wifi_unconnected,
@@ -105,8 +97,8 @@ typedef enum
 typedef struct 
 {
   controllerQWiFiMesgType_t wifiStatus;
-  int16_t rssi;
   bool valid;
+  int16_t rssi;
 } controllerQWiFiMesg_t;
 
 // ====================================
@@ -130,7 +122,7 @@ typedef struct
 // HydroBrick
 // ====================================
 
-typedef enum 
+typedef enum : uint8_t
 {
     e_cmsg_hydro_unknown,
     e_cmsg_hydro_reading,
@@ -155,26 +147,21 @@ typedef struct
 } hydrometerQData_t;
 
 
-typedef union
-{
-  hydrometerQData_t reading;
-  hydrometerQScannedBricks_t scannedBricks;
-} controllerHydroQData_t;
-
+static_assert(sizeof(hydrometerQData_t) <= MSGPOOL_SLOT_SIZE, "hydrometerQData_t does not fit in message pool slot");
+static_assert(sizeof(hydrometerQScannedBricks_t) <= MSGPOOL_SLOT_SIZE, "hydrometerQScannedBricks_t does not fit in message pool slot");
 
 typedef struct 
 {
   controllerQHydroMesgType_t mesgId;
-  controllerHydroQData_t data;
+  msgPoolHandle_t poolHandle;   // hydrometerQData_t | hydrometerQScannedBricks_t
 } controllerQHydroMesg_t;
 
 // ====================================
 // Controller-Q message
 // ====================================
 
-typedef enum 
+typedef enum : uint8_t
 {
-    e_mtype_controller,
     e_mtype_button,
     e_mtype_sensor,
     e_mtype_backend,
@@ -184,7 +171,6 @@ typedef enum
 
 typedef union 
 {
-  controllerQTimerMesg_t     controlMesg;
   // controllerQButtonMesg_t   buttonMesg;
   controllerQSensorMesg_t   sensorMesg;
   controllerQBackendMesg_t  backendMesg;
@@ -197,16 +183,38 @@ typedef union
 typedef struct 
 {
   controllerQMesgType_t type;
-  controllerQMesgData_t mesg;
   bool valid;
+  controllerQMesgData_t mesg;
+#if (CFG_TELEMETRY_LATENCY == true)
+  uint32_t stampUs;             // enqueue time (telemetry), set by controllerQueueSend : 12 -> 16 bytes
+#endif
 } controllerQItem_t;
 
+// ====================================
+// Lanes & backpressure
+// ====================================
+
+// Messages travel to the controller in lanes, the controller always takes
+// the highest priority lane first (see lanes.h). Lane and policy per message
+// class are declared in controller.cpp (controllerPolicies).
+
+typedef enum : uint8_t
+{
+    e_lane_safety,        // actuator commands, set-point, API scheduling
+    e_lane_normal,        // events : sensor setup, hydrometer, time
+    e_lane_bulk,          // telemetry : temperatures, delays, heartbeat, WiFi
+    e_lane_count
+} controllerLane_t;
+
+typedef laneStats_t controllerLaneStats_t;
+
 // ====================================
 // EXTERNALS
 // ====================================
 
 extern bool globalWifiConfigMode;
-extern int controllerQueueSend(controllerQItem_t *, TickType_t);
+extern int controllerQueueSend(controllerQItem_t *, TickType_t);   // pdTRUE when accepted (see policy)
+extern void controllerLaneStats(controllerLane_t lane, controllerLaneStats_t *stats);
 extern void initController(void);
 
 #endif
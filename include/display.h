@@ -3,6 +3,7 @@
 #define __DISPLAY__
 
 #include <Arduino.h>
+#include "config.h"
 
 typedef enum displayQueueDataType
 {
@@ -44,7 +45,7 @@ typedef union displayQueueData
 {
   int16_t temperature;
   int16_t setPoint;
-  uint8_t actuators;
+  uint16_t actuators;
   uint16_t compDelay;
   uint16_t time;
   uint16_t heartBeat;
@@ -60,13 +61,16 @@ typedef struct displayQueueItem
   displayQueueData_t data;
   bool valid;
   uint8_t number;
+#if (CFG_TELEMETRY_LATENCY == true)
+  uint32_t stampUs;     // enqueue time (telemetry), set by displayQueueSend
+#endif
 } displayQueueItem_t;
 
 
 extern int displayQueueSend(displayQueueItem_t *, TickType_t);
 extern void initDisplay(void);
 extern void initLVGL(void);
-extern void updateLVGL(void);
+extern uint32_t updateLVGL(void);   // returns ms until LVGL has work again
 extern void displayText(String *, displayMessageType_t, uint8_t);
 
 #endif
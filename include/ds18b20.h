@@ -0,0 +1,82 @@
+//
+// ds18b20
+//
+
+#ifndef __DS18B20_H__
+#define __DS18B20_H__
+
+#include <stdint.h>
+#include "onewire_rmt.h"
+
+// DS18B20 conversion timing and scratchpad decoding, independent of the bus
+// driver, so a host program can run the sensor pipeline against a simulated
+// probe.
+//
+// The sensors task pipelines the conversions : a conversion is started at the
+// end of a sample period and collected at the end of the next one, so the
+// resolution must be chosen such that the conversion fits in the period.
+
+#define DS18B20_MIN_RESOLUTION  9
+#define DS18B20_MAX_RESOLUTION  12
+
+// DS18B20 commands
+#define DS18B20_CONVERT_T       0x44
+#define DS18B20_WRITE_SCRATCH   0x4E
+#define DS18B20_READ_SCRATCH    0xBE
+
+// maximum conversion time (datasheet) :
+//  9 bits :  94 ms
+// 10 bits : 188 ms
+// 11 bits : 375 ms
+// 12 bits : 750 ms
+static inline uint16_t ds18b20ConversionMs(uint8_t bits)
+{
+  return 750 >> (DS18B20_MAX_RESOLUTION - bits);
+}
+
+// highest resolution (up to maxBits) of which the conversion fits in the
+// sample period, the lowest resolution when none fits
+static inline uint8_t ds18b20ResolutionForPeriod(uint16_t periodMs, uint8_t maxBits)
+{
+  uint8_t bits = maxBits;
+
+  while ((bits > DS18B20_MIN_RESOLUTION) && (ds18b20ConversionMs(bits) >= periodMs))
+  {
+    bits--;
+  }
+  return bits;
+}
+
+// configuration register (scratchpad byte 4) for a resolution
+static inline uint8_t ds18b20ConfigByte(uint8_t bits)
+{
+  return ((bits - DS18B20_MIN_RESOLUTION) << 5) | 0x1F;
+}
+
+// Scratchpad (9 bytes, CRC in the last) to temperature in 1/128 degrees
+// Celcius. An all zero scratchpad (no probe answering on a pulled down bus)
+// has a valid CRC too, it is rejected. Below 12 bits the low bits of the
+// reading are undefined, they are cleared for the resolution in byte 4.
+static inline bool ds18b20DecodeScratchpad(const uint8_t *scratchPad, int32_t &raw)
+{
+  uint8_t allBits = 0;
+  uint8_t bits = DS18B20_MIN_RESOLUTION + ((scratchPad[4] >> 5) & 3);
+  int16_t value;
+
+  for (uint8_t i = 0; i < 9; i++)
+  {
+    allBits |= scratchPad[i];
+  }
+
+  if ((allBits == 0) || (oneWireCrc8(scratchPad, 8) != scratchPad[8]))
+  {
+    return false;
+  }
+
+  value = (int16_t)((scratchPad[1] << 8) | scratchPad[0]);
+  value &= ~((1 << (DS18B20_MAX_RESOLUTION - bits)) - 1);
+  raw = (int32_t)value * 8;
+  return true;
+}
+
+#endif
@@ -0,0 +1,110 @@
+//
+// fallback
+//
+
+#ifndef __FALLBACK_H__
+#define __FALLBACK_H__
+
+#include <stdint.h>
+
+// Local hysteresis thermostat, controls the relays while the backend is
+// unreachable. The controller decides when it takes over and hands back
+// (backend response invalid or missing), this class only decides the relays:
+//
+//   temperature >= set-point + hysteresis : cool on
+//   temperature <= set-point              : cool off
+//   temperature <= set-point - hysteresis : heat on
+//   temperature >= set-point              : heat off
+//
+// Between these limits the relays keep their state, so a takeover continues
+// from the relays as the backend left them. Cooling and heating are never on
+// together. Without a set-point or a valid temperature all relays are off.
+//
+// Compressor (on/off) delays are enforced by the actuators task for every
+// relay request, whoever made it.
+
+class FallbackThermostat
+{
+private:
+  int16_t hysteresis_x10;
+  uint16_t coolMask;            // relay bits, 0 = no cooling / heating
+  uint16_t heatMask;
+  int16_t setPoint_x10;
+  bool setPointValid;
+  bool active;
+  uint16_t request;
+
+public:
+  FallbackThermostat(int16_t hysteresisx10, uint16_t coolRelayMask, uint16_t heatRelayMask)
+  {
+    hysteresis_x10 = hysteresisx10;
+    coolMask = coolRelayMask;
+    heatMask = heatRelayMask;
+    setPoint_x10 = 0;
+    setPointValid = false;
+    active = false;
+    request = 0;
+  }
+
+  // last known set-point, kept while the backend is gone
+  void setSetPoint(int16_t setPointx10)
+  {
+    setPoint_x10 = setPointx10;
+    setPointValid = true;
+  }
+
+  bool getSetPoint(int16_t &setPointx10)
+  {
+    setPointx10 = setPoint_x10;
+    return setPointValid;
+  }
+
+  // take over control, actuators : relays as the backend left them
+  void takeOver(uint16_t actuators)
+  {
+    request = actuators & (coolMask | heatMask);
+    if ((request & coolMask) && (request & heatMask))
+    {
+      request = 0;
+    }
+    active = true;
+  }
+
+  void handBack(void)
+  {
+    active = false;
+  }
+
+  bool isActive(void)
+  {
+    return active;
+  }
+
+  // relay request for a new temperature reading
+  uint16_t update(int16_t temperature_x10, bool temperatureValid)
+  {
+    if (!setPointValid || !temperatureValid)
+    {
+      request = 0;
+      return request;
+    }
+
+    if (temperature_x10 >= setPoint_x10 + hysteresis_x10)
+    {
+      request = coolMask;
+    }
+    else if (temperature_x10 <= setPoint_x10 - hysteresis_x10)
+    {
+      request = heatMask;
+    }
+    else if (((request & coolMask) && (temperature_x10 <= setPoint_x10)) ||
+             ((request & heatMask) && (temperature_x10 >= setPoint_x10)))
+    {
+      request = 0;
+    }
+
+    return request;
+  }
+};
+
+#endif
@@ -61,6 +61,9 @@ typedef struct hydroQMesg
 {
   hydroQMesgType_t mesgId;
   int16_t data;
+#if (CFG_TELEMETRY_LATENCY == true)
+  uint32_t stampUs;     // enqueue time (telemetry), set by hydroQueueSend
+#endif
 } hydroQueueItem_t;
 
 
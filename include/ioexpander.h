@@ -0,0 +1,104 @@
+//
+// ioexpander
+//
+
+#ifndef __IOEXPANDER_H__
+#define __IOEXPANDER_H__
+
+#include <stdint.h>
+
+// Shadow output register of a 16 bit I/O expander (TCA9555).
+//
+// Relay changes are staged in the shadow (set()), flush() writes all 16
+// outputs in one bus transaction (write16 : address, register, 2 bytes).
+// Writing pin by pin costs one transaction per pin, and the relays would not
+// switch together. Nothing is written when the register already holds the
+// value; a failed write is repeated by the next flush().
+//
+// Port is the expander driver, anything with bool write16(uint16_t), so a
+// host program can run it against a fake expander.
+
+typedef struct
+{
+  uint32_t writes;              // write16 transactions
+  uint32_t failed;
+  uint32_t skipped;             // flush without a change
+  uint32_t pinWrites;           // pins changed : transactions when written pin by pin
+} ioExpanderStats_t;
+
+template <class Port>
+class IoExpanderShadow
+{
+private:
+  Port &port;
+  uint16_t shadow;
+  uint16_t written;             // register content, valid when known
+  uint16_t outputs;             // pins in use (statistics)
+  bool known;
+  ioExpanderStats_t stats;
+
+public:
+  // outputs : pins in use, initial : power-on output register of the
+  // TCA9555 (all high)
+  IoExpanderShadow(Port &expanderPort, uint16_t outputPins, uint16_t initial = 0xFFFF) : port(expanderPort)
+  {
+    outputs = outputPins;
+    shadow = initial;
+    written = initial;
+    known = false;
+    stats = {0, 0, 0, 0};
+  }
+
+  void set(uint8_t pin, bool level)
+  {
+    if (level)
+    {
+      shadow |= (1 << pin);
+    }
+    else
+    {
+      shadow &= ~(1 << pin);
+    }
+  }
+
+  // write the shadow, force : also when unchanged (e.g. after an expander
+  // reset). Returns false when the write failed.
+  bool flush(bool force = false)
+  {
+    uint16_t changed = (known && !force) ? (shadow ^ written) : outputs;
+
+    if (known && (shadow == written) && !force)
+    {
+      stats.skipped++;
+      return true;
+    }
+
+    for (uint16_t bits = changed & outputs; bits; bits &= bits - 1)
+    {
+      stats.pinWrites++;
+    }
+    stats.writes++;
+
+    if (!port.write16(shadow))
+    {
+      stats.failed++;
+      known = false;
+      return false;
+    }
+    written = shadow;
+    known = true;
+    return true;
+  }
+
+  uint16_t getShadow(void)
+  {
+    return shadow;
+  }
+
+  void getStats(ioExpanderStats_t &expanderStats)
+  {
+    expanderStats = stats;
+  }
+};
+
+#endif
@@ -0,0 +1,208 @@
+//
+// lanes
+//
+
+#ifndef __LANES_H__
+#define __LANES_H__
+
+#include <stdint.h>
+#include "mailbox.h"
+
+// Lanes & backpressure of a message queue.
+//
+// Messages travel in lanes (a queue each), the receiver always takes the
+// highest priority lane (0) first. The class of a message decides its lane
+// and what happens when that lane is full (policy). Coalesced messages wait
+// in a mailbox slot per class & number and never fill a lane queue.
+//
+// Port is the queue driver, and knows the message classes, so a host program
+// can flood the lanes through a fake queue :
+//
+//   bool send(uint8_t lane, const ITEM &item, uint32_t waitTicks)
+//   bool sendToFront(uint8_t lane, const ITEM &item)
+//   bool receive(uint8_t lane, ITEM &item)
+//   bool peek(uint8_t lane, ITEM &item)
+//   uint8_t waiting(uint8_t lane)
+//   void lock(void), unlock(void)                  // protects mailbox & statistics
+//   laneClass_t classify(const ITEM &item, uint8_t &classIndex)
+//   uint8_t number(const ITEM &item)               // coalesce per class & number
+//   void discard(const ITEM &item)                 // dropped by drop-oldest
+
+typedef enum : uint8_t
+{
+  e_policy_block,               // wait for room (up to waitTicks), drop when still full
+  e_policy_drop_oldest,         // full lane : discard the oldest message (of a drop-oldest class)
+  e_policy_drop_newest,         // full lane : discard this message
+  e_policy_coalesce             // keep only the latest message (per class & number)
+} lanePolicy_t;
+
+typedef struct
+{
+  uint8_t lane;
+  lanePolicy_t policy;
+} laneClass_t;
+
+typedef struct
+{
+  uint32_t sent;
+  uint32_t dropped;
+  uint32_t coalesced;           // replaced by a newer message before it was handled
+  uint32_t blocked;             // sender had to wait
+  uint8_t highWater;            // max messages waiting
+} laneStats_t;
+
+template <typename ITEM, class Port, int LANES, int SLOTS>
+class Lanes
+{
+private:
+  Port &port;
+  Mailbox<ITEM, SLOTS> mailbox;
+  laneStats_t stats[LANES];
+
+public:
+  Lanes(Port &lanesPort) : port(lanesPort)
+  {
+    for (int lane = 0; lane < LANES; lane++)
+    {
+      stats[lane] = {0, 0, 0, 0, 0};
+    }
+  }
+
+  // send with the policy of the message class, waitTicks is only used by the
+  // block policy. Returns true when accepted, classIndex is set for telemetry.
+  bool send(const ITEM &item, uint32_t waitTicks, uint8_t &classIndex)
+  {
+    laneClass_t laneClass = port.classify(item, classIndex);
+    uint8_t lane = laneClass.lane;
+    uint8_t classOldest;
+    ITEM oldest;
+    bool r;
+    uint8_t waiting;
+
+    switch (laneClass.policy)
+    {
+    case e_policy_coalesce:
+      port.lock();
+      switch (mailbox.put(lane, classIndex, port.number(item), item))
+      {
+      case e_mailbox_replaced:
+        stats[lane].coalesced++;
+        r = true;
+        break;
+      case e_mailbox_added:
+        r = true;
+        break;
+      default:
+        r = false;
+        break;
+      }
+      port.unlock();
+      break;
+
+    case e_policy_block:
+      r = port.send(lane, item, 0);
+      if (!r)
+      {
+        port.lock();
+        stats[lane].blocked++;
+        port.unlock();
+        r = port.send(lane, item, waitTicks);
+      }
+      break;
+
+    case e_policy_drop_oldest:
+      r = port.send(lane, item, 0);
+      // only a message of a drop-oldest class makes room, never one that must be delivered
+      if (!r && port.peek(lane, oldest) &&
+          (port.classify(oldest, classOldest).policy == e_policy_drop_oldest) &&
+          port.receive(lane, oldest))
+      {
+        if (port.classify(oldest, classOldest).policy == e_policy_drop_oldest)
+        {
+          port.discard(oldest);
+          port.lock();
+          stats[lane].dropped++;
+          port.unlock();
+        }
+        else
+        {
+          // receiver took the peeked message meanwhile : put this one back
+          port.sendToFront(lane, oldest);
+        }
+        r = port.send(lane, item, 0);
+      }
+      break;
+
+    case e_policy_drop_newest:
+    default:
+      r = port.send(lane, item, 0);
+      break;
+    }
+
+    waiting = port.waiting(lane);
+
+    port.lock();
+    if (r)
+    {
+      stats[lane].sent++;
+    }
+    else
+    {
+      stats[lane].dropped++;
+    }
+    if (waiting > stats[lane].highWater)
+    {
+      stats[lane].highWater = waiting;
+    }
+    port.unlock();
+
+    return r;
+  }
+
+  // next message, highest priority lane first
+  bool receive(ITEM &item)
+  {
+    bool found;
+
+    for (uint8_t lane = 0; lane < LANES; lane++)
+    {
+      if (port.receive(lane, item))
+      {
+        return true;
+      }
+
+      port.lock();
+      found = mailbox.take(lane, item);
+      port.unlock();
+      if (found)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // messages waiting in the lane queues (not the mailbox)
+  uint8_t waiting(void)
+  {
+    uint8_t count = 0;
+
+    for (uint8_t lane = 0; lane < LANES; lane++)
+    {
+      count += port.waiting(lane);
+    }
+    return count;
+  }
+
+  void getStats(uint8_t lane, laneStats_t &laneStats)
+  {
+    if (lane < LANES)
+    {
+      port.lock();
+      laneStats = stats[lane];
+      port.unlock();
+    }
+  }
+};
+
+#endif
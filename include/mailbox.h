@@ -0,0 +1,112 @@
+//
+// mailbox
+//
+
+#ifndef __MAILBOX_H__
+#define __MAILBOX_H__
+
+#include <stdint.h>
+
+// Latest-wins message slots, for values that are sent periodically and of
+// which only the latest matters (temperatures, delays, heartbeat).
+//
+// A message is identified by its class and number (e.g. sensor-id). put()
+// replaces a waiting message of the same class & number, or takes a free
+// slot; the number of waiting messages is bounded by the classes & numbers
+// in use, not by the send rate. A group (e.g. a lane) lets the receiver take
+// the messages of one group only.
+//
+// Not thread safe : the owner holds its lock around put() and take().
+
+typedef enum : uint8_t
+{
+  e_mailbox_full,               // no free slot, message not stored
+  e_mailbox_added,
+  e_mailbox_replaced            // a waiting message was replaced
+} mailboxResult_t;
+
+template <typename ITEM, int SLOTS>
+class Mailbox
+{
+private:
+  struct
+  {
+    bool pending;
+    uint8_t group;
+    uint8_t classIndex;
+    uint8_t number;
+    ITEM item;
+  } slots[SLOTS];
+
+public:
+  Mailbox(void)
+  {
+    clear();
+  }
+
+  void clear(void)
+  {
+    for (int i = 0; i < SLOTS; i++)
+    {
+      slots[i].pending = false;
+    }
+  }
+
+  mailboxResult_t put(uint8_t group, uint8_t classIndex, uint8_t number, const ITEM &item)
+  {
+    int freeSlot = -1;
+
+    for (int i = 0; i < SLOTS; i++)
+    {
+      if (slots[i].pending && (slots[i].classIndex == classIndex) && (slots[i].number == number))
+      {
+        slots[i].item = item;
+        return e_mailbox_replaced;
+      }
+      if (!slots[i].pending && (freeSlot < 0))
+      {
+        freeSlot = i;
+      }
+    }
+
+    if (freeSlot < 0)
+    {
+      return e_mailbox_full;
+    }
+
+    slots[freeSlot].pending = true;
+    slots[freeSlot].group = group;
+    slots[freeSlot].classIndex = classIndex;
+    slots[freeSlot].number = number;
+    slots[freeSlot].item = item;
+    return e_mailbox_added;
+  }
+
+  // a waiting message of the group, false when none
+  bool take(uint8_t group, ITEM &item)
+  {
+    for (int i = 0; i < SLOTS; i++)
+    {
+      if (slots[i].pending && (slots[i].group == group))
+      {
+        item = slots[i].item;
+        slots[i].pending = false;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint8_t waiting(void)
+  {
+    uint8_t count = 0;
+
+    for (int i = 0; i < SLOTS; i++)
+    {
+      count += slots[i].pending ? 1 : 0;
+    }
+    return count;
+  }
+};
+
+#endif
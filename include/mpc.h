@@ -0,0 +1,364 @@
+//
+// mpc
+//
+
+#ifndef __MPC_H__
+#define __MPC_H__
+
+#include <stdint.h>
+
+// Model-predictive control of a compressor (cooling relay, on/off).
+//
+// Model : first order plus dead time for the rate of change of the wort
+// temperature, per step of the controller (e.g. 120 s)
+//
+//   r[k+1] = a r[k] + b u[k-d] + c        x[k+1] = x[k] + r[k+1]
+//
+// x : temperature * 10 (mean of the readings in the step, smoothing), u : relay
+// (0/1), a : chamber air lag, c : ambient and fermentation heat. The wort
+// itself is so slow (hours) that it is an integrator within the horizon.
+//
+// The dead time d is not known in advance : one recursive least squares (RLS)
+// estimator runs per candidate d, the one with the smallest prediction error
+// is used. The regressor is the rate simulated by the estimator itself
+// (output error) : the measured rate is mostly sensor noise and quantisation,
+// and would bias a towards 0. Forgetting follows slow changes (ambient, yeast
+// activity).
+//
+// Planning : every step the relay sequences of the horizon with at most two
+// switches are predicted, respecting the minimum on and off time. Cost is the
+// squared error to the set-point plus switchCost per switch. The first step of
+// the cheapest plan is applied, the next step plans again (receding horizon).
+// The compressor is switched off before the set-point is reached, the lag
+// finishes the job, and short cycles are avoided. The horizon should be about
+// one compressor cycle, longer horizons trust the simple model too far.
+//
+// Until the model is identified (enough steps, a and b plausible) the relay
+// is a hysteresis thermostat, which also excites the model.
+
+#define MPC_MAX_DEAD_STEPS      12      // dead time candidates 0 .. MPC_MAX_DEAD_STEPS - 1
+#define MPC_MAX_HORIZON         60      // steps
+#define MPC_ERROR_FORGET        0.98f   // prediction error average of the candidates
+#define MPC_P_INIT              1.0e3f  // initial covariance
+#define MPC_P_MAX_TRACE         1.0e5f  // no forgetting above this (no excitation)
+#define MPC_NR_PARAMS           3       // a b c
+
+typedef struct
+{
+  uint8_t samplesPerStep;       // readings averaged per model step
+  uint8_t horizon;              // steps, <= MPC_MAX_HORIZON
+  uint16_t minOnSteps;          // compressor protection
+  uint16_t minOffSteps;
+  uint16_t minModelSteps;       // identified steps before the model is used
+  int16_t hysteresis_x10;       // thermostat until the model is used
+  float forgetting;             // RLS, e.g. 0.998
+  float switchCost;             // cost of one switch, in (0.1 degree)^2 steps
+} mpcParams_t;
+
+class CompressorMpc
+{
+private:
+  // RLS estimate of [a b c] for one dead time
+  typedef struct
+  {
+    float theta[MPC_NR_PARAMS];
+    float p[MPC_NR_PARAMS][MPC_NR_PARAMS];
+    float rate;                 // simulated by the model (regressor)
+    float errorSq;
+  } mpcEstimate_t;
+
+  mpcParams_t params;
+  mpcEstimate_t estimate[MPC_MAX_DEAD_STEPS];
+  uint8_t history[MPC_MAX_DEAD_STEPS + 1];   // u[k-1], u[k-2], ...
+  int32_t sampleSum;
+  uint8_t sampleCount;          // readings in this step
+  uint8_t validCount;           // valid readings in sampleSum
+  float offset_x10;             // temperatures relative to the first step (conditioning)
+  float previous;               // x[k-1]
+  bool havePrevious;
+  uint16_t steps;               // identified steps (saturates)
+  uint16_t sinceSwitch;         // steps since the last relay switch
+  bool relayOn;
+  uint8_t deadSteps;            // best candidate
+
+  void resetEstimate(mpcEstimate_t &e)
+  {
+    for (uint8_t i = 0; i < MPC_NR_PARAMS; i++)
+    {
+      e.theta[i] = 0.0f;
+      for (uint8_t j = 0; j < MPC_NR_PARAMS; j++)
+      {
+        e.p[i][j] = (i == j) ? MPC_P_INIT : 0.0f;
+      }
+    }
+    e.rate = 0.0f;
+    e.errorSq = 0.0f;
+  }
+
+  void identify(mpcEstimate_t &e, float u, float y)
+  {
+    float phi[MPC_NR_PARAMS] = {e.rate, u, 1.0f};
+    float pPhi[MPC_NR_PARAMS];
+    float gain[MPC_NR_PARAMS];
+    float denominator = params.forgetting;
+    float error = y;
+    float lambda;
+    float trace = 0.0f;
+
+    for (uint8_t i = 0; i < MPC_NR_PARAMS; i++)
+    {
+      pPhi[i] = 0.0f;
+      for (uint8_t j = 0; j < MPC_NR_PARAMS; j++)
+      {
+        pPhi[i] += e.p[i][j] * phi[j];
+      }
+      denominator += phi[i] * pPhi[i];
+      error -= e.theta[i] * phi[i];
+      trace += e.p[i][i];
+    }
+
+    e.errorSq = MPC_ERROR_FORGET * e.errorSq + (1.0f - MPC_ERROR_FORGET) * error * error;
+
+    lambda = (trace > MPC_P_MAX_TRACE) ? 1.0f : params.forgetting;
+    for (uint8_t i = 0; i < MPC_NR_PARAMS; i++)
+    {
+      gain[i] = pPhi[i] / denominator;
+      e.theta[i] += gain[i] * error;
+    }
+    // P symmetric : P phi = (phi' P)'
+    for (uint8_t i = 0; i < MPC_NR_PARAMS; i++)
+    {
+      for (uint8_t j = 0; j < MPC_NR_PARAMS; j++)
+      {
+        e.p[i][j] = (e.p[i][j] - gain[i] * pPhi[j]) / lambda;
+      }
+    }
+
+    e.rate = e.theta[0] * e.rate + e.theta[1] * u + e.theta[2];
+  }
+
+  bool plausible(const mpcEstimate_t &e)
+  {
+    // stable, cooling lowers the temperature
+    return (e.theta[0] >= 0.0f) && (e.theta[0] < 1.0f) && (e.theta[1] < 0.0f);
+  }
+
+  // cost of : current relay for hold steps, other state for run steps, back again
+  float planCost(float x, float rate, float setPoint, uint8_t hold, uint8_t run)
+  {
+    const mpcEstimate_t &e = estimate[deadSteps];
+    float cost = 0.0f;
+    uint8_t u;
+    float error;
+
+    for (uint8_t i = 0; i < params.horizon; i++)
+    {
+      if (i < deadSteps)
+      {
+        u = history[deadSteps - 1 - i];
+      }
+      else
+      {
+        u = ((i - deadSteps) < hold) || ((i - deadSteps) >= hold + run) ? relayOn : !relayOn;
+      }
+      rate = e.theta[0] * rate + e.theta[1] * u + e.theta[2];
+      x += rate;
+      error = x - setPoint;
+      cost += error * error;
+    }
+
+    if (hold < params.horizon)
+    {
+      cost += params.switchCost;
+      if (hold + run < params.horizon)
+      {
+        cost += params.switchCost;
+      }
+    }
+    return cost;
+  }
+
+  bool plan(float x, float rate, float setPoint)
+  {
+    uint16_t minCurrent = relayOn ? params.minOnSteps : params.minOffSteps;
+    uint16_t minOther = relayOn ? params.minOffSteps : params.minOnSteps;
+    uint16_t firstSwitch = (sinceSwitch >= minCurrent) ? 0 : minCurrent - sinceSwitch;
+    float best = planCost(x, rate, setPoint, params.horizon, 0);
+    uint8_t bestHold = params.horizon;
+    float cost;
+
+    for (uint16_t hold = firstSwitch; hold < params.horizon; hold++)
+    {
+      for (uint16_t run = minOther; hold + run <= params.horizon; run++)
+      {
+        cost = planCost(x, rate, setPoint, hold, run);
+        if (cost < best)
+        {
+          best = cost;
+          bestHold = hold;
+        }
+      }
+    }
+    return (bestHold == 0) ? !relayOn : relayOn;
+  }
+
+  bool thermostat(float x, float setPoint)
+  {
+    uint16_t minCurrent = relayOn ? params.minOnSteps : params.minOffSteps;
+
+    if (sinceSwitch < minCurrent)
+    {
+      return relayOn;
+    }
+    if (!relayOn && (x >= setPoint + params.hysteresis_x10))
+    {
+      return true;
+    }
+    if (relayOn && (x <= setPoint))
+    {
+      return false;
+    }
+    return relayOn;
+  }
+
+public:
+  CompressorMpc(const mpcParams_t &mpcParams)
+  {
+    params = mpcParams;
+    if (params.horizon > MPC_MAX_HORIZON)
+    {
+      params.horizon = MPC_MAX_HORIZON;
+    }
+    relayOn = false;
+    sinceSwitch = 0;      // boot : respect the minimum off time
+    reset();
+  }
+
+  // forget the model (e.g. other fermenter), the relay state is kept
+  void reset(void)
+  {
+    for (uint8_t d = 0; d < MPC_MAX_DEAD_STEPS; d++)
+    {
+      resetEstimate(estimate[d]);
+    }
+    for (uint8_t i = 0; i <= MPC_MAX_DEAD_STEPS; i++)
+    {
+      history[i] = relayOn;
+    }
+    sampleSum = 0;
+    sampleCount = 0;
+    validCount = 0;
+    havePrevious = false;
+    steps = 0;
+    deadSteps = 0;
+  }
+
+  // temperature reading at a fixed period, returns true when a model step is
+  // due (step())
+  bool sample(int16_t temperature_x10, bool valid)
+  {
+    if (valid)
+    {
+      sampleSum += temperature_x10;
+      validCount++;
+    }
+    sampleCount++;
+    return sampleCount >= params.samplesPerStep;
+  }
+
+  // model step : identify on the mean of the readings, plan, relay to apply.
+  // Without a set-point or without valid readings in the step the relay goes
+  // off (after its minimum on time).
+  bool step(int16_t setPoint_x10, bool setPointValid)
+  {
+    bool reading = (validCount > 0);
+    float x = 0.0f;
+    bool request;
+
+    if (reading)
+    {
+      if (!havePrevious && (steps == 0))
+      {
+        offset_x10 = (float)sampleSum / validCount;
+      }
+      x = (float)sampleSum / validCount - offset_x10;
+    }
+    sampleSum = 0;
+    sampleCount = 0;
+    validCount = 0;
+
+    if (reading && havePrevious)
+    {
+      for (uint8_t d = 0; d < MPC_MAX_DEAD_STEPS; d++)
+      {
+        identify(estimate[d], history[d], x - previous);
+      }
+      for (uint8_t d = 0; d < MPC_MAX_DEAD_STEPS; d++)
+      {
+        if (estimate[d].errorSq < estimate[deadSteps].errorSq)
+        {
+          deadSteps = d;
+        }
+      }
+      if (steps < UINT16_MAX)
+      {
+        steps++;
+      }
+    }
+    previous = x;
+    havePrevious = reading;
+
+    if (!reading || !setPointValid)
+    {
+      request = (sinceSwitch < params.minOnSteps) && relayOn;
+    }
+    else if (isIdentified())
+    {
+      request = plan(x, estimate[deadSteps].rate, setPoint_x10 - offset_x10);
+    }
+    else
+    {
+      request = thermostat(x, setPoint_x10 - offset_x10);
+    }
+
+    if (request != relayOn)
+    {
+      relayOn = request;
+      sinceSwitch = 0;
+    }
+    if (sinceSwitch < UINT16_MAX)
+    {
+      sinceSwitch++;
+    }
+
+    for (uint8_t i = MPC_MAX_DEAD_STEPS; i > 0; i--)
+    {
+      history[i] = history[i - 1];
+    }
+    history[0] = relayOn;
+
+    return relayOn;
+  }
+
+  bool isIdentified(void)
+  {
+    return (steps >= params.minModelSteps) && plausible(estimate[deadSteps]);
+  }
+
+  // model of the best dead time : cooling rate (degree * 10 per step, with
+  // the relay on continuously), dead time in steps
+  void getModel(float &coolRate_x10, uint8_t &dead)
+  {
+    const mpcEstimate_t &e = estimate[deadSteps];
+
+    coolRate_x10 = -e.theta[1] / (1.0f - e.theta[0]);
+    dead = deadSteps;
+  }
+
+  bool getRelay(void)
+  {
+    return relayOn;
+  }
+};
+
+#endif
@@ -0,0 +1,26 @@
+//
+// msgpool
+//
+
+#ifndef __MSGPOOL_H__
+#define __MSGPOOL_H__
+
+#include <Arduino.h>
+
+// Pre-allocated pool for large or rare message payloads (scan results,
+// hydrometer readings, device names). The sender fills a slot and only the
+// (1 byte) handle travels through the queue, the receiver frees the slot.
+
+#define MSGPOOL_NR_SLOTS     8
+#define MSGPOOL_SLOT_SIZE    32
+#define MSGPOOL_NO_SLOT      0xFF
+
+typedef uint8_t msgPoolHandle_t;
+
+extern msgPoolHandle_t msgPoolAlloc(void);       // MSGPOOL_NO_SLOT when pool is empty
+extern void *msgPoolGet(msgPoolHandle_t handle);
+extern void msgPoolFree(msgPoolHandle_t handle);
+extern uint8_t msgPoolInUse(void);
+extern uint32_t msgPoolAllocFailures(void);
+
+#endif
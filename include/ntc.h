@@ -0,0 +1,153 @@
+//
+// ntc
+//
+
+#ifndef __NTC_H__
+#define __NTC_H__
+
+#include <stdint.h>
+
+// NTC thermistor conversion, integer only at runtime.
+//
+// The NTC is the lower resistor of a voltage divider: series resistor to the
+// supply, NTC to ground. The input is the divider ratio (NTC voltage / supply
+// voltage) as a 16 bit fraction. A lookup table with the temperature at
+// 2^SEGMENTS_LOG2 + 1 equally spaced ratios is generated at compile time from
+// the Steinhart-Hart equation
+//
+//   1/T = A + B ln(R) + C ln(R)^3
+//
+// and placed in flash. A conversion is a table lookup and a linear
+// interpolation.
+//
+// The probe is described by a struct with the (constexpr) coefficients:
+//
+//   struct myProbe
+//   {
+//     static constexpr double A = 1.009249522e-3;
+//     static constexpr double B = 2.378405444e-4;
+//     static constexpr double C = 2.019202697e-7;
+//     static constexpr double seriesOhm = 10000.0;
+//   };
+//
+//   int16_t t;
+//   bool valid = NtcLut<myProbe, 6>::temperature_x10(ratio16, t);
+
+// ============================================================================
+// COMPILE TIME MATH (C++11 constexpr : single return statement, recursion)
+// ============================================================================
+
+#define NTC_LN2     0.6931471805599453
+#define NTC_KELVIN  273.15
+
+// sum of z^n / n for odd n (z2 = z * z)
+constexpr double ntcLnSeries(double z2, double term, int n)
+{
+  return (n > 41) ? 0.0 : term / n + ntcLnSeries(z2, term * z2, n + 2);
+}
+
+// ln(x) = 2 atanh(z), z = (x - 1) / (x + 1), for x in [1, 2) : |z| <= 1/3
+constexpr double ntcLnReduced(double z)
+{
+  return 2.0 * ntcLnSeries(z * z, z, 1);
+}
+
+// natural logarithm, x > 0 : scale x into [1, 2) by powers of 2
+constexpr double ntcLn(double x)
+{
+  return (x >= 2.0) ? ntcLn(x / 2.0) + NTC_LN2 :
+         (x < 1.0)  ? ntcLn(x * 2.0) - NTC_LN2 :
+                      ntcLnReduced((x - 1.0) / (x + 1.0));
+}
+
+// Steinhart-Hart, temperature in degrees Celcius
+constexpr double ntcCelcius(double a, double b, double c, double lnR)
+{
+  return 1.0 / (a + b * lnR + c * lnR * lnR * lnR) - NTC_KELVIN;
+}
+
+// NTC resistance at divider ratio
+constexpr double ntcResistance(double seriesOhm, double ratio)
+{
+  return seriesOhm * ratio / (1.0 - ratio);
+}
+
+// divider ratio of table entry i. The first and last entry (short / open
+// circuit) are moved half a segment inwards, to stay finite.
+constexpr double ntcRatio(int i, int segments)
+{
+  return (i == 0) ? 0.5 / segments : (i == segments) ? (segments - 0.5) / segments : (double)i / segments;
+}
+
+constexpr int16_t ntcRound(double value)
+{
+  return (int16_t)((value >= 0.0) ? value + 0.5 : value - 0.5);
+}
+
+template <typename PROBE> constexpr int16_t ntcEntry_x10(int i, int segments)
+{
+  return ntcRound(10.0 * ntcCelcius(PROBE::A, PROBE::B, PROBE::C, ntcLn(ntcResistance(PROBE::seriesOhm, ntcRatio(i, segments)))));
+}
+
+// ============================================================================
+// LOOKUP TABLE
+// ============================================================================
+
+// compile time index list 0 .. N-1
+template <int... I> struct NtcIndexList
+{
+};
+
+template <int N, int... I> struct NtcMakeIndexList : NtcMakeIndexList<N - 1, N - 1, I...>
+{
+};
+
+template <int... I> struct NtcMakeIndexList<0, I...>
+{
+  typedef NtcIndexList<I...> type;
+};
+
+template <typename PROBE, int SEGMENTS, typename LIST> struct NtcTable;
+
+template <typename PROBE, int SEGMENTS, int... I> struct NtcTable<PROBE, SEGMENTS, NtcIndexList<I...> >
+{
+  static constexpr int16_t values[sizeof...(I)] = { ntcEntry_x10<PROBE>(I, SEGMENTS)... };
+};
+
+template <typename PROBE, int SEGMENTS, int... I> constexpr int16_t NtcTable<PROBE, SEGMENTS, NtcIndexList<I...> >::values[sizeof...(I)];
+
+template <typename PROBE, int SEGMENTS_LOG2> class NtcLut
+{
+  static_assert((SEGMENTS_LOG2 >= 2) && (SEGMENTS_LOG2 <= 10), "NtcLut : 4 .. 1024 segments");
+
+private:
+  static const int SEGMENTS = 1 << SEGMENTS_LOG2;
+  static const int SHIFT = 16 - SEGMENTS_LOG2;
+
+  typedef NtcTable<PROBE, SEGMENTS, typename NtcMakeIndexList<SEGMENTS + 1>::type> table;
+
+public:
+  // ratio16 : NTC voltage / supply voltage * 65536
+  // Returns false for a ratio in the first or last segment (short / open circuit)
+  static bool temperature_x10(uint16_t ratio16, int16_t &temperature)
+  {
+    int i = ratio16 >> SHIFT;
+    int32_t fraction = ratio16 & ((1 << SHIFT) - 1);
+    int32_t low;
+    int32_t high;
+
+    if ((i == 0) || (i >= SEGMENTS - 1))
+    {
+      temperature = 0;
+      return false;
+    }
+
+    low = table::values[i];
+    high = table::values[i + 1];
+    temperature = low + (((high - low) * fraction) >> SHIFT);
+
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,142 @@
+//
+// onewire_rmt
+//
+
+#ifndef __ONEWIRE_RMT_H__
+#define __ONEWIRE_RMT_H__
+
+#include <stdint.h>
+
+// 1-Wire bus driven by the RMT peripheral instead of bit-banging.
+//
+// Every bit slot is one RMT symbol (low time, released time). The TX channel
+// drives the (open-drain) pin, a RX channel on the same pin records the low
+// pulses on the wire. Timing is done by hardware, interrupts stay enabled and
+// the calling task is blocked (not spinning) while a byte is on the wire.
+//
+// The symbol encoding & decoding below is plain C, independent of the RMT
+// driver.
+
+// Standard speed timing in microseconds
+#define OW_RESET_LOW_US         480   // reset pulse
+#define OW_RESET_RELEASE_US     480   // presence detect window
+#define OW_PRESENCE_MIN_US      60
+#define OW_PRESENCE_MAX_US      240
+#define OW_SLOT_1_LOW_US        6     // write 1 / read slot
+#define OW_SLOT_1_RELEASE_US    64
+#define OW_SLOT_0_LOW_US        60    // write 0
+#define OW_SLOT_0_RELEASE_US    10
+#define OW_READ_THRESHOLD_US    15    // low pulse shorter than this reads as 1
+#define OW_RX_IDLE_US           100   // line released this long ends a receive
+
+typedef struct
+{
+  uint16_t lowUs;
+  uint16_t releaseUs;
+} oneWireSymbol_t;
+
+// reset pulse, followed by presence detect window
+static inline void oneWireEncodeReset(oneWireSymbol_t *symbol)
+{
+  symbol->lowUs = OW_RESET_LOW_US;
+  symbol->releaseUs = OW_RESET_RELEASE_US;
+}
+
+// one slot per bit, LSB first. Writing a 1 is also the read slot.
+static inline void oneWireEncodeBit(uint8_t bit, oneWireSymbol_t *symbol)
+{
+  symbol->lowUs = bit ? OW_SLOT_1_LOW_US : OW_SLOT_0_LOW_US;
+  symbol->releaseUs = bit ? OW_SLOT_1_RELEASE_US : OW_SLOT_0_RELEASE_US;
+}
+
+// 8 slots, to read a byte encode 0xFF
+static inline void oneWireEncodeByte(uint8_t value, oneWireSymbol_t *symbols)
+{
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    oneWireEncodeBit((value >> i) & 1, &symbols[i]);
+  }
+}
+
+// Presence : the master reset pulse followed by a low pulse of a device
+static inline bool oneWireDecodePresence(const uint16_t *lowUs, uint8_t count)
+{
+  return (count >= 2) && (lowUs[1] >= OW_PRESENCE_MIN_US) && (lowUs[1] <= OW_PRESENCE_MAX_US);
+}
+
+// Read slots : the wire is low for a short time for a 1, a device holds it low for a 0
+static inline bool oneWireDecodeBits(const uint16_t *lowUs, uint8_t count, uint8_t numBits, uint8_t &value)
+{
+  value = 0;
+
+  if (count != numBits)
+  {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < numBits; i++)
+  {
+    if (lowUs[i] < OW_READ_THRESHOLD_US)
+    {
+      value |= (1 << i);
+    }
+  }
+  return true;
+}
+
+// Dallas/Maxim CRC8 (polynomial x^8 + x^5 + x^4 + 1)
+static inline uint8_t oneWireCrc8(const uint8_t *data, uint8_t length)
+{
+  uint8_t crc = 0;
+
+  while (length--)
+  {
+    uint8_t inByte = *data++;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+      uint8_t mix = (crc ^ inByte) & 0x01;
+      crc >>= 1;
+      if (mix)
+      {
+        crc ^= 0x8C;
+      }
+      inByte >>= 1;
+    }
+  }
+  return crc;
+}
+
+// ============================================================================
+// RMT BUS DRIVER
+// ============================================================================
+
+class OneWireRMT
+{
+private:
+  uint8_t pin;
+  int txChannel;
+  int rxChannel;
+  void *rxRingBuffer;
+  bool initialised;
+
+  // search state
+  uint8_t searchRom[8];
+  int8_t lastDiscrepancy;
+  bool lastDevice;
+
+  bool transfer(const oneWireSymbol_t *symbols, uint8_t count, uint16_t *lowUs, uint8_t maxLow, uint8_t &numLow);
+  bool readBits(uint8_t numBits, uint8_t &value);
+
+public:
+  OneWireRMT(void);
+  bool begin(uint8_t gpio, int txRmtChannel, int rxRmtChannel);
+  bool reset(void);                  // true when a device answers with a presence pulse
+  bool write(uint8_t value);
+  bool read(uint8_t &value);
+  bool select(const uint8_t *rom);   // Match ROM
+  bool skip(void);                   // Skip ROM (broadcast)
+  void resetSearch(void);
+  bool search(uint8_t *rom);         // Search ROM, next device
+};
+
+#endif
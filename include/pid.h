@@ -0,0 +1,118 @@
+//
+// pid
+//
+
+#ifndef __PID_H__
+#define __PID_H__
+
+#include <stdint.h>
+
+// Fixed-point PID controller, called at a fixed sample period.
+//
+// Temperatures are degrees * 10 (like all sensor values), the output is per
+// mille of full power (PID_OUTPUT_MAX). Gains are Q16.16 fixed point and
+// include the sample period, e.g. for a 1 second period :
+//
+//   kp : per mille per 0.1 degree error
+//   ki : per mille per 0.1 degree error, per second
+//   kd : per mille per 0.1 degree change of the temperature, per second
+//
+// - derivative on the measurement, a set-point step gives no output kick,
+//   low-pass filtered over 2^derivativeShift samples (sensor quantisation
+//   would otherwise toggle the output between its limits)
+// - anti-windup : the integral is clamped to the output range and does not
+//   grow further while the output is saturated in the same direction
+// - the first update after reset() starts without derivative
+//
+// Integer only (64 bit products).
+
+#define PID_Q16(gain)     ((int32_t)((gain) * 65536.0f + 0.5f))
+#define PID_OUTPUT_MAX    1000
+
+typedef struct
+{
+  int32_t kp_q16;
+  int32_t ki_q16;
+  int32_t kd_q16;
+  int16_t outputMin;            // per mille
+  int16_t outputMax;
+  uint8_t derivativeShift;      // derivative filter, 0 = none
+} pidParams_t;
+
+class Pid
+{
+private:
+  pidParams_t params;
+  int64_t integral_q16;
+  int64_t derivative_q16;       // filtered
+  int16_t previous_x10;
+  bool first;
+  int16_t output;
+
+  static int64_t clamp(int64_t value, int64_t low, int64_t high)
+  {
+    return (value < low) ? low : ((value > high) ? high : value);
+  }
+
+public:
+  Pid(const pidParams_t &pidParams)
+  {
+    params = pidParams;
+    reset();
+  }
+
+  // bumpless start from an output (per mille), e.g. the current power
+  void reset(int16_t startOutput = 0)
+  {
+    integral_q16 = clamp(startOutput, params.outputMin, params.outputMax) << 16;
+    derivative_q16 = 0;
+    previous_x10 = 0;
+    first = true;
+    output = startOutput;
+  }
+
+  void setParams(const pidParams_t &pidParams)
+  {
+    params = pidParams;
+    integral_q16 = clamp(integral_q16, (int64_t)params.outputMin << 16, (int64_t)params.outputMax << 16);
+  }
+
+  // one sample : output (per mille) for set-point & measured temperature
+  int16_t update(int16_t setPoint_x10, int16_t measured_x10)
+  {
+    int32_t error = (int32_t)setPoint_x10 - measured_x10;
+    int64_t proportional_q16 = (int64_t)params.kp_q16 * error;
+    int64_t integral = integral_q16 + (int64_t)params.ki_q16 * error;
+    int64_t sum_q16;
+
+    if (!first)
+    {
+      derivative_q16 += (-(int64_t)params.kd_q16 * ((int32_t)measured_x10 - previous_x10) - derivative_q16) >> params.derivativeShift;
+    }
+
+    integral = clamp(integral, (int64_t)params.outputMin << 16, (int64_t)params.outputMax << 16);
+    sum_q16 = proportional_q16 + integral + derivative_q16;
+
+    // anti-windup : keep the old integral while saturated in the error direction
+    if (!(((sum_q16 > ((int64_t)params.outputMax << 16)) && (error > 0)) ||
+          ((sum_q16 < ((int64_t)params.outputMin << 16)) && (error < 0))))
+    {
+      integral_q16 = integral;
+    }
+
+    sum_q16 = proportional_q16 + integral_q16 + derivative_q16;
+    output = (int16_t)clamp((sum_q16 + (1 << 15)) >> 16, params.outputMin, params.outputMax);
+
+    previous_x10 = measured_x10;
+    first = false;
+
+    return output;
+  }
+
+  int16_t getOutput(void)
+  {
+    return output;
+  }
+};
+
+#endif
@@ -0,0 +1,226 @@
+//
+// profile
+//
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stdint.h>
+
+// Local set-point schedule (fermentation or mash), runs without the backend.
+//
+// A profile is a list of steps, each with a target set-point:
+//
+//   hold    : set-point = target for durationS
+//   ramp    : set-point moves linearly from the set-point at the start of the
+//             step to target in durationS
+//   wait-sg : set-point = target until the specific gravity is at or below
+//             sg_x1000 (hydrometer), durationS is a time-out (0 = none)
+//
+// tick() is called every control period (e.g. the temperature sample period):
+// it interpolates the set-point and moves to the next step(s) as soon as a step
+// is complete, so a transition is never more than one tick late. After the
+// last step the last set-point is kept.
+//
+// A backend (cloud) change of the set-point overrides the profile until the
+// next step transition, the profile timing continues meanwhile.
+//
+// Time is milliseconds (e.g. millis()), only differences between ticks are
+// used, so a wrap of the timer is harmless.
+
+#define PROFILE_MAX_STEPS       16
+#define PROFILE_NAME_LENGTH     24
+#define PROFILE_MAX_DURATION_S  (45UL * 24 * 3600)    // per step, fits milliseconds in 32 bit
+
+typedef enum : uint8_t
+{
+  e_profile_hold,
+  e_profile_ramp,
+  e_profile_wait_sg
+} profileStepType_t;
+
+typedef struct
+{
+  profileStepType_t type;
+  int16_t target_x10;           // set-point, degree * 10
+  uint32_t durationS;           // wait-sg : time-out, 0 = none
+  uint16_t sg_x1000;            // wait-sg : specific gravity to reach
+} profileStep_t;
+
+typedef struct
+{
+  char name[PROFILE_NAME_LENGTH];
+  uint8_t numSteps;
+  profileStep_t steps[PROFILE_MAX_STEPS];
+} profile_t;
+
+// profile.cpp : profile files on LittleFS
+extern bool profileLoad(const char *path, profile_t *profile);
+extern void initProfile(void);
+
+class ProfileExecutor
+{
+private:
+  profile_t profile;
+  bool running;
+  uint8_t step;
+  uint32_t stepElapsedMs;
+  uint32_t lastTickMs;
+  int16_t stepStart_x10;        // set-point when the step started (ramp)
+  int16_t setPoint_x10;
+  bool overridden;
+
+  bool stepDone(const profileStep_t &s, uint16_t sg_x1000, bool sgValid)
+  {
+    switch (s.type)
+    {
+    case e_profile_wait_sg:
+      if (sgValid && (sg_x1000 <= s.sg_x1000))
+      {
+        return true;
+      }
+      return (s.durationS > 0) && (stepElapsedMs >= s.durationS * 1000);
+
+    case e_profile_hold:
+    case e_profile_ramp:
+    default:
+      return stepElapsedMs >= s.durationS * 1000;
+    }
+  }
+
+  // set-point of the current step (not overridden)
+  int16_t stepSetPoint(void)
+  {
+    const profileStep_t &s = profile.steps[step];
+    int32_t delta;
+
+    if ((s.type != e_profile_ramp) || (stepElapsedMs >= s.durationS * 1000))
+    {
+      return s.target_x10;
+    }
+
+    delta = (int32_t)s.target_x10 - stepStart_x10;
+    return stepStart_x10 + (int16_t)((int64_t)delta * stepElapsedMs / (s.durationS * 1000));
+  }
+
+public:
+  ProfileExecutor()
+  {
+    profile.numSteps = 0;
+    running = false;
+    step = 0;
+    setPoint_x10 = 0;
+    overridden = false;
+  }
+
+  // start at step (resume : time already spent in that step). A ramp starts
+  // from the target of the step before, or startSetPoint for the first step.
+  bool start(const profile_t &newProfile, uint32_t nowMs, int16_t startSetPoint_x10, uint8_t startStep = 0, uint32_t startElapsedMs = 0)
+  {
+    if ((newProfile.numSteps == 0) || (newProfile.numSteps > PROFILE_MAX_STEPS) || (startStep >= newProfile.numSteps))
+    {
+      return false;
+    }
+
+    profile = newProfile;
+    running = true;
+    step = startStep;
+    stepElapsedMs = startElapsedMs;
+    lastTickMs = nowMs;
+    stepStart_x10 = (startStep > 0) ? newProfile.steps[startStep - 1].target_x10 : startSetPoint_x10;
+    overridden = false;
+    setPoint_x10 = stepSetPoint();
+    return true;
+  }
+
+  void stop(void)
+  {
+    running = false;
+  }
+
+  // backend set-point, until the next step transition
+  void override(int16_t overrideSetPoint_x10)
+  {
+    overridden = true;
+    setPoint_x10 = overrideSetPoint_x10;
+  }
+
+  // one control period : set-point. Returns true on a step transition (or the
+  // end of the profile).
+  bool tick(uint32_t nowMs, uint16_t sg_x1000, bool sgValid)
+  {
+    bool transition = false;
+
+    if (!running)
+    {
+      return false;
+    }
+
+    // saturates (wait-sg without time-out)
+    stepElapsedMs += ((nowMs - lastTickMs) < (UINT32_MAX - stepElapsedMs)) ? nowMs - lastTickMs : UINT32_MAX - stepElapsedMs;
+    lastTickMs = nowMs;
+
+    // time beyond the end of a step counts for the next one, so short steps
+    // pass in the same tick and the schedule does not drift
+    while (stepDone(profile.steps[step], sg_x1000, sgValid))
+    {
+      const profileStep_t &s = profile.steps[step];
+      uint32_t excessMs = 0;
+
+      if (((s.type != e_profile_wait_sg) || (s.durationS > 0)) && (stepElapsedMs >= s.durationS * 1000))
+      {
+        excessMs = stepElapsedMs - s.durationS * 1000;
+      }
+
+      transition = true;
+      overridden = false;
+      stepStart_x10 = s.target_x10;
+      if (step + 1 >= profile.numSteps)
+      {
+        running = false;
+        setPoint_x10 = stepStart_x10;
+        return transition;
+      }
+      step++;
+      stepElapsedMs = excessMs;
+    }
+
+    if (!overridden)
+    {
+      setPoint_x10 = stepSetPoint();
+    }
+    return transition;
+  }
+
+  bool isRunning(void)
+  {
+    return running;
+  }
+
+  bool isOverridden(void)
+  {
+    return overridden;
+  }
+
+  int16_t getSetPoint(void)
+  {
+    return setPoint_x10;
+  }
+
+  uint8_t getStep(void)
+  {
+    return step;
+  }
+
+  uint32_t getStepElapsedMs(void)
+  {
+    return stepElapsedMs;
+  }
+
+  const profile_t &getProfile(void)
+  {
+    return profile;
+  }
+};
+
+#endif
@@ -0,0 +1,186 @@
+//
+// relayengine
+//
+
+#ifndef __RELAYENGINE_H__
+#define __RELAYENGINE_H__
+
+#include <stdint.h>
+
+// Protection delays of up to RELAY_ENGINE_MAX relays (e.g. a compressor).
+//
+// Requests and outputs are bitmasks, every bit corresponds with a relay. Per
+// relay, measured from its last switch (the actual output, not the request):
+//
+//   onDelayMs  : off at least this long before it may switch on again
+//                (compressor delay). Boot counts as a switch off, so boot
+//                loops or power cuts cannot short-cycle a compressor, unless
+//                the off time before the boot is known (restoreOff()).
+//   offDelayMs : on at least this long before it may switch off (minimum
+//                run time)
+//
+// A request that cannot be served yet stays pending, the relay switches as
+// soon as its delay has passed. A request that goes back before that cancels
+// it. Deadlines are absolute (switch time + delay) on a monotonic millisecond
+// clock, so the moment update() is called (a message arriving, a late wakeup)
+// never shortens or stretches a delay. nextEventMs() tells when update() is
+// needed next.
+//
+// Time is milliseconds, only differences are used : a wrap of the clock is
+// harmless as long as a delay is shorter than 24 days.
+
+#define RELAY_ENGINE_MAX        16
+#define RELAY_ENGINE_NO_EVENT   UINT32_MAX
+
+typedef struct
+{
+  uint32_t onDelayMs;
+  uint32_t offDelayMs;
+} relayTiming_t;
+
+class RelayEngine
+{
+private:
+  const relayTiming_t *timing;
+  uint8_t count;
+  uint16_t mask;                // relays in use
+  uint16_t request;
+  uint16_t actual;
+  uint16_t settled;             // delay since the last switch has passed
+  uint32_t switchMs[RELAY_ENGINE_MAX];
+
+  uint32_t delayMs(uint8_t number)
+  {
+    return ((actual >> number) & 1) ? timing[number].offDelayMs : timing[number].onDelayMs;
+  }
+
+  // time left of the delay since the last switch, 0 when passed
+  uint32_t delayLeftMs(uint8_t number, uint32_t nowMs)
+  {
+    uint32_t elapsed = nowMs - switchMs[number];
+
+    if ((settled >> number) & 1)
+    {
+      return 0;
+    }
+    return (elapsed >= delayMs(number)) ? 0 : delayMs(number) - elapsed;
+  }
+
+public:
+  // all relays off, their on delays start now
+  RelayEngine(const relayTiming_t *relayTiming, uint8_t relayCount, uint32_t nowMs)
+  {
+    timing = relayTiming;
+    count = (relayCount > RELAY_ENGINE_MAX) ? RELAY_ENGINE_MAX : relayCount;
+    mask = (count >= 16) ? 0xFFFF : (uint16_t)((1U << count) - 1);
+    request = 0;
+    actual = 0;
+    settled = 0;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+      switchMs[i] = nowMs;
+      if (timing[i].onDelayMs == 0)
+      {
+        settled |= (1 << i);
+      }
+    }
+  }
+
+  // the relay was off for offMs already when the engine started (e.g. before
+  // a reset) : its on delay counts from then. Before the first update().
+  void restoreOff(uint8_t number, uint32_t offMs, uint32_t nowMs)
+  {
+    if ((number >= count) || ((actual >> number) & 1))
+    {
+      return;
+    }
+
+    if (offMs >= timing[number].onDelayMs)
+    {
+      settled |= (1 << number);
+    }
+    else
+    {
+      switchMs[number] = nowMs - offMs;
+    }
+  }
+
+  // new request (or only time passed) : actual outputs
+  uint16_t update(uint32_t nowMs, uint16_t newRequest)
+  {
+    uint16_t bit;
+
+    request = newRequest & mask;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+      bit = (1 << i);
+
+      if (delayLeftMs(i, nowMs) == 0)
+      {
+        settled |= bit;
+      }
+
+      if (((request ^ actual) & bit) && (settled & bit))
+      {
+        actual ^= bit;
+        switchMs[i] = nowMs;
+        settled &= ~bit;
+        if (delayMs(i) == 0)
+        {
+          settled |= bit;
+        }
+      }
+    }
+    return actual;
+  }
+
+  // milliseconds until update() has something to do (a pending switch, or a
+  // delay that ends), RELAY_ENGINE_NO_EVENT when nothing is counting
+  uint32_t nextEventMs(uint32_t nowMs)
+  {
+    uint32_t next = RELAY_ENGINE_NO_EVENT;
+    uint32_t left;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+      if (!((settled >> i) & 1))
+      {
+        left = delayLeftMs(i, nowMs);
+        if (left < next)
+        {
+          next = left;
+        }
+      }
+    }
+    return next;
+  }
+
+  // milliseconds until a pending request of the relay is served, 0 if none
+  uint32_t remainingMs(uint8_t number, uint32_t nowMs)
+  {
+    if ((number >= count) || !(((request ^ actual) >> number) & 1))
+    {
+      return 0;
+    }
+    return delayLeftMs(number, nowMs);
+  }
+
+  uint16_t getPending(void)
+  {
+    return request ^ actual;
+  }
+
+  uint16_t getActual(void)
+  {
+    return actual;
+  }
+
+  uint8_t getCount(void)
+  {
+    return count;
+  }
+};
+
+#endif
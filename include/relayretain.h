@@ -0,0 +1,101 @@
+//
+// relayretain
+//
+
+#ifndef __RELAYRETAIN_H__
+#define __RELAYRETAIN_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Last switch time of COUNT relays, kept over a warm reset (the record lives
+// in memory that the reset does not clear, e.g. RTC_NOINIT_ATTR). Times are
+// microseconds of a clock that keeps counting over the reset (RTC timer).
+//
+// A record is only trusted with the magic and a matching CRC; uninitialised
+// memory after a power-on fails the check. A relay that was on at the reset
+// was switched off by it at an unknown time, its off time is not restored.
+//
+// No constructor : the record must survive the C++ start-up of the firmware.
+
+#define RELAY_RETAIN_MAGIC      0x52454C59      // "RELY"
+
+// CRC-32 (IEEE 802.3, reflected), the same value as esp_rom_crc32_le(0, ...)
+static inline uint32_t relayRetainCrc(const uint8_t *data, size_t length)
+{
+  uint32_t crc = 0xFFFFFFFF;
+
+  for (size_t i = 0; i < length; i++)
+  {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+template <uint8_t COUNT>
+struct RelayRetained
+{
+  uint64_t switchUs[COUNT];     // clock time of the last switch
+  uint32_t magic;
+  uint16_t actual;
+  uint16_t reserved;
+  uint32_t crc;                 // of everything above
+
+  uint32_t checksum(void) const
+  {
+    return relayRetainCrc((const uint8_t *)this, offsetof(RelayRetained, crc));
+  }
+
+  // relays that changed switched at nowUs, outputs : relays on after the switch
+  void recordSwitch(uint16_t outputs, uint16_t changed, uint64_t nowUs)
+  {
+    for (uint8_t i = 0; i < COUNT; i++)
+    {
+      if ((changed >> i) & 1)
+      {
+        switchUs[i] = nowUs;
+      }
+    }
+    magic = RELAY_RETAIN_MAGIC;
+    actual = outputs;
+    reserved = 0;
+    crc = checksum();
+  }
+
+  bool valid(void) const
+  {
+    return (magic == RELAY_RETAIN_MAGIC) && (crc == checksum());
+  }
+
+  // boot : off time of the relays that were off before the reset. Returns
+  // the relays with a known off time (offMs set), 0 for a cold start.
+  uint16_t restore(bool warmReset, uint64_t nowUs, uint32_t offMs[COUNT]) const
+  {
+    uint16_t restored = 0;
+    uint64_t ms;
+
+    if (!warmReset || !valid())
+    {
+      return 0;
+    }
+
+    for (uint8_t i = 0; i < COUNT; i++)
+    {
+      // on at the reset, or the clock went back (not the same clock)
+      if (((actual >> i) & 1) || (switchUs[i] > nowUs))
+      {
+        continue;
+      }
+      ms = (nowUs - switchUs[i]) / 1000;
+      offMs[i] = (ms > UINT32_MAX) ? UINT32_MAX : (uint32_t)ms;
+      restored |= (1 << i);
+    }
+    return restored;
+  }
+};
+
+#endif
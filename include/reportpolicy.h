@@ -0,0 +1,81 @@
+//
+// reportpolicy
+//
+
+#ifndef __REPORTPOLICY_H__
+#define __REPORTPOLICY_H__
+
+#include <stdint.h>
+
+// Deadband / heartbeat reporting of sensor values, per channel.
+//
+// A report is only sent when it differs at least 'deadband' from the last
+// sent value (but not more often than minIntervalMs), when the valid-flag
+// changes, or after heartbeatMs of silence. The first report of a channel
+// is always sent.
+//
+// Time is milliseconds, only differences are used (a wrap of the clock is
+// harmless).
+
+template <int CHANNELS> class ReportPolicy
+{
+private:
+  int16_t deadband;
+  uint32_t minIntervalMs;
+  uint32_t heartbeatMs;
+
+  int16_t value[CHANNELS];     // last sent
+  bool valid[CHANNELS];
+  bool sent[CHANNELS];         // sent at least once
+  uint32_t sentMs[CHANNELS];
+
+public:
+  ReportPolicy(int16_t valueDeadband, uint32_t minInterval, uint32_t heartbeat)
+  {
+    deadband = valueDeadband;
+    minIntervalMs = minInterval;
+    heartbeatMs = heartbeat;
+    reset();
+  }
+
+  void reset(void)
+  {
+    for (int c = 0; c < CHANNELS; c++)
+    {
+      value[c] = 0;
+      valid[c] = false;
+      sent[c] = false;
+      sentMs[c] = 0;
+    }
+  }
+
+  // returns true when the report of channel must be sent
+  bool check(uint8_t channel, int16_t newValue, bool newValid, uint32_t nowMs)
+  {
+    uint32_t elapsed;
+    int32_t difference;
+    bool changed;
+    bool send;
+
+    elapsed = nowMs - sentMs[channel];
+    difference = (int32_t)newValue - value[channel];
+    changed = newValid && ((difference >= deadband) || (-difference >= deadband));
+
+    send = !sent[channel] ||
+           (newValid != valid[channel]) ||
+           (changed && (elapsed >= minIntervalMs)) ||
+           (elapsed >= heartbeatMs);
+
+    if (send)
+    {
+      value[channel] = newValue;
+      valid[channel] = newValid;
+      sent[channel] = true;
+      sentMs[channel] = nowMs;
+    }
+
+    return send;
+  }
+};
+
+#endif
@@ -0,0 +1,284 @@
+//
+// scheduler
+//
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// Deadline scheduler for the periodic and one-shot jobs of a task.
+//
+// Jobs are identified by a small number (0 .. MAX_JOBS-1). Pending jobs are
+// kept in a binary min-heap ordered by deadline, so the task waits on its
+// queue exactly until the first deadline and runs the due jobs itself:
+//
+//   waitMs = scheduler.msUntilNext(millis());
+//   xQueueReceive(queue, &mesg, ticks(waitMs));   // handle message
+//   while (scheduler.popDue(millis(), job))       // handle due jobs
+//
+// - periodic jobs are re-armed from their deadline, not from the time they
+//   ran, so the period does not drift (missed periods are skipped)
+// - jobs that fall due within coalesceMs of each other run in one wakeup
+// - schedule() of a pending job replaces its deadline (no duplicates)
+//
+// Time is a 32 bit millisecond counter, wrap around is handled.
+
+#define SCHEDULER_IDLE UINT32_MAX   // msUntilNext() : nothing scheduled
+
+typedef struct
+{
+  const char *name;
+  uint32_t dueMs;
+  uint32_t periodMs;            // 0 = one-shot
+  uint32_t runs;
+  uint32_t skipped;             // periods missed (task was busy)
+} schedulerJobStats_t;
+
+template <int MAX_JOBS> class Scheduler
+{
+  static_assert((MAX_JOBS > 0) && (MAX_JOBS < 255), "Scheduler : 1 .. 254 jobs");
+
+private:
+  static const uint8_t NOT_PENDING = 0xFF;
+
+  typedef struct
+  {
+    uint32_t dueMs;
+    uint32_t periodMs;          // 0 = one-shot
+    uint32_t runs;
+    uint32_t skipped;           // periods missed (task was busy)
+    const char *name;
+    uint8_t heapIndex;          // NOT_PENDING if not scheduled
+  } job_t;
+
+  job_t jobs[MAX_JOBS];
+  uint8_t heap[MAX_JOBS];       // job ids, earliest deadline at heap[0]
+  uint8_t heapSize;
+  uint32_t coalesceMs;
+
+  static bool before(uint32_t a, uint32_t b)
+  {
+    return (int32_t)(a - b) < 0;
+  }
+
+  void place(uint8_t index, uint8_t id)
+  {
+    heap[index] = id;
+    jobs[id].heapIndex = index;
+  }
+
+  void siftUp(uint8_t index)
+  {
+    uint8_t id = heap[index];
+
+    while (index > 0)
+    {
+      uint8_t parent = (index - 1) / 2;
+
+      if (!before(jobs[id].dueMs, jobs[heap[parent]].dueMs))
+      {
+        break;
+      }
+      place(index, heap[parent]);
+      index = parent;
+    }
+    place(index, id);
+  }
+
+  void siftDown(uint8_t index)
+  {
+    uint8_t id = heap[index];
+
+    while (true)
+    {
+      uint8_t child = 2 * index + 1;
+
+      if (child >= heapSize)
+      {
+        break;
+      }
+      if ((child + 1 < heapSize) && before(jobs[heap[child + 1]].dueMs, jobs[heap[child]].dueMs))
+      {
+        child++;
+      }
+      if (!before(jobs[heap[child]].dueMs, jobs[id].dueMs))
+      {
+        break;
+      }
+      place(index, heap[child]);
+      index = child;
+    }
+    place(index, id);
+  }
+
+  void remove(uint8_t id)
+  {
+    uint8_t index = jobs[id].heapIndex;
+    uint8_t last;
+
+    jobs[id].heapIndex = NOT_PENDING;
+    heapSize--;
+
+    if (index == heapSize)
+    {
+      return;
+    }
+
+    // move last element into the hole, restore heap order
+    last = heap[heapSize];
+    place(index, last);
+    siftUp(index);
+    siftDown(jobs[last].heapIndex);
+  }
+
+public:
+  Scheduler(uint32_t coalesceWindowMs)
+  {
+    heapSize = 0;
+    coalesceMs = coalesceWindowMs;
+
+    for (uint8_t id = 0; id < MAX_JOBS; id++)
+    {
+      jobs[id].dueMs = 0;
+      jobs[id].periodMs = 0;
+      jobs[id].runs = 0;
+      jobs[id].skipped = 0;
+      jobs[id].name = "?";
+      jobs[id].heapIndex = NOT_PENDING;
+    }
+  }
+
+  void setName(uint8_t id, const char *name)
+  {
+    if (id < MAX_JOBS)
+    {
+      jobs[id].name = name;
+    }
+  }
+
+  // (re)arm job : first run after delayMs, then every periodMs (0 = one-shot)
+  void schedule(uint8_t id, uint32_t nowMs, uint32_t delayMs, uint32_t periodMs = 0)
+  {
+    if (id >= MAX_JOBS)
+    {
+      return;
+    }
+
+    jobs[id].dueMs = nowMs + delayMs;
+    jobs[id].periodMs = periodMs;
+
+    if (jobs[id].heapIndex == NOT_PENDING)
+    {
+      place(heapSize, id);
+      heapSize++;
+      siftUp(jobs[id].heapIndex);
+    }
+    else
+    {
+      // deadline may have moved either way
+      siftUp(jobs[id].heapIndex);
+      siftDown(jobs[id].heapIndex);
+    }
+  }
+
+  void cancel(uint8_t id)
+  {
+    if ((id < MAX_JOBS) && (jobs[id].heapIndex != NOT_PENDING))
+    {
+      remove(id);
+    }
+  }
+
+  bool isScheduled(uint8_t id)
+  {
+    return (id < MAX_JOBS) && (jobs[id].heapIndex != NOT_PENDING);
+  }
+
+  // time to wait for the first deadline, 0 if due, SCHEDULER_IDLE if nothing is scheduled
+  uint32_t msUntilNext(uint32_t nowMs)
+  {
+    if (heapSize == 0)
+    {
+      return SCHEDULER_IDLE;
+    }
+    if (!before(nowMs, jobs[heap[0]].dueMs))
+    {
+      return 0;
+    }
+    return jobs[heap[0]].dueMs - nowMs;
+  }
+
+  // Take the next job that is due at nowMs (or within the coalesce window).
+  // One-shot jobs are removed, periodic jobs are re-armed.
+  bool popDue(uint32_t nowMs, uint8_t &id)
+  {
+    job_t *job;
+
+    if ((heapSize == 0) || before(nowMs + coalesceMs, jobs[heap[0]].dueMs))
+    {
+      return false;
+    }
+
+    id = heap[0];
+    job = &jobs[id];
+    job->runs++;
+
+    if (job->periodMs == 0)
+    {
+      remove(id);
+    }
+    else
+    {
+      job->dueMs += job->periodMs;
+      if (!before(nowMs, job->dueMs))
+      {
+        // task was busy for more than a period : skip, keep the phase
+        uint32_t missed = (nowMs - job->dueMs) / job->periodMs + 1;
+
+        job->skipped += missed;
+        job->dueMs += missed * job->periodMs;
+      }
+      siftDown(0);
+    }
+
+    return true;
+  }
+
+  // pending jobs in deadline order (ids), returns their number
+  uint8_t getPending(uint8_t order[MAX_JOBS])
+  {
+    uint8_t n = heapSize;
+
+    // heap order is not deadline order : sort a copy (few jobs)
+    memcpy(order, heap, n);
+    for (uint8_t i = 1; i < n; i++)
+    {
+      uint8_t id = order[i];
+      uint8_t j = i;
+
+      while ((j > 0) && before(jobs[id].dueMs, jobs[order[j - 1]].dueMs))
+      {
+        order[j] = order[j - 1];
+        j--;
+      }
+      order[j] = id;
+    }
+    return n;
+  }
+
+  void getStats(uint8_t id, schedulerJobStats_t &stats)
+  {
+    if (id < MAX_JOBS)
+    {
+      stats.name = jobs[id].name;
+      stats.dueMs = jobs[id].dueMs;
+      stats.periodMs = jobs[id].periodMs;
+      stats.runs = jobs[id].runs;
+      stats.skipped = jobs[id].skipped;
+    }
+  }
+};
+
+#endif
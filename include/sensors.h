@@ -4,6 +4,15 @@
 
 #include <Arduino.h>
 
+// Sampling profiles (sample rate, report rate & decimation), see sensors.cpp
+typedef enum
+{
+  e_sensors_profile_default,
+  e_sensors_profile_mash,
+  e_sensors_profile_boil,
+  e_sensors_profile_fermentation,
+  e_sensors_profile_count
+} sensorsProfile_t;
 
 extern int sensorsQueueSend(uint8_t *, TickType_t);
 extern void initSensors(void);
@@ -5,39 +5,431 @@
 #ifndef __SMOOTH_H__
 #define __SMOOTH_H__
 
-template <int SAMPLE_WINDOW> class Smooth
+#include <stdint.h>
+#include <stdlib.h>
+
+// Windows up to this size use a compile-time generated sorting network,
+// larger windows use the incremental ordered window
+#define SMOOTH_NETWORK_MAX_WINDOW 15
+
+// ============================================================================
+// SORTING NETWORK
+// ============================================================================
+//
+// Odd-even transposition network, unrolled at compile time: SAMPLE_WINDOW
+// rounds of compare-exchanges on neighbouring elements, alternating between
+// even and odd pairs. Every compare-exchange is a min/max pair, so there are
+// no data dependent branches.
+
+template <typename T> static inline void smoothCompareExchange(T &a, T &b)
+{
+  T low = (a < b) ? a : b;
+  T high = (a < b) ? b : a;
+
+  a = low;
+  b = high;
+}
+
+// one round : compare-exchange pairs (I, I+1), (I+2, I+3), ...
+template <int SAMPLE_WINDOW, int I, bool DONE = (I + 1 >= SAMPLE_WINDOW)> struct SmoothNetworkRound
+{
+  template <typename T> static inline void apply(T *v)
+  {
+    smoothCompareExchange(v[I], v[I + 1]);
+    SmoothNetworkRound<SAMPLE_WINDOW, I + 2>::apply(v);
+  }
+};
+
+template <int SAMPLE_WINDOW, int I> struct SmoothNetworkRound<SAMPLE_WINDOW, I, true>
+{
+  template <typename T> static inline void apply(T *) {}
+};
+
+// all rounds
+template <int SAMPLE_WINDOW, int ROUND = 0, bool DONE = (ROUND >= SAMPLE_WINDOW)> struct SmoothNetwork
+{
+  template <typename T> static inline void sort(T *v)
+  {
+    SmoothNetworkRound<SAMPLE_WINDOW, ROUND & 1>::apply(v);
+    SmoothNetwork<SAMPLE_WINDOW, ROUND + 1>::sort(v);
+  }
+};
+
+template <int SAMPLE_WINDOW, int ROUND> struct SmoothNetwork<SAMPLE_WINDOW, ROUND, true>
+{
+  template <typename T> static inline void sort(T *) {}
+};
+
+// compile-time type selection
+template <bool CONDITION, typename IF_TRUE, typename IF_FALSE> struct SmoothSelect
+{
+  typedef IF_TRUE type;
+};
+
+template <typename IF_TRUE, typename IF_FALSE> struct SmoothSelect<false, IF_TRUE, IF_FALSE>
+{
+  typedef IF_FALSE type;
+};
+
+// ============================================================================
+// NETWORK WINDOW (small windows)
+// ============================================================================
+//
+// Ring buffer only. The median is taken from a sorted copy made by the
+// sorting network, the average of the valid samples is a branch-free loop.
+
+template <int SAMPLE_WINDOW> class SmoothNetworkWindow
 {
 
 private:
 
-  int _samples[SAMPLE_WINDOW];
-  int _samplesSorted[SAMPLE_WINDOW];
-  int _sampleCount;
-  int _state;
-  int _maxDeviation;
-  int _value;
-  int _outputValid;
+  int _samples[SAMPLE_WINDOW];  // ring buffer, arrival order
+  int _oldest;                  // ring buffer index of oldest sample
+
+public:
 
-  // compare function required for qsort
-  static int compare_int(const void *a, const void *b)
+  SmoothNetworkWindow()
   {
-    int a_val = *((long *)a);
-    int b_val = *((long *)b);
+    _oldest = 0;
+  }
+
+  // add sample 'index' while window is filling up
+  void fill(int index, int value)
+  {
+    _samples[index] = value;
+  }
+
+  // replace oldest sample by new sample (window is full)
+  void replace(int value)
+  {
+    _samples[_oldest] = value;
 
-    if (a_val == b_val)
+    _oldest++;
+    if (_oldest == SAMPLE_WINDOW)
     {
-      return 0;
+      _oldest = 0;
     }
-    else if (a_val < b_val)
+  }
+
+  int median(void)
+  {
+    int sorted[SAMPLE_WINDOW];
+
+    for (int i = 0; i < SAMPLE_WINDOW; i++)
     {
-      return -1;
+      sorted[i] = _samples[i];
+    }
+    SmoothNetwork<SAMPLE_WINDOW>::sort(sorted);
+
+    return sorted[SAMPLE_WINDOW / 2];
+  }
+
+  // sum and number of samples deviating less than maxDeviation from median
+  long sumValid(int median, int maxDeviation, int &numValidSamples)
+  {
+    long sumSamples = 0;
+    int count = 0;
+
+    for (int i = 0; i < SAMPLE_WINDOW; i++)
+    {
+      int deviation = _samples[i] - median;
+      int valid = (deviation < maxDeviation) & (deviation > -maxDeviation);
+
+      sumSamples += valid ? _samples[i] : 0;
+      count += valid;
+    }
+
+    numValidSamples = count;
+    return sumSamples;
+  }
+};
+
+// ============================================================================
+// ORDERED WINDOW (large windows)
+// ============================================================================
+//
+// Samples are kept in a ring buffer (arrival order) and, in parallel, in a
+// balanced search tree ordered by value (treap). Tree node i holds ring buffer
+// sample i, so a new sample replaces the oldest one by taking that node out of
+// the tree and inserting it again with the new value : O(log N), no samples
+// are moved or copied. Every node also holds the number and the sum of the
+// samples in its subtree, which gives the median (the sample with rank N/2)
+// and the sum of the samples within the outlier limits in O(log N) as well.
+//
+// Equal values are ordered by node index, so every node has a unique key.
+// Node priorities are a fixed hash of the node index : the tree has the shape
+// of a random binary search tree (expected depth O(log N)), whatever the order
+// of the values, e.g. a steadily rising temperature.
+
+template <int SAMPLE_WINDOW> class SmoothOrderedWindow
+{
+
+private:
+
+  typedef struct
+  {
+    int value;
+    long sum;                 // of the samples in the subtree
+    int16_t left;             // node index, -1 = none
+    int16_t right;
+    uint16_t count;           // samples in the subtree
+    uint16_t priority;        // heap order : parent >= children
+  } smoothNode_t;
+
+  smoothNode_t _nodes[SAMPLE_WINDOW];   // node i = ring buffer sample i
+  int16_t _root;
+  int _oldest;                          // ring buffer index of oldest sample
+
+  static uint16_t priority(int node)
+  {
+    uint32_t hash = (uint32_t)(node + 1) * 0x9E3779B9u;
+
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    return (uint16_t)(hash >> 16);
+  }
+
+  uint16_t count(int16_t node)
+  {
+    return (node < 0) ? 0 : _nodes[node].count;
+  }
+
+  long sum(int16_t node)
+  {
+    return (node < 0) ? 0 : _nodes[node].sum;
+  }
+
+  void update(int16_t node)
+  {
+    smoothNode_t &n = _nodes[node];
+
+    n.count = 1 + count(n.left) + count(n.right);
+    n.sum = n.value + sum(n.left) + sum(n.right);
+  }
+
+  // key order : value, then node index
+  bool less(int16_t a, int16_t b)
+  {
+    return (_nodes[a].value < _nodes[b].value) || ((_nodes[a].value == _nodes[b].value) && (a < b));
+  }
+
+  // subtree t into nodes before and after node (node itself not in t)
+  void split(int16_t t, int16_t node, int16_t &before, int16_t &after)
+  {
+    if (t < 0)
+    {
+      before = -1;
+      after = -1;
+    }
+    else if (less(t, node))
+    {
+      split(_nodes[t].right, node, _nodes[t].right, after);
+      before = t;
+      update(t);
     }
     else
     {
-      return 1;
+      split(_nodes[t].left, node, before, _nodes[t].left);
+      after = t;
+      update(t);
     }
-  };
+  }
+
+  // all keys in a before all keys in b
+  int16_t merge(int16_t a, int16_t b)
+  {
+    if (a < 0)
+    {
+      return b;
+    }
+    if (b < 0)
+    {
+      return a;
+    }
+    if (_nodes[a].priority >= _nodes[b].priority)
+    {
+      _nodes[a].right = merge(_nodes[a].right, b);
+      update(a);
+      return a;
+    }
+    _nodes[b].left = merge(a, _nodes[b].left);
+    update(b);
+    return b;
+  }
+
+  void insert(int16_t node)
+  {
+    int16_t before;
+    int16_t after;
+
+    _nodes[node].left = -1;
+    _nodes[node].right = -1;
+    update(node);
+
+    split(_root, node, before, after);
+    _root = merge(merge(before, node), after);
+  }
+
+  // remove node from subtree t, returns the new subtree root
+  int16_t erase(int16_t t, int16_t node)
+  {
+    if (t == node)
+    {
+      return merge(_nodes[t].left, _nodes[t].right);
+    }
+    if (less(node, t))
+    {
+      _nodes[t].left = erase(_nodes[t].left, node);
+    }
+    else
+    {
+      _nodes[t].right = erase(_nodes[t].right, node);
+    }
+    update(t);
+    return t;
+  }
 
+  // number and sum of the samples with a value below limit (or equal to it
+  // when inclusive)
+  long sumBelow(long limit, bool inclusive, int &numSamples)
+  {
+    int16_t t = _root;
+    long sumSamples = 0;
+
+    numSamples = 0;
+    while (t >= 0)
+    {
+      const smoothNode_t &n = _nodes[t];
+
+      if ((n.value < limit) || (inclusive && (n.value == limit)))
+      {
+        numSamples += count(n.left) + 1;
+        sumSamples += sum(n.left) + n.value;
+        t = n.right;
+      }
+      else
+      {
+        t = n.left;
+      }
+    }
+    return sumSamples;
+  }
+
+  int subtreeDepth(int16_t t)
+  {
+    int left;
+    int right;
+
+    if (t < 0)
+    {
+      return 0;
+    }
+    left = subtreeDepth(_nodes[t].left);
+    right = subtreeDepth(_nodes[t].right);
+    return 1 + ((left > right) ? left : right);
+  }
+
+public:
+
+  SmoothOrderedWindow()
+  {
+    _root = -1;
+    _oldest = 0;
+
+    for (int i = 0; i < SAMPLE_WINDOW; i++)
+    {
+      _nodes[i].priority = priority(i);
+    }
+  }
+
+  // add sample 'index' while window is filling up
+  void fill(int index, int value)
+  {
+    _nodes[index].value = value;
+    insert(index);
+  }
+
+  // replace oldest sample by new sample (window is full)
+  void replace(int value)
+  {
+    _root = erase(_root, _oldest);
+    _nodes[_oldest].value = value;
+    insert(_oldest);
+
+    _oldest++;
+    if (_oldest == SAMPLE_WINDOW)
+    {
+      _oldest = 0;
+    }
+  }
+
+  // sample with rank SAMPLE_WINDOW / 2
+  int median(void)
+  {
+    int16_t t = _root;
+    int rank = SAMPLE_WINDOW / 2;
+
+    while (rank != count(_nodes[t].left))
+    {
+      if (rank < count(_nodes[t].left))
+      {
+        t = _nodes[t].left;
+      }
+      else
+      {
+        rank -= count(_nodes[t].left) + 1;
+        t = _nodes[t].right;
+      }
+    }
+    return _nodes[t].value;
+  }
+
+  // sum and number of samples deviating less than maxDeviation from median
+  long sumValid(int median, int maxDeviation, int &numValidSamples)
+  {
+    int numBelowHigh;
+    int numBelowLow;
+    long sumSamples;
+
+    if (maxDeviation <= 0)
+    {
+      numValidSamples = 0;
+      return 0;
+    }
+
+    // valid : median - maxDeviation < value < median + maxDeviation
+    sumSamples = sumBelow((long)median + maxDeviation, false, numBelowHigh);
+    sumSamples -= sumBelow((long)median - maxDeviation, true, numBelowLow);
+
+    numValidSamples = numBelowHigh - numBelowLow;
+    return sumSamples;
+  }
+
+  // tree depth (host test : expected O(log N))
+  int depth(void)
+  {
+    return subtreeDepth(_root);
+  }
+};
+
+// ============================================================================
+// SMOOTH
+// ============================================================================
+
+template <int SAMPLE_WINDOW> class Smooth
+{
+
+private:
+
+  typename SmoothSelect<(SAMPLE_WINDOW <= SMOOTH_NETWORK_MAX_WINDOW),
+                        SmoothNetworkWindow<SAMPLE_WINDOW>,
+                        SmoothOrderedWindow<SAMPLE_WINDOW> >::type _window;
+  int _sampleCount;
+  int _state;
+  int _maxDeviation;
+  int _value;
+  int _outputValid;
 
 public:
 
@@ -56,7 +448,6 @@ public:
   void setValue(int value)
   {
     int median;
-    long deviation;
     long sumSamples;
     int numValidSamples;
 
@@ -64,8 +455,8 @@ public:
     {
     case 0:
     {
-      // Consume new samples until _samples buffer is full. Output remains invalid
-      _samples[_sampleCount] = value;
+      // Consume new samples until window is full. Output remains invalid
+      _window.fill(_sampleCount, value);
       _sampleCount++;
 
       if (_sampleCount == SAMPLE_WINDOW)
@@ -78,38 +469,14 @@ public:
 
     case 1:
     {
-      // Shift new samples into _samples buffer
-      for (int i = 1; i < SAMPLE_WINDOW; i++)
-      {
-        _samples[i - 1] = _samples[i];
-      }
-      _samples[SAMPLE_WINDOW - 1] = value;
-
-      // Sort all samples into _samplesSorted buffer 
-      // ...first create copy
-      for (int i = 1; i < SAMPLE_WINDOW; i++)
-      {
-        _samplesSorted[i] = _samples[i];
-      }
-      qsort(_samplesSorted, SAMPLE_WINDOW, sizeof(int), compare_int);
+      // Replace oldest sample by new sample
+      _window.replace(value);
 
       // Get median from sorted samples
-      median = _samplesSorted[SAMPLE_WINDOW / 2];
+      median = _window.median();
 
       // Average all samples. skipping outlyers
-      sumSamples = 0;
-      numValidSamples = 0;
-      for (int i = 0; i < SAMPLE_WINDOW; i++)
-      {
-        deviation = _samples[i] - median;
-
-        // calculate sum & outlyer detection
-        if (abs(deviation) < _maxDeviation)
-        {
-          sumSamples += _samples[i];
-          numValidSamples++;
-        }
-      }
+      sumSamples = _window.sumValid(median, _maxDeviation, numValidSamples);
 
       // Compute average of valid samples
       if (numValidSamples > 0)
@@ -127,7 +494,7 @@ public:
     break;
     }
   }
- 
+
   // Set maximum deviation from median
   void setMaxDeviation(int maxDeviation)
   {
@@ -148,4 +515,4 @@ public:
 
 };
 
-#endif
\ No newline at end of file
+#endif
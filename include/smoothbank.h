@@ -0,0 +1,175 @@
+//
+// smoothbank
+//
+
+#ifndef __SMOOTHBANK_H__
+#define __SMOOTHBANK_H__
+
+#include <stdint.h>
+#include "smooth.h"
+
+// Multi-channel version of Smooth : same median based outlier filter with
+// averaging, for CHANNELS inputs that are sampled together (one scan).
+//
+// Samples are stored structure-of-arrays: one row per window slot holding
+// the int16_t samples of all channels. Every step (sorting network compare-
+// exchange, deviation check, summing) is a loop over the channels of a row,
+// so all channels are processed together by straight, vectorizable loops.
+// The bank always uses the sorting network, so it is meant for small windows.
+//
+// With valid inputs only, every channel gives the same output as a separate
+// Smooth<SAMPLE_WINDOW> : no output for the first SAMPLE_WINDOW samples, then
+// the filtered window. Smooth has no notion of an invalid input (the caller
+// skips it), here an invalid input takes a slot with a repeat of the
+// previous sample, so the window keeps moving with the scans.
+
+template <int CHANNELS> struct SmoothBankRow
+{
+  int16_t v[CHANNELS];
+};
+
+// compare-exchange of two rows, per channel (used by SmoothNetwork)
+template <int CHANNELS> static inline void smoothCompareExchange(SmoothBankRow<CHANNELS> &a, SmoothBankRow<CHANNELS> &b)
+{
+  for (int c = 0; c < CHANNELS; c++)
+  {
+    int16_t low = (a.v[c] < b.v[c]) ? a.v[c] : b.v[c];
+    int16_t high = (a.v[c] < b.v[c]) ? b.v[c] : a.v[c];
+
+    a.v[c] = low;
+    b.v[c] = high;
+  }
+}
+
+template <int CHANNELS, int SAMPLE_WINDOW> class SmoothBank
+{
+  static_assert(SAMPLE_WINDOW <= SMOOTH_NETWORK_MAX_WINDOW, "SmoothBank uses a sorting network, use Smooth<> for large windows");
+
+private:
+
+  SmoothBankRow<CHANNELS> _samples[SAMPLE_WINDOW]; // ring buffer, arrival order
+  int _oldest;                                     // ring buffer index of oldest row
+
+  int16_t _maxDeviation[CHANNELS];
+  int16_t _value[CHANNELS];
+  uint8_t _fillCount[CHANNELS];                    // valid samples received, up to SAMPLE_WINDOW
+  bool _outputValid[CHANNELS];
+
+public:
+
+  // C-tor
+  SmoothBank()
+  {
+    _oldest = 0;
+
+    for (int c = 0; c < CHANNELS; c++)
+    {
+      _maxDeviation[c] = 1;
+      _value[c] = 0;
+      _fillCount[c] = 0;
+      _outputValid[c] = false;
+    }
+
+    for (int i = 0; i < SAMPLE_WINDOW; i++)
+    {
+      for (int c = 0; c < CHANNELS; c++)
+      {
+        _samples[i].v[c] = 0;
+      }
+    }
+  };
+
+  // provide a new scan (one value per channel) to smoothing operator
+  // A channel with an invalid value repeats its previous sample and has
+  // no valid output for this scan.
+  void setValues(const int16_t *values, const bool *valid)
+  {
+    SmoothBankRow<CHANNELS> sorted[SAMPLE_WINDOW];
+    int32_t sumSamples[CHANNELS];
+    int16_t numValidSamples[CHANNELS];
+    bool full[CHANNELS];
+    int newest;
+
+    newest = (_oldest == 0) ? SAMPLE_WINDOW - 1 : _oldest - 1;
+
+    // Replace oldest row by new scan. Like Smooth, a channel has output from
+    // its first valid sample after SAMPLE_WINDOW valid samples (window full)
+    for (int c = 0; c < CHANNELS; c++)
+    {
+      full[c] = (_fillCount[c] == SAMPLE_WINDOW);
+      _samples[_oldest].v[c] = valid[c] ? values[c] : _samples[newest].v[c];
+      _fillCount[c] += (valid[c] && !full[c]) ? 1 : 0;
+    }
+
+    _oldest++;
+    if (_oldest == SAMPLE_WINDOW)
+    {
+      _oldest = 0;
+    }
+
+    // Sort a copy of all rows, per channel, and get median row
+    for (int i = 0; i < SAMPLE_WINDOW; i++)
+    {
+      sorted[i] = _samples[i];
+    }
+    SmoothNetwork<SAMPLE_WINDOW>::sort(sorted);
+
+    const SmoothBankRow<CHANNELS> &median = sorted[SAMPLE_WINDOW / 2];
+
+    // Average all samples. skipping outlyers
+    for (int c = 0; c < CHANNELS; c++)
+    {
+      sumSamples[c] = 0;
+      numValidSamples[c] = 0;
+    }
+
+    for (int i = 0; i < SAMPLE_WINDOW; i++)
+    {
+      for (int c = 0; c < CHANNELS; c++)
+      {
+        int deviation = _samples[i].v[c] - median.v[c];
+        int inRange = (deviation < _maxDeviation[c]) & (deviation > -_maxDeviation[c]);
+
+        sumSamples[c] += inRange ? _samples[i].v[c] : 0;
+        numValidSamples[c] += inRange;
+      }
+    }
+
+    // Compute average of valid samples
+    for (int c = 0; c < CHANNELS; c++)
+    {
+      _outputValid[c] = valid[c] && full[c] && (numValidSamples[c] > 0);
+      _value[c] = _outputValid[c] ? sumSamples[c] / numValidSamples[c] : 0;
+    }
+  }
+
+  // Set maximum deviation from median, for one channel
+  void setMaxDeviation(int channel, int16_t maxDeviation)
+  {
+    _maxDeviation[channel] = maxDeviation;
+  }
+
+  // Set maximum deviation from median, for all channels
+  void setMaxDeviation(int16_t maxDeviation)
+  {
+    for (int c = 0; c < CHANNELS; c++)
+    {
+      _maxDeviation[c] = maxDeviation;
+    }
+  }
+
+  // returns true when getValue has a valid return for channel
+  bool isValid(int channel)
+  {
+    return _outputValid[channel];
+  };
+
+  // get Smoothed output of channel
+  int16_t getValue(int channel)
+  {
+    return _value[channel];
+  }
+
+};
+
+#endif
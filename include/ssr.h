@@ -0,0 +1,38 @@
+#ifndef __SSR_H__
+#define __SSR_H__
+
+#include <stdint.h>
+
+// Time-proportioned outputs for solid state relays (heating elements).
+//
+// Every CFG_SSR_WINDOW_MS an output is switched on for duty per mille of the
+// window. Switching is done by esp_timer callbacks (2 per window & channel),
+// no task polls the outputs. The windows of the channels are spread over the
+// window time, so elements on the same mains phase do not all switch on at
+// the same moment. On-times shorter than CFG_SSR_MIN_PULSE_MS are skipped
+// (zero-cross SSRs need at least a mains cycle).
+
+#define SSR_DUTY_MAX  1000    // per mille
+
+// on-time (us) of a window for a duty : 0 when shorter than the minimum pulse,
+// the whole window when the off-time would be shorter than it
+static inline uint32_t ssrOnTimeUs(uint16_t dutyPerMille, uint32_t windowUs, uint32_t minPulseUs)
+{
+  uint32_t onTimeUs = (uint32_t)dutyPerMille * (windowUs / SSR_DUTY_MAX);
+
+  if (onTimeUs < minPulseUs)
+  {
+    return 0;
+  }
+  if (onTimeUs >= windowUs - minPulseUs)
+  {
+    return windowUs;
+  }
+  return onTimeUs;
+}
+
+extern void ssrSetDuty(uint8_t channel, uint16_t dutyPerMille);
+extern uint16_t ssrGetDuty(uint8_t channel);
+extern void initSSR(void);
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef __STATESTORE_H__
+#define __STATESTORE_H__
+
+#include <Arduino.h>
+#include "config.h"
+#include "controller.h"
+
+// Latest-value store for the state shown on the display and sent to the
+// backend. Every key holds only its newest value plus a version, a new
+// value replaces the previous one (latest wins, nothing queues up).
+//
+// - Writers publish a complete value. A write is a short critical section,
+//   so it cannot be preempted half-way.
+// - Readers never lock : they copy the value and retry if the version
+//   changed during the copy (sequence lock). Readers on the other core
+//   never wait for the writer's task.
+// - A consumer task can subscribe to keys. On every publish it gets a task
+//   notification with bit STATE_BIT(key) set (xTaskNotifyWait), the bits
+//   above STATE_ALL_BITS stay free for the task itself.
+//
+// Readers pass the version they saw last. This gives "is there a new value"
+// and per key counters : updates a reader never saw (lost, normal under
+// latest-wins) and reads that found nothing new (stale).
+
+typedef enum : uint8_t
+{
+  e_state_temperature,
+  e_state_humidity,
+  e_state_setpoint,
+  e_state_actuators,
+  e_state_wifi,
+  e_state_time,
+  e_state_hydro,
+  e_state_count
+} stateKey_t;
+
+#define STATE_BIT(key)          (1UL << (key))
+#define STATE_ALL_BITS          (STATE_BIT(e_state_count) - 1)
+#define STATE_MAX_SUBSCRIBERS   4
+
+typedef struct
+{
+  int16_t temperature_x10[CFG_TEMP_MAX_NR_SENSORS];   // per sensor-id
+  bool valid[CFG_TEMP_MAX_NR_SENSORS];
+  uint16_t readings[CFG_TEMP_MAX_NR_SENSORS];         // readings received, tells which sensor was updated
+  uint8_t numSensors;
+} stateTemperature_t;
+
+typedef struct
+{
+  int16_t humidity_x10;
+  bool valid;
+} stateHumidity_t;
+
+typedef struct
+{
+  int16_t setPoint_x10;
+  bool valid;
+} stateSetPoint_t;
+
+typedef struct
+{
+  uint16_t actuators;           // every bit corresponds with an actuator (CFG_RELAY_COUNT <= 16)
+  bool valid;
+  bool fallback;                // set by the local thermostat (backend unreachable)
+} stateActuators_t;
+
+typedef struct
+{
+  int16_t rssi;
+  char status;                  // '-', 'A', 'I', 'p', '?'
+  bool valid;
+} stateWiFi_t;
+
+typedef struct
+{
+  uint16_t time;                // hours << 8 | minutes
+  bool valid;
+} stateTime_t;
+
+typedef struct
+{
+  hydrometerQData_t reading;
+  bool valid;
+} stateHydro_t;
+
+// value type of each key
+template <stateKey_t KEY> struct StateType;
+template <> struct StateType<e_state_temperature> { typedef stateTemperature_t type; };
+template <> struct StateType<e_state_humidity>    { typedef stateHumidity_t type; };
+template <> struct StateType<e_state_setpoint>    { typedef stateSetPoint_t type; };
+template <> struct StateType<e_state_actuators>   { typedef stateActuators_t type; };
+template <> struct StateType<e_state_wifi>        { typedef stateWiFi_t type; };
+template <> struct StateType<e_state_time>        { typedef stateTime_t type; };
+template <> struct StateType<e_state_hydro>       { typedef stateHydro_t type; };
+
+// Slot size : the largest value type of all keys, in whole 32 bit words. It
+// follows the types (e.g. CFG_TEMP_MAX_NR_SENSORS), a key without a
+// StateType does not compile.
+constexpr size_t stateMaxSize(size_t a, size_t b)
+{
+  return (a > b) ? a : b;
+}
+
+template <int KEY> struct StateMaxSize
+{
+  static const size_t size = stateMaxSize(sizeof(typename StateType<(stateKey_t)KEY>::type), StateMaxSize<KEY - 1>::size);
+};
+
+template <> struct StateMaxSize<-1>
+{
+  static const size_t size = 0;
+};
+
+#define STATE_MAX_SIZE          ((StateMaxSize<e_state_count - 1>::size + 3) & ~(size_t)3)   // bytes per value
+
+static_assert(STATE_MAX_SIZE <= UINT8_MAX, "state value larger than 255 bytes");
+
+extern void statePublishRaw(stateKey_t key, const void *value, uint8_t size);
+extern bool stateReadRaw(stateKey_t key, void *value, uint8_t size, uint32_t *lastVersion);
+extern bool stateSubscribe(TaskHandle_t task, uint32_t keyBits);
+extern void stateReport(void);
+
+template <stateKey_t KEY> static inline void statePublish(const typename StateType<KEY>::type &value)
+{
+  static_assert(sizeof(value) <= STATE_MAX_SIZE, "state value larger than STATE_MAX_SIZE");
+  statePublishRaw(KEY, &value, sizeof(value));
+}
+
+// Copy the newest value. Returns false if never published, or (lastVersion
+// != NULL) if there is nothing newer than *lastVersion. A value that was
+// never published reads as all zero (not valid).
+template <stateKey_t KEY> static inline bool stateRead(typename StateType<KEY>::type &value, uint32_t *lastVersion = NULL)
+{
+  static_assert(sizeof(value) <= STATE_MAX_SIZE, "state value larger than STATE_MAX_SIZE");
+  return stateReadRaw(KEY, &value, sizeof(value), lastVersion);
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <Arduino.h>
+
+// Run-time counters of the application tasks and their queues. Reported
+// periodically by the controller (CFG_TELEMETRY_INTERVAL_S).
+//
+// Per task (each task owns one queue):
+// - loop wakeups, and busy time : from telemetryWakeup() until the task
+//   blocks again (telemetrySleep()). Wall clock, so time the task was
+//   preempted by a higher priority task is counted as busy.
+// - stack high-water mark (registered tasks)
+// - queue : sends, send failures per message type, depth high-water and the
+//   enqueue-to-dequeue latency histogram. Queue items carry the enqueue time
+//   (telemetryStamp()) set by the *QueueSend wrapper, when
+//   CFG_TELEMETRY_LATENCY is set. That costs 4 bytes per item : the
+//   controller item grows from 12 to 16 bytes (14 lane entries and 12
+//   mailbox slots : 104 bytes), the actuator item from 2 to 8 (padding).
+//
+// All counters are plain increments or short critical sections, a few
+// microseconds per message.
+
+typedef enum : uint8_t
+{
+  e_tel_controller,
+  e_tel_comms,
+  e_tel_hydro,
+  e_tel_display,
+  e_tel_actuators,
+  e_tel_sensors,
+  e_tel_count
+} telemetryTask_t;
+
+#define TELEMETRY_MESG_TYPES        16    // send failures per message type, higher types are counted as the last
+#define TELEMETRY_LATENCY_BUCKETS   6     // < 100 us, < 1 ms, < 10 ms, < 100 ms, < 1 s, >= 1 s
+
+typedef struct
+{
+  uint32_t sent;
+  uint32_t failed;
+  uint32_t latency[TELEMETRY_LATENCY_BUCKETS];
+  uint32_t latencyMaxUs;
+  uint8_t highWater;
+  uint8_t length;
+} telemetryQueueStats_t;
+
+// enqueue time of a queue item (microseconds, wraps after 71 minutes)
+static inline uint32_t telemetryStamp(void)
+{
+  return (uint32_t)esp_timer_get_time();
+}
+
+extern void telemetryRegisterTask(telemetryTask_t task, TaskHandle_t handle, uint8_t queueLength);
+extern void telemetryQueueSend(telemetryTask_t task, uint8_t mesgType, BaseType_t result, UBaseType_t depth);
+extern void telemetryQueueReceive(telemetryTask_t task, uint32_t stampUs);
+extern void telemetryQueueStats(telemetryTask_t task, telemetryQueueStats_t *stats);
+extern void telemetryWakeup(telemetryTask_t task);
+extern void telemetrySleep(telemetryTask_t task);
+extern void telemetryReport(void);
+extern int telemetrySummary(char *line, size_t size);
+extern void initTelemetry(void);
+
+#endif
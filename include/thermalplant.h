@@ -0,0 +1,147 @@
+//
+// thermalplant
+//
+
+#ifndef __THERMALPLANT_H__
+#define __THERMALPLANT_H__
+
+#include <stdint.h>
+
+// Thermal model of a fermentation chamber, used by the simulation sensor.
+//
+//   ambient <--> chamber air (+ walls) <--> wort (fermenter)
+//                  ^    ^                    ^
+//             cooling  heating          fermentation heat
+//
+// Both temperatures are integrated with 1 second steps. Compressor and heater
+// do not reach their power instantly: a first order lag with their own time
+// constant. Sensor readings get noise from a seeded xorshift generator and
+// are quantised like a DS18B20 (1/16 degree), so the same seed and the same
+// relay sequence always give the same readings.
+
+typedef struct
+{
+  float wortKg;                 // wort mass, heat capacity of water
+  float chamberJPerK;           // heat capacity of chamber air & walls
+  float wortChamberWPerK;       // heat transfer wort <-> chamber (fermenter wall)
+  float chamberAmbientWPerK;    // heat transfer chamber <-> ambient (insulation)
+  float ambientC;
+  float coolingW;               // compressor cooling power (steady state)
+  float heatingW;               // heater power (steady state)
+  float compressorTauS;         // compressor lag, time constant
+  float heaterTauS;             // heater lag, time constant
+  float fermentationW;          // heat produced by the yeast
+  float sensorNoiseC;           // peak sensor noise
+} thermalPlantParams_t;
+
+#define THERMAL_PLANT_WATER_J_PER_KG_K  4186.0f
+#define THERMAL_PLANT_STEP_MS           1000
+
+class ThermalPlant
+{
+private:
+  thermalPlantParams_t params;
+  float wortC;
+  float chamberC;
+  float coolingW;               // actual (lagging) cooling power
+  float heatingW;               // actual (lagging) heating power
+  uint32_t timeMs;
+  uint32_t rng;
+
+  // xorshift32, uniform in [-1, 1]
+  float noise(void)
+  {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (float)(rng >> 8) / (float)(1 << 23) - 1.0f;
+  }
+
+  // explicit Euler step of dt seconds
+  void integrate(float dt, bool coolOn, bool heatOn)
+  {
+    float wortToChamberW;
+    float ambientToChamberW;
+
+    coolingW += ((coolOn ? params.coolingW : 0.0f) - coolingW) * dt / params.compressorTauS;
+    heatingW += ((heatOn ? params.heatingW : 0.0f) - heatingW) * dt / params.heaterTauS;
+
+    wortToChamberW = params.wortChamberWPerK * (wortC - chamberC);
+    ambientToChamberW = params.chamberAmbientWPerK * (params.ambientC - chamberC);
+
+    wortC += (params.fermentationW - wortToChamberW) * dt / (params.wortKg * THERMAL_PLANT_WATER_J_PER_KG_K);
+    chamberC += (wortToChamberW + ambientToChamberW + heatingW - coolingW) * dt / params.chamberJPerK;
+  }
+
+  // sensor reading * 10 : noise, DS18B20 resolution
+  int16_t reading_x10(float temperatureC)
+  {
+    float value = (temperatureC + noise() * params.sensorNoiseC) * 16.0f;
+    int32_t sixteenths = (int32_t)((value >= 0.0f) ? value + 0.5f : value - 0.5f);
+
+    return (int16_t)((sixteenths * 10) / 16);
+  }
+
+public:
+  ThermalPlant(const thermalPlantParams_t &plantParams, float startC, uint32_t seed)
+  {
+    params = plantParams;
+    reset(startC, seed);
+  }
+
+  // wort & chamber at startC, relays off. seed must not be 0.
+  void reset(float startC, uint32_t seed)
+  {
+    wortC = startC;
+    chamberC = startC;
+    coolingW = 0.0f;
+    heatingW = 0.0f;
+    timeMs = 0;
+    rng = (seed != 0) ? seed : 1;
+  }
+
+  // advance model time by ms, with relay states during that time
+  void step(uint32_t ms, bool coolOn, bool heatOn)
+  {
+    timeMs += ms;
+
+    while (ms >= THERMAL_PLANT_STEP_MS)
+    {
+      integrate(THERMAL_PLANT_STEP_MS / 1000.0f, coolOn, heatOn);
+      ms -= THERMAL_PLANT_STEP_MS;
+    }
+
+    if (ms > 0)
+    {
+      integrate(ms / 1000.0f, coolOn, heatOn);
+    }
+  }
+
+  float getWortC(void)
+  {
+    return wortC;
+  }
+
+  float getChamberC(void)
+  {
+    return chamberC;
+  }
+
+  // model time since reset
+  uint32_t getTimeMs(void)
+  {
+    return timeMs;
+  }
+
+  int16_t getWortSensor_x10(void)
+  {
+    return reading_x10(wortC);
+  }
+
+  int16_t getChamberSensor_x10(void)
+  {
+    return reading_x10(chamberC);
+  }
+};
+
+#endif
@@ -13,278 +13,373 @@ TCA9555 TCA(0x20);
 
 #include "actuators.h"
 #include "controller.h"
+#include "telemetry.h"
+#include "relayengine.h"
+#include "ioexpander.h"
+
+#if (CFG_RELAY_RETAIN == true)
+#include "relayretain.h"
+#if CONFIG_IDF_TARGET_ESP32S3
+#include "esp32s3/rtc.h"
+#else
+#include "esp32/rtc.h"
+#endif
+#endif
 
 #define LOG_TAG "ACTS"
 
+#if (CFG_RELAY_TYPE_GPIO == true)
+#define ACTUATORS_RELAY(n)  {CFG_RELAY##n##_PIN, CFG_RELAY##n##_ON_LEVEL, CFG_RELAY##n##_OUTPUT_TYPE}
+#else
+#define ACTUATORS_RELAY(n)  {CFG_RELAY##n##_PIN, CFG_RELAY##n##_ON_LEVEL, OUTPUT}
+#endif
+#define ACTUATORS_TIMING(n) {CFG_RELAY##n##_ON_DELAY * 1000UL, CFG_RELAY##n##_OFF_DELAY * 1000UL}
+
+typedef struct
+{
+  uint8_t pin;                  // GPIO (0 = no relay) or IO-expander pin
+  uint8_t onLevel;
+  uint8_t outputType;           // GPIO pinMode
+} actuatorRelay_t;
+
+// one entry per relay (CFG_RELAY_COUNT), add CFG_RELAY<n>_* to config.h for more
+static const actuatorRelay_t relays[] =
+{
+  ACTUATORS_RELAY(0),
+  ACTUATORS_RELAY(1),
+};
+
+static const relayTiming_t relayTimings[] =
+{
+  ACTUATORS_TIMING(0),
+  ACTUATORS_TIMING(1),
+};
+
+#define ACTUATORS_COUNT     (sizeof(relays) / sizeof(relays[0]))
+
+static_assert(ACTUATORS_COUNT == CFG_RELAY_COUNT, "relay table does not match CFG_RELAY_COUNT");
+static_assert(sizeof(relayTimings) / sizeof(relayTimings[0]) == ACTUATORS_COUNT, "relay timing table incomplete");
+static_assert(ACTUATORS_COUNT <= RELAY_ENGINE_MAX, "too many relays");
+
 // GLOBALS
-// static QueueHandle_t actuatorsQueue = NULL;
 static QueueHandle_t actuatorsQueue = NULL;
 static TaskHandle_t actuatorsTaskHandle = NULL;
 
-static void setActuator(uint8_t number, uint8_t onOff)
+// actual relay output states, every bit corresponds with an actuator
+static volatile uint16_t actuatorsActual = 0;
+
+#if (CFG_RELAY_TYPE_IOEXP == true)
+// expander pins driving a relay
+static uint16_t relayPins(void)
 {
-  static bool pinModeNotSet = true;
+  uint16_t pins = 0;
 
-  uint8_t pin;
-  uint8_t onLevel;
-  bool valid;
+  for (uint8_t i = 0; i < ACTUATORS_COUNT; i++)
+  {
+    pins |= (1 << relays[i].pin);
+  }
+  return pins;
+}
 
-  if (pinModeNotSet)
+// all relay changes in one I2C transaction (50 kHz bus)
+static IoExpanderShadow<TCA9555> expander(TCA, relayPins());
+static volatile uint32_t expanderBusUs = 0;
+
+static void flushExpander(bool force)
+{
+  int64_t startUs = esp_timer_get_time();
+
+  if (!expander.flush(force))
   {
-    pinModeNotSet = false;
+    ESP_LOGE(LOG_TAG, "IO-expander write failed");
+  }
+  expanderBusUs += (uint32_t)(esp_timer_get_time() - startUs);
+}
+#endif
 
-#if (CFG_RELAY_TYPE_GPIO == true)
-    if (CFG_RELAY0_PIN > 0)
-    {
-      pinMode(CFG_RELAY0_PIN, CFG_RELAY0_OUTPUT_TYPE);
-    }
+// monotonic milliseconds (not the tick count of a blocked queue wait)
+static uint32_t actuatorsNowMs(void)
+{
+  return (uint32_t)(esp_timer_get_time() / 1000);
+}
 
-    if (CFG_RELAY1_PIN > 0)
+static void initOutputs(void)
+{
+#if (CFG_RELAY_TYPE_GPIO == true)
+  for (uint8_t i = 0; i < ACTUATORS_COUNT; i++)
+  {
+    if (relays[i].pin > 0)
     {
-      pinMode(CFG_RELAY1_PIN, CFG_RELAY1_OUTPUT_TYPE);
+      pinMode(relays[i].pin, relays[i].outputType);
     }
+  }
 #endif
 
 #if (CFG_RELAY_TYPE_IOEXP == true)
-    Wire.begin(CFG_I2C_SDA, CFG_I2C_SCL);
-    Wire.setClock(50000);
+  Wire.begin(CFG_I2C_SDA, CFG_I2C_SCL);
+  Wire.setClock(50000);
 
-    ESP_LOGD(LOG_TAG,"BEGIN=%d\n",TCA.begin());
+  ESP_LOGD(LOG_TAG,"BEGIN=%d\n",TCA.begin());
 
-    // TODO : check TCA result & send error message in case no IO-expander is detected
+  // TODO : check TCA result & send error message in case no IO-expander is detected
 
-    // set pin-modes and switch relay's off
-    TCA.pinMode1(CFG_RELAY0_PIN, OUTPUT);
-    TCA.write1(CFG_RELAY0_PIN, !CFG_RELAY0_ON_LEVEL);
-    TCA.pinMode1(CFG_RELAY1_PIN, OUTPUT);
-    TCA.write1(CFG_RELAY1_PIN, !CFG_RELAY1_ON_LEVEL);
-#endif
+  // relays off before the pins become outputs (power-on register is all high)
+  for (uint8_t i = 0; i < ACTUATORS_COUNT; i++)
+  {
+    expander.set(relays[i].pin, !relays[i].onLevel);
   }
+  flushExpander(true);
 
-  valid = false;
-
-  switch (number)
+  for (uint8_t i = 0; i < ACTUATORS_COUNT; i++)
   {
-    case 0:
-      pin     = CFG_RELAY0_PIN;
-      onLevel = CFG_RELAY0_ON_LEVEL;
-      valid   = true;
-      break;
-    case 1:
-      pin     = CFG_RELAY1_PIN;
-      onLevel = CFG_RELAY1_ON_LEVEL;
-      valid   = true;
-      break;  
+    TCA.pinMode1(relays[i].pin, OUTPUT);
   }
+#endif
+}
 
-  if (onOff == 0)
+// write the relay outputs, all = false : only the ones that changed
+static void setActuators(uint16_t value, bool all)
+{
+  static bool pinModeNotSet = true;
+  uint16_t changed;
+  uint8_t level;
+
+  if (pinModeNotSet)
   {
-    // invert level
-    onLevel = !onLevel;
+    pinModeNotSet = false;
+    initOutputs();
+    all = true;
   }
 
-  if (valid)
+  changed = all ? 0xFFFF : (value ^ actuatorsActual);
+  actuatorsActual = value;
+
+  for (uint8_t i = 0; i < ACTUATORS_COUNT; i++)
   {
+    if (!((changed >> i) & 1))
+    {
+      continue;
+    }
+
+    level = ((value >> i) & 1) ? relays[i].onLevel : !relays[i].onLevel;
+
 #if (CFG_RELAY_TYPE_GPIO == true)
-    if (pin > 0)
+    if (relays[i].pin > 0)
     {
-      digitalWrite(pin, onLevel);
+      digitalWrite(relays[i].pin, level);
     }
-#endif    
+#endif
 #if (CFG_RELAY_TYPE_IOEXP == true)
-    TCA.write1(pin, onLevel); 
+    expander.set(relays[i].pin, level);
 #endif
-    ESP_LOGI(LOG_TAG,"digitalWrite(%d, %d)",pin, onLevel);
+    ESP_LOGI(LOG_TAG,"RELAY%d %s : digitalWrite(%d, %d)", i, ((value >> i) & 1) ? "ON" : "OFF", relays[i].pin, level);
   }
+
+#if (CFG_RELAY_TYPE_IOEXP == true)
+  flushExpander(all);
+#endif
 }
 
 
 void powerUpActuators(void)
 {
-  setActuator(0, 0);
-  setActuator(1, 0);
+  setActuators(0, true);
 }
 
 
-// ============================================================================
-// ACTUATORS TASK
-// ============================================================================
-
-static void actuatorsTask(void *arg)
+// actual relay states (after on/off delays), every bit corresponds with an actuator
+uint16_t getActuatorsActual(void)
 {
-  actuatorQueueItem_t actuatorMesg;
-  controllerQItem_t controllerMsg;
+  return actuatorsActual;
+}
 
-  uint8_t actuatorReqeuest0;
-  uint8_t actuatorReqeuest1;
-  uint8_t actuatorActual0;
-  uint8_t actuatorActual1;
-  uint16_t onDelaySec0;
-  uint16_t onDelaySec1;
-  uint16_t offDelaySec0;
-  uint16_t offDelaySec1;
-
-  // INIT DELAYS
-  // we also could start the task loop with all delays initially zero,
-  // however presetting them ensures a initial delay after boot.
-  // This prevent violation the delays in case of accidental boot-
-  // loops during code development or possible power-outages
-  onDelaySec0   = CFG_RELAY0_ON_DELAY;
-  onDelaySec1   = CFG_RELAY1_ON_DELAY;
-  offDelaySec0  = CFG_RELAY0_OFF_DELAY;
-  offDelaySec1  = CFG_RELAY0_OFF_DELAY;
-
-  actuatorActual0 = 0;
-  actuatorActual1 = 0;
-  
-  // Task loop
-  while (true)
-  {
-    // get message from queue
-    // if (xQueueReceive(actuatorsQueue, &actuatorMesg, 1000 / portTICK_PERIOD_MS) == pdTRUE)
-    if (xQueueReceive(actuatorsQueue, &actuatorMesg, 1000 / portTICK_PERIOD_MS) == pdTRUE)
-    {
-      ESP_LOGI(LOG_TAG,"received qMesg.data=%d", actuatorMesg.data);
-      actuatorReqeuest0 = actuatorMesg.data & 1;
-      actuatorReqeuest1 = (actuatorMesg.data >> 1) & 1;
-    }
 
-    // ON-OFF DELAY 
-    // Actuators may have a pre-defined (see config.h) on and/or off delay
-    // when an actuator goes into off-state it immediately can be triggered to go into on-state 
-    // but then CFG_RELAY0_ON_DELAY time must  have been passed before the actuator is 
-    // actually switched on...the task will take care for the delayed-switch-on
-    // Similar is true for switching off.
-    // All delays are in seconds/loop-iterations
+// log the IO-expander bus use (telemetry) : transactions and bus time, and
+// the transactions a write per relay pin would have taken
+void actuatorsReport(void)
+{
+#if (CFG_RELAY_TYPE_IOEXP == true)
+  ioExpanderStats_t stats;
+  uint32_t busUs = expanderBusUs;
 
+  expander.getStats(stats);
+  ESP_LOGI(LOG_TAG, "i2c : writes=%u failed=%u skipped=%u per-pin=%u bus=%u us (per-pin ~%u us)",
+           (unsigned)stats.writes, (unsigned)stats.failed, (unsigned)stats.skipped, (unsigned)stats.pinWrites, (unsigned)busUs,
+           (unsigned)((stats.writes > 0) ? (uint64_t)busUs * stats.pinWrites / stats.writes : 0));
+#endif
+}
 
-    // ACTUATOR 0 - Switch ON request
 
-    if (actuatorReqeuest0 && !actuatorActual0)
-    {
-      controllerMsg.type                    = e_mtype_backend;
-      controllerMsg.mesg.backendMesg.mesgId = e_msg_backend_act_delay;
-      controllerMsg.mesg.backendMesg.number = 0;
-      controllerMsg.mesg.backendMesg.data16   = onDelaySec0;
-      controllerQueueSend(&controllerMsg, 0);
-    }
+// ============================================================================
+// RETAINED RELAY STATE
+// ============================================================================
 
-    // switch on if onDelay is not counting
-    if (actuatorReqeuest0 && !actuatorActual0 && (onDelaySec0 == 0))
-    {
-      // printf("[ACTS] RELAY0 ON !!!\n");
-      ESP_LOGI(LOG_TAG,"RELAY0 ON !!!");
-      setActuator(0, 1);
-      actuatorActual0 = 1;
-      offDelaySec0 = CFG_RELAY0_OFF_DELAY;
-    }
-    else
-    {
-      if (onDelaySec0 > 0)
-      {
-        // Count down
-        onDelaySec0--;
-      }
-    }
+#if (CFG_RELAY_RETAIN == true)
+// The last switch time of every relay is kept in RTC memory that is not
+// cleared by a software, panic or watchdog reset (OTA update, crash). The RTC
+// timer keeps counting over these resets, so after a warm reset the time a
+// relay has been off is known exactly and its on-delay continues instead of
+// starting over. Power-on and brown-out resets (RTC memory and timer lost or
+// unreliable) and a bad CRC fall back to the full delay, as does a relay that
+// was on at the reset (switched off by the reset, at an unknown time).
 
+static RTC_NOINIT_ATTR RelayRetained<ACTUATORS_COUNT> retained;
 
+// relays that changed switched now
+static void retainSwitch(uint16_t actual, uint16_t changed)
+{
+  retained.recordSwitch(actual, changed, esp_rtc_get_time_us());
+}
 
-    // ACTUATOR 0 - Switch OFF request
+static bool warmReset(void)
+{
+  switch (esp_reset_reason())
+  {
+  case ESP_RST_SW:
+  case ESP_RST_PANIC:
+  case ESP_RST_INT_WDT:
+  case ESP_RST_TASK_WDT:
+  case ESP_RST_WDT:
+  case ESP_RST_DEEPSLEEP:
+    return true;
+
+  default:
+    return false;
+  }
+}
 
-    if (!actuatorReqeuest0 && actuatorActual0)
-    {
-      controllerMsg.type                    = e_mtype_backend;
-      controllerMsg.mesg.backendMesg.mesgId = e_msg_backend_act_delay;
-      controllerMsg.mesg.backendMesg.number = 0;
-      controllerMsg.mesg.backendMesg.data16   = offDelaySec0;
-      controllerQueueSend(&controllerMsg, 0);
-    }
+// boot : on-delays of the relays that were off before a warm reset continue
+static void restoreDelays(RelayEngine &engine, uint32_t nowMs)
+{
+  uint32_t offMs[ACTUATORS_COUNT];
+  uint16_t restored = retained.restore(warmReset(), esp_rtc_get_time_us(), offMs);
 
-    // switch off if offDelay is not counting
-    if (!actuatorReqeuest0 && actuatorActual0 && (offDelaySec0 == 0))
-    {
-      // printf("[ACTS] RELAY0 OFF !!!\n");
-      ESP_LOGI(LOG_TAG,"RELAY0 OFF !!!");
-      setActuator(0, 0);
-      actuatorActual0 = 0;
-      onDelaySec0 = CFG_RELAY0_ON_DELAY;
-    }
-    else
+  if (restored == 0)
+  {
+    ESP_LOGI(LOG_TAG, "no off times retained (reset reason %d) : full on-delays", esp_reset_reason());
+  }
+  for (uint8_t i = 0; i < ACTUATORS_COUNT; i++)
+  {
+    if ((restored >> i) & 1)
     {
-      // Count down
-      if (offDelaySec0 > 0)
-      {
-        offDelaySec0--;
-      }
+      engine.restoreOff(i, offMs[i], nowMs);
+      ESP_LOGI(LOG_TAG, "warm start : RELAY%d off for %u s", i, (unsigned)(offMs[i] / 1000));
     }
+  }
+
+  // all relays are off now, the ones without a known off time since boot
+  retainSwitch(0, ((1 << ACTUATORS_COUNT) - 1) & ~restored);
+}
+#endif
 
 
-    // ACTUATOR 1 - Switch ON request
+// ============================================================================
+// ACTUATORS TASK
+// ============================================================================
+
+// remaining delay of a pending request, to the controller (display), every
+// time the number of seconds changes and once 0 when it is served
+static void reportDelays(RelayEngine &engine, uint32_t nowMs, uint16_t reportedSec[])
+{
+  controllerQItem_t controllerMsg;
+  uint16_t sec;
 
-    if (actuatorReqeuest1 && !actuatorActual1)
+  for (uint8_t i = 0; i < ACTUATORS_COUNT; i++)
+  {
+    sec = (uint16_t)((engine.remainingMs(i, nowMs) + 999) / 1000);
+    if (sec != reportedSec[i])
     {
+      reportedSec[i] = sec;
       controllerMsg.type                    = e_mtype_backend;
       controllerMsg.mesg.backendMesg.mesgId = e_msg_backend_act_delay;
-      controllerMsg.mesg.backendMesg.number = 1;
-      controllerMsg.mesg.backendMesg.data16   = onDelaySec1;
+      controllerMsg.mesg.backendMesg.number = i;
+      controllerMsg.mesg.backendMesg.data16 = sec;
       controllerQueueSend(&controllerMsg, 0);
     }
+  }
+}
 
-    // switch on if onDelay is not counting
-    if (actuatorReqeuest1 && !actuatorActual1 && (onDelaySec1 == 0))
-    {
-      // printf("[ACTS] RELAY1 ON !!!\n");
-      ESP_LOGI(LOG_TAG,"RELAY1 ON !!!");
-      setActuator(1, 1);
-      actuatorActual1 = 1;
-      offDelaySec1 = CFG_RELAY1_OFF_DELAY;
-    }
-    else
+// milliseconds until the next change of a reported delay (whole seconds)
+static uint32_t reportWaitMs(RelayEngine &engine, uint32_t nowMs)
+{
+  uint32_t wait = RELAY_ENGINE_NO_EVENT;
+  uint32_t remaining;
+
+  for (uint8_t i = 0; i < ACTUATORS_COUNT; i++)
+  {
+    remaining = engine.remainingMs(i, nowMs);
+    if ((remaining > 0) && ((remaining - 1) % 1000 + 1 < wait))
     {
-      if (onDelaySec1 > 0)
-      {
-        // count-down
-        onDelaySec1--;
-      }
+      wait = (remaining - 1) % 1000 + 1;
     }
+  }
+  return wait;
+}
 
+static void actuatorsTask(void *arg)
+{
+  actuatorQueueItem_t actuatorMesg;
+  uint16_t reportedSec[ACTUATORS_COUNT] = {0};
+  uint16_t request = 0;
+  uint16_t actual;
+  uint32_t nowMs;
+  uint32_t waitMs;
+  TickType_t waitTicks;
+
+  // ON-OFF DELAY
+  // Relays may have a pre-defined (see config.h) on and/or off delay, see
+  // relayengine.h. The engine starts with all on-delays counting : this
+  // ensures a delay after boot, so accidental boot-loops during code
+  // development or power-outages cannot violate the compressor delay.
+  // After a warm reset the off time before the reset counts (retained).
+  RelayEngine engine(relayTimings, ACTUATORS_COUNT, actuatorsNowMs());
+
+#if (CFG_RELAY_RETAIN == true)
+  restoreDelays(engine, actuatorsNowMs());
+#endif
 
-
-    // ACTUATOR 1 - Switch OFF request
-
-    if (!actuatorReqeuest1 && actuatorActual1)
+  // Task loop
+  while (true)
+  {
+    // block until the next request, or until a delay ends (deadline of the
+    // engine) or the reported delay of a pending request changes
+    nowMs = actuatorsNowMs();
+    waitMs = engine.nextEventMs(nowMs);
+    if (reportWaitMs(engine, nowMs) < waitMs)
     {
-      controllerMsg.type                      = e_mtype_backend;
-      controllerMsg.mesg.backendMesg.mesgId = e_msg_backend_act_delay;
-      controllerMsg.mesg.backendMesg.number = 1;
-      controllerMsg.mesg.backendMesg.data16   = offDelaySec1;
-      controllerQueueSend(&controllerMsg, 0);   
+      waitMs = reportWaitMs(engine, nowMs);
     }
+    waitTicks = (waitMs == RELAY_ENGINE_NO_EVENT) ? portMAX_DELAY : (waitMs + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
 
-    // switch off if offDelay is not counting
-    if (!actuatorReqeuest1 && actuatorActual1 && (offDelaySec1 == 0))
+    telemetrySleep(e_tel_actuators);
+    if (xQueueReceive(actuatorsQueue, &actuatorMesg, waitTicks) == pdTRUE)
     {
-      // printf("[ACTS] RELAY1 OFF !!!\n");
-      ESP_LOGI(LOG_TAG,"RELAY1 OFF !!!");
-      setActuator(1, 0);
-      actuatorActual1 = 0;
-      onDelaySec1 = CFG_RELAY1_ON_DELAY;
+#if (CFG_TELEMETRY_LATENCY == true)
+      telemetryQueueReceive(e_tel_actuators, actuatorMesg.stampUs);
+#endif
+      ESP_LOGI(LOG_TAG,"received qMesg.data=%d", actuatorMesg.data);
+      request = actuatorMesg.data;
     }
-    else
+    telemetryWakeup(e_tel_actuators);
+
+    // all outputs at once
+    nowMs = actuatorsNowMs();
+    actual = engine.update(nowMs, request);
+    if (actual != actuatorsActual)
     {
-      if (offDelaySec1 > 0)
-      {
-      // count-down
-        offDelaySec1--;
-      }
+#if (CFG_RELAY_RETAIN == true)
+      retainSwitch(actual, actual ^ actuatorsActual);
+#endif
+      setActuators(actual, false);
     }
-
+    reportDelays(engine, nowMs, reportedSec);
   }
 };
 
 
 
-// wrapper for sendQueue 
+// wrapper for sendQueue : the queue is a mailbox, the latest request
+// replaces one that was not handled yet (never blocks, never fails)
 int actuatorsQueueSend(actuatorQueueItem_t * actuatorQMesg, TickType_t xTicksToWait)
 {
   int r;
@@ -292,7 +387,11 @@ int actuatorsQueueSend(actuatorQueueItem_t * actuatorQMesg, TickType_t xTicksToW
 
   if (actuatorsQueue != NULL)
   {
-    r =  xQueueSend(actuatorsQueue, actuatorQMesg , xTicksToWait);
+#if (CFG_TELEMETRY_LATENCY == true)
+    actuatorQMesg->stampUs = telemetryStamp();
+#endif
+    r =  xQueueOverwrite(actuatorsQueue, actuatorQMesg);
+    telemetryQueueSend(e_tel_actuators, 0, r, 1);
   }
 
   return r;
@@ -305,7 +404,7 @@ void initActuators(void)
   int r;
   ESP_LOGI(LOG_TAG,"initActuators()");
 
-  actuatorsQueue = xQueueCreate(5, sizeof(actuatorQueueItem_t));
+  actuatorsQueue = xQueueCreate(1, sizeof(actuatorQueueItem_t));  // mailbox (xQueueOverwrite)
 
   if (actuatorsQueue == 0)
   {
@@ -319,6 +418,7 @@ void initActuators(void)
   {
     ESP_LOGE(LOG_TAG, "Could not create task, error-code=%d", r);
   }
+  telemetryRegisterTask(e_tel_actuators, actuatorsTaskHandle, 1);
 }
 
 // end of file
\ No newline at end of file
@@ -15,12 +15,17 @@
 #endif
 #include "controller.h"
 #include "comms.h"
+#include "telemetry.h"
+#include "statestore.h"
+#include "sensors.h"
 #if (CFG_HYDRO_ENABLE == true)
 #include "hydrobrick.h"
 #endif
 
 #define LOG_TAG "COMMS"
 
+#define COMMS_QUEUE_LENGTH 4
+
 // GLOBALS
 static QueueHandle_t communicationQueue = NULL;
 
@@ -32,7 +37,7 @@ static DynamicJsonDocument jsonResponseDoc(1024);
 static DynamicJsonDocument PROAPIFilterDoc(80);
 static JsonArray devices;
 
-static const int16_t urlBufSize = 300;
+static const int16_t urlBufSize = 400;
 static char URL[urlBufSize];
 
 // NETWORK
@@ -48,7 +53,7 @@ static char usedForDevicesValue[32];
 static bool usedForDevicesValid;
 
 // ACTUATORS
-static uint8_t actuators = 0;
+static uint16_t actuators = 0;
 static bool actuatorsValid;
 
 // TIME / RTC
@@ -86,12 +91,123 @@ static void startWiFi()
 
 }
 
+// ============================================================================
+// BACKEND COMMANDS : OPTIONAL KEYS OF THE IOT API RESPONSE
+// The backend repeats a command in every response while it stands, only a
+// changed command is sent to the controller. For commands that must not be
+// repeated by a reboot (auto-tune, profile : a running profile resumes where
+// it was) the first response only records them.
+// ============================================================================
+
+#define COMMS_CMD_ABSENT INT32_MIN       // key not in the response
+#define COMMS_CMD_STOP (INT32_MIN + 1)   // key is false
+
+static bool commandsSeen = false;
+static int32_t autoTuneCommand = COMMS_CMD_ABSENT;
+static int32_t profileCommand = COMMS_CMD_ABSENT;
+static int32_t sensorProfileCommand = COMMS_CMD_ABSENT;
+
+// "sensor_profile" names, in sensorsProfile_t order
+static const char *const sensorProfileNames[e_sensors_profile_count] = {"default", "mash", "boil", "fermentation"};
+
+// false : stop, a number : value * scale (rounded), anything else : absent
+static int32_t commandValue(const char *key, float scale)
+{
+  JsonVariant value = jsonResponseDoc[key];
+  int32_t scaled;
+
+  if (value.is<bool>())
+  {
+    return value.as<bool>() ? COMMS_CMD_ABSENT : COMMS_CMD_STOP;
+  }
+  if (!value.is<float>())
+  {
+    return COMMS_CMD_ABSENT;
+  }
+
+  scaled = lroundf(value.as<float>() * scale);
+  if ((scaled < INT16_MIN) || (scaled > INT16_MAX))
+  {
+    ESP_LOGE(LOG_TAG, "%s out of range", key);
+    return COMMS_CMD_ABSENT;
+  }
+  return scaled;
+}
+
+// send a changed command (onBoot : also the one in the first response), last
+// is kept when the controller queue is full so the next response tries again
+static void commandSend(int32_t &last, int32_t command, controllerQItem_t &controllerMesg, bool onBoot)
+{
+  if ((commandsSeen || onBoot) && (command != last) && (command != COMMS_CMD_ABSENT))
+  {
+    if (controllerQueueSend(&controllerMesg, 0) != pdTRUE)
+    {
+      ESP_LOGE(LOG_TAG, "command not accepted by controller");
+      return;
+    }
+  }
+  last = command;
+}
+
+static void backendCommands(void)
+{
+  controllerQItem_t controllerMesg;
+  JsonVariant name = jsonResponseDoc["sensor_profile"];
+  int32_t command;
+
+  // "autotune" : set-point in degrees starts an auto-tune, false stops it
+  command = commandValue("autotune", 10.0);
+  controllerMesg.type = e_mtype_backend;
+  controllerMesg.mesg.backendMesg.mesgId = e_msg_backend_autotune;
+  controllerMesg.mesg.backendMesg.data16 = (command == COMMS_CMD_STOP) ? 0 : command;
+  controllerMesg.mesg.backendMesg.valid = (command != COMMS_CMD_STOP);
+  commandSend(autoTuneCommand, command, controllerMesg, false);
+
+  // "profile" : step number (1 = first step) starts the local profile, false stops it
+  command = commandValue("profile", 1.0);
+  if ((command != COMMS_CMD_STOP) && (command < 1))
+  {
+    command = COMMS_CMD_ABSENT;
+  }
+  controllerMesg.type = e_mtype_backend;
+  controllerMesg.mesg.backendMesg.mesgId = e_msg_backend_profile;
+  controllerMesg.mesg.backendMesg.data16 = (command == COMMS_CMD_STOP) ? 0 : command - 1;
+  controllerMesg.mesg.backendMesg.valid = (command != COMMS_CMD_STOP);
+  commandSend(profileCommand, command, controllerMesg, false);
+
+  // "sensor_profile" : sampling profile by name
+  command = COMMS_CMD_ABSENT;
+  if (name.is<const char *>())
+  {
+    for (uint8_t i = 0; i < e_sensors_profile_count; i++)
+    {
+      if (strcmp(name.as<const char *>(), sensorProfileNames[i]) == 0)
+      {
+        command = i;
+      }
+    }
+    if (command == COMMS_CMD_ABSENT)
+    {
+      ESP_LOGE(LOG_TAG, "unknown sensor_profile %s", name.as<const char *>());
+    }
+  }
+  controllerMesg.type = e_mtype_sensor;
+  controllerMesg.mesg.sensorMesg.mesgId = e_msg_sensor_profile;
+  controllerMesg.mesg.sensorMesg.number = 0;
+  controllerMesg.mesg.sensorMesg.data = command;
+  commandSend(sensorProfileCommand, command, controllerMesg, true);
+
+  commandsSeen = true;
+}
+
 // ============================================================================
 // CALL IOT API: SEND TEMPERATURE TO BACKEND AND GET NEW ACTUATOR VALUES
 // send actuator & next poll interval to controller queue
 // ============================================================================
-static void callBierBotIOTAPI(uint16_t temperature)
+static void callBierBotIOTAPI(void)
 {
+  stateTemperature_t temperature;
+  int urlLength;
   uint8_t updatedActuator;
   int getStatus;
   DeserializationError deserialisationError;
@@ -109,19 +225,28 @@ static void callBierBotIOTAPI(uint16_t temperature)
   actuatorsValid = false;
   nextTempReqMs = 0;
   
-  snprintf(URL, urlBufSize, "%s%s?apikey=%s&type=%s&brand=%s&version=%s&chipid=%6x%6x&s_number_temp_0=%2.1f&s_number_temp_id_0=%d&a_bool_epower_0=%d&a_bool_epower_1=%d",
-           CFG_COMM_BBURL_API_BASE,
-           CFG_COMM_BBURL_API_IOT,
-           config.apiKey.c_str(),
-           CFG_COMM_DEVICE_TYPE,
-           CFG_COMM_DEVICE_BRAND,
-           CFG_COMM_DEVICE_VERSION,
-           (uint32_t)(chipId >> 24), // split in 2 parts as we cannot print a 64-bit integer
-           (uint32_t)(chipId & 0x00FFFFFF),
-           temperature / 10.0,
-           0, // NOTE: sensor-id is harcoded to 0, update in case of extending to multiple sensors
-           (actuators & 1),
-           ((actuators >> 1) & 1));
+  urlLength = snprintf(URL, urlBufSize, "%s%s?apikey=%s&type=%s&brand=%s&version=%s&chipid=%6x%6x&a_bool_epower_0=%d&a_bool_epower_1=%d",
+                       CFG_COMM_BBURL_API_BASE,
+                       CFG_COMM_BBURL_API_IOT,
+                       config.apiKey.c_str(),
+                       CFG_COMM_DEVICE_TYPE,
+                       CFG_COMM_DEVICE_BRAND,
+                       CFG_COMM_DEVICE_VERSION,
+                       (uint32_t)(chipId >> 24), // split in 2 parts as we cannot print a 64-bit integer
+                       (uint32_t)(chipId & 0x00FFFFFF),
+                       (actuators & 1),
+                       ((actuators >> 1) & 1));
+
+  // add a temperature parameter per valid sensor-id, latest values
+  stateRead<e_state_temperature>(temperature);
+  for (uint8_t i = 0; (i < CFG_TEMP_MAX_NR_SENSORS) && (urlLength < urlBufSize); i++)
+  {
+    if (temperature.valid[i])
+    {
+      urlLength += snprintf(&URL[urlLength], urlBufSize - urlLength, "&s_number_temp_%d=%2.1f&s_number_temp_id_%d=%d",
+                            i, temperature.temperature_x10[i] / 10.0, i, i);
+    }
+  }
 
   ESP_LOGI(LOG_TAG, "API-url=%s", URL);
 
@@ -211,6 +336,8 @@ static void callBierBotIOTAPI(uint16_t temperature)
       ESP_LOGI(LOG_TAG, "used_for_devices not received");
     }
 
+    backendCommands();
+
   } // extract values
 
   // Send actuator info to controller
@@ -253,13 +380,13 @@ static void callBierBotPROAPI(void)
   uint16_t setPointValue;
   bool setPointValid;
   String deviceName;
-  String *deviceNameQPtr;
+  bool deviceNameValid;
   controllerQItem_t controllerMesg;
   bool validResponse;
 
   setPointValue = 0;
   setPointValid = false;
-  deviceNameQPtr = NULL; // We do not have an explicit valid flag for this pointer, as we can set it to NULL
+  deviceNameValid = false;
 
   if (usedForDevicesValid)
   {
@@ -306,14 +433,7 @@ static void callBierBotPROAPI(void)
       ESP_LOGI(LOG_TAG, "setPointValid=%d", setPointValid);
       ESP_LOGI(LOG_TAG, "deviceName=%d", deviceName.c_str());
 
-      if (jsonResponseDoc.containsKey("name"))
-      {
-        // first time to receive name OR name has changed
-        if ((deviceNameQPtr == NULL) || (deviceNameQPtr->equals(deviceName)))
-        {
-          deviceNameQPtr = new String(deviceName);
-        }
-      }
+      deviceNameValid = jsonResponseDoc.containsKey("name");
     }
   }
   else
@@ -327,21 +447,31 @@ static void callBierBotPROAPI(void)
   controllerMesg.mesg.backendMesg.valid = setPointValid;
   controllerQueueSend(&controllerMesg, 0);
 
-  if (deviceNameQPtr != NULL)
+  if (deviceNameValid)
   {
+    // name is passed by reference (message pool), controller frees the slot
     controllerMesg.type = e_mtype_backend;
     controllerMesg.mesg.backendMesg.mesgId = e_msg_backend_device_name;
-    controllerMesg.mesg.backendMesg.stringPtr = deviceNameQPtr;
+    controllerMesg.mesg.backendMesg.poolHandle = msgPoolAlloc();
     controllerMesg.mesg.backendMesg.valid = true;
-    controllerQueueSend(&controllerMesg, 0);
+
+    if (msgPoolGet(controllerMesg.mesg.backendMesg.poolHandle) != NULL)
+    {
+      snprintf((char *)msgPoolGet(controllerMesg.mesg.backendMesg.poolHandle), MSGPOOL_SLOT_SIZE, "%s", deviceName.c_str());
+
+      if (controllerQueueSend(&controllerMesg, 0) != pdTRUE)
+      {
+        msgPoolFree(controllerMesg.mesg.backendMesg.poolHandle);
+      }
+    }
   }
 
   // Send next request time to controller
   controllerMesg.type = e_mtype_backend;
   controllerMesg.mesg.backendMesg.mesgId = e_msg_backend_next_PROAPIcall_ms;
-  controllerMesg.mesg.backendMesg.data32 = 60 * 1000;
+  controllerMesg.mesg.backendMesg.data32 = CFG_COMM_PROAPI_INTERVAL * 1000;
   controllerMesg.mesg.backendMesg.valid = true;
-  controllerQueueSend(&controllerMesg, 0);  
+  controllerQueueSend(&controllerMesg, 0);
 }
 #endif
 
@@ -496,11 +626,11 @@ static void getNetworkTime(void)
 
   if (rtcValid)
   {
-    controllerMesg.mesg.controlMesg.data = ((rtc.getHour(hours24Mode) & 0xFF) << 8) | (rtc.getMinute() & 0xFF);
+    controllerMesg.mesg.backendMesg.data16 = ((rtc.getHour(hours24Mode) & 0xFF) << 8) | (rtc.getMinute() & 0xFF);
   }
   else
   {
-    controllerMesg.mesg.controlMesg.data = 0;
+    controllerMesg.mesg.backendMesg.data16 = 0;
   }
   controllerQueueSend(&controllerMesg, 0);
 
@@ -524,15 +654,21 @@ static void communicationTask(void *arg)
   // TASK LOOP
   while (true)
   {
-    // Receive message from queue
-    r = xQueueReceive(communicationQueue, &message, 100 / portTICK_PERIOD_MS);
+    // Receive message from queue, nothing to do until then
+    telemetrySleep(e_tel_comms);
+    r = xQueueReceive(communicationQueue, &message, portMAX_DELAY);
+    telemetryWakeup(e_tel_comms);
 
     if (r == pdTRUE)
     {
+#if (CFG_TELEMETRY_LATENCY == true)
+      telemetryQueueReceive(e_tel_comms, message.stampUs);
+#endif
+
       switch (message.type)
       {
       case e_type_comms_iotapi:
-        callBierBotIOTAPI(message.temperature_x10);
+        callBierBotIOTAPI();
         break;
       case e_type_comms_proapi:
         callBierBotPROAPI();
@@ -560,6 +696,11 @@ static void communicationTask(void *arg)
   }
 }
 
+// wrapper for sendQueue. Policy : a full queue drops the new request, the
+// caller is told (pdFALSE). All requests are controller jobs (IoT-API,
+// Pro-API, NTP) that reschedule themselves a second later when the send
+// fails, so a dropped request is delayed, not lost. Waiting would stall the
+// controller (and the actuators) behind a slow HTTP call.
 int communicationQueueSend(commsQueueItem_t *queueItem, TickType_t xTicksToWait)
 {
   int r;
@@ -567,7 +708,11 @@ int communicationQueueSend(commsQueueItem_t *queueItem, TickType_t xTicksToWait)
 
   if (communicationQueue != NULL)
   {
+#if (CFG_TELEMETRY_LATENCY == true)
+    queueItem->stampUs = telemetryStamp();
+#endif
     r = xQueueSend(communicationQueue, queueItem, xTicksToWait);
+    telemetryQueueSend(e_tel_comms, queueItem->type, r, uxQueueMessagesWaiting(communicationQueue));
   }
 
   return r;
@@ -592,7 +737,7 @@ void initCommmunication(void)
   initHydroBrick();
 #endif 
 
-  communicationQueue = xQueueCreate(4, sizeof(commsQueueItem_t));
+  communicationQueue = xQueueCreate(COMMS_QUEUE_LENGTH, sizeof(commsQueueItem_t));
   if (communicationQueue == 0)
   {
     ESP_LOGE(LOG_TAG, "Cannot create communicationQueue. This is FATAL");
@@ -607,6 +752,7 @@ void initCommmunication(void)
   {
     ESP_LOGE(LOG_TAG, "could not create task, error-code=%d", r);
   }
+  telemetryRegisterTask(e_tel_comms, communicationTaskHandle, COMMS_QUEUE_LENGTH);
 
   startWiFi();
 
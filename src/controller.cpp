@@ -3,13 +3,30 @@
 //
 
 #include <Arduino.h>
+#include <Preferences.h>
 
 #include "config.h"
 // #include "blinkled.h"
 #include "actuators.h"
 #include "display.h"
 #include "controller.h"
+#include "sensors.h"
 #include "comms.h"
+#include "scheduler.h"
+#include "telemetry.h"
+#include "statestore.h"
+#include "fallback.h"
+#if (CFG_MPC_ENABLE == true)
+#include "mpc.h"
+#endif
+#if (CFG_PROFILE_ENABLE == true)
+#include "profile.h"
+#endif
+#if (CFG_PID_ENABLE == true)
+#include "pid.h"
+#include "ssr.h"
+#include "autotune.h"
+#endif
 #if (CFG_HYDRO_ENABLE == true)
 #include "hydrobrick.h"
 #endif
@@ -19,12 +36,197 @@
 
 #define LOG_TAG "CTRL"
 
-// Queues
-static QueueHandle_t controllerQueue = NULL;
+#define CONTROLLER_ANY_MESG       0xFF    // policy matches all messages of the type
+#define CONTROLLER_MAILBOX_SLOTS  12      // coalesced messages (class & number)
+#define CONTROLLER_NR_POLICIES    (sizeof(controllerPolicies) / sizeof(controllerPolicies[0]))
+
+// Queues : one per lane, highest priority lane first
+static QueueHandle_t laneQueues[e_lane_count] = {NULL};
+static const uint8_t laneLengths[e_lane_count] = {CFG_CTRL_LANE_SAFETY_LENGTH, CFG_CTRL_LANE_NORMAL_LENGTH, CFG_CTRL_LANE_BULK_LENGTH};
+static const char *laneNames[e_lane_count] = {"safety", "normal", "bulk"};
+static portMUX_TYPE laneMux = portMUX_INITIALIZER_UNLOCKED;
 
 // controller task handle
 static TaskHandle_t controllerTaskHandle = NULL;
 
+// ============================================================================
+// LANES & BACKPRESSURE POLICY
+// ============================================================================
+
+typedef struct
+{
+  controllerQMesgType_t type;
+  uint8_t mesgId;               // CONTROLLER_ANY_MESG : all of type
+  laneClass_t laneClass;
+} controllerClassPolicy_t;
+
+// Policy per message class. A lost actuator command, set-point or API
+// schedule would leave the system in a wrong (or stuck) state : senders of
+// these wait for room. Values that are sent periodically only need their
+// latest value. Classes not in this table : normal lane, drop-newest.
+static const controllerClassPolicy_t controllerPolicies[] = {
+    {e_mtype_backend, e_msg_backend_actuators, {e_lane_safety, e_policy_block}},
+    {e_mtype_backend, e_msg_backend_temp_setpoint, {e_lane_safety, e_policy_block}},
+    {e_mtype_backend, e_msg_backend_next_IOTAPIcall_ms, {e_lane_safety, e_policy_block}},
+    {e_mtype_backend, e_msg_backend_next_PROAPIcall_ms, {e_lane_safety, e_policy_block}},
+    {e_mtype_backend, e_msg_backend_time_update, {e_lane_normal, e_policy_block}},
+    {e_mtype_backend, e_msg_backend_autotune, {e_lane_normal, e_policy_block}},
+    {e_mtype_backend, e_msg_backend_profile, {e_lane_normal, e_policy_block}},
+    {e_mtype_backend, e_msg_backend_device_name, {e_lane_normal, e_policy_drop_oldest}},
+    {e_mtype_backend, e_msg_backend_act_delay, {e_lane_bulk, e_policy_coalesce}},
+    {e_mtype_backend, e_msg_backend_heartbeat, {e_lane_bulk, e_policy_coalesce}},
+    {e_mtype_sensor, e_msg_sensor_numSensors, {e_lane_normal, e_policy_block}},
+    {e_mtype_sensor, e_msg_sensor_profile, {e_lane_normal, e_policy_block}},
+    {e_mtype_sensor, e_msg_sensor_temperature, {e_lane_bulk, e_policy_coalesce}},
+    {e_mtype_sensor, e_msg_sensor_humidity, {e_lane_bulk, e_policy_coalesce}},
+    {e_mtype_hydro, CONTROLLER_ANY_MESG, {e_lane_normal, e_policy_drop_oldest}},
+    {e_mtype_wifi, CONTROLLER_ANY_MESG, {e_lane_bulk, e_policy_coalesce}},
+};
+
+static const controllerClassPolicy_t defaultPolicy = {e_mtype_button, CONTROLLER_ANY_MESG, {e_lane_normal, e_policy_drop_newest}};
+
+static uint8_t itemMesgId(const controllerQItem_t *item)
+{
+  switch (item->type)
+  {
+  case e_mtype_sensor:
+    return item->mesg.sensorMesg.mesgId;
+  case e_mtype_backend:
+    return item->mesg.backendMesg.mesgId;
+  case e_mtype_hydro:
+    return item->mesg.hydroMesg.mesgId;
+  default:
+    return CONTROLLER_ANY_MESG;
+  }
+}
+
+// sensor-id, actuator number
+static uint8_t itemNumber(const controllerQItem_t *item)
+{
+  switch (item->type)
+  {
+  case e_mtype_sensor:
+    return item->mesg.sensorMesg.number;
+  case e_mtype_backend:
+    return item->mesg.backendMesg.number;
+  default:
+    return 0;
+  }
+}
+
+// free message pool slot of a message that will not be handled
+static void itemDiscard(const controllerQItem_t *item)
+{
+  if (item->type == e_mtype_hydro)
+  {
+    msgPoolFree(item->mesg.hydroMesg.poolHandle);
+  }
+  else if ((item->type == e_mtype_backend) && (item->mesg.backendMesg.mesgId == e_msg_backend_device_name))
+  {
+    msgPoolFree(item->mesg.backendMesg.poolHandle);
+  }
+}
+
+// policy table index, CONTROLLER_NR_POLICIES for default policy
+static uint8_t itemPolicyIndex(const controllerQItem_t *item)
+{
+  uint8_t mesgId = itemMesgId(item);
+  uint8_t i;
+
+  for (i = 0; i < CONTROLLER_NR_POLICIES; i++)
+  {
+    if ((controllerPolicies[i].type == item->type) &&
+        ((controllerPolicies[i].mesgId == CONTROLLER_ANY_MESG) || (controllerPolicies[i].mesgId == mesgId)))
+    {
+      break;
+    }
+  }
+  return i;
+}
+
+static const controllerClassPolicy_t *itemPolicy(const controllerQItem_t *item, uint8_t *index)
+{
+  uint8_t i = itemPolicyIndex(item);
+
+  *index = i;
+  return (i < CONTROLLER_NR_POLICIES) ? &controllerPolicies[i] : &defaultPolicy;
+}
+
+// lane queues (FreeRTOS) & message classes of the controller
+class ControllerLanesPort
+{
+public:
+  bool send(uint8_t lane, const controllerQItem_t &item, uint32_t waitTicks)
+  {
+    return xQueueSend(laneQueues[lane], &item, waitTicks) == pdTRUE;
+  }
+
+  bool sendToFront(uint8_t lane, const controllerQItem_t &item)
+  {
+    return xQueueSendToFront(laneQueues[lane], &item, 0) == pdTRUE;
+  }
+
+  bool receive(uint8_t lane, controllerQItem_t &item)
+  {
+    return xQueueReceive(laneQueues[lane], &item, 0) == pdTRUE;
+  }
+
+  bool peek(uint8_t lane, controllerQItem_t &item)
+  {
+    return xQueuePeek(laneQueues[lane], &item, 0) == pdTRUE;
+  }
+
+  uint8_t waiting(uint8_t lane)
+  {
+    return uxQueueMessagesWaiting(laneQueues[lane]);
+  }
+
+  void lock(void)
+  {
+    portENTER_CRITICAL(&laneMux);
+  }
+
+  void unlock(void)
+  {
+    portEXIT_CRITICAL(&laneMux);
+  }
+
+  laneClass_t classify(const controllerQItem_t &item, uint8_t &classIndex)
+  {
+    return itemPolicy(&item, &classIndex)->laneClass;
+  }
+
+  uint8_t number(const controllerQItem_t &item)
+  {
+    return itemNumber(&item);
+  }
+
+  void discard(const controllerQItem_t &item)
+  {
+    itemDiscard(&item);
+  }
+};
+
+static ControllerLanesPort lanesPort;
+static Lanes<controllerQItem_t, ControllerLanesPort, e_lane_count, CONTROLLER_MAILBOX_SLOTS> lanes(lanesPort);
+
+void controllerLaneStats(controllerLane_t lane, controllerLaneStats_t *stats)
+{
+  lanes.getStats(lane, *stats);
+}
+
+static void controllerLaneReport(void)
+{
+  controllerLaneStats_t stats;
+
+  for (uint8_t lane = 0; lane < e_lane_count; lane++)
+  {
+    controllerLaneStats((controllerLane_t)lane, &stats);
+    ESP_LOGI(LOG_TAG, "lane %-6s : sent=%u dropped=%u coalesced=%u blocked=%u high-water=%d/%d", laneNames[lane],
+             (unsigned)stats.sent, (unsigned)stats.dropped, (unsigned)stats.coalesced, (unsigned)stats.blocked, stats.highWater, laneLengths[lane]);
+  }
+}
+
 // communication time variables (all in milliseconds)
 static uint32_t NTPCallTimeMS;
 static uint32_t displayTimeTimeMS;
@@ -33,13 +235,34 @@ static uint32_t PROAPICallTimeMS;
 
 #if (CFG_HYDRO_ENABLE == true)
 static uint32_t hydroCallTimeMS;
-static TimerHandle_t hydroTimer;
 #endif
 
-static TimerHandle_t NTPTimer;
-static TimerHandle_t displayTimeTimer;
-static TimerHandle_t IOTAPITimer;
-static TimerHandle_t PROAPITimer;
+// Controller jobs, run by the controller task itself (see scheduler.h)
+typedef enum : uint8_t
+{
+  e_job_ntp,
+  e_job_time,
+  e_job_iotapi,
+  e_job_proapi,
+#if (CFG_HYDRO_ENABLE == true)
+  e_job_hydro,
+#endif
+  e_job_dump,
+  e_job_telemetry,
+  e_job_backend,
+#if (CFG_PID_ENABLE == true)
+  e_job_pid,
+#endif
+#if (CFG_MPC_ENABLE == true)
+  e_job_mpc,
+#endif
+#if (CFG_PROFILE_ENABLE == true)
+  e_job_profile,
+#endif
+  e_job_count
+} controllerJob_t;
+
+static Scheduler<e_job_count> scheduler(CFG_CTRL_SCHED_COALESCE_MS);
 
 // TIME / RTC
 #if (CFG_DISPLAY_TIME == true)
@@ -47,82 +270,708 @@ static ESP32Time rtc;
 static bool rtcValid = false;
 #endif
 
-// TEMPERATURE
-static uint16_t temperature_x10;
-static bool temperatureValid = false;
+// Temperatures, set-point, actuators, WiFi, time & hydrometer values are
+// published in the state store (statestore.h), display & comms read the
+// latest values from there.
 
-static void NTPTimerCallback(TimerHandle_t timer)
+// true if at least one temperature sensor has a valid reading
+static bool anyTemperatureValid(void)
 {
-  controllerQItem_t qmesg;
+  stateTemperature_t temperature;
 
-  qmesg.type = e_mtype_controller;
-  qmesg.valid = true;
-  qmesg.mesg.controlMesg.mesgId = e_msg_timer_ntp;
-  qmesg.mesg.controlMesg.data = 0;
-  controllerQueueSend(&qmesg, 0);
+  stateRead<e_state_temperature>(temperature);
+  for (uint8_t i = 0; i < CFG_TEMP_MAX_NR_SENSORS; i++)
+  {
+    if (temperature.valid[i])
+    {
+      return true;
+    }
+  }
+  return false;
 }
 
-static void displayTimeCallback(TimerHandle_t timer)
+// ============================================================================
+// ACTUATORS & FALLBACK THERMOSTAT
+// ============================================================================
+
+// Relays follow the backend (IoT API epower_N_state). When its response is
+// invalid, or no valid response came for CFG_FALLBACK_TIMEOUT_S (e_job_backend
+// watchdog), the local thermostat takes over on the last known set-point.
+// The next valid response hands control back to the backend. With
+// CFG_MPC_ENABLE the compressor relay follows the MPC in all cases.
+
+static FallbackThermostat fallback(CFG_FALLBACK_HYSTERESIS_X10,
+                                   (CFG_FALLBACK_COOL_RELAY >= 0) ? (1 << CFG_FALLBACK_COOL_RELAY) : 0,
+                                   (CFG_FALLBACK_HEAT_RELAY >= 0) ? (1 << CFG_FALLBACK_HEAT_RELAY) : 0);
+static uint16_t actuators = 0;
+
+#if (CFG_MPC_ENABLE == true)
+#if (CFG_MPC_HEAT_RELAY == CFG_MPC_COOL_RELAY)
+#error "CFG_MPC_HEAT_RELAY must differ from CFG_MPC_COOL_RELAY"
+#endif
+
+#define MPC_STEP_MS   (CFG_MPC_SAMPLE_MS * CFG_MPC_SAMPLES_PER_STEP)
+#define MPC_STEPS(s)  ((uint16_t)(((s) * 1000UL + MPC_STEP_MS - 1) / MPC_STEP_MS))
+
+static const mpcParams_t mpcParams = {CFG_MPC_SAMPLES_PER_STEP, CFG_MPC_HORIZON, MPC_STEPS(CFG_MPC_MIN_ON_S), MPC_STEPS((CFG_MPC_COOL_RELAY == 0) ? CFG_RELAY0_ON_DELAY : CFG_RELAY1_ON_DELAY),
+                                      MPC_STEPS(CFG_MPC_MODEL_H * 3600UL), CFG_MPC_HYSTERESIS_X10, CFG_MPC_FORGETTING, CFG_MPC_SWITCH_COST};
+static CompressorMpc mpc(mpcParams);
+#endif
+
+static bool autoTuneRunning(void);   // PID : HEATING ELEMENTS
+
+// send relay request to actuators task (on change), publish it (display)
+static void setActuators(uint16_t newActuatorValue, bool valid)
 {
-  controllerQItem_t qmesg;
+  actuatorQueueItem_t actuatorsQMesg;
+  stateActuators_t actuatorsState;
 
-  qmesg.type = e_mtype_controller;
-  qmesg.valid = true;
-  qmesg.mesg.controlMesg.mesgId = e_msg_timer_time;
-  qmesg.mesg.controlMesg.data = 0;
-  controllerQueueSend(&qmesg, 0);
+#if (CFG_MPC_ENABLE == true)
+  // compressor is scheduled by the MPC, never together with heating
+  if (!autoTuneRunning())
+  {
+    newActuatorValue &= ~(1 << CFG_MPC_COOL_RELAY);
+    if (mpc.getRelay())
+    {
+      newActuatorValue |= (1 << CFG_MPC_COOL_RELAY);
+#if (CFG_MPC_HEAT_RELAY >= 0)
+      newActuatorValue &= ~(1 << CFG_MPC_HEAT_RELAY);
+#endif
+    }
+  }
+#endif
+
+  if (newActuatorValue != actuators)
+  {
+    actuators = newActuatorValue;
+    actuatorsQMesg.data = newActuatorValue;
+    actuatorsQueueSend(&actuatorsQMesg, 0);
+  }
+
+  actuatorsState.actuators = newActuatorValue;
+  actuatorsState.valid = valid;
+  actuatorsState.fallback = fallback.isActive();
+  statePublish<e_state_actuators>(actuatorsState);
 }
 
-static void IOTAPITimerCallback(TimerHandle_t timer)
+// relays by local thermostat, on the control sensor
+static void fallbackControl(void)
 {
-  controllerQItem_t qmesg;
+  stateTemperature_t temperature;
 
-  qmesg.type = e_mtype_controller;
-  qmesg.valid = true;
-  qmesg.mesg.controlMesg.mesgId = e_msg_timer_iotapi;
-  qmesg.mesg.controlMesg.data = 0;
-  controllerQueueSend(&qmesg, 0);
+  stateRead<e_state_temperature>(temperature);
+  setActuators(fallback.update(temperature.temperature_x10[CFG_FALLBACK_SENSOR], temperature.valid[CFG_FALLBACK_SENSOR]), true);
 }
 
-static void PROAPITimerCallback(TimerHandle_t timer)
+static void backendLost(const char *reason)
 {
-  controllerQItem_t qmesg;
+  int16_t setPoint_x10;
+
+  if (autoTuneRunning())
+  {
+    return;
+  }
 
-  qmesg.type = e_mtype_controller;
-  qmesg.valid = true;
-  qmesg.mesg.controlMesg.mesgId = e_msg_timer_proapi;
-  qmesg.mesg.controlMesg.data = 0;
-  controllerQueueSend(&qmesg, 0);
+  if (!fallback.isActive())
+  {
+    fallback.takeOver(actuators);
+    if (fallback.getSetPoint(setPoint_x10))
+    {
+      ESP_LOGW(LOG_TAG, "backend lost (%s) : local control, set-point=%d", reason, setPoint_x10);
+      displayText(new String("Offline : local control"), e_status_bar, 0);
+    }
+    else
+    {
+      ESP_LOGW(LOG_TAG, "backend lost (%s) : no set-point known, actuators off", reason);
+      displayText(new String("Offline : actuators off"), e_status_bar, 0);
+    }
+  }
+  fallbackControl();
 }
 
+static void backendValid(void)
+{
+  // watchdog
+  scheduler.schedule(e_job_backend, millis(), CFG_FALLBACK_TIMEOUT_S * 1000);
+
+  if (fallback.isActive())
+  {
+    fallback.handBack();
+    ESP_LOGW(LOG_TAG, "backend back : control handed back");
+    displayText(new String("Online"), e_status_bar, 10);
+  }
+}
+
+// set-point survives a reboot while the backend is unreachable (persist)
+static void fallbackSetPoint(int16_t setPoint_x10, bool persist)
+{
+  Preferences prefs;
+  int16_t known;
+
+  if (fallback.getSetPoint(known) && (known == setPoint_x10))
+  {
+    return;
+  }
+
+  fallback.setSetPoint(setPoint_x10);
+
+  if (persist)
+  {
+    prefs.begin(BBPREFS, false);
+    prefs.putShort(BBPREFS_FALLBACK_SETPOINT, setPoint_x10);
+    prefs.end();
+  }
+
+  if (fallback.isActive())
+  {
+    fallbackControl();
+  }
+}
+
+// set-point used for control : published (display, PID) and kept by the
+// fallback thermostat (fallback, MPC)
+static void applySetPoint(int16_t setPoint_x10, bool valid, bool persist)
+{
+  stateSetPoint_t setPoint;
+
+  setPoint.setPoint_x10 = setPoint_x10;
+  setPoint.valid = valid;
+  statePublish<e_state_setpoint>(setPoint);
+
+  if (valid)
+  {
+    fallbackSetPoint(setPoint_x10, persist);
+  }
+}
+
+static void initFallback(void)
+{
+  Preferences prefs;
+
+  prefs.begin(BBPREFS, true);
+  if (prefs.isKey(BBPREFS_FALLBACK_SETPOINT))
+  {
+    fallback.setSetPoint(prefs.getShort(BBPREFS_FALLBACK_SETPOINT, 0));
+  }
+  prefs.end();
+}
+
+// ============================================================================
+// PID : HEATING ELEMENTS
+// ============================================================================
+
+#if (CFG_PID_ENABLE == true)
+static pidParams_t pidParams = {PID_Q16(CFG_PID_KP), PID_Q16(CFG_PID_KI), PID_Q16(CFG_PID_KD), 0, PID_OUTPUT_MAX, CFG_PID_DERIVATIVE_SHIFT};
+static Pid pid(pidParams);
+static bool pidRunning = false;
+
+// Auto-tune : relay experiment through the relay actuators (see autotune.h),
+// the relays are not driven by backend or fallback thermostat meanwhile.
+static const autoTuneParams_t autoTuneParams = {CFG_AUTOTUNE_HYSTERESIS_X10, CFG_AUTOTUNE_MAX_DEVIATION_X10,
+                                                CFG_AUTOTUNE_COOLING ? CFG_RELAY0_ON_DELAY * 1000UL : 0,
+                                                CFG_AUTOTUNE_MAX_DURATION_H * 3600UL * 1000UL, CFG_AUTOTUNE_MAX_CYCLES, CFG_AUTOTUNE_TOLERANCE_PERCENT};
+static RelayAutoTune autoTune(autoTuneParams);
+
+static bool autoTuneRunning(void)
+{
+  return autoTune.getState() == e_autotune_running;
+}
+
+static void autoTuneStart(int16_t setPoint_x10)
+{
+  ESP_LOGI(LOG_TAG, "auto-tune : start, set-point=%d, relay %d", setPoint_x10, CFG_AUTOTUNE_RELAY);
+  autoTune.start(millis(), setPoint_x10, CFG_AUTOTUNE_COOLING);
+  setActuators(0, true);
+  displayText(new String("Auto-tune running"), e_status_bar, 0);
+}
+
+static void autoTuneStop(void)
+{
+  ESP_LOGI(LOG_TAG, "auto-tune : stopped");
+  autoTune.stop();
+  setActuators(0, true);
+  displayText(new String("Auto-tune stopped"), e_status_bar, 10);
+}
+
+// experiment ended : store gains (Preferences), relays off
+static void autoTuneFinish(void)
+{
+  Preferences prefs;
+  float ku;
+  float tuMs;
+  float kp;
+  float ki;
+  float kd;
+
+  setActuators(0, true);
+
+  if (autoTune.getUltimate(ku, tuMs) && autoTune.getGains(CFG_PID_PERIOD_MS, kp, ki, kd))
+  {
+    ESP_LOGI(LOG_TAG, "auto-tune : done after %d cycles, Ku=%.1f, Tu=%.0f s -> kp=%.2f ki=%.4f kd=%.1f",
+             autoTune.getCycles(), ku, tuMs / 1000.0f, kp, ki, kd);
+
+    prefs.begin(BBPREFS, false);
+    prefs.putFloat(BBPREFS_PID_KP, kp);
+    prefs.putFloat(BBPREFS_PID_KI, ki);
+    prefs.putFloat(BBPREFS_PID_KD, kd);
+    prefs.end();
+
+    pidParams.kp_q16 = PID_Q16(kp);
+    pidParams.ki_q16 = PID_Q16(ki);
+    pidParams.kd_q16 = PID_Q16(kd);
+    pid.setParams(pidParams);
+
+    displayText(new String("Auto-tune done"), e_status_bar, 10);
+  }
+  else
+  {
+    ESP_LOGE(LOG_TAG, "auto-tune : failed after %d cycles", autoTune.getCycles());
+    displayText(new String("Auto-tune failed"), e_status_bar, 10);
+  }
+  autoTune.stop();
+}
+
+// new reading of the control sensor
+static void autoTuneControl(int16_t temperature_x10, bool valid)
+{
+  bool relayOn;
+
+  if (!valid)
+  {
+    autoTuneStop();
+    return;
+  }
+
+  relayOn = autoTune.update(millis(), temperature_x10);
+  if (autoTuneRunning())
+  {
+    setActuators(relayOn ? (1 << CFG_AUTOTUNE_RELAY) : 0, true);
+  }
+  else
+  {
+    autoTuneFinish();
+  }
+}
+
+// gains of a previous auto-tune
+static void initPid(void)
+{
+  Preferences prefs;
+
+  prefs.begin(BBPREFS, true);
+  if (prefs.isKey(BBPREFS_PID_KP) && prefs.isKey(BBPREFS_PID_KI) && prefs.isKey(BBPREFS_PID_KD))
+  {
+    pidParams.kp_q16 = PID_Q16(prefs.getFloat(BBPREFS_PID_KP));
+    pidParams.ki_q16 = PID_Q16(prefs.getFloat(BBPREFS_PID_KI));
+    pidParams.kd_q16 = PID_Q16(prefs.getFloat(BBPREFS_PID_KD));
+    pid.setParams(pidParams);
+    ESP_LOGI(LOG_TAG, "pid : auto-tuned gains kp=%.2f ki=%.4f kd=%.1f", prefs.getFloat(BBPREFS_PID_KP), prefs.getFloat(BBPREFS_PID_KI), prefs.getFloat(BBPREFS_PID_KD));
+  }
+  prefs.end();
+}
+
+// one PID sample, output to all elements (off without set-point or temperature,
+// or while auto-tuning)
+static void pidControl(void)
+{
+  stateTemperature_t temperature;
+  stateSetPoint_t setPoint;
+  int16_t duty = 0;
+
+  stateRead<e_state_temperature>(temperature);
+#if (CFG_PID_SETPOINT_LOCAL == true)
+  setPoint.setPoint_x10 = CFG_PID_SETPOINT_X10;
+  setPoint.valid = true;
+#else
+  stateRead<e_state_setpoint>(setPoint);
+#endif
+
+  if (setPoint.valid && temperature.valid[CFG_PID_SENSOR] && !autoTuneRunning())
+  {
+    if (!pidRunning)
+    {
+      pid.reset();
+      pidRunning = true;
+    }
+    duty = pid.update(setPoint.setPoint_x10, temperature.temperature_x10[CFG_PID_SENSOR]);
+  }
+  else
+  {
+    pidRunning = false;
+  }
+
+  for (uint8_t channel = 0; channel < CFG_SSR_NR_CHANNELS; channel++)
+  {
+    ssrSetDuty(channel, duty);
+  }
+
+  ESP_LOGD(LOG_TAG, "pid : set-point=%d, temperature=%d, duty=%d", setPoint.setPoint_x10, temperature.temperature_x10[CFG_PID_SENSOR], duty);
+}
+#else
+static bool autoTuneRunning(void)
+{
+  return false;
+}
+#endif
+
+// ============================================================================
+// MPC : COMPRESSOR
+// ============================================================================
+
+#if (CFG_MPC_ENABLE == true)
+// sample the control sensor, every CFG_MPC_SAMPLES_PER_STEP samples a model
+// step on the last known set-point (kept by the fallback thermostat)
+static void mpcControl(void)
+{
+  stateTemperature_t temperature;
+  int16_t setPoint_x10;
+  bool setPointValid;
+  bool identified;
+  float coolRate_x10;
+  uint8_t dead;
+
+  stateRead<e_state_temperature>(temperature);
+  if (!mpc.sample(temperature.temperature_x10[CFG_MPC_SENSOR], temperature.valid[CFG_MPC_SENSOR]))
+  {
+    return;
+  }
+
+  identified = mpc.isIdentified();
+  setPointValid = fallback.getSetPoint(setPoint_x10);
+  mpc.step(setPoint_x10, setPointValid);
+  setActuators(actuators, true);
+
+  mpc.getModel(coolRate_x10, dead);
+  if (mpc.isIdentified() != identified)
+  {
+    ESP_LOGI(LOG_TAG, "mpc : model %s, cooling %.2f degree/h, dead time %d s", mpc.isIdentified() ? "identified" : "lost",
+             coolRate_x10 * 3600000.0f / (10.0f * MPC_STEP_MS), dead * MPC_STEP_MS / 1000);
+  }
+  ESP_LOGD(LOG_TAG, "mpc : set-point=%d, temperature=%d, compressor=%d", setPoint_x10, temperature.temperature_x10[CFG_MPC_SENSOR], mpc.getRelay());
+}
+#endif
+
+// ============================================================================
+// PROFILE : LOCAL SET-POINT SCHEDULE
+// ============================================================================
+
+#if (CFG_PROFILE_ENABLE == true)
+// The profile (CFG_PROFILE_PATH) sets the set-point every CFG_PROFILE_TICK_MS,
+// also while the backend is unreachable. Progress is saved in Preferences, a
+// running profile resumes after a reboot. A changed backend set-point
+// overrides the current step (see profile.h).
+
+static ProfileExecutor profile;
+static int16_t profileSetPoint_x10;         // last applied
+static uint32_t profileSavedMs;
+static int16_t cloudSetPoint_x10;
+static bool cloudSetPointValid = false;
+
+static void profileSave(bool running)
+{
+  Preferences prefs;
+
+  prefs.begin(BBPREFS, false);
+  prefs.putBool(BBPREFS_PROFILE_RUN, running);
+  prefs.putUChar(BBPREFS_PROFILE_STEP, profile.getStep());
+  prefs.putULong(BBPREFS_PROFILE_ELAPSED, profile.getStepElapsedMs() / 1000);
+  prefs.end();
+  profileSavedMs = millis();
+}
+
+static void profileStatus(void)
+{
+  char text[48];
+
+  if (profile.isRunning())
+  {
+    snprintf(text, sizeof(text), "%s : step %d/%d", profile.getProfile().name, profile.getStep() + 1, profile.getProfile().numSteps);
+  }
+  else
+  {
+    snprintf(text, sizeof(text), "%s : done", profile.getProfile().name);
+  }
+  displayText(new String(text), e_status_bar, 10);
+}
+
+// one control period : interpolate, step transitions, apply set-point
+static void profileControl(void)
+{
+  bool sgValid = false;
+  uint16_t sg_x1000 = 0;
 #if (CFG_HYDRO_ENABLE == true)
-static void hydroTimerCallback(TimerHandle_t timer)
+  stateHydro_t hydro;
+
+  stateRead<e_state_hydro>(hydro);
+  sgValid = hydro.valid;
+  sg_x1000 = hydro.reading.SG_x1000;
+#endif
+
+  if (!profile.isRunning())
+  {
+    return;
+  }
+
+  if (profile.tick(millis(), sg_x1000, sgValid))
+  {
+    ESP_LOGI(LOG_TAG, "profile : %s, set-point=%d", profile.isRunning() ? "next step" : "done", profile.getSetPoint());
+    profileSave(profile.isRunning());
+    profileStatus();
+  }
+  else if (millis() - profileSavedMs >= CFG_PROFILE_SAVE_S * 1000UL)
+  {
+    profileSave(true);
+  }
+
+  if (profile.getSetPoint() != profileSetPoint_x10)
+  {
+    profileSetPoint_x10 = profile.getSetPoint();
+    applySetPoint(profileSetPoint_x10, true, !profile.isRunning());
+  }
+}
+
+static void profileStart(uint8_t step, uint32_t elapsedS)
+{
+  static profile_t loaded;
+  int16_t setPoint_x10 = 0;
+
+  if (!profileLoad(CFG_PROFILE_PATH, &loaded))
+  {
+    displayText(new String("No valid profile"), e_status_bar, 10);
+    return;
+  }
+
+  fallback.getSetPoint(setPoint_x10);
+  if (!profile.start(loaded, millis(), setPoint_x10, step, elapsedS * 1000))
+  {
+    ESP_LOGE(LOG_TAG, "profile : cannot start at step %d", step + 1);
+    return;
+  }
+
+  ESP_LOGI(LOG_TAG, "profile : '%s' started at step %d, %u s", loaded.name, step + 1, elapsedS);
+  profileSetPoint_x10 = profile.getSetPoint();
+  applySetPoint(profileSetPoint_x10, true, false);
+  profileSave(true);
+  profileStatus();
+}
+
+static void profileStop(void)
+{
+  if (profile.isRunning())
+  {
+    ESP_LOGI(LOG_TAG, "profile : stopped at step %d", profile.getStep() + 1);
+    profile.stop();
+    profileSave(false);
+    applySetPoint(profileSetPoint_x10, true, true);
+    displayText(new String("Profile stopped"), e_status_bar, 10);
+  }
+}
+
+// backend set-point while a profile runs : a change overrides the step.
+// Returns true if the profile owns the set-point.
+static bool profileCloudSetPoint(int16_t setPoint_x10, bool valid)
+{
+  bool changed = valid && cloudSetPointValid && (setPoint_x10 != cloudSetPoint_x10);
+
+  if (valid)
+  {
+    cloudSetPoint_x10 = setPoint_x10;
+    cloudSetPointValid = true;
+  }
+
+  if (!profile.isRunning())
+  {
+    return false;
+  }
+
+  if (changed)
+  {
+    ESP_LOGI(LOG_TAG, "profile : step %d overridden by backend, set-point=%d", profile.getStep() + 1, setPoint_x10);
+    profile.override(setPoint_x10);
+    profileControl();
+  }
+  return true;
+}
+
+// resume a profile that was running before the reboot
+static void initProfileControl(void)
 {
-  controllerQItem_t qmesg;
+  Preferences prefs;
+  bool running;
+  uint8_t step;
+  uint32_t elapsedS;
+
+  initProfile();
 
-  qmesg.type = e_mtype_controller;
-  qmesg.valid = true;
-  qmesg.mesg.controlMesg.mesgId = e_msg_timer_hydro;
-  qmesg.mesg.controlMesg.data = 0;
-  controllerQueueSend(&qmesg, 0);
+  prefs.begin(BBPREFS, true);
+  running = prefs.getBool(BBPREFS_PROFILE_RUN, false);
+  step = prefs.getUChar(BBPREFS_PROFILE_STEP, 0);
+  elapsedS = prefs.getULong(BBPREFS_PROFILE_ELAPSED, 0);
+  prefs.end();
+
+  if (running)
+  {
+    profileStart(step, elapsedS);
+  }
+#if (CFG_PROFILE_AUTOSTART == true)
+  else
+  {
+    profileStart(0, 0);
+  }
+#endif
 }
 #endif
 
 // ============================================================================
-// CONTROLLER TASK
+// CONTROLLER JOBS
 // ============================================================================
 
-void controllerTask(void *arg)
+// log pending jobs in deadline order
+static void dumpScheduler(uint32_t nowMs)
+{
+  uint8_t order[e_job_count];
+  uint8_t n = scheduler.getPending(order);
+  schedulerJobStats_t job;
+
+  ESP_LOGI(LOG_TAG, "scheduler : %d pending jobs", n);
+  for (uint8_t i = 0; i < n; i++)
+  {
+    scheduler.getStats(order[i], job);
+    ESP_LOGI(LOG_TAG, " %-8s in %7d ms, period %7u ms, runs %u, skipped %u",
+             job.name, (int)(job.dueMs - nowMs), (unsigned)job.periodMs, (unsigned)job.runs, (unsigned)job.skipped);
+  }
+}
+
+static void runJob(uint8_t job)
 {
-  controllerQItem_t qMesgRecv;
-  actuatorQueueItem_t actuatorsQMesg;
-  displayQueueItem_t displayQMesg;
   commsQueueItem_t commsQMesg;
+#if (CFG_DISPLAY_TIME == true)
+  stateTime_t time;
+#endif
 #if (CFG_HYDRO_ENABLE == true)
   hydroQueueItem_t hydroQmesg;
 #endif
 
-  uint8_t actuators = 0;
+  switch (job)
+  {
+#if (CFG_HYDRO_ENABLE == true)
+  case e_job_hydro:
+    // we must now read the hydrometer, next reading is scheduled when the reading arrives
+    ESP_LOGI(LOG_TAG, "e_job_hydro");
+    hydroQmesg.mesgId = e_msg_hydro_cmd_get_reading;
+    hydroQmesg.data = 0;
+    if (hydroQueueSend(&hydroQmesg, 0) != pdTRUE)
+    {
+      // hydro queue full : retry in 1 second
+      scheduler.schedule(e_job_hydro, millis(), 1000);
+    }
+    break;
+#endif
+
+  case e_job_iotapi:
+    ESP_LOGI(LOG_TAG, "e_job_iotapi");
+    // communication task reads the latest temperatures, backend returns the next call time
+    commsQMesg.type = e_type_comms_iotapi;
+    commsQMesg.valid = true;
+    if (!anyTemperatureValid() || (communicationQueueSend(&commsQMesg, 0) != pdTRUE))
+    {
+      // no temperature yet or comms queue full : retry in 1 second
+      scheduler.schedule(e_job_iotapi, millis(), 1000);
+    }
+    break;
+
+  case e_job_proapi:
+    ESP_LOGI(LOG_TAG, "e_job_proapi");
+    // backend returns the next call time
+    commsQMesg.type = e_type_comms_proapi;
+    commsQMesg.valid = true;
+    if (!anyTemperatureValid() || (communicationQueueSend(&commsQMesg, 0) != pdTRUE))
+    {
+      // no temperature yet or comms queue full : retry in 1 second
+      scheduler.schedule(e_job_proapi, millis(), 1000);
+    }
+    break;
+
+  case e_job_ntp:
+    // we must now get accurate time using NTP, re-scheduled on e_msg_backend_time_update
+    ESP_LOGI(LOG_TAG, "e_job_ntp");
+    commsQMesg.type = e_type_comms_ntp;
+    commsQMesg.valid = true;
+    if (communicationQueueSend(&commsQMesg, 0) != pdTRUE)
+    {
+      // comms queue full : retry in 1 second
+      scheduler.schedule(e_job_ntp, millis(), 1000);
+    }
+    break;
+
+  case e_job_time:
+#if (CFG_DISPLAY_TIME == true)
+    ESP_LOGV(LOG_TAG, "e_job_time");
+    // publish TIME (display)
+    if (rtcValid)
+    {
+      time.time = (uint8_t)rtc.getHour(true) << 8 | (uint8_t)rtc.getMinute();
+      time.valid = true;
+      statePublish<e_state_time>(time);
+    }
+#endif
+    break;
+
+  case e_job_dump:
+    dumpScheduler(millis());
+    break;
+
+  case e_job_backend:
+    backendLost("no response");
+    break;
+
+#if (CFG_PID_ENABLE == true)
+  case e_job_pid:
+    pidControl();
+    break;
+#endif
+
+#if (CFG_MPC_ENABLE == true)
+  case e_job_mpc:
+    mpcControl();
+    break;
+#endif
+
+#if (CFG_PROFILE_ENABLE == true)
+  case e_job_profile:
+    profileControl();
+    break;
+#endif
+
+  case e_job_telemetry:
+    telemetryReport();
+    stateReport();
+    controllerLaneReport();
+    actuatorsReport();
+#if (CFG_TELEMETRY_ON_DISPLAY == true)
+    {
+      char line[64];
+
+      telemetrySummary(line, sizeof(line));
+      displayText(new String(line), e_status_bar, 10);
+    }
+#endif
+    break;
+  }
+}
+
+// ============================================================================
+// CONTROLLER TASK
+// ============================================================================
+
+void controllerTask(void *arg)
+{
+  controllerQItem_t qMesgRecv;
+  displayQueueItem_t displayQMesg;
+  uint32_t waitMs;
+  uint8_t job;
+  BaseType_t r;
+
   char label = ' ';
 
   printf("Heap Size (initController 4): %d, free: %d\n", ESP.getHeapSize(), ESP.getFreeHeap());
@@ -134,128 +983,160 @@ void controllerTask(void *arg)
   String *welcome = new String("Welcome !");
   displayText(welcome, e_status_bar, 10);
 
-  // Timer stuff
+  // Jobs
+
+  scheduler.setName(e_job_ntp, "ntp");
+  scheduler.setName(e_job_time, "time");
+  scheduler.setName(e_job_iotapi, "iotapi");
+  scheduler.setName(e_job_proapi, "proapi");
+  scheduler.setName(e_job_dump, "dump");
+  scheduler.setName(e_job_telemetry, "telemetry");
+  scheduler.setName(e_job_backend, "backend");
+#if (CFG_PID_ENABLE == true)
+  initPid();
+  scheduler.setName(e_job_pid, "pid");
+  scheduler.schedule(e_job_pid, millis(), CFG_PID_PERIOD_MS, CFG_PID_PERIOD_MS); // Periodic
+#endif
+#if (CFG_MPC_ENABLE == true)
+  scheduler.setName(e_job_mpc, "mpc");
+  scheduler.schedule(e_job_mpc, millis(), CFG_MPC_SAMPLE_MS, CFG_MPC_SAMPLE_MS); // Periodic
+#endif
 
   NTPCallTimeMS = 3000;
-  NTPTimer = xTimerCreate("ntp", NTPCallTimeMS / portTICK_PERIOD_MS, pdFALSE, 0, NTPTimerCallback); // One-shot
-  xTimerStart(NTPTimer, 0);
+  scheduler.schedule(e_job_ntp, millis(), NTPCallTimeMS); // One-shot
 
   displayTimeTimeMS = 5000;
-  displayTimeTimer = xTimerCreate("ntp", NTPCallTimeMS / portTICK_PERIOD_MS, pdTRUE, 0, displayTimeCallback); // Autoreload
-  xTimerStart(displayTimeTimer, 0);
+  scheduler.schedule(e_job_time, millis(), displayTimeTimeMS, displayTimeTimeMS); // Periodic
 
   IOTAPICallTimeMS = 5000;
-  IOTAPITimer = xTimerCreate("iotapi", IOTAPICallTimeMS / portTICK_PERIOD_MS, pdFAIL, 0, IOTAPITimerCallback); // One-shot
-  xTimerStart(IOTAPITimer, 0);
+  scheduler.schedule(e_job_iotapi, millis(), IOTAPICallTimeMS); // One-shot
 
   PROAPICallTimeMS = 10000;
-  PROAPITimer = xTimerCreate("proapi", PROAPICallTimeMS / portTICK_PERIOD_MS, pdFAIL, 0, PROAPITimerCallback); // One-shot
-  xTimerStart(PROAPITimer, 0);
+  scheduler.schedule(e_job_proapi, millis(), PROAPICallTimeMS); // One-shot
 
 #if (CFG_HYDRO_ENABLE == true)
   hydroCallTimeMS = 4000; // initial time
-  hydroTimer = xTimerCreate("hydro", hydroCallTimeMS / portTICK_PERIOD_MS, pdFALSE, 0, hydroTimerCallback);
-  xTimerStart(hydroTimer, 0);
+  scheduler.setName(e_job_hydro, "hydro");
+  scheduler.schedule(e_job_hydro, millis(), hydroCallTimeMS);
+#endif
+
+#if (CFG_CTRL_SCHED_DUMP_INTERVAL_S > 0)
+  scheduler.schedule(e_job_dump, millis(), CFG_CTRL_SCHED_DUMP_INTERVAL_S * 1000, CFG_CTRL_SCHED_DUMP_INTERVAL_S * 1000);
+#endif
+
+  initFallback();
+  scheduler.schedule(e_job_backend, millis(), CFG_FALLBACK_TIMEOUT_S * 1000); // One-shot, watchdog
+
+  // after initFallback : a resumed profile continues from the known set-point
+#if (CFG_PROFILE_ENABLE == true)
+  initProfileControl();
+  scheduler.setName(e_job_profile, "profile");
+  scheduler.schedule(e_job_profile, millis(), CFG_PROFILE_TICK_MS, CFG_PROFILE_TICK_MS); // Periodic
+#endif
+
+#if (CFG_TELEMETRY_INTERVAL_S > 0)
+  scheduler.schedule(e_job_telemetry, millis(), CFG_TELEMETRY_INTERVAL_S * 1000, CFG_TELEMETRY_INTERVAL_S * 1000);
 #endif
 
   while (true)
   {
+    // sleep until a message arrives or the first job is due
+    waitMs = scheduler.msUntilNext(millis());
+
+    r = lanes.receive(qMesgRecv) ? pdTRUE : pdFALSE;
+    if (r != pdTRUE)
+    {
+      // every accepted message gives a notification
+      telemetrySleep(e_tel_controller);
+      ulTaskNotifyTake(pdTRUE, (waitMs == SCHEDULER_IDLE) ? portMAX_DELAY : (waitMs + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+      telemetryWakeup(e_tel_controller);
+      r = lanes.receive(qMesgRecv) ? pdTRUE : pdFALSE;
+    }
 
-    if (xQueueReceive(controllerQueue, &qMesgRecv, 10 / portTICK_PERIOD_MS) == pdTRUE)
+    if (r == pdTRUE)
     {
+#if (CFG_TELEMETRY_LATENCY == true)
+      telemetryQueueReceive(e_tel_controller, qMesgRecv.stampUs);
+#endif
+
       switch (qMesgRecv.type)
       {
-      case e_mtype_controller:
-        switch (qMesgRecv.mesg.controlMesg.mesgId)
+      case e_mtype_sensor:
+        switch (qMesgRecv.mesg.sensorMesg.mesgId)
         {
-#if (CFG_HYDRO_ENABLE == true)
-        case e_msg_timer_hydro:
-          // timer has triggered, we must now read the hydrometer
-          ESP_LOGI(LOG_TAG, "e_msg_timer_hydro");
-          hydroQmesg.mesgId = e_msg_hydro_cmd_get_reading;
-          hydroQmesg.data = 0;
-          hydroQueueSend(&hydroQmesg, 0);
-          break;
-#endif
-        case e_msg_timer_iotapi:
-          ESP_LOGI(LOG_TAG, "e_msg_timer_iotapi");
-          if (temperatureValid)
+        case e_msg_sensor_numSensors:
+        {
+          stateTemperature_t temperature;
+
+          ESP_LOGI(LOG_TAG, "received e_msg_sensor_numSensors, data=%d", qMesgRecv.mesg.sensorMesg.data);
+
+          // forget readings of sensors no longer present
+          stateRead<e_state_temperature>(temperature);
+          temperature.numSensors = qMesgRecv.mesg.sensorMesg.data;
+          for (uint8_t i = temperature.numSensors; i < CFG_TEMP_MAX_NR_SENSORS; i++)
           {
-            // send temperature to communication task
-            commsQMesg.type = e_type_comms_iotapi;
-            commsQMesg.temperature_x10 = temperature_x10;
-            commsQMesg.valid = true;
-            communicationQueueSend(&commsQMesg, 0);
+            temperature.valid[i] = false;
           }
-          else
+          statePublish<e_state_temperature>(temperature);
+        }
+        break;
+
+        case e_msg_sensor_temperature:
+        {
+          stateTemperature_t temperature;
+          uint8_t sensorId = qMesgRecv.mesg.sensorMesg.number;
+
+          ESP_LOGD(LOG_TAG, "received e_msg_sensor_temperature, nr=%d, data=%d", sensorId, qMesgRecv.mesg.sensorMesg.data);
+
+          if (sensorId >= CFG_TEMP_MAX_NR_SENSORS)
           {
-            // restart timer / retry in 1 second
-            xTimerChangePeriod(IOTAPITimer, 1000 / portTICK_PERIOD_MS, 0);
-            xTimerStart(IOTAPITimer, 0);
+            break;
           }
-          break;
 
-        case e_msg_timer_proapi:
-          ESP_LOGI(LOG_TAG, "e_msg_timer_proapi");
-          if (temperatureValid)
+          // publish temperature (display shows sensor 0, communication sends all)
+          // controller is the only writer, read-modify-publish is safe
+          stateRead<e_state_temperature>(temperature);
+          temperature.temperature_x10[sensorId] = qMesgRecv.mesg.sensorMesg.data;
+          temperature.valid[sensorId] = qMesgRecv.valid;
+          temperature.readings[sensorId]++;
+          statePublish<e_state_temperature>(temperature);
+
+          if (fallback.isActive() && (sensorId == CFG_FALLBACK_SENSOR))
           {
-            // send temperature to communication task
-            commsQMesg.type = e_type_comms_proapi;
-            commsQMesg.valid = true;
-            communicationQueueSend(&commsQMesg, 0);
+            fallbackControl();
           }
-          else
+#if (CFG_PID_ENABLE == true)
+          if (autoTuneRunning() && (sensorId == CFG_PID_SENSOR))
           {
-            // restart timer / retry in 1 second
-            xTimerChangePeriod(IOTAPITimer, 1000 / portTICK_PERIOD_MS, 0);
-            xTimerStart(IOTAPITimer, 0);
+            autoTuneControl(temperature.temperature_x10[sensorId], temperature.valid[sensorId]);
           }
-          break;
+#endif
+        }
+        break;
 
-        case e_msg_timer_ntp:
-          // timer has triggered, we must now get accurate time using NTP
-          ESP_LOGI(LOG_TAG, "e_msg_timer_ntp");
-          commsQMesg.type = e_type_comms_ntp;
-          commsQMesg.valid = true;
-          communicationQueueSend(&commsQMesg, 0);
-          break;
+        case e_msg_sensor_humidity:
+        {
+          stateHumidity_t humidity;
 
-#if (CFG_DISPLAY_TIME == true)
-        case e_msg_timer_time:
-          ESP_LOGV(LOG_TAG, "e_msg_timer_time");
-          // send TIME to display
-          if (rtcValid)
-          {
-            displayQMesg.type = e_time;
-            displayQMesg.data.time = (uint8_t)rtc.getHour(true) << 8 | (uint8_t)rtc.getMinute();
-            displayQMesg.valid = true;
-            displayQueueSend(&displayQMesg, 0);
-          }
-          break;
-#endif
+          ESP_LOGD(LOG_TAG, "received e_msg_sensor_humidity, data=%d", qMesgRecv.mesg.sensorMesg.data);
+
+          humidity.humidity_x10 = qMesgRecv.mesg.sensorMesg.data;
+          humidity.valid = qMesgRecv.valid;
+          statePublish<e_state_humidity>(humidity);
         }
-        break; // e_mtype_controller
+        break;
 
-      case e_mtype_sensor:
-        switch (qMesgRecv.mesg.sensorMesg.mesgId)
+        case e_msg_sensor_profile:
         {
-        case e_msg_sensor_numSensors:
-          ESP_LOGI(LOG_TAG, "received e_msg_sensor_numSensors, data=%d", qMesgRecv.mesg.sensorMesg.data);
-          break;
+          uint8_t profile = qMesgRecv.mesg.sensorMesg.data;
 
-        case e_msg_sensor_temperature:
-          ESP_LOGD(LOG_TAG, "received e_msg_sensor_temperature, data=%d", qMesgRecv.mesg.sensorMesg.data);
+          ESP_LOGI(LOG_TAG, "received e_msg_sensor_profile, data=%d", profile);
 
-          // send temperature to communication task
-          temperature_x10 = qMesgRecv.mesg.sensorMesg.data;
-          temperatureValid = qMesgRecv.valid;
+          // forward to sensors task
+          sensorsQueueSend(&profile, 0);
+        }
+        break;
 
-          // send temperature to display
-          displayQMesg.type = e_temperature;
-          displayQMesg.data.temperature = qMesgRecv.mesg.sensorMesg.data;
-          displayQMesg.valid = qMesgRecv.valid;
-          displayQueueSend(&displayQMesg, 0);
-          break;
         case e_msg_sensor_unknown:
           ESP_LOGE(LOG_TAG, "received e_msg_sensor_unknown");
           break;
@@ -268,7 +1149,7 @@ void controllerTask(void *arg)
         {
         case e_msg_backend_next_IOTAPIcall_ms:
         {
-          uint16_t newTimerValue;
+          uint32_t newTimerValue;
           if (qMesgRecv.mesg.backendMesg.valid)
           {
             newTimerValue = qMesgRecv.mesg.backendMesg.data32;
@@ -278,45 +1159,45 @@ void controllerTask(void *arg)
             newTimerValue = 60000; // try again in a minute
           }
 
-          // Restart timer
-          ESP_LOGI(LOG_TAG, "new timer value, data=%d, valid=%d", qMesgRecv.mesg.backendMesg.data32, qMesgRecv.mesg.backendMesg.valid);
-          xTimerChangePeriod(IOTAPITimer, newTimerValue / portTICK_PERIOD_MS, 0);
-          xTimerStart(IOTAPITimer, 0);
+          ESP_LOGI(LOG_TAG, "next IOT API call, data=%u, valid=%d", (unsigned)qMesgRecv.mesg.backendMesg.data32, qMesgRecv.mesg.backendMesg.valid);
+          scheduler.schedule(e_job_iotapi, millis(), newTimerValue);
         }
         break;
 
         case e_msg_backend_next_PROAPIcall_ms:
-          break;
-
-        case e_msg_backend_actuators:
         {
-          uint8_t newActuatorValue;
+          uint32_t newTimerValue;
           if (qMesgRecv.mesg.backendMesg.valid)
           {
-            newActuatorValue = qMesgRecv.mesg.backendMesg.data16;
+            newTimerValue = qMesgRecv.mesg.backendMesg.data32;
           }
           else
           {
-            newActuatorValue = 0; // All actuators off
+            newTimerValue = CFG_COMM_PROAPI_INTERVAL * 1000;
           }
 
+          ESP_LOGI(LOG_TAG, "next PRO API call, data=%u, valid=%d", (unsigned)qMesgRecv.mesg.backendMesg.data32, qMesgRecv.mesg.backendMesg.valid);
+          scheduler.schedule(e_job_proapi, millis(), newTimerValue);
+        }
+        break;
+
+        case e_msg_backend_actuators:
           ESP_LOGI(LOG_TAG, "received e_msg_backend_actuators, data=%d, valid=%d", qMesgRecv.mesg.backendMesg.data16, qMesgRecv.mesg.backendMesg.valid);
 
-          // send actuators/relay state to actuators tasks
-          if (newActuatorValue != actuators)
+          if (qMesgRecv.mesg.backendMesg.valid)
           {
-            actuators = newActuatorValue;
-            actuatorsQMesg.data = newActuatorValue;
-            actuatorsQueueSend(&actuatorsQMesg, 0);
+            backendValid();
+            if (!autoTuneRunning())
+            {
+              setActuators(qMesgRecv.mesg.backendMesg.data16, true);
+            }
           }
-
-          // send actuators to display task
-          displayQMesg.type = e_actuator;
-          displayQMesg.data.actuators = newActuatorValue;
-          displayQMesg.valid = qMesgRecv.mesg.backendMesg.valid;
-          displayQueueSend(&displayQMesg, 0);
-        }
-        break; // e_msg_backend_actuators
+          else
+          {
+            // local thermostat (all actuators off without set-point)
+            backendLost("invalid response");
+          }
+          break; // e_msg_backend_actuators
 
         case e_msg_backend_act_delay:
           ESP_LOGI(LOG_TAG, "received e_msg_backend_act_delay, nr=%d, data=%d", qMesgRecv.mesg.backendMesg.number, qMesgRecv.mesg.backendMesg.data16);
@@ -340,33 +1221,66 @@ void controllerTask(void *arg)
 
         case e_msg_backend_temp_setpoint:
           ESP_LOGI(LOG_TAG, "received e_msg_backend_temp_setpoint, data=%d, valid=%d", qMesgRecv.mesg.backendMesg.data16, qMesgRecv.mesg.backendMesg.valid);
-          // send temperature set-point information to display
-          displayQMesg.type = e_setpoint;
-          displayQMesg.data.temperature = qMesgRecv.mesg.backendMesg.data16;
-          displayQMesg.valid = qMesgRecv.mesg.backendMesg.valid;
-          displayQueueSend(&displayQMesg, 0);
+#if (CFG_PROFILE_ENABLE == true)
+          if (profileCloudSetPoint(qMesgRecv.mesg.backendMesg.data16, qMesgRecv.mesg.backendMesg.valid))
+          {
+            break;
+          }
+#endif
+          applySetPoint(qMesgRecv.mesg.backendMesg.data16, qMesgRecv.mesg.backendMesg.valid, true);
           break; // e_msg_backend_temp_setpoint
 
+        case e_msg_backend_autotune:
+          ESP_LOGI(LOG_TAG, "received e_msg_backend_autotune, data=%d, valid=%d", qMesgRecv.mesg.backendMesg.data16, qMesgRecv.mesg.backendMesg.valid);
+#if (CFG_PID_ENABLE == true)
+          if (qMesgRecv.mesg.backendMesg.valid)
+          {
+            autoTuneStart(qMesgRecv.mesg.backendMesg.data16);
+          }
+          else if (autoTuneRunning())
+          {
+            autoTuneStop();
+          }
+#endif
+          break; // e_msg_backend_autotune
+
+        case e_msg_backend_profile:
+          ESP_LOGI(LOG_TAG, "received e_msg_backend_profile, data=%d, valid=%d", qMesgRecv.mesg.backendMesg.data16, qMesgRecv.mesg.backendMesg.valid);
+#if (CFG_PROFILE_ENABLE == true)
+          if (qMesgRecv.mesg.backendMesg.valid)
+          {
+            profileStart(qMesgRecv.mesg.backendMesg.data16, 0);
+          }
+          else
+          {
+            profileStop();
+          }
+#endif
+          break; // e_msg_backend_profile
+
         case e_msg_backend_device_name:
           ESP_LOGI(LOG_TAG, "received e_msg_backend_device_a");
-          // send device name to display (using helper function)
-          displayText(qMesgRecv.mesg.backendMesg.stringPtr, e_device_name, 0);
+          // send device name to display (using helper function), free message pool slot
+          if (msgPoolGet(qMesgRecv.mesg.backendMesg.poolHandle) != NULL)
+          {
+            displayText(new String((const char *)msgPoolGet(qMesgRecv.mesg.backendMesg.poolHandle)), e_device_name, 0);
+            msgPoolFree(qMesgRecv.mesg.backendMesg.poolHandle);
+          }
           break; // e_msg_backend_device_name
 
         case e_msg_backend_time_update:
-          ESP_LOGI(LOG_TAG, "received e_msg_time_data, data=%2d:%02d", qMesgRecv.mesg.controlMesg.data >> 8, qMesgRecv.mesg.controlMesg.data & 255);
+          ESP_LOGI(LOG_TAG, "received e_msg_time_data, data=%2d:%02d", qMesgRecv.mesg.backendMesg.data16 >> 8, qMesgRecv.mesg.backendMesg.data16 & 255);
 
-          // re-start NTP timer with appropriate interval
+          // schedule next NTP request with appropriate interval
           if (qMesgRecv.valid)
           {
-            xTimerChangePeriod(NTPTimer, CFG_COMM_TIMEREQUEST_INTERVAL_S * 1000 / portTICK_PERIOD_MS, 0);
+            scheduler.schedule(e_job_ntp, millis(), CFG_COMM_TIMEREQUEST_INTERVAL_S * 1000);
             rtcValid = true;
           }
           else
           {
-            xTimerChangePeriod(NTPTimer, 10 * 1000 / portTICK_PERIOD_MS, 0);
+            scheduler.schedule(e_job_ntp, millis(), 10 * 1000);
           }
-          xTimerStart(NTPTimer, 0);
 
           break; // e_msg_backend_time_updated
 
@@ -377,6 +1291,9 @@ void controllerTask(void *arg)
         break; // e_mtype_backend
 
       case e_mtype_wifi:
+      {
+        stateWiFi_t wifi;
+
         ESP_LOGI(LOG_TAG, "received e_mtype_wifi (rssi=%d, status=%d)", qMesgRecv.mesg.WiFiMesg.rssi, qMesgRecv.mesg.WiFiMesg.wifiStatus);
 
         switch (qMesgRecv.mesg.WiFiMesg.wifiStatus)
@@ -398,39 +1315,51 @@ void controllerTask(void *arg)
           break;
         }
 
-        // send WiFi information to display
-        displayQMesg.type = e_wifi;
-        displayQMesg.data.wifiData.rssi = qMesgRecv.mesg.WiFiMesg.rssi;
-        displayQMesg.data.wifiData.status = label;
-        displayQMesg.valid = qMesgRecv.valid;
-        displayQueueSend(&displayQMesg, 0);
-        break; // e_mtype_wifi
+        // publish WiFi information (display)
+        wifi.rssi = qMesgRecv.mesg.WiFiMesg.rssi;
+        wifi.status = label;
+        wifi.valid = qMesgRecv.valid;
+        statePublish<e_state_wifi>(wifi);
+      }
+      break; // e_mtype_wifi
 
 #if (CFG_HYDRO_ENABLE == true)
       case e_mtype_hydro:
         switch (qMesgRecv.mesg.hydroMesg.mesgId)
         {
         case e_cmsg_hydro_reading:
+        {
+          static const hydrometerQData_t noReading = {};
+          const hydrometerQData_t *reading;
+          stateHydro_t hydro;
+
+          // reading is passed by reference (message pool), slot is freed below
+          reading = (const hydrometerQData_t *)msgPoolGet(qMesgRecv.mesg.hydroMesg.poolHandle);
+          if (reading == NULL)
+          {
+            reading = &noReading;
+          }
+
           if (qMesgRecv.valid)
           {
             ESP_LOGI(LOG_TAG, "hydrobrick reading:");
-            ESP_LOGI(LOG_TAG, " SG           = %1.3f", qMesgRecv.mesg.hydroMesg.data.reading.SG_x1000 / 1000.0);
-            ESP_LOGI(LOG_TAG, " angle        = %2.2f", qMesgRecv.mesg.hydroMesg.data.reading.angle_x100 / 100.0);
-            ESP_LOGI(LOG_TAG, " temperature  = %2.1f", qMesgRecv.mesg.hydroMesg.data.reading.temperature_x10 / 10.0);
-            ESP_LOGI(LOG_TAG, " bat. voltage = %1.3f", qMesgRecv.mesg.hydroMesg.data.reading.batteryVoltage_x1000 / 1000.0);
-            ESP_LOGI(LOG_TAG, " status       = %d", qMesgRecv.mesg.hydroMesg.data.reading.status);
-            ESP_LOGI(LOG_TAG, " RSSI         = %d", qMesgRecv.mesg.hydroMesg.data.reading.RSSI);
+            ESP_LOGI(LOG_TAG, " SG           = %1.3f", reading->SG_x1000 / 1000.0);
+            ESP_LOGI(LOG_TAG, " angle        = %2.2f", reading->angle_x100 / 100.0);
+            ESP_LOGI(LOG_TAG, " temperature  = %2.1f", reading->temperature_x10 / 10.0);
+            ESP_LOGI(LOG_TAG, " bat. voltage = %1.3f", reading->batteryVoltage_x1000 / 1000.0);
+            ESP_LOGI(LOG_TAG, " status       = %d", reading->status);
+            ESP_LOGI(LOG_TAG, " RSSI         = %d", reading->RSSI);
 
             hydroCallTimeMS = 30 * 1000;
 
-            // if (qMesgRecv.mesg.hydroMesg.data.reading.status & battery_charging)
+            // if (reading->status & battery_charging)
             // {
             //   String *charge = new String("Charging");
             //   displayText(charge, e_status_bar, 25);
             // }
             // else
             // {
-            //   String *angle = new String(qMesgRecv.mesg.hydroMesg.data.reading.batteryVoltage_x1000 / 1000.0);
+            //   String *angle = new String(reading->batteryVoltage_x1000 / 1000.0);
             //   displayText(angle, e_status_bar, 25);
             // }
           }
@@ -441,32 +1370,21 @@ void controllerTask(void *arg)
           }
 
           ESP_LOGI(LOG_TAG, "hydrobrick next reading after %d (ms)", hydroCallTimeMS);
-          xTimerChangePeriod(hydroTimer, hydroCallTimeMS / portTICK_PERIOD_MS, 0);
-          xTimerStart(hydroTimer, 0);
-
-          // send specific gravity to display
-          displayQMesg.type = e_specific_gravity;
-          displayQMesg.data.specificGravity = qMesgRecv.mesg.hydroMesg.data.reading.SG_x1000;
-          displayQMesg.valid = qMesgRecv.valid;
-          displayQueueSend(&displayQMesg, 0);
-
-          // send HB temperature to display
-          displayQMesg.type = e_hb_temperature;
-          displayQMesg.data.temperature = qMesgRecv.mesg.hydroMesg.data.reading.temperature_x10;
-          displayQMesg.valid = qMesgRecv.valid;
-          displayQueueSend(&displayQMesg, 0);
+          scheduler.schedule(e_job_hydro, millis(), hydroCallTimeMS);
 
-          // send voltage to display
-          displayQMesg.type = e_voltage;
-          displayQMesg.data.voltage = qMesgRecv.mesg.hydroMesg.data.reading.batteryVoltage_x1000;
-          displayQMesg.valid = qMesgRecv.valid;
-          displayQueueSend(&displayQMesg, 0);
+          // publish reading (display : specific gravity, HB temperature, voltage)
+          hydro.reading = *reading;
+          hydro.valid = qMesgRecv.valid;
+          statePublish<e_state_hydro>(hydro);
 
-          break; // e_cmsg_hydro_reading
+          msgPoolFree(qMesgRecv.mesg.hydroMesg.poolHandle);
+        }
+        break; // e_cmsg_hydro_reading
 
           
       case e_cmsg_hydro_scanned_bricks:
         ESP_LOGE(LOG_TAG, "e_cmsg_hydro_scanned_bricks");
+        msgPoolFree(qMesgRecv.mesg.hydroMesg.poolHandle);
         break;          
 
 
@@ -480,6 +1398,12 @@ void controllerTask(void *arg)
 #endif
       }
     }
+
+    // run all jobs that are due (or due within the coalesce window)
+    while (scheduler.popDue(millis(), job))
+    {
+      runJob(job);
+    }
   }
 
 #ifdef BOARD_HAS_RGB_LED
@@ -504,15 +1428,42 @@ void controllerTask(void *arg)
 #endif
 }
 
-// wrapper for sendQueue
+// wrapper for sendQueue : lane & backpressure policy of the message class.
+// xTicksToWait is only used by block policy (at least CFG_CTRL_BLOCK_MS).
 int controllerQueueSend(controllerQItem_t *controllerQMesg, TickType_t xTicksToWait)
 {
+  uint8_t policyIndex;
   int r;
-  r = pdTRUE;
 
-  if (controllerQueue != NULL)
+  if (laneQueues[e_lane_count - 1] == NULL)
+  {
+    return pdTRUE;
+  }
+
+  if (xTicksToWait < CFG_CTRL_BLOCK_MS / portTICK_PERIOD_MS)
+  {
+    xTicksToWait = CFG_CTRL_BLOCK_MS / portTICK_PERIOD_MS;
+  }
+#if (CFG_TELEMETRY_LATENCY == true)
+  controllerQMesg->stampUs = telemetryStamp();
+#endif
+
+  r = lanes.send(*controllerQMesg, xTicksToWait, policyIndex) ? pdTRUE : pdFALSE;
+
+  // telemetry : message type is the class (controllerPolicies index), depth is all lanes
+  telemetryQueueSend(e_tel_controller, policyIndex, r, lanes.waiting());
+
+  if (r == pdTRUE)
+  {
+    if (controllerTaskHandle != NULL)
+    {
+      xTaskNotifyGive(controllerTaskHandle);
+    }
+  }
+  else
   {
-    r = xQueueSend(controllerQueue, controllerQMesg, xTicksToWait);
+    ESP_LOGW(LOG_TAG, "%s lane: message dropped (type=%d, id=%d)", laneNames[itemPolicy(controllerQMesg, &policyIndex)->laneClass.lane],
+             controllerQMesg->type, itemMesgId(controllerQMesg));
   }
 
   return r;
@@ -526,14 +1477,24 @@ void initController(void)
 
   printf("Heap Size (initController 1): %d, free: %d\n", ESP.getHeapSize(), ESP.getFreeHeap());
 
-  controllerQueue = xQueueCreate(8, sizeof(controllerQItem_t));
-
-  printf("Heap Size (initController 2): %d, free: %d\n", ESP.getHeapSize(), ESP.getFreeHeap());
+#if (CFG_PID_ENABLE == true)
+  // elements off before the controller task runs
+  initSSR();
+#endif
 
-  if (controllerQueue == 0)
+  for (uint8_t lane = 0; lane < e_lane_count; lane++)
   {
-    ESP_LOGE(LOG_TAG, "Cannot create controllerQueue");
+    laneQueues[lane] = xQueueCreate(laneLengths[lane], sizeof(controllerQItem_t));
+    if (laneQueues[lane] == 0)
+    {
+      ESP_LOGE(LOG_TAG, "Cannot create %s lane queue", laneNames[lane]);
+    }
   }
+  ESP_LOGI(LOG_TAG, "controllerQItem_t=%d bytes, lane queues=%d bytes (items), lanes & mailboxes=%d bytes, message pool=%d bytes",
+           (int)sizeof(controllerQItem_t), (int)((CFG_CTRL_LANE_SAFETY_LENGTH + CFG_CTRL_LANE_NORMAL_LENGTH + CFG_CTRL_LANE_BULK_LENGTH) * sizeof(controllerQItem_t)),
+           (int)sizeof(lanes), MSGPOOL_NR_SLOTS * MSGPOOL_SLOT_SIZE);
+
+  printf("Heap Size (initController 2): %d, free: %d\n", ESP.getHeapSize(), ESP.getFreeHeap());
 
   // create task
   r = xTaskCreatePinnedToCore(controllerTask, "controllerTask", 8 * 1024, NULL, 10, &controllerTaskHandle, 1);
@@ -542,6 +1503,7 @@ void initController(void)
   {
     ESP_LOGE(LOG_TAG, "Could not create task, error-code=%d", r);
   }
+  telemetryRegisterTask(e_tel_controller, controllerTaskHandle, CFG_CTRL_LANE_SAFETY_LENGTH + CFG_CTRL_LANE_NORMAL_LENGTH + CFG_CTRL_LANE_BULK_LENGTH);
 
   printf("Heap Size (initController 3): %d, free: %d\n", ESP.getHeapSize(), ESP.getFreeHeap());
 }
@@ -6,12 +6,28 @@
 #include <ui.h>
 #include "config.h"
 #include "display.h"
+#include "telemetry.h"
+#include "statestore.h"
+#include "mailbox.h"
 
 #define LOG_TAG "DISP"
 
+#define DISPLAY_SECOND_TICKS  (1000 / portTICK_PERIOD_MS)
+#define DISPLAY_QUEUE_LENGTH  5
+#define DISPLAY_MAILBOX_SLOTS 6             // delays (per actuator), heartbeat, progress tick
+
+// task notification bits : state store keys (low bits) & message in displayQueue
+#define DISPLAY_NOTIFY_QUEUE  (1UL << 31)
+#define DISPLAY_STATE_KEYS    (STATE_BIT(e_state_temperature) | STATE_BIT(e_state_setpoint) | STATE_BIT(e_state_actuators) | \
+                               STATE_BIT(e_state_wifi) | STATE_BIT(e_state_time) | STATE_BIT(e_state_hydro))
+
 static QueueHandle_t displayQueue = NULL;
 static TaskHandle_t displayTaskHandle = NULL;
 
+// periodic values : latest wins, per type & number
+static Mailbox<displayQueueItem_t, DISPLAY_MAILBOX_SLOTS> displayMailbox;
+static portMUX_TYPE displayMailboxMux = portMUX_INITIALIZER_UNLOCKED;
+
 
 // color defintions for chart series
 static const lv_color_t tempGraphColor = lv_color_make(0x10, 0x80, 0x10);
@@ -39,6 +55,7 @@ static void progressBarTimerCallback(TimerHandle_t timer)
   displayQueueItem_t qmesg;
 
   qmesg.type = e_progress_tick;
+  qmesg.number = 0;
   qmesg.valid = true;
   displayQueueSend(&qmesg, 0);
 }
@@ -158,6 +175,164 @@ static void displayTemperature(float value, bool valid, lv_obj_t *label, lv_obj_
 }
 
 
+// ============================================================================
+// STATE STORE
+// ============================================================================
+
+// Values shown on the display are read from the state store (latest wins)
+// and handled as if they were queue messages. Queued messages are events
+// (text, delays, heartbeat) that must not be merged.
+
+static uint32_t stateVersions[e_state_count];   // last version read, per key
+static uint32_t statePending = 0;               // bit per displayQueueDataType_t with a new value
+static uint16_t shownReadings = 0;              // readings of sensor 0 already in graph
+
+static stateTemperature_t stateTemperature;
+static stateSetPoint_t stateSetPoint;
+static stateActuators_t stateActuators;
+static stateWiFi_t stateWiFi;
+static stateTime_t stateTime;
+static stateHydro_t stateHydro;
+
+// read the changed keys, mark the display items to update
+static void displayStateRead(uint32_t keyBits)
+{
+  if ((keyBits & STATE_BIT(e_state_temperature)) && stateRead<e_state_temperature>(stateTemperature, &stateVersions[e_state_temperature]))
+  {
+    // only sensor 0 is shown, one graph point per reading
+    if (stateTemperature.readings[0] != shownReadings)
+    {
+      shownReadings = stateTemperature.readings[0];
+      statePending |= (1 << e_temperature);
+    }
+  }
+  if ((keyBits & STATE_BIT(e_state_setpoint)) && stateRead<e_state_setpoint>(stateSetPoint, &stateVersions[e_state_setpoint]))
+  {
+    statePending |= (1 << e_setpoint);
+  }
+  if ((keyBits & STATE_BIT(e_state_actuators)) && stateRead<e_state_actuators>(stateActuators, &stateVersions[e_state_actuators]))
+  {
+    statePending |= (1 << e_actuator);
+  }
+  if ((keyBits & STATE_BIT(e_state_wifi)) && stateRead<e_state_wifi>(stateWiFi, &stateVersions[e_state_wifi]))
+  {
+    statePending |= (1 << e_wifi);
+  }
+  if ((keyBits & STATE_BIT(e_state_time)) && stateRead<e_state_time>(stateTime, &stateVersions[e_state_time]))
+  {
+    statePending |= (1 << e_time);
+  }
+  if ((keyBits & STATE_BIT(e_state_hydro)) && stateRead<e_state_hydro>(stateHydro, &stateVersions[e_state_hydro]))
+  {
+    statePending |= (1 << e_specific_gravity) | (1 << e_hb_temperature) | (1 << e_voltage);
+  }
+}
+
+// next pending display item, as message
+static bool displayStateMesg(displayQueueItem_t *qMesg)
+{
+  displayQueueDataType_t type;
+
+  if (statePending == 0)
+  {
+    return false;
+  }
+
+  type = (displayQueueDataType_t)__builtin_ctz(statePending);
+  statePending &= ~(1 << type);
+
+  qMesg->type = type;
+  qMesg->number = 0;
+
+  switch (type)
+  {
+  case e_temperature:
+    qMesg->data.temperature = stateTemperature.temperature_x10[0];
+    qMesg->valid = stateTemperature.valid[0];
+    break;
+  case e_setpoint:
+    qMesg->data.temperature = stateSetPoint.setPoint_x10;
+    qMesg->valid = stateSetPoint.valid;
+    break;
+  case e_actuator:
+    qMesg->data.actuators = stateActuators.actuators;
+    qMesg->valid = stateActuators.valid;
+    break;
+  case e_wifi:
+    qMesg->data.wifiData.rssi = stateWiFi.rssi;
+    qMesg->data.wifiData.status = stateWiFi.status;
+    qMesg->valid = stateWiFi.valid;
+    break;
+  case e_time:
+    qMesg->data.time = stateTime.time;
+    qMesg->valid = stateTime.valid;
+    break;
+  case e_specific_gravity:
+    qMesg->data.specificGravity = stateHydro.reading.SG_x1000;
+    qMesg->valid = stateHydro.valid;
+    break;
+  case e_hb_temperature:
+    qMesg->data.temperature = stateHydro.reading.temperature_x10;
+    qMesg->valid = stateHydro.valid;
+    break;
+  case e_voltage:
+    qMesg->data.voltage = stateHydro.reading.batteryVoltage_x1000;
+    qMesg->valid = stateHydro.valid;
+    break;
+  default:
+    return false;
+  }
+
+  return true;
+}
+
+static bool displayMailboxTake(displayQueueItem_t *qMesg)
+{
+  bool found;
+
+  portENTER_CRITICAL(&displayMailboxMux);
+  found = displayMailbox.take(0, *qMesg);
+  portEXIT_CRITICAL(&displayMailboxMux);
+  return found;
+}
+
+static uint8_t displayMailboxWaiting(void)
+{
+  uint8_t waiting;
+
+  portENTER_CRITICAL(&displayMailboxMux);
+  waiting = displayMailbox.waiting();
+  portEXIT_CRITICAL(&displayMailboxMux);
+  return waiting;
+}
+
+// Wait (up to waitTicks) for a queued message or a changed state value.
+// Queued messages go first, then the mailbox.
+static bool displayNextMesg(displayQueueItem_t *qMesg, TickType_t waitTicks)
+{
+  uint32_t notifyBits = 0;
+
+  if ((statePending != 0) || (uxQueueMessagesWaiting(displayQueue) != 0) || (displayMailboxWaiting() != 0))
+  {
+    waitTicks = 0;
+  }
+
+  telemetrySleep(e_tel_display);
+  xTaskNotifyWait(0, UINT32_MAX, &notifyBits, waitTicks);
+  telemetryWakeup(e_tel_display);
+  displayStateRead(notifyBits & DISPLAY_STATE_KEYS);
+
+  if ((xQueueReceive(displayQueue, qMesg, 0) == pdTRUE) || displayMailboxTake(qMesg))
+  {
+#if (CFG_TELEMETRY_LATENCY == true)
+    telemetryQueueReceive(e_tel_display, qMesg->stampUs);
+#endif
+    return true;
+  }
+
+  return displayStateMesg(qMesg);
+}
+
 // ============================================================================
 // DISPLAY TASK
 // ============================================================================
@@ -182,6 +357,8 @@ void displayTask(void *arg)
   bool timeToggle = false;
   uint32_t tickCount = 0;
   uint32_t prevTickCount = 0;
+  uint32_t lvglWaitMs = 0;
+  TickType_t waitTicks;
   uint8_t timeHours;
   uint8_t timeMinutes;
 
@@ -214,9 +391,26 @@ void displayTask(void *arg)
   progressBarTimer = xTimerCreate("progressBar", 1000 / portTICK_PERIOD_MS, pdTRUE, 0, progressBarTimerCallback);
   xTimerStart(progressBarTimer, 0);
 
+  // latest values : get notified on change, show what is there already
+  stateSubscribe(xTaskGetCurrentTaskHandle(), DISPLAY_STATE_KEYS);
+  displayStateRead(DISPLAY_STATE_KEYS);
+
   while (true)
   {
-    if (xQueueReceive(displayQueue, &qMesg, 100 / portTICK_PERIOD_MS) == pdTRUE)
+    // Block until a message or new value arrives, the status-bar second is due or LVGL
+    // has work (its next timer, but not more often than CFG_DISPLAY_LVGL_PERIOD_MS)
+    tickCount = xTaskGetTickCount();
+    waitTicks = ((tickCount - prevTickCount) > DISPLAY_SECOND_TICKS) ? 0 : DISPLAY_SECOND_TICKS + 1 - (tickCount - prevTickCount);
+    if (lvglWaitMs < CFG_DISPLAY_LVGL_PERIOD_MS)
+    {
+      lvglWaitMs = CFG_DISPLAY_LVGL_PERIOD_MS;
+    }
+    if (lvglWaitMs / portTICK_PERIOD_MS < waitTicks)
+    {
+      waitTicks = lvglWaitMs / portTICK_PERIOD_MS;
+    }
+
+    if (displayNextMesg(&qMesg, waitTicks))
     {
       // printf("[DISP] received qMesg.type=%d\n", qMesg.type);
 
@@ -584,7 +778,7 @@ void displayTask(void *arg)
 
     // Show/update time in lower status-bar once every second
     tickCount = xTaskGetTickCount();
-    if ((tickCount - prevTickCount) > 1000)
+    if ((tickCount - prevTickCount) > DISPLAY_SECOND_TICKS)
     {
       static char separator;
 
@@ -623,7 +817,7 @@ void displayTask(void *arg)
     // ESP_LOGE(LOG_TAG, "BEFORE LV_TIMER_HANDLER");    
     // lv_timer_handler();
     // ESP_LOGE(LOG_TAG, "AFTER LV_TIMER_HANDLER");    
-    updateLVGL();
+    lvglWaitMs = updateLVGL();
 
 #if (CFG_ENABLE_SCREENSHOT == true)
     static int prevButton = 1;
@@ -655,19 +849,62 @@ void displayText(String * message, displayMessageType_t messageType, uint8_t tim
   displayQMesg.data.textData.messageType = messageType;
   displayQMesg.valid = true;
 
-  displayQueueSend(&displayQMesg , 0);
+  if (displayQueueSend(&displayQMesg , 0) != pdTRUE)
+  {
+    // not delivered : nobody else will delete it
+    delete message;
+  }
 }
 
 
-// wrapper for sendQueue 
+// wrapper for sendQueue. Policy per message type :
+//  - delay, heartbeat, progress tick : sent periodically, only the latest
+//    value matters. They wait in a mailbox slot (per type & number), a newer
+//    one replaces the waiting one; a busy display never loses the last value.
+//  - text : an event, queued in order. A full queue drops the new message
+//    (logged, counted by telemetry), displayText() deletes its String. The
+//    display task empties the queue every pass; a full queue means it is
+//    stuck, and waiting in the sender (controller, timer task) would stall
+//    the sender as well.
 int displayQueueSend(displayQueueItem_t * displayQMesg, TickType_t xTicksToWait)
 {
   int r;
+  uint8_t number;
   r = pdTRUE;
 #ifndef CFG_DISPLAY_NONE
   if (displayQueue != NULL)
   {
-    r =  xQueueSend(displayQueue, displayQMesg , xTicksToWait);
+#if (CFG_TELEMETRY_LATENCY == true)
+    displayQMesg->stampUs = telemetryStamp();
+#endif
+
+    switch (displayQMesg->type)
+    {
+    case e_delay:
+    case e_heartbeat:
+    case e_progress_tick:
+      portENTER_CRITICAL(&displayMailboxMux);
+      // only the delay is per actuator
+      number = (displayQMesg->type == e_delay) ? displayQMesg->number : 0;
+      r = (displayMailbox.put(0, displayQMesg->type, number, *displayQMesg) != e_mailbox_full) ? pdTRUE : pdFALSE;
+      portEXIT_CRITICAL(&displayMailboxMux);
+      break;
+
+    default:
+      r = xQueueSend(displayQueue, displayQMesg, xTicksToWait);
+      break;
+    }
+    telemetryQueueSend(e_tel_display, displayQMesg->type, r, uxQueueMessagesWaiting(displayQueue));
+
+    // display task waits on its notification (queue & state store)
+    if ((r == pdTRUE) && (displayTaskHandle != NULL))
+    {
+      xTaskNotify(displayTaskHandle, DISPLAY_NOTIFY_QUEUE, eSetBits);
+    }
+    else if (r != pdTRUE)
+    {
+      ESP_LOGW(LOG_TAG, "message dropped (type=%d)", displayQMesg->type);
+    }
   }
 #endif
   return r;
@@ -696,7 +933,7 @@ void initDisplay(void)
 #endif
 
 
-  displayQueue = xQueueCreate(5, sizeof(displayQueueItem_t));
+  displayQueue = xQueueCreate(DISPLAY_QUEUE_LENGTH, sizeof(displayQueueItem_t));
   if (displayQueue == 0)
   {
     ESP_LOGE(LOG_TAG, "Cannot create displayQueue");
@@ -709,6 +946,7 @@ void initDisplay(void)
   {
     ESP_LOGE(LOG_TAG, "Could not create task, error-code=%d", r);
   }
+  telemetryRegisterTask(e_tel_display, displayTaskHandle, DISPLAY_QUEUE_LENGTH);
 
 #endif // CFG_DISPLAY_NONE
 }
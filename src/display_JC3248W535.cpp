@@ -169,9 +169,11 @@ void initLVGL()
 
 
 
-void updateLVGL(void)
+uint32_t updateLVGL(void)
 {
-    lv_timer_handler(); /* let the GUI do its work */
+  uint32_t nextMs;
+
+    nextMs = lv_timer_handler(); /* let the GUI do its work */
 
 #ifdef DIRECT_MODE
 #if defined(CANVAS) || defined(RGB_PANEL)
@@ -189,6 +191,8 @@ void updateLVGL(void)
 #endif
 #endif // !DIRECT_MODE
 
+  return nextMs;
+
 }
 
 #endif
@@ -24,7 +24,7 @@ static uint16_t setPoint;
 static bool heart;
 static bool  rssiValid;
 static int16_t rssi;
-static uint8_t actuators;
+static uint16_t actuators;
 static uint16_t cdelay;
 
 // fonts : https://github.com/olikraus/u8g2/wiki/fntlistallplain#42-pixel-height
@@ -137,8 +137,8 @@ void displayTask(void *arg)
 
       case e_actuator:
         // TODO : make a list of actuators
-        static uint8_t actuator0 = 0;
-        static uint8_t actuator1 = 0;
+        static uint16_t actuator0 = 0;
+        static uint16_t actuator1 = 0;
         const char *label;
         printf("[DISP] actuator=%d value=%d\n", qMesg.number, qMesg.data.actuators);
         lcd.setCursor(12, 1);
@@ -8,9 +8,13 @@
 #include <NimBLEDevice.h>
 #include "controller.h"
 #include "hydrobrick.h"
+#include "telemetry.h"
 
 #define LOG_TAG "HYDRO"
 
+#define HYDRO_CONNECT_RETRY_MS  100   // retry interval while connecting to a discovered brick
+#define HYDRO_QUEUE_LENGTH      16
+
 static scanMode_t scanMode;
 static hydrometerScannedBricks_t scannedBricks;
 
@@ -21,6 +25,10 @@ static QueueHandle_t hydroQueue = NULL;
 // Task handle
 static TaskHandle_t hydroTaskHandle = NULL;
 
+// events (bit per hydroQMesgType_t) that did not fit in the queue
+static uint32_t hydroPendingEvents = 0;
+static portMUX_TYPE hydroEventsMux = portMUX_INITIALIZER_UNLOCKED;
+
 // UUIDs
 static NimBLEUUID HDhydrometerService(HDhydrometerServiceUUID);
 static NimBLEUUID HDhydrometerCharacteristic(HDhydrometerCharacteristicID);
@@ -306,6 +314,24 @@ void readService(void)
   }
 }
 
+// oldest kind of event that did not fit in the queue, after the queue is empty
+static bool hydroTakeEvent(hydroQueueItem_t *qMesg)
+{
+  uint32_t events;
+
+  portENTER_CRITICAL(&hydroEventsMux);
+  events = hydroPendingEvents;
+  if (events != 0)
+  {
+    qMesg->mesgId = (hydroQMesgType_t)__builtin_ctz(events);
+    qMesg->data = 0;
+    hydroPendingEvents &= ~(1UL << qMesg->mesgId);
+  }
+  portEXIT_CRITICAL(&hydroEventsMux);
+
+  return (events != 0);
+}
+
 static void timeOutTimerCallback(TimerHandle_t xTimer)
 {
   hydroQueueItem_t qmesg;
@@ -339,6 +365,7 @@ void hydrometerTask(void *arg)
   states_t next_state = state_idle;
   bool timeOutOccurred;
   controllerQItem_t controllerQMesg;
+  TickType_t waitTicks;
 
   // SETUP TIMEOUT - TIMER
   timeOutTimer = xTimerCreate("timeout", 15000 / portTICK_PERIOD_MS, pdFALSE, 0, timeOutTimerCallback);
@@ -346,7 +373,35 @@ void hydrometerTask(void *arg)
   while (true)
   {
     // RECEIVE QUEUE MESSAGE
-    r = xQueueReceive(hydroQueue, &qMesgRecv, 100 / portTICK_PERIOD_MS);
+    // Block until the next BLE event, unless the FSM has a pending state
+    // change or is retrying to connect to a discovered brick.
+    if ((next_state != state) || (hydroPendingEvents != 0))
+    {
+      waitTicks = 0;
+    }
+    else if (state == state_discovered)
+    {
+      waitTicks = HYDRO_CONNECT_RETRY_MS / portTICK_PERIOD_MS;
+    }
+    else
+    {
+      waitTicks = portMAX_DELAY;
+    }
+
+    telemetrySleep(e_tel_hydro);
+    r = xQueueReceive(hydroQueue, &qMesgRecv, waitTicks);
+    telemetryWakeup(e_tel_hydro);
+
+    if (r == pdTRUE)
+    {
+#if (CFG_TELEMETRY_LATENCY == true)
+      telemetryQueueReceive(e_tel_hydro, qMesgRecv.stampUs);
+#endif
+    }
+    else
+    {
+      r = hydroTakeEvent(&qMesgRecv) ? pdTRUE : pdFALSE;
+    }
 
     if (r == pdTRUE)
     {
@@ -446,30 +501,41 @@ void hydrometerTask(void *arg)
       {
       case e_scan_for_registered_brick:
       {
+        hydrometerQData_t *reading;
+
         controllerQMesg.valid = hydrometerDataValid;
         controllerQMesg.type = e_mtype_hydro;
         controllerQMesg.mesg.hydroMesg.mesgId = e_cmsg_hydro_reading;
+        controllerQMesg.mesg.hydroMesg.poolHandle = msgPoolAlloc();
 
-        if (hydrometerDataValid)
+        // reading is passed by reference (message pool), controller frees the slot
+        reading = (hydrometerQData_t *)msgPoolGet(controllerQMesg.mesg.hydroMesg.poolHandle);
+
+        if (reading != NULL)
         {
-          controllerQMesg.mesg.hydroMesg.data.reading.status = hydrometerDataBytes.data.status;
-          controllerQMesg.mesg.hydroMesg.data.reading.angle_x100 = hydrometerDataBytes.data.angle_x100;
-          controllerQMesg.mesg.hydroMesg.data.reading.temperature_x10 = hydrometerDataBytes.data.temperature_x10;
-          controllerQMesg.mesg.hydroMesg.data.reading.batteryVoltage_x1000 = hydrometerDataBytes.data.batteryVoltage_x1000;
-          controllerQMesg.mesg.hydroMesg.data.reading.SG_x1000 = angleToSG(hydrometerDataBytes.data.angle_x100);
-          controllerQMesg.mesg.hydroMesg.data.reading.RSSI = hydroBrickDevice.getRSSI();
+          if (hydrometerDataValid)
+          {
+            reading->status = hydrometerDataBytes.data.status;
+            reading->angle_x100 = hydrometerDataBytes.data.angle_x100;
+            reading->temperature_x10 = hydrometerDataBytes.data.temperature_x10;
+            reading->batteryVoltage_x1000 = hydrometerDataBytes.data.batteryVoltage_x1000;
+            reading->SG_x1000 = angleToSG(hydrometerDataBytes.data.angle_x100);
+            reading->RSSI = hydroBrickDevice.getRSSI();
+          }
+          else
+          {
+            memset(reading, 0, sizeof(hydrometerQData_t));
+          }
         }
         else
         {
-          controllerQMesg.mesg.hydroMesg.data.reading.status = 0;
-          controllerQMesg.mesg.hydroMesg.data.reading.angle_x100 = 0;
-          controllerQMesg.mesg.hydroMesg.data.reading.temperature_x10 = 0;
-          controllerQMesg.mesg.hydroMesg.data.reading.batteryVoltage_x1000 = 0;
-          controllerQMesg.mesg.hydroMesg.data.reading.SG_x1000 = 0;
-          controllerQMesg.mesg.hydroMesg.data.reading.RSSI = 0;
+          controllerQMesg.valid = false;
         }
 
-        controllerQueueSend(&controllerQMesg, 0);
+        if (controllerQueueSend(&controllerQMesg, 0) != pdTRUE)
+        {
+          msgPoolFree(controllerQMesg.mesg.hydroMesg.poolHandle);
+        }
       }
       break;
 
@@ -496,7 +562,14 @@ void hydrometerTask(void *arg)
   } // while (true)
 }
 
-// wrapper for sendQueue
+// wrapper for sendQueue. Policy per message :
+//  - commands (controller) : a full queue drops the command, the controller
+//    job sees the failure and retries a second later.
+//  - events (BLE callbacks, timeout timer) : the sender must not block, and
+//    the state machine must not miss a connect or timeout. An event that does
+//    not fit is kept as a pending bit per event type (data is always 0) and
+//    handled after the queued messages; a repeated event of the same type
+//    merges with it.
 int hydroQueueSend(hydroQueueItem_t *hydroQMesg, TickType_t xTicksToWait)
 {
   int r;
@@ -504,7 +577,20 @@ int hydroQueueSend(hydroQueueItem_t *hydroQMesg, TickType_t xTicksToWait)
 
   if (hydroQueue != NULL)
   {
+#if (CFG_TELEMETRY_LATENCY == true)
+    hydroQMesg->stampUs = telemetryStamp();
+#endif
     r = xQueueSend(hydroQueue, hydroQMesg, xTicksToWait);
+    telemetryQueueSend(e_tel_hydro, hydroQMesg->mesgId, r, uxQueueMessagesWaiting(hydroQueue));
+
+    if ((r != pdTRUE) && (hydroQMesg->mesgId >= e_msg_hydro_evt_device_discovered))
+    {
+      portENTER_CRITICAL(&hydroEventsMux);
+      hydroPendingEvents |= (1UL << hydroQMesg->mesgId);
+      portEXIT_CRITICAL(&hydroEventsMux);
+      ESP_LOGW(LOG_TAG, "queue full : event %d pending", hydroQMesg->mesgId);
+      r = pdTRUE;
+    }
   }
 
   return r;
@@ -521,7 +607,7 @@ void initHydroBrick(void)
   initBLE();
 
   // Create queue
-  hydroQueue = xQueueCreate(16, sizeof(hydroQueueItem_t));
+  hydroQueue = xQueueCreate(HYDRO_QUEUE_LENGTH, sizeof(hydroQueueItem_t));
   if (hydroQueue == 0)
   {
     ESP_LOGE(LOG_TAG, "Cannot create controllerQueue.");
@@ -534,6 +620,7 @@ void initHydroBrick(void)
   {
     ESP_LOGE(LOG_TAG, "Could not create task, error-code=%d", r);
   }
+  telemetryRegisterTask(e_tel_hydro, hydroTaskHandle, HYDRO_QUEUE_LENGTH);
 
 }
 
@@ -14,6 +14,7 @@
 // #include "monitor.h"
 #include "actuators.h"
 #include "display.h"
+#include "telemetry.h"
 
 #if (CFG_HYDRO_ENABLE == true)
 #include "hydrobrick.h"
@@ -29,7 +30,6 @@ configValues_t config;
 // - when file-system cannot be openened show message/go in to FATAL-mode
 // - Add mode into GUI status bar (mode=ONLINE/LOCAL/ERROR/FATAL/CONFIG)
 // - Add method (button/GUI/DRD) to enter config mode
-// - Add support for NTC sensors, using (external) ADC
 // - FIX: When tempsensor reads no value the graph will contine to draw last valid temperature...it should dislay not temperature for those measurements
 // - Add way to set the update frequency of the temperature graph
 
@@ -65,6 +65,9 @@ void setup()
   // this to prevent unwatend heating/cooling after a reboot
   powerUpActuators();
 
+  // before the tasks start, so their first wakeups are counted
+  initTelemetry();
+
 #ifdef BOARD_HAS_RGB_LED
   pinMode(RGB_LED_R, OUTPUT);
   pinMode(RGB_LED_G, OUTPUT);
@@ -0,0 +1,71 @@
+//
+//  msgpool.cpp
+//
+
+#include <Arduino.h>
+#include "msgpool.h"
+
+#define LOG_TAG "POOL"
+
+static_assert(MSGPOOL_NR_SLOTS <= 32, "MSGPOOL_NR_SLOTS > 32");
+
+// slots are 4 byte aligned, so payload structs can be used in place
+static uint32_t slots[MSGPOOL_NR_SLOTS][MSGPOOL_SLOT_SIZE / sizeof(uint32_t)];
+static uint32_t slotsInUse = 0;     // bit per slot
+static uint32_t allocFailures = 0;
+static portMUX_TYPE poolMux = portMUX_INITIALIZER_UNLOCKED;
+
+msgPoolHandle_t msgPoolAlloc(void)
+{
+  msgPoolHandle_t handle = MSGPOOL_NO_SLOT;
+
+  portENTER_CRITICAL(&poolMux);
+  for (uint8_t i = 0; i < MSGPOOL_NR_SLOTS; i++)
+  {
+    if ((slotsInUse & (1 << i)) == 0)
+    {
+      slotsInUse |= (1 << i);
+      handle = i;
+      break;
+    }
+  }
+  if (handle == MSGPOOL_NO_SLOT)
+  {
+    allocFailures++;
+  }
+  portEXIT_CRITICAL(&poolMux);
+
+  if (handle == MSGPOOL_NO_SLOT)
+  {
+    ESP_LOGE(LOG_TAG, "Message pool empty");
+  }
+
+  return handle;
+}
+
+void *msgPoolGet(msgPoolHandle_t handle)
+{
+  return (handle < MSGPOOL_NR_SLOTS) ? slots[handle] : NULL;
+}
+
+void msgPoolFree(msgPoolHandle_t handle)
+{
+  if (handle < MSGPOOL_NR_SLOTS)
+  {
+    portENTER_CRITICAL(&poolMux);
+    slotsInUse &= ~(1 << handle);
+    portEXIT_CRITICAL(&poolMux);
+  }
+}
+
+uint8_t msgPoolInUse(void)
+{
+  return __builtin_popcount(slotsInUse);
+}
+
+uint32_t msgPoolAllocFailures(void)
+{
+  return allocFailures;
+}
+
+// end of file
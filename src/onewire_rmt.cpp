@@ -0,0 +1,300 @@
+//
+//  onewire_rmt.cpp
+//
+
+#include "config.h"
+
+#if (CFG_TEMP_SENSOR_TYPE_DS18B20_ENABLED == true) && (CFG_TEMP_DS18B20_USE_RMT == true)
+
+#include <Arduino.h>
+#include <driver/rmt.h>
+#include <driver/gpio.h>
+#include <soc/rmt_periph.h>
+#include <esp_rom_gpio.h>
+#include <freertos/ringbuf.h>
+#include "onewire_rmt.h"
+
+#define LOG_TAG "OWRMT"
+
+// 80 MHz APB clock / 80 = 1 tick per microsecond
+#define OW_RMT_CLK_DIV          80
+#define OW_RMT_RX_BUFFER_SIZE   512
+#define OW_RMT_RX_TIMEOUT_MS    10
+#define OW_RMT_MAX_SYMBOLS      8
+
+OneWireRMT::OneWireRMT(void)
+{
+  rxRingBuffer = NULL;
+  initialised = false;
+  resetSearch();
+}
+
+bool OneWireRMT::begin(uint8_t gpio, int txRmtChannel, int rxRmtChannel)
+{
+  rmt_config_t txConfig = RMT_DEFAULT_CONFIG_TX((gpio_num_t)gpio, (rmt_channel_t)txRmtChannel);
+  rmt_config_t rxConfig = RMT_DEFAULT_CONFIG_RX((gpio_num_t)gpio, (rmt_channel_t)rxRmtChannel);
+  RingbufHandle_t ringBuffer;
+
+  if (initialised)
+  {
+    return true;
+  }
+
+  pin = gpio;
+  txChannel = txRmtChannel;
+  rxChannel = rxRmtChannel;
+
+  // TX : idle (released) level is high
+  txConfig.clk_div = OW_RMT_CLK_DIV;
+  txConfig.tx_config.idle_output_en = true;
+  txConfig.tx_config.idle_level = RMT_IDLE_LEVEL_HIGH;
+
+  // RX : a released line longer than OW_RX_IDLE_US ends the receive, filter glitches
+  rxConfig.clk_div = OW_RMT_CLK_DIV;
+  rxConfig.rx_config.idle_threshold = OW_RX_IDLE_US;
+  rxConfig.rx_config.filter_en = true;
+  rxConfig.rx_config.filter_ticks_thresh = 30; // APB ticks
+
+  if ((rmt_config(&txConfig) != ESP_OK) || (rmt_driver_install(txConfig.channel, 0, 0) != ESP_OK))
+  {
+    ESP_LOGE(LOG_TAG, "Cannot install RMT TX channel %d", txChannel);
+    return false;
+  }
+
+  if ((rmt_config(&rxConfig) != ESP_OK) || (rmt_driver_install(rxConfig.channel, OW_RMT_RX_BUFFER_SIZE, 0) != ESP_OK))
+  {
+    ESP_LOGE(LOG_TAG, "Cannot install RMT RX channel %d", rxChannel);
+    rmt_driver_uninstall(txConfig.channel);
+    return false;
+  }
+
+  rmt_get_ringbuf_handle(rxConfig.channel, &ringBuffer);
+  rxRingBuffer = ringBuffer;
+
+  // Configuring RX made the pin an input. Make it open-drain input/output and
+  // route the TX signal to it again, so TX drives and RX listens on one wire.
+  gpio_set_pull_mode((gpio_num_t)pin, GPIO_PULLUP_ONLY);
+  gpio_set_direction((gpio_num_t)pin, GPIO_MODE_INPUT_OUTPUT_OD);
+  esp_rom_gpio_connect_out_signal(pin, rmt_periph_signals.groups[0].channels[txChannel].tx_sig, false, false);
+
+  initialised = true;
+  ESP_LOGI(LOG_TAG, "1-Wire RMT bus on pin %d (tx=%d, rx=%d)", pin, txChannel, rxChannel);
+
+  return true;
+}
+
+// Send symbols. When lowUs != NULL the low pulses seen on the wire are
+// returned (in microseconds).
+bool OneWireRMT::transfer(const oneWireSymbol_t *symbols, uint8_t count, uint16_t *lowUs, uint8_t maxLow, uint8_t &numLow)
+{
+  rmt_item32_t items[OW_RMT_MAX_SYMBOLS];
+  rmt_item32_t *rxItems;
+  size_t rxSize;
+  bool status;
+
+  numLow = 0;
+
+  if (!initialised || (count > OW_RMT_MAX_SYMBOLS))
+  {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    items[i].level0 = 0;
+    items[i].duration0 = symbols[i].lowUs;
+    items[i].level1 = 1;
+    items[i].duration1 = symbols[i].releaseUs;
+  }
+
+  if (lowUs != NULL)
+  {
+    // drop stale receive data
+    while ((rxItems = (rmt_item32_t *)xRingbufferReceive((RingbufHandle_t)rxRingBuffer, &rxSize, 0)) != NULL)
+    {
+      vRingbufferReturnItem((RingbufHandle_t)rxRingBuffer, rxItems);
+    }
+    rmt_rx_start((rmt_channel_t)rxChannel, true);
+  }
+
+  status = (rmt_write_items((rmt_channel_t)txChannel, items, count, true) == ESP_OK);
+
+  if (lowUs != NULL)
+  {
+    rxItems = (rmt_item32_t *)xRingbufferReceive((RingbufHandle_t)rxRingBuffer, &rxSize, OW_RMT_RX_TIMEOUT_MS / portTICK_PERIOD_MS);
+    rmt_rx_stop((rmt_channel_t)rxChannel);
+
+    if (rxItems != NULL)
+    {
+      // collect durations of all low levels
+      for (size_t i = 0; i < rxSize / sizeof(rmt_item32_t); i++)
+      {
+        if ((rxItems[i].level0 == 0) && (rxItems[i].duration0 > 0) && (numLow < maxLow))
+        {
+          lowUs[numLow++] = rxItems[i].duration0;
+        }
+        if ((rxItems[i].level1 == 0) && (rxItems[i].duration1 > 0) && (numLow < maxLow))
+        {
+          lowUs[numLow++] = rxItems[i].duration1;
+        }
+      }
+      vRingbufferReturnItem((RingbufHandle_t)rxRingBuffer, rxItems);
+    }
+    else
+    {
+      status = false;
+    }
+  }
+
+  return status;
+}
+
+bool OneWireRMT::reset(void)
+{
+  oneWireSymbol_t symbol;
+  uint16_t lowUs[4];
+  uint8_t numLow;
+
+  oneWireEncodeReset(&symbol);
+
+  return transfer(&symbol, 1, lowUs, 4, numLow) && oneWireDecodePresence(lowUs, numLow);
+}
+
+bool OneWireRMT::readBits(uint8_t numBits, uint8_t &value)
+{
+  oneWireSymbol_t symbols[8];
+  uint16_t lowUs[8];
+  uint8_t numLow;
+
+  for (uint8_t i = 0; i < numBits; i++)
+  {
+    oneWireEncodeBit(1, &symbols[i]);
+  }
+
+  return transfer(symbols, numBits, lowUs, 8, numLow) && oneWireDecodeBits(lowUs, numLow, numBits, value);
+}
+
+bool OneWireRMT::write(uint8_t value)
+{
+  oneWireSymbol_t symbols[8];
+  uint8_t numLow;
+
+  oneWireEncodeByte(value, symbols);
+
+  return transfer(symbols, 8, NULL, 0, numLow);
+}
+
+bool OneWireRMT::read(uint8_t &value)
+{
+  return readBits(8, value);
+}
+
+bool OneWireRMT::select(const uint8_t *rom)
+{
+  bool status;
+
+  status = write(0x55);
+  for (uint8_t i = 0; (i < 8) && status; i++)
+  {
+    status = write(rom[i]);
+  }
+  return status;
+}
+
+bool OneWireRMT::skip(void)
+{
+  return write(0xCC);
+}
+
+void OneWireRMT::resetSearch(void)
+{
+  lastDiscrepancy = -1;
+  lastDevice = false;
+  memset(searchRom, 0, sizeof(searchRom));
+}
+
+// Search ROM (Maxim application note 187). Returns the next device on the bus.
+bool OneWireRMT::search(uint8_t *rom)
+{
+  oneWireSymbol_t symbol;
+  uint8_t bits;
+  uint8_t numLow;
+  uint8_t direction;
+  int8_t lastZero;
+
+  if (lastDevice || !reset() || !write(0xF0))
+  {
+    resetSearch();
+    return false;
+  }
+
+  lastZero = -1;
+
+  for (int8_t bitIndex = 0; bitIndex < 64; bitIndex++)
+  {
+    // bit and its complement
+    if (!readBits(2, bits) || (bits == 3))
+    {
+      // no device (left) participating
+      resetSearch();
+      return false;
+    }
+
+    if (bits != 0)
+    {
+      // all devices have the same bit
+      direction = bits & 1;
+    }
+    else
+    {
+      // discrepancy
+      if (bitIndex < lastDiscrepancy)
+      {
+        direction = (searchRom[bitIndex / 8] >> (bitIndex % 8)) & 1;
+      }
+      else
+      {
+        direction = (bitIndex == lastDiscrepancy);
+      }
+
+      if (direction == 0)
+      {
+        lastZero = bitIndex;
+      }
+    }
+
+    if (direction)
+    {
+      searchRom[bitIndex / 8] |= (1 << (bitIndex % 8));
+    }
+    else
+    {
+      searchRom[bitIndex / 8] &= ~(1 << (bitIndex % 8));
+    }
+
+    oneWireEncodeBit(direction, &symbol);
+    if (!transfer(&symbol, 1, NULL, 0, numLow))
+    {
+      // bus state unknown, the next search starts over
+      resetSearch();
+      return false;
+    }
+  }
+
+  lastDiscrepancy = lastZero;
+  lastDevice = (lastDiscrepancy == -1);
+
+  if (oneWireCrc8(searchRom, 7) != searchRom[7])
+  {
+    ESP_LOGE(LOG_TAG, "ROM CRC error");
+    resetSearch();
+    return false;
+  }
+
+  memcpy(rom, searchRom, 8);
+  return true;
+}
+
+#endif // CFG_TEMP_DS18B20_USE_RMT
+
+// end of file
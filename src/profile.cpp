@@ -0,0 +1,136 @@
+//
+//  profile.cpp
+//
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include "config.h"
+#include "profile.h"
+
+#define LOG_TAG "PROF"
+
+#define PROFILE_JSON_SIZE   2048
+
+// Profile file (LittleFS, e.g. data/profile.json with "pio run -t uploadfs"):
+//
+// {
+//   "name": "Ale",
+//   "steps": [
+//     { "type": "hold",    "temp": 18.0, "hours": 72 },
+//     { "type": "ramp",    "temp": 21.0, "hours": 24 },
+//     { "type": "wait_sg", "temp": 21.0, "sg": 1.012, "hours": 240 },
+//     { "type": "hold",    "temp": 2.0,  "minutes": 30 }
+//   ]
+// }
+//
+// Durations are "hours" and/or "minutes" (both are added), for wait_sg the
+// time-out (none when missing).
+
+static bool fsMounted = false;
+
+static bool profileStepType(const char *name, profileStepType_t *type)
+{
+  if (strcmp(name, "hold") == 0)
+  {
+    *type = e_profile_hold;
+  }
+  else if (strcmp(name, "ramp") == 0)
+  {
+    *type = e_profile_ramp;
+  }
+  else if (strcmp(name, "wait_sg") == 0)
+  {
+    *type = e_profile_wait_sg;
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+// read and check a profile file, false (and profile untouched) on any error
+bool profileLoad(const char *path, profile_t *profile)
+{
+  static profile_t loaded;
+  DynamicJsonDocument doc(PROFILE_JSON_SIZE);
+  DeserializationError error;
+  JsonArray steps;
+  File file;
+  float durationS;
+
+  if (!fsMounted)
+  {
+    return false;
+  }
+
+  file = LittleFS.open(path, "r");
+  if (!file)
+  {
+    ESP_LOGW(LOG_TAG, "no profile %s", path);
+    return false;
+  }
+  error = deserializeJson(doc, file);
+  file.close();
+  if (error)
+  {
+    ESP_LOGE(LOG_TAG, "profile %s : deserializeJson() failed: %s", path, error.f_str());
+    return false;
+  }
+
+  steps = doc["steps"].as<JsonArray>();
+  if (steps.isNull() || (steps.size() == 0) || (steps.size() > PROFILE_MAX_STEPS))
+  {
+    ESP_LOGE(LOG_TAG, "profile %s : 1..%d steps expected", path, PROFILE_MAX_STEPS);
+    return false;
+  }
+
+  memset(&loaded, 0, sizeof(loaded));
+  snprintf(loaded.name, sizeof(loaded.name), "%s", doc["name"] | "profile");
+  loaded.numSteps = 0;
+
+  for (JsonObject step : steps)
+  {
+    profileStep_t *s = &loaded.steps[loaded.numSteps];
+
+    if (!profileStepType(step["type"] | "", &s->type) || !step["temp"].is<float>())
+    {
+      ESP_LOGE(LOG_TAG, "profile %s : step %d : type or temp missing", path, loaded.numSteps + 1);
+      return false;
+    }
+
+    s->target_x10 = (int16_t)lroundf(step["temp"].as<float>() * 10.0f);
+    durationS = step["hours"].as<float>() * 3600.0f + step["minutes"].as<float>() * 60.0f;
+    if ((durationS < 0.0f) || (durationS > PROFILE_MAX_DURATION_S))
+    {
+      ESP_LOGE(LOG_TAG, "profile %s : step %d : duration out of range", path, loaded.numSteps + 1);
+      return false;
+    }
+    s->durationS = (uint32_t)durationS;
+
+    if (s->type == e_profile_wait_sg)
+    {
+      if (!step["sg"].is<float>())
+      {
+        ESP_LOGE(LOG_TAG, "profile %s : step %d : sg missing", path, loaded.numSteps + 1);
+        return false;
+      }
+      s->sg_x1000 = (uint16_t)lroundf(step["sg"].as<float>() * 1000.0f);
+    }
+    loaded.numSteps++;
+  }
+
+  *profile = loaded;
+  ESP_LOGI(LOG_TAG, "profile %s : '%s', %d steps", path, profile->name, profile->numSteps);
+  return true;
+}
+
+void initProfile(void)
+{
+  fsMounted = LittleFS.begin(false);
+  if (!fsMounted)
+  {
+    ESP_LOGW(LOG_TAG, "LittleFS not mounted (no file system uploaded ?)");
+  }
+}
@@ -4,17 +4,25 @@
 
 #include <Arduino.h>
 #include "config.h"
-#include "smooth.h"
+#include "smoothbank.h"
+#include "reportpolicy.h"
 #include "sensors.h"
 #include "controller.h"
+#include "telemetry.h"
 
 #define LOG_TAG "SENS"
 
 // SENSOR SPECIFIC INCLUDES
 
+#if (CFG_TEMP_SENSOR_TYPE_SIMULATION_ENABLED == true)
+#include "actuators.h"
+#include "thermalplant.h"
+#endif
+
 #if (CFG_TEMP_SENSOR_TYPE_DS18B20_ENABLED == true)
 #include <OneWire.h>
 #include <DallasTemperature.h>
+#include "ds18b20.h"
 #if (CFG_TEMP_SENSOR_TYPE_DS18B20_ENABLED == true)
 #if (CFG_TEMP_SENSOR_TYPE_DS18B20_CHECK_COUNTERFEIT == true)
 #include <CheckDS18B20.h>
@@ -33,8 +41,16 @@ using namespace CheckDS18B20;
 #include <SensirionI2cSht4x.h>
 #endif
 
-// Loop delay
-#define DELAY (1000)
+#if (CFG_TEMP_SENSOR_TYPE_NTC_ENABLED == true)
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#include "ntc.h"
+#endif
+
+// Smoothing channels (values per scan) : one per temperature sensor, followed by humidity
+#define SENSORS_HUMIDITY_CHANNEL (CFG_TEMP_MAX_NR_SENSORS)
+#define SENSORS_NUM_CHANNELS     (CFG_TEMP_MAX_NR_SENSORS + 1)
+#define SENSORS_QUEUE_LENGTH     5
 
 // Queues
 //static QueueHandle_t sensorsQueue = NULL;
@@ -102,28 +118,104 @@ public:
     tempInCelcius = false;
   };
 
-  bool getTemperature(float &temperature)
+  // start a measurement, result is collected by getTemperature() one sample period later
+  bool startConversion(void)
   {
-    temperature = -127;
     return true;
   }
 
+  // adapt sensor settings to sample period
+  void setSamplePeriod(uint16_t)
+  {
+  }
+
+  // number of sensors (probes) read per scan
+  uint8_t getNumSensors(void)
+  {
+    return 1;
+  }
+
+  // temperature of sensor 'index', multiplied by 10
+  bool getTemperature(uint8_t index, int16_t &temperature_x10)
+  {
+    temperature_x10 = -1270;
+    return true;
+  }
+
+  // true when the sensor also measures relative humidity
+  bool hasHumidity(void)
+  {
+    return false;
+  }
+
+  // relative humidity of last read, multiplied by 10
+  bool getHumidity(int16_t &humidity_x10)
+  {
+    humidity_x10 = 0;
+    return false;
+  }
+
 private:
   bool tempInCelcius = true;
 };
 
 #if (CFG_TEMP_SENSOR_TYPE_SIMULATION_ENABLED == true)
+static const thermalPlantParams_t simulationParams =
+{
+  CFG_SIM_WORT_KG,
+  CFG_SIM_CHAMBER_J_PER_K,
+  CFG_SIM_WORT_CHAMBER_W_PER_K,
+  CFG_SIM_CHAMBER_AMBIENT_W_PER_K,
+  CFG_SIM_AMBIENT_TEMP,
+  CFG_SIM_COOLING_W,
+  CFG_SIM_HEATING_W,
+  CFG_SIM_COMPRESSOR_TAU_S,
+  CFG_SIM_HEATER_TAU_S,
+  CFG_SIM_FERMENTATION_W,
+  CFG_SIM_SENSOR_NOISE
+};
+
+// Fermentation chamber model, closed loop with the actual relay states.
+// Sensor 0 is the wort, sensor 1 the chamber air.
 class temperatureSensorSimulator : public temperatureSensorBase
 {
+private:
+  ThermalPlant plant;
+  uint16_t samplePeriodMs;
+
 public:
+  temperatureSensorSimulator() : plant(simulationParams, CFG_SIM_START_TEMP, CFG_SIM_SEED)
+  {
+    samplePeriodMs = CFG_TEMP_SAMPLE_PERIOD_MS;
+  }
+
   bool init(void)
   {
     return true;
   }
 
-  bool getTemperature(float &temperature)
+  void setSamplePeriod(uint16_t periodMs)
+  {
+    samplePeriodMs = periodMs;
+  }
+
+  uint8_t getNumSensors(void)
   {
-    temperature = 5.0 + rand() * 30.0 / RAND_MAX;
+    return 2;
+  }
+
+  bool getTemperature(uint8_t index, int16_t &temperature_x10)
+  {
+    uint16_t relays;
+
+    // one scan : advance model by one sample period
+    if (index == 0)
+    {
+      relays = getActuatorsActual();
+      plant.step(samplePeriodMs, (relays >> CFG_SIM_COOL_RELAY) & 1, (relays >> CFG_SIM_HEAT_RELAY) & 1);
+    }
+
+    temperature_x10 = (index == 0) ? plant.getWortSensor_x10() : plant.getChamberSensor_x10();
     return true;
   }
 };
@@ -133,11 +225,20 @@ public:
 class temperatureSensorDS18B20 : public temperatureSensorBase
 {
 private:
+#if (CFG_TEMP_DS18B20_USE_RMT == true)
+  OneWireRMT oneWire;
+#else
   OneWire oneWire;
   DallasTemperature sensors;
+#endif
   uint8_t numSensors;
+  uint8_t resolution;
 
-#if (CFG_TEMP_SENSOR_TYPE_DS18B20_CHECK_COUNTERFEIT == true)
+  // Per probe : ROM address (enumerated once at init) & health
+  DeviceAddress addresses[CFG_TEMP_MAX_NR_SENSORS];
+  uint8_t errorCount[CFG_TEMP_MAX_NR_SENSORS];
+
+#if (CFG_TEMP_SENSOR_TYPE_DS18B20_CHECK_COUNTERFEIT == true) && (CFG_TEMP_DS18B20_USE_RMT == false)
   void checkDS18B20Counterfeit()
   {
     CheckDS18B20::DS18B20_family_enum result;
@@ -156,21 +257,118 @@ private:
   }
 #endif
 
+#if (CFG_TEMP_DS18B20_USE_RMT == true)
+  // Transport on RMT peripheral : the DS18B20 commands are sent directly
+
+  uint16_t millisToWaitForConversion(uint8_t bits)
+  {
+    return ds18b20ConversionMs(bits);
+  }
+
+  // enumerate bus, cache ROM addresses of DS18B20 probes
+  void searchSensors(void)
+  {
+    oneWire.resetSearch();
+    while ((numSensors < CFG_TEMP_MAX_NR_SENSORS) && oneWire.search(addresses[numSensors]))
+    {
+      if (addresses[numSensors][0] == DS18B20MODEL)
+      {
+        numSensors++;
+      }
+    }
+  }
+
+  // Write Scratchpad on all probes (TH, TL, configuration)
+  bool writeResolution(uint8_t bits)
+  {
+    return oneWire.reset() && oneWire.skip() &&
+           oneWire.write(DS18B20_WRITE_SCRATCH) && oneWire.write(0x4B) && oneWire.write(0x46) &&
+           oneWire.write(ds18b20ConfigByte(bits));
+  }
+
+  // Read Scratchpad of one probe, returns temperature in 1/128 degrees Celcius
+  bool readTemperatureRaw(uint8_t index, int32_t &raw)
+  {
+    uint8_t scratchPad[9];
+    bool status;
+
+    status = oneWire.reset() && oneWire.select(addresses[index]) && oneWire.write(DS18B20_READ_SCRATCH);
+
+    for (uint8_t i = 0; (i < sizeof(scratchPad)) && status; i++)
+    {
+      status = oneWire.read(scratchPad[i]);
+    }
+
+    status = status && ds18b20DecodeScratchpad(scratchPad, raw);
+    if (!status)
+    {
+      raw = DEVICE_DISCONNECTED_RAW;
+    }
+
+    return status;
+  }
+#else
+  uint16_t millisToWaitForConversion(uint8_t bits)
+  {
+    return sensors.millisToWaitForConversion(bits);
+  }
+
+  // enumerate bus, cache ROM addresses of DS18B20 probes
+  void searchSensors(void)
+  {
+    for (uint8_t i = 0; (i < sensors.getDeviceCount()) && (numSensors < CFG_TEMP_MAX_NR_SENSORS); i++)
+    {
+      if (sensors.getAddress(addresses[numSensors], i) && sensors.validFamily(addresses[numSensors]))
+      {
+        numSensors++;
+      }
+    }
+  }
+
+  bool writeResolution(uint8_t bits)
+  {
+    sensors.setResolution(bits);
+    return true;
+  }
+
+  bool readTemperatureRaw(uint8_t index, int32_t &raw)
+  {
+    raw = sensors.getTemp(addresses[index]); // 1/128 degrees Celcius, scratchpad is CRC checked
+    return (raw != DEVICE_DISCONNECTED_RAW);
+  }
+#endif
+
 public:
   bool init(void)
   {
     bool status;
-    uint16_t millisForConversion;
 
     status = false;
+    numSensors = 0;
+    resolution = CFG_TEMP_DS18B20_MAX_RESOLUTION;
+
+#if (CFG_TEMP_DS18B20_USE_RMT == true)
+    if (oneWire.begin(CFG_TEMP_PIN, CFG_TEMP_RMT_TX_CHANNEL, CFG_TEMP_RMT_RX_CHANNEL))
+    {
+      searchSensors();
+    }
+#else
     oneWire.begin(CFG_TEMP_PIN);
     sensors.setOneWire(&oneWire);
 
     sensors.begin();
-    sensors.setResolution(12);
-    sensors.setWaitForConversion(true);
-    millisForConversion = sensors.millisToWaitForConversion();
-    numSensors = sensors.getDS18Count();
+    sensors.setWaitForConversion(false); // do not block, conversion is collected next sample period
+    searchSensors();
+#endif
+    writeResolution(resolution);
+
+    for (uint8_t i = 0; i < numSensors; i++)
+    {
+      ESP_LOGI(LOG_TAG, "DS18B20 sensor %d : %02X%02X%02X%02X%02X%02X%02X%02X", i,
+               addresses[i][0], addresses[i][1], addresses[i][2], addresses[i][3],
+               addresses[i][4], addresses[i][5], addresses[i][6], addresses[i][7]);
+      errorCount[i] = 0;
+    }
 
     ESP_LOGI(LOG_TAG, "Number of DS18B20 sensors found=%d", numSensors);
 
@@ -178,10 +376,12 @@ public:
     {
       status = true;
 
+#if (CFG_TEMP_DS18B20_USE_RMT == false)
       ESP_LOGI(LOG_TAG, "isParasitePowerMode()=%d\n", sensors.isParasitePowerMode());
-      ESP_LOGI(LOG_TAG, "millisToWaitForConversion()=%d\n", millisForConversion);
+#endif
+      ESP_LOGI(LOG_TAG, "millisToWaitForConversion()=%d\n", millisToWaitForConversion(resolution));
 
-#if (CFG_TEMP_SENSOR_TYPE_DS18B20_CHECK_COUNTERFEIT == true)
+#if (CFG_TEMP_SENSOR_TYPE_DS18B20_CHECK_COUNTERFEIT == true) && (CFG_TEMP_DS18B20_USE_RMT == false)
       checkDS18B20Counterfeit();
 #endif
     }
@@ -189,37 +389,115 @@ public:
     return status;
   };
 
-  bool getTemperature(float &temperature)
+  // Use highest resolution of which the conversion fits in the sample period
+  void setSamplePeriod(uint16_t periodMs)
+  {
+    uint8_t bits;
+
+    bits = ds18b20ResolutionForPeriod(periodMs, CFG_TEMP_DS18B20_MAX_RESOLUTION);
+
+    if (bits != resolution)
+    {
+      resolution = bits;
+      writeResolution(resolution);
+      ESP_LOGI(LOG_TAG, "DS18B20 resolution=%d bits (sample period=%d ms)", resolution, periodMs);
+    }
+  }
+
+  // start conversion on all probes (broadcast), without waiting for the result
+  bool startConversion(void)
   {
     bool status;
 
     status = false;
-    temperature = DEVICE_DISCONNECTED_C;
 
     if (numSensors > 0)
     {
-      sensors.requestTemperaturesByIndex(0);
-      vTaskDelay(sensors.millisToWaitForConversion() / portTICK_PERIOD_MS);
+#if (CFG_TEMP_DS18B20_USE_RMT == true)
+      status = oneWire.reset() && oneWire.skip() && oneWire.write(DS18B20_CONVERT_T);
+#else
+      sensors.requestTemperatures();
+      status = true;
+#endif
+    }
+
+    return status;
+  }
+
+  uint8_t getNumSensors(void)
+  {
+    return numSensors;
+  }
+
+  // collect result of conversion started one sample period ago, read by ROM address
+  bool getTemperature(uint8_t index, int16_t &temperature_x10)
+  {
+    bool status;
+    int32_t raw;
+
+    status = false;
+    temperature_x10 = 0;
+
+    if (index < numSensors)
+    {
+      status = readTemperatureRaw(index, raw);
 
+      if (status)
+      {
 #ifdef CFG_TEMP_IN_CELCIUS
-      temperature = sensors.getTempCByIndex(0);
-      status = (temperature != DEVICE_DISCONNECTED_C);
+        temperature_x10 = (raw * 10) / 128;
 #elif CFG_TEMP_IN_FARENHEID
-      temperature = sensors.getTempFByIndex(0);
-      tempError = (tempSens == DEVICE_DISCONNECTED_F);
+        temperature_x10 = (raw * 18) / 128 + 320;
 #endif
+        if (errorCount[index] >= CFG_TEMP_SENSOR_MAX_ERRORS)
+        {
+          ESP_LOGI(LOG_TAG, "DS18B20 sensor %d recovered", index);
+        }
+        errorCount[index] = 0;
+      }
+      else
+      {
+        if (errorCount[index] < CFG_TEMP_SENSOR_MAX_ERRORS)
+        {
+          errorCount[index]++;
+          if (errorCount[index] == CFG_TEMP_SENSOR_MAX_ERRORS)
+          {
+            ESP_LOGE(LOG_TAG, "DS18B20 sensor %d failed", index);
+          }
+        }
+      }
     }
+
     return status;
   }
 };
 #endif
 
 #if (CFG_TEMP_SENSOR_TYPE_SHT3X_ENABLED == true)
+// Periodic measurement mode : the sensor measures on its own, a read only
+// fetches the latest result (temperature + humidity) in one short I2C transaction.
 class temperatureSensorSHT3x : public temperatureSensorBase
 {
 private:
   SensirionI2cSht3x sensor;
   char errorMessage[64];
+  Mps mps;
+  int16_t humidity_x10;
+  bool humidityValid;
+
+  bool startPeriodicMeasurement(void)
+  {
+    int16_t error;
+
+    error = sensor.startPeriodicMeasurement(REPEATABILITY_MEDIUM, mps);
+    if (error != NO_ERROR)
+    {
+      errorToString(error, errorMessage, sizeof errorMessage);
+      ESP_LOGE(LOG_TAG, "Sensor error: %s", errorMessage);
+    }
+
+    return (error == NO_ERROR);
+  }
 
 public:
   bool init(void)
@@ -237,18 +515,67 @@ public:
     status = (sensor.softReset() == 0);
     vTaskDelay(100 / portTICK_PERIOD_MS);
 
+    humidityValid = false;
+    mps = MPS_TWO_PER_SECOND;
+    status = status && startPeriodicMeasurement();
+
     return status;
   }
 
-  bool getTemperature(float &temperature)
+  // Measure at least twice per sample period, so a new result is always
+  // buffered when it is fetched. Lower rates give less self heating.
+  void setSamplePeriod(uint16_t periodMs)
   {
-    static bool status;
-    static int16_t error;
-    static float humidity;
+    Mps newMps;
+
+    if (periodMs >= 4000)
+    {
+      newMps = MPS_HALF_PER_SECOND;
+    }
+    else if (periodMs >= 2000)
+    {
+      newMps = MPS_ONE_PER_SECOND;
+    }
+    else if (periodMs >= 1000)
+    {
+      newMps = MPS_TWO_PER_SECOND;
+    }
+    else if (periodMs >= 500)
+    {
+      newMps = MPS_FOUR_PER_SECOND;
+    }
+    else
+    {
+      newMps = MPS_TEN_PER_SECOND;
+    }
+
+    if (newMps != mps)
+    {
+      mps = newMps;
+      sensor.stopMeasurement();
+      vTaskDelay(1 / portTICK_PERIOD_MS);
+      startPeriodicMeasurement();
+      ESP_LOGI(LOG_TAG, "SHT3x periodic measurement, mps=%d (sample period=%d ms)", mps, periodMs);
+    }
+  }
+
+  uint8_t getNumSensors(void)
+  {
+    return 1;
+  }
+
+  // fetch latest buffered result, humidity is kept for getHumidity()
+  bool getTemperature(uint8_t index, int16_t &temperature_x10)
+  {
+    bool status;
+    int16_t error;
+    uint16_t temperatureTicks;
+    uint16_t humidityTicks;
 
     status = false;
+    humidityValid = false;
 
-    error = sensor.measureSingleShot(REPEATABILITY_MEDIUM, false, temperature, humidity);
+    error = sensor.readMeasurement(temperatureTicks, humidityTicks);
     if (error != NO_ERROR)
     {
       errorToString(error, errorMessage, sizeof errorMessage);
@@ -256,21 +583,56 @@ public:
     }
     else
     {
+      temperature_x10 = sensor.signalTemperature(temperatureTicks) * 10;
+      humidity_x10 = sensor.signalHumidity(humidityTicks) * 10;
+      humidityValid = true;
       status = true;
     }
 
     return status;
   }
+
+  bool hasHumidity(void)
+  {
+    return true;
+  }
+
+  bool getHumidity(int16_t &humidity)
+  {
+    humidity = humidity_x10;
+    return humidityValid;
+  }
 };
 #endif
 
 #if (CFG_TEMP_SENSOR_TYPE_SHT4X_ENABLED == true)
+// The SHT4x has no periodic mode. The measurement command is sent by
+// startConversion() and the result is read one sample period later, so no
+// I2C transaction waits for the measurement to finish.
+#define SHT4X_CMD_MEASURE_HIGH_PRECISION 0xFD
+
 class temperatureSensorSHT4x : public temperatureSensorBase
 {
 private:
   SensirionI2cSht4x sensor;
-  int16_t error;
-  char errorMessage[64];
+  int16_t humidity_x10;
+  bool humidityValid;
+
+  // Sensirion CRC8 (polynomial 0x31, init 0xFF) of one data word
+  uint8_t crc8(const uint8_t *data)
+  {
+    uint8_t crc = 0xFF;
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+      crc ^= data[i];
+      for (uint8_t bit = 0; bit < 8; bit++)
+      {
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1);
+      }
+    }
+    return crc;
+  }
 
 public:
   bool init(void)
@@ -283,31 +645,255 @@ public:
     Wire.begin();
 #endif
 
-    sensor.begin(Wire, SHT30_I2C_ADDR_44);
+    sensor.begin(Wire, SHT40_I2C_ADDR_44);
     status = (sensor.softReset() == 0);
     vTaskDelay(10 / portTICK_PERIOD_MS);
 
+    humidityValid = false;
+
     return status;
   }
 
-  bool getTemperature(float &temperature)
+  uint8_t getNumSensors(void)
+  {
+    return 1;
+  }
+
+  bool startConversion(void)
+  {
+    Wire.beginTransmission(SHT40_I2C_ADDR_44);
+    Wire.write(SHT4X_CMD_MEASURE_HIGH_PRECISION);
+
+    return (Wire.endTransmission() == 0);
+  }
+
+  // read result of measurement started one sample period ago, humidity is kept for getHumidity()
+  bool getTemperature(uint8_t index, int16_t &temperature_x10)
   {
-    static bool status;
-    static float humidity;
+    bool status;
+    uint8_t data[6];
+    int32_t ticks;
 
     status = false;
+    humidityValid = false;
 
-    error = sensor.measureHighPrecision(temperature, humidity);
-    if (error != NO_ERROR)
+    if (Wire.requestFrom((uint8_t)SHT40_I2C_ADDR_44, (uint8_t)sizeof(data)) == sizeof(data))
     {
-      errorToString(error, errorMessage, sizeof errorMessage);
-      ESP_LOGE(LOG_TAG, "Sensor error: %s", errorMessage);
+      for (uint8_t i = 0; i < sizeof(data); i++)
+      {
+        data[i] = Wire.read();
+      }
+
+      if ((crc8(&data[0]) == data[2]) && (crc8(&data[3]) == data[5]))
+      {
+        // T = -45 + 175 * ticks / 65535, RH = -6 + 125 * ticks / 65535
+        ticks = (data[0] << 8) | data[1];
+        temperature_x10 = -450 + (1750 * ticks) / 65535;
+
+        ticks = (data[3] << 8) | data[4];
+        humidity_x10 = -60 + (1250 * ticks) / 65535;
+        humidity_x10 = (humidity_x10 < 0) ? 0 : (humidity_x10 > 1000) ? 1000 : humidity_x10;
+
+        humidityValid = true;
+        status = true;
+      }
+      else
+      {
+        ESP_LOGE(LOG_TAG, "Sensor error: CRC");
+      }
     }
     else
     {
-      status = true;
+      ESP_LOGE(LOG_TAG, "Sensor error: no data");
+    }
+
+    return status;
+  }
+
+  bool hasHumidity(void)
+  {
+    return true;
+  }
+
+  bool getHumidity(int16_t &humidity)
+  {
+    humidity = humidity_x10;
+    return humidityValid;
+  }
+};
+#endif
+
+#if (CFG_TEMP_SENSOR_TYPE_NTC_ENABLED == true)
+static_assert(CFG_NTC_NR_CHANNELS <= CFG_TEMP_MAX_NR_SENSORS, "CFG_NTC_NR_CHANNELS > CFG_TEMP_MAX_NR_SENSORS");
+
+#define NTC_DMA_FRAME_BYTES   256   // conversion results per DMA interrupt (4 bytes each)
+#define NTC_DMA_BUFFER_BYTES  4096  // about one second of conversions at 1 kHz
+
+static const adc1_channel_t ntcChannels[CFG_NTC_NR_CHANNELS] = CFG_NTC_ADC_CHANNELS;
+
+// Steinhart-Hart coefficients, used at compile time for the lookup table
+struct ntcProbe
+{
+  static constexpr double A = CFG_NTC_SH_A;
+  static constexpr double B = CFG_NTC_SH_B;
+  static constexpr double C = CFG_NTC_SH_C;
+  static constexpr double seriesOhm = CFG_NTC_SERIES_OHM;
+};
+
+// The ADC samples all NTC channels continuously, results are written to a
+// buffer by DMA. Each scan averages all results buffered since the previous
+// scan (oversampling) and converts the average with the lookup table.
+class temperatureSensorNTC : public temperatureSensorBase
+{
+private:
+  esp_adc_cal_characteristics_t adcChars;
+  bool started = false;
+  uint32_t sampleSum[CFG_NTC_NR_CHANNELS];
+  uint16_t sampleCount[CFG_NTC_NR_CHANNELS];
+  uint8_t frame[NTC_DMA_FRAME_BYTES];
+
+  // read all buffered conversion results, sum per channel
+  void collectSamples(void)
+  {
+    esp_err_t ret;
+    uint32_t length;
+
+    for (uint8_t c = 0; c < CFG_NTC_NR_CHANNELS; c++)
+    {
+      sampleSum[c] = 0;
+      sampleCount[c] = 0;
+    }
+
+    do
+    {
+      // ESP_ERR_INVALID_STATE : buffer was full, oldest results are lost
+      ret = adc_digi_read_bytes(frame, sizeof(frame), &length, 0);
+
+      for (uint32_t n = 0; n + SOC_ADC_DIGI_RESULT_BYTES <= length; n += SOC_ADC_DIGI_RESULT_BYTES)
+      {
+        adc_digi_output_data_t *result = (adc_digi_output_data_t *)&frame[n];
+
+        for (uint8_t c = 0; c < CFG_NTC_NR_CHANNELS; c++)
+        {
+          if ((result->type2.unit == 0) && (result->type2.channel == ntcChannels[c]))
+          {
+            sampleSum[c] += result->type2.data;
+            sampleCount[c]++;
+          }
+        }
+      }
+    } while (((ret == ESP_OK) || (ret == ESP_ERR_INVALID_STATE)) && (length > 0));
+  }
+
+public:
+  bool init(void)
+  {
+    adc_digi_init_config_t dmaConfig;
+    adc_digi_configuration_t digiConfig;
+    adc_digi_pattern_config_t pattern[CFG_NTC_NR_CHANNELS];
+
+    if (started)
+    {
+      return true;
+    }
+
+    memset(&dmaConfig, 0, sizeof(dmaConfig));
+    memset(&digiConfig, 0, sizeof(digiConfig));
+    memset(pattern, 0, sizeof(pattern));
+
+    dmaConfig.max_store_buf_size = NTC_DMA_BUFFER_BYTES;
+    dmaConfig.conv_num_each_intr = NTC_DMA_FRAME_BYTES;
+
+    for (uint8_t c = 0; c < CFG_NTC_NR_CHANNELS; c++)
+    {
+      dmaConfig.adc1_chan_mask |= (1 << ntcChannels[c]);
+
+      pattern[c].atten = ADC_ATTEN_DB_11;
+      pattern[c].channel = ntcChannels[c];
+      pattern[c].unit = 0; // ADC1
+      pattern[c].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+
+    digiConfig.conv_limit_en = false;
+    digiConfig.conv_limit_num = 250;
+    digiConfig.pattern_num = CFG_NTC_NR_CHANNELS;
+    digiConfig.adc_pattern = pattern;
+    digiConfig.sample_freq_hz = CFG_NTC_SAMPLE_FREQ_HZ;
+    digiConfig.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    digiConfig.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+
+    if (adc_digi_initialize(&dmaConfig) != ESP_OK)
+    {
+      ESP_LOGE(LOG_TAG, "Cannot initialise ADC DMA");
+      return false;
+    }
+
+    if ((adc_digi_controller_configure(&digiConfig) != ESP_OK) || (adc_digi_start() != ESP_OK))
+    {
+      ESP_LOGE(LOG_TAG, "Cannot start continuous ADC");
+      adc_digi_deinitialize();
+      return false;
+    }
+
+    esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &adcChars);
+    started = true;
+
+    ESP_LOGI(LOG_TAG, "NTC: %d channels, %d conversions/s", CFG_NTC_NR_CHANNELS, CFG_NTC_SAMPLE_FREQ_HZ);
+
+    return true;
+  }
+
+  uint8_t getNumSensors(void)
+  {
+    return CFG_NTC_NR_CHANNELS;
+  }
+
+  // average of the samples of one period, converted by lookup table (integer only)
+  bool getTemperature(uint8_t index, int16_t &temperature_x10)
+  {
+    bool status;
+    uint32_t raw16;
+    uint32_t mv0;
+    uint32_t mv1;
+    uint32_t mv16;
+    uint32_t ratio16;
+
+    temperature_x10 = 0;
+
+    if (index >= CFG_NTC_NR_CHANNELS)
+    {
+      return false;
+    }
+
+    // one scan : collect samples of all channels once
+    if (index == 0)
+    {
+      collectSamples();
+    }
+
+    if (sampleCount[index] == 0)
+    {
+      return false;
     }
 
+    // oversampled ADC reading, 4 extra bits
+    raw16 = (sampleSum[index] << 4) / sampleCount[index];
+
+    // calibrated voltage (mV * 16), interpolated between whole ADC readings
+    mv0 = esp_adc_cal_raw_to_voltage(raw16 >> 4, &adcChars);
+    mv1 = esp_adc_cal_raw_to_voltage((raw16 >> 4) + 1, &adcChars);
+    mv16 = (mv0 << 4) + (mv1 - mv0) * (raw16 & 0x0F);
+
+    // divider ratio * 65536
+    ratio16 = (mv16 << 12) / CFG_NTC_SUPPLY_MV;
+    ratio16 = (ratio16 > 0xFFFF) ? 0xFFFF : ratio16;
+
+    status = NtcLut<ntcProbe, CFG_NTC_LUT_SEGMENTS_LOG2>::temperature_x10(ratio16, temperature_x10);
+
+#ifdef CFG_TEMP_IN_FARENHEID
+    temperature_x10 = (temperature_x10 * 9) / 5 + 320;
+#endif
+
     return status;
   }
 };
@@ -317,15 +903,111 @@ public:
 // SENSORS TASK
 // ============================================================================
 
+// SAMPLING PROFILES
+// Sample period and report rate are set separately, the samples of a report
+// interval are decimated here, so only one value per report goes downstream.
+
+typedef enum
+{
+  e_decimate_mean,
+  e_decimate_min,
+  e_decimate_max
+} sensorsDecimation_t;
+
+typedef struct
+{
+  uint16_t samplePeriodMs;
+  uint16_t reportEvery;               // samples per report
+  sensorsDecimation_t decimation;
+} sensorsProfileSettings_t;
+
+// indexed by sensorsProfile_t
+static const sensorsProfileSettings_t sensorsProfiles[e_sensors_profile_count] =
+{
+  { CFG_TEMP_SAMPLE_PERIOD_MS, 1, e_decimate_mean },   // e_sensors_profile_default
+  { 100, 10, e_decimate_mean },                        // e_sensors_profile_mash : 10 Hz sampling, 1 Hz reporting
+  { 100, 10, e_decimate_max },                         // e_sensors_profile_boil : 10 Hz sampling, 1 Hz reporting
+  { 1000, 10, e_decimate_mean }                        // e_sensors_profile_fermentation : 1 Hz sampling, 0.1 Hz reporting
+};
+
+typedef struct
+{
+  int32_t sum[SENSORS_NUM_CHANNELS];
+  int16_t min[SENSORS_NUM_CHANNELS];
+  int16_t max[SENSORS_NUM_CHANNELS];
+  uint16_t count[SENSORS_NUM_CHANNELS];
+} sensorsDecimator_t;
+
+static void decimatorReset(sensorsDecimator_t *decimator)
+{
+  for (uint8_t i = 0; i < SENSORS_NUM_CHANNELS; i++)
+  {
+    decimator->sum[i] = 0;
+    decimator->min[i] = INT16_MAX;
+    decimator->max[i] = INT16_MIN;
+    decimator->count[i] = 0;
+  }
+}
+
+static void decimatorAdd(sensorsDecimator_t *decimator, uint8_t channel, int16_t value)
+{
+  decimator->sum[channel] += value;
+  decimator->min[channel] = (value < decimator->min[channel]) ? value : decimator->min[channel];
+  decimator->max[channel] = (value > decimator->max[channel]) ? value : decimator->max[channel];
+  decimator->count[channel]++;
+}
+
+// returns false (value unchanged) when channel had no samples
+static bool decimatorGet(sensorsDecimator_t *decimator, uint8_t channel, sensorsDecimation_t decimation, int16_t &value)
+{
+  if (decimator->count[channel] == 0)
+  {
+    return false;
+  }
+
+  switch (decimation)
+  {
+  case e_decimate_min:
+    value = decimator->min[channel];
+    break;
+  case e_decimate_max:
+    value = decimator->max[channel];
+    break;
+  case e_decimate_mean:
+  default:
+    value = decimator->sum[channel] / decimator->count[channel];
+    break;
+  }
+
+  return true;
+}
+
 static void sensorsTask(void *arg)
 {
-  static float tempSens = 0.0;
-  static int tempSmooth = 0;
+  static int16_t reportValue[SENSORS_NUM_CHANNELS];
+  static bool reportValid[SENSORS_NUM_CHANNELS];
   static bool tempInitValid = false;
-  static bool tempSensValid = false;
-  static bool tempSmoothValid = false;
+  static bool conversionStarted = false;
+  static uint8_t numSensors = 0;
+  static uint8_t numValid;
+  static TickType_t lastWakeTime;
   static controllerQItem_t qControllerMesg;
-  static Smooth<CFG_TEMP_SMOOTH_NUM_SAMPLES> smooth;
+  static SmoothBank<SENSORS_NUM_CHANNELS, CFG_TEMP_SMOOTH_NUM_SAMPLES> smooth;
+  static int16_t scanValues[SENSORS_NUM_CHANNELS];
+  static bool scanValid[SENSORS_NUM_CHANNELS];
+  static uint8_t profileRequest;
+  static sensorsProfileSettings_t profile;
+  static sensorsDecimator_t decimator;
+  // unchanged values are not reported, see reportpolicy.h
+  static ReportPolicy<SENSORS_NUM_CHANNELS> reporter(CFG_TEMP_REPORT_DEADBAND, CFG_TEMP_REPORT_MIN_INTERVAL_MS, CFG_TEMP_REPORT_HEARTBEAT_MS);
+  static uint16_t numSamples;         // samples in current report interval
+  static int64_t busyStart;
+  static uint32_t statReads = 0;      // sensor reads
+  static uint32_t statErrors = 0;     // failed sensor reads
+  static uint32_t statScans = 0;
+  static int64_t statBusyUs = 0;      // time spent in sensor access (collect + start)
+  static uint32_t statSent = 0;       // reports sent to controller
+  static uint32_t statSuppressed = 0; // reports suppressed by reporting policy
 
 #if (CFG_TEMP_SENSOR_TYPE_SIMULATION_ENABLED == true)
   static temperatureSensorSimulator sensor;
@@ -335,57 +1017,190 @@ static void sensorsTask(void *arg)
   static temperatureSensorSHT3x sensor;
 #elif (CFG_TEMP_SENSOR_TYPE_SHT4X_ENABLED == true)
   static temperatureSensorSHT4x sensor;
+#elif (CFG_TEMP_SENSOR_TYPE_NTC_ENABLED == true)
+  static temperatureSensorNTC sensor;
 #else
 
 #endif
 
   smooth.setMaxDeviation(CFG_TEMP_SMOOTH_MAX_DEVIATION); // 1 degree
+  smooth.setMaxDeviation(SENSORS_HUMIDITY_CHANNEL, CFG_HUMIDITY_SMOOTH_MAX_DEVIATION);
+
+  for (uint8_t i = 0; i < SENSORS_NUM_CHANNELS; i++)
+  {
+    reportValue[i] = 0;
+    reportValid[i] = false;
+    scanValid[i] = false;
+  }
+
+  profile = sensorsProfiles[CFG_TEMP_SENSOR_PROFILE];
+  decimatorReset(&decimator);
+  reporter.reset();
+  numSamples = 0;
 
   tempInitValid = false;
-  tempSensValid = false;
-  tempSmoothValid = false;
+  conversionStarted = false;
+
+  lastWakeTime = xTaskGetTickCount();
 
   // TASK LOOP
+  // Conversions are pipelined : each period first collects the result of the
+  // conversion started in the previous period and then starts the next one.
+  // The task wakes at a fixed rate, so samples are equally spaced.
+  // Every profile.reportEvery samples the decimated values are reported.
   while (true)
   {
-    // If sensor(s) not initialised yet, or there is a sensor error --> Initialise sensor
-    if ((tempInitValid == false) || (tempSensValid == false))
+    // Switch sampling profile (requested through the controller)
+    if (xQueueReceive(sensorsQueue, &profileRequest, 0) == pdTRUE)
+    {
+      if (profileRequest < e_sensors_profile_count)
+      {
+        profile = sensorsProfiles[profileRequest];
+        sensor.setSamplePeriod(profile.samplePeriodMs);
+        decimatorReset(&decimator);
+        numSamples = 0;
+
+        ESP_LOGI(LOG_TAG, "Sensor profile %d: sample period=%d ms, report every %d samples, decimation=%d",
+                 profileRequest, profile.samplePeriodMs, profile.reportEvery, profile.decimation);
+      }
+      else
+      {
+        ESP_LOGE(LOG_TAG, "Unknown sensor profile %d", profileRequest);
+      }
+    }
+
+    // If sensor(s) not initialised yet, or all sensors failed --> Initialise sensor(s)
+    if (tempInitValid == false)
     {
       tempInitValid = sensor.init();
-      ESP_LOGI(LOG_TAG,"Temp sensor init: %d", tempInitValid);
+      sensor.setSamplePeriod(profile.samplePeriodMs);
+      conversionStarted = false;
+
+      numSensors = tempInitValid ? sensor.getNumSensors() : 0;
+      if (numSensors > SENSORS_NUM_CHANNELS)
+      {
+        numSensors = SENSORS_NUM_CHANNELS;
+      }
+
+      ESP_LOGI(LOG_TAG,"Temp sensor init: %d, number of sensors: %d", tempInitValid, numSensors);
+
+      qControllerMesg.type = e_mtype_sensor;
+      qControllerMesg.mesg.sensorMesg.mesgId = e_msg_sensor_numSensors;
+      qControllerMesg.mesg.sensorMesg.number = 0;
+      qControllerMesg.mesg.sensorMesg.data = numSensors;
+      qControllerMesg.valid = tempInitValid;
+      controllerQueueSend(&qControllerMesg, 0);
     }
 
-    // If there is a sensor initialised --> Measure temperature
+    // If there is a sensor initialised --> Collect temperatures & start next conversion
     if (tempInitValid)
     {
-      tempSensValid = sensor.getTemperature(tempSens);
+      busyStart = esp_timer_get_time();
 
-      if (tempSensValid)
+      if (conversionStarted)
       {
-        // smooth measured temp * 10 (1 digit accuracy)
-        smooth.setValue(tempSens * 10);
+        numValid = 0;
+        for (uint8_t i = 0; i < CFG_TEMP_MAX_NR_SENSORS; i++)
+        {
+          scanValid[i] = (i < numSensors) && sensor.getTemperature(i, scanValues[i]);
+          numValid += scanValid[i];
+        }
+        scanValid[SENSORS_HUMIDITY_CHANNEL] = sensor.getHumidity(scanValues[SENSORS_HUMIDITY_CHANNEL]);
+        statReads += numSensors;
+        statErrors += numSensors - numValid;
+
+        // smooth measured temps * 10 (1 digit accuracy), whole scan in one call
+        smooth.setValues(scanValues, scanValid);
+
+        // decimate valid smoothed values until next report
+        for (uint8_t i = 0; i < SENSORS_NUM_CHANNELS; i++)
+        {
+          if (scanValid[i] && smooth.isValid(i))
+          {
+            decimatorAdd(&decimator, i, smooth.getValue(i));
+          }
+        }
 
-        if (smooth.isValid())
+        if (numValid == 0)
         {
-          tempSmooth = smooth.getValue();
-          tempSmoothValid = true;
+          ESP_LOGE(LOG_TAG,"Invbalid temperature measurement");
+          tempInitValid = false; // re-initialise sensor(s)
         }
       }
-      else
+
+      conversionStarted = tempInitValid && sensor.startConversion();
+
+      statBusyUs += esp_timer_get_time() - busyStart;
+      statScans++;
+
+#if (CFG_TEMP_STATS_INTERVAL > 0)
+      if (statScans == CFG_TEMP_STATS_INTERVAL)
       {
-        ESP_LOGE(LOG_TAG,"Invbalid temperature measurement");
+        ESP_LOGI(LOG_TAG, "Sensor stats: %u reads, %u errors, %u us per scan, %u reports sent, %u suppressed",
+                 statReads, statErrors, (uint32_t)(statBusyUs / statScans), statSent, statSuppressed);
+        statReads = 0;
+        statErrors = 0;
+        statSent = 0;
+        statSuppressed = 0;
+        statScans = 0;
+        statBusyUs = 0;
       }
+#endif
     }
 
-    // Always send temperature + valid-flag to controller-queue
-    qControllerMesg.type = e_mtype_sensor;
-    qControllerMesg.mesg.sensorMesg.mesgId = e_msg_sensor_temperature;
-    qControllerMesg.mesg.sensorMesg.data = tempSmooth;
-    qControllerMesg.valid = (tempSensValid & tempSmoothValid); // both valids must be true !
-    controllerQueueSend(&qControllerMesg, 0);
+    numSamples++;
+
+    // Every report interval : send temperature + valid-flag of every sensor to controller-queue.
+    // A channel is valid when it had at least one valid sample in the interval.
+    if (numSamples >= profile.reportEvery)
+    {
+      for (uint8_t i = 0; i < SENSORS_NUM_CHANNELS; i++)
+      {
+        reportValid[i] = decimatorGet(&decimator, i, profile.decimation, reportValue[i]);
+      }
+      decimatorReset(&decimator);
+      numSamples = 0;
+
+      for (uint8_t i = 0; i < ((numSensors > 0) ? numSensors : 1); i++)
+      {
+        if (!reporter.check(i, reportValue[i], reportValid[i], lastWakeTime * portTICK_PERIOD_MS))
+        {
+          statSuppressed++;
+          continue;
+        }
+        statSent++;
+
+        qControllerMesg.type = e_mtype_sensor;
+        qControllerMesg.mesg.sensorMesg.mesgId = e_msg_sensor_temperature;
+        qControllerMesg.mesg.sensorMesg.number = i;
+        qControllerMesg.mesg.sensorMesg.data = reportValue[i];
+        qControllerMesg.valid = reportValid[i];
+        controllerQueueSend(&qControllerMesg, 0);
+      }
+
+      if (sensor.hasHumidity())
+      {
+        if (reporter.check(SENSORS_HUMIDITY_CHANNEL, reportValue[SENSORS_HUMIDITY_CHANNEL], reportValid[SENSORS_HUMIDITY_CHANNEL], lastWakeTime * portTICK_PERIOD_MS))
+        {
+          statSent++;
+
+          qControllerMesg.type = e_mtype_sensor;
+          qControllerMesg.mesg.sensorMesg.mesgId = e_msg_sensor_humidity;
+          qControllerMesg.mesg.sensorMesg.number = 0;
+          qControllerMesg.mesg.sensorMesg.data = reportValue[SENSORS_HUMIDITY_CHANNEL];
+          qControllerMesg.valid = reportValid[SENSORS_HUMIDITY_CHANNEL];
+          controllerQueueSend(&qControllerMesg, 0);
+        }
+        else
+        {
+          statSuppressed++;
+        }
+      }
+    }
 
-    // vTaskDelay(DELAY / portTICK_PERIOD_MS);
-    vTaskDelay(DELAY / portTICK_PERIOD_MS);
+    telemetrySleep(e_tel_sensors);
+    vTaskDelayUntil(&lastWakeTime, profile.samplePeriodMs / portTICK_PERIOD_MS);
+    telemetryWakeup(e_tel_sensors);
   }
 }
 
@@ -397,7 +1212,9 @@ int sensorsQueueSend(uint8_t *sensorsQMesg, TickType_t xTicksToWait)
 
   if (sensorsQueue != NULL)
   {
+    // profile requests are polled once per sample period : no latency stamp
     r = xQueueSend(sensorsQueue, sensorsQMesg, xTicksToWait);
+    telemetryQueueSend(e_tel_sensors, *sensorsQMesg, r, uxQueueMessagesWaiting(sensorsQueue));
   }
 
   return r;
@@ -411,20 +1228,23 @@ void initSensors(void)
 
   // scanI2Cbus();
 
-  sensorsQueue = xQueueCreate(5, sizeof(uint8_t));
+  sensorsQueue = xQueueCreate(SENSORS_QUEUE_LENGTH, sizeof(uint8_t));
 
   if (sensorsQueue == 0)
   {
     ESP_LOGE(LOG_TAG, "Cannot create sensorsQueue");
   }
 
-  // create task
-  r = xTaskCreatePinnedToCore(sensorsTask, "sensorsTask", 2 * 1024, NULL, 10, &sensorsTaskHandle, 1);
+  // create task. Own frames up to ~450 B (RMT search & transfer buffers,
+  // SmoothBank sort copy), ESP_LOG formatting (vprintf) ~1.5 KB, interrupt
+  // context ~0.5 KB : 2 KB overflowed, see stack-free in the telemetry log.
+  r = xTaskCreatePinnedToCore(sensorsTask, "sensorsTask", 4 * 1024, NULL, 10, &sensorsTaskHandle, 1);
 
   if (r != pdPASS)
   {
     ESP_LOGE(LOG_TAG, "Could not create task, error-code=%d", r);
   }
+  telemetryRegisterTask(e_tel_sensors, sensorsTaskHandle, SENSORS_QUEUE_LENGTH);
 }
 
 // end of file
\ No newline at end of file
@@ -0,0 +1,112 @@
+//
+//  ssr.cpp
+//
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "config.h"
+#include "ssr.h"
+
+#define LOG_TAG "SSR"
+
+#if (CFG_PID_ENABLE == true)
+
+static const uint8_t ssrPins[CFG_SSR_NR_CHANNELS] = CFG_SSR_PINS;
+
+typedef struct
+{
+  esp_timer_handle_t windowTimer;   // start of window : output on
+  esp_timer_handle_t offTimer;      // end of on-time : output off
+  volatile uint16_t duty;           // per mille, read at start of window
+  bool periodic;                    // window timer runs periodic (after phase offset)
+} ssrChannel_t;
+
+static ssrChannel_t channels[CFG_SSR_NR_CHANNELS];
+
+static void ssrOutput(uint8_t channel, bool on)
+{
+  digitalWrite(ssrPins[channel], on ? CFG_SSR_ON_LEVEL : !CFG_SSR_ON_LEVEL);
+}
+
+static void ssrWindowCallback(void *arg)
+{
+  uint8_t channel = (uint8_t)(uintptr_t)arg;
+  ssrChannel_t *ssr = &channels[channel];
+  uint32_t onTimeUs = ssrOnTimeUs(ssr->duty, CFG_SSR_WINDOW_MS * 1000, CFG_SSR_MIN_PULSE_MS * 1000);
+
+  // first window started after the phase offset of the channel
+  if (!ssr->periodic)
+  {
+    ssr->periodic = true;
+    esp_timer_start_periodic(ssr->windowTimer, CFG_SSR_WINDOW_MS * 1000);
+  }
+
+  if (onTimeUs == 0)
+  {
+    ssrOutput(channel, false);
+  }
+  else if (onTimeUs == CFG_SSR_WINDOW_MS * 1000)
+  {
+    // (nearly) full power : stay on
+    ssrOutput(channel, true);
+  }
+  else
+  {
+    ssrOutput(channel, true);
+    esp_timer_start_once(ssr->offTimer, onTimeUs);
+  }
+}
+
+static void ssrOffCallback(void *arg)
+{
+  ssrOutput((uint8_t)(uintptr_t)arg, false);
+}
+
+// new duty is used from the next window on
+void ssrSetDuty(uint8_t channel, uint16_t dutyPerMille)
+{
+  if (channel < CFG_SSR_NR_CHANNELS)
+  {
+    channels[channel].duty = (dutyPerMille > SSR_DUTY_MAX) ? SSR_DUTY_MAX : dutyPerMille;
+  }
+}
+
+uint16_t ssrGetDuty(uint8_t channel)
+{
+  return (channel < CFG_SSR_NR_CHANNELS) ? channels[channel].duty : 0;
+}
+
+void initSSR(void)
+{
+  esp_timer_create_args_t args = {};
+
+  ESP_LOGI(LOG_TAG, "init : %d channels, window=%d ms", CFG_SSR_NR_CHANNELS, CFG_SSR_WINDOW_MS);
+
+  for (uint8_t channel = 0; channel < CFG_SSR_NR_CHANNELS; channel++)
+  {
+    ssrChannel_t *ssr = &channels[channel];
+
+    pinMode(ssrPins[channel], OUTPUT);
+    ssrOutput(channel, false);
+    ssr->duty = 0;
+    ssr->periodic = false;
+
+    args.arg = (void *)(uintptr_t)channel;
+    args.dispatch_method = ESP_TIMER_TASK;
+
+    args.callback = ssrWindowCallback;
+    args.name = "ssrWindow";
+    esp_timer_create(&args, &ssr->windowTimer);
+
+    args.callback = ssrOffCallback;
+    args.name = "ssrOff";
+    esp_timer_create(&args, &ssr->offTimer);
+
+    // spread the channels over the window
+    esp_timer_start_once(ssr->windowTimer, 1000 + (uint64_t)channel * CFG_SSR_WINDOW_MS * 1000 / CFG_SSR_NR_CHANNELS);
+  }
+}
+
+#endif // CFG_PID_ENABLE
+
+// end of file
@@ -0,0 +1,144 @@
+//
+//  statestore.cpp
+//
+
+#include <Arduino.h>
+#include "statestore.h"
+
+#define LOG_TAG "STATE"
+
+// Sequence lock per key : the sequence is odd while a write is in progress
+// and advances by 2 per publish. Version 0 means never published.
+typedef struct
+{
+  uint32_t sequence;
+  uint32_t data[STATE_MAX_SIZE / sizeof(uint32_t)];
+  // statistics
+  uint32_t published;
+  uint32_t lost;
+  uint32_t stale;
+  uint32_t retries;
+} stateEntry_t;
+
+static stateEntry_t entries[e_state_count];
+static portMUX_TYPE writeMux = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t subscribers[STATE_MAX_SUBSCRIBERS];
+static uint32_t subscriberBits[STATE_MAX_SUBSCRIBERS];
+static uint8_t numSubscribers = 0;
+
+static const char *keyNames[e_state_count] = {"temp", "humidity", "setpoint", "actuators", "wifi", "time", "hydro"};
+
+void statePublishRaw(stateKey_t key, const void *value, uint8_t size)
+{
+  stateEntry_t *entry;
+  uint32_t sequence;
+
+  if ((key >= e_state_count) || (size > STATE_MAX_SIZE))
+  {
+    return;
+  }
+
+  entry = &entries[key];
+
+  portENTER_CRITICAL(&writeMux);
+  sequence = entry->sequence;
+  __atomic_store_n(&entry->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(entry->data, value, size);
+  __atomic_store_n(&entry->sequence, sequence + 2, __ATOMIC_RELEASE);
+  entry->published++;
+  portEXIT_CRITICAL(&writeMux);
+
+  for (uint8_t i = 0; i < numSubscribers; i++)
+  {
+    if (subscriberBits[i] & STATE_BIT(key))
+    {
+      xTaskNotify(subscribers[i], STATE_BIT(key), eSetBits);
+    }
+  }
+}
+
+bool stateReadRaw(stateKey_t key, void *value, uint8_t size, uint32_t *lastVersion)
+{
+  stateEntry_t *entry;
+  uint32_t before;
+  uint32_t after;
+
+  if ((key >= e_state_count) || (size > STATE_MAX_SIZE))
+  {
+    return false;
+  }
+
+  entry = &entries[key];
+
+  while (true)
+  {
+    before = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+    if ((before & 1) == 0)
+    {
+      memcpy(value, entry->data, size);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      after = __atomic_load_n(&entry->sequence, __ATOMIC_RELAXED);
+      if (before == after)
+      {
+        break;
+      }
+    }
+    // writer on the other core, is never preempted : try again
+    __atomic_fetch_add(&entry->retries, 1, __ATOMIC_RELAXED);
+  }
+
+  if (lastVersion != NULL)
+  {
+    if (before == *lastVersion)
+    {
+      __atomic_fetch_add(&entry->stale, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+
+    // versions advance by 2 per publish
+    if ((*lastVersion != 0) && (before - *lastVersion > 2))
+    {
+      __atomic_fetch_add(&entry->lost, (before - *lastVersion) / 2 - 1, __ATOMIC_RELAXED);
+    }
+    *lastVersion = before;
+  }
+
+  return (before != 0);
+}
+
+// call before the first publish of the keys, from any task
+bool stateSubscribe(TaskHandle_t task, uint32_t keyBits)
+{
+  bool subscribed = false;
+
+  portENTER_CRITICAL(&writeMux);
+  if (numSubscribers < STATE_MAX_SUBSCRIBERS)
+  {
+    subscribers[numSubscribers] = task;
+    subscriberBits[numSubscribers] = keyBits & STATE_ALL_BITS;
+    numSubscribers++;
+    subscribed = true;
+  }
+  portEXIT_CRITICAL(&writeMux);
+
+  if (!subscribed)
+  {
+    ESP_LOGE(LOG_TAG, "Too many subscribers");
+  }
+
+  return subscribed;
+}
+
+// log counters per key
+void stateReport(void)
+{
+  for (uint8_t key = 0; key < e_state_count; key++)
+  {
+    ESP_LOGI(LOG_TAG, "%-9s : published=%u lost=%u stale=%u retries=%u", keyNames[key],
+             (unsigned)entries[key].published, (unsigned)entries[key].lost, (unsigned)entries[key].stale, (unsigned)entries[key].retries);
+  }
+}
+
+// end of file
@@ -0,0 +1,317 @@
+//
+//  telemetry.cpp
+//
+
+#include "config.h"
+#include <Arduino.h>
+#include "telemetry.h"
+
+#define LOG_TAG "TELE"
+
+static const char *taskNames[e_tel_count] = {"ctrl", "comms", "hydro", "disp", "acts", "sens"};
+
+// task loop wakeups & busy time, written by the owning task only
+static volatile uint32_t wakeups[e_tel_count];
+static uint32_t reportedWakeups[e_tel_count];
+static volatile uint32_t busyUs[e_tel_count];
+static uint32_t reportedBusyUs[e_tel_count];
+static uint32_t wakeupUs[e_tel_count];
+static bool awake[e_tel_count];
+
+static TaskHandle_t taskHandles[e_tel_count];
+
+// queues : sent by any task, received by the owning task
+static telemetryQueueStats_t queueStats[e_tel_count];
+static uint16_t failedPerType[e_tel_count][TELEMETRY_MESG_TYPES];
+static portMUX_TYPE queueMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t reportedUs;
+static TickType_t reportedTicks;
+
+// Idle share : run time of the idle task of each CPU, from the FreeRTOS
+// run-time statistics, against the esp_timer time between two reports. The
+// run-time clock must be esp_timer (microseconds, same clock as
+// telemetryStamp()) : the CPU clock counter wraps in 18 s and is per CPU.
+// Without run-time statistics the idle share is not reported.
+#if (configGENERATE_RUN_TIME_STATS == 1) && (configUSE_TRACE_FACILITY == 1) && defined(CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER)
+#define TELEMETRY_IDLE_MEASURED true
+#else
+#define TELEMETRY_IDLE_MEASURED false
+#endif
+
+#define TELEMETRY_IDLE_UNKNOWN  -1
+
+static int16_t idlePermille[portNUM_PROCESSORS];
+
+#if (TELEMETRY_IDLE_MEASURED == true)
+static uint32_t reportedIdleUs[portNUM_PROCESSORS];
+
+// run time of the idle task of cpu, microseconds (wraps after 71 minutes)
+static uint32_t idleRunTimeUs(uint8_t cpu)
+{
+  TaskStatus_t status;
+
+  vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(cpu), &status, pdFALSE, eReady);
+  return status.ulRunTimeCounter;
+}
+#endif
+
+void telemetryRegisterTask(telemetryTask_t task, TaskHandle_t handle, uint8_t queueLength)
+{
+  if (task < e_tel_count)
+  {
+    taskHandles[task] = handle;
+    queueStats[task].length = queueLength;
+  }
+}
+
+// from the *QueueSend wrapper, depth : messages waiting after the send
+void telemetryQueueSend(telemetryTask_t task, uint8_t mesgType, BaseType_t result, UBaseType_t depth)
+{
+  telemetryQueueStats_t *stats;
+
+  if (task >= e_tel_count)
+  {
+    return;
+  }
+
+  stats = &queueStats[task];
+
+  portENTER_CRITICAL(&queueMux);
+  if (result == pdTRUE)
+  {
+    stats->sent++;
+  }
+  else
+  {
+    stats->failed++;
+    failedPerType[task][(mesgType < TELEMETRY_MESG_TYPES) ? mesgType : TELEMETRY_MESG_TYPES - 1]++;
+  }
+  if (depth > stats->highWater)
+  {
+    stats->highWater = depth;
+  }
+  portEXIT_CRITICAL(&queueMux);
+}
+
+// from the receive loop, stampUs : telemetryStamp() of the sender
+void telemetryQueueReceive(telemetryTask_t task, uint32_t stampUs)
+{
+  telemetryQueueStats_t *stats;
+  uint32_t latencyUs = telemetryStamp() - stampUs;
+  uint32_t limitUs = 100;
+  uint8_t bucket = 0;
+
+  if (task >= e_tel_count)
+  {
+    return;
+  }
+
+  while ((bucket < TELEMETRY_LATENCY_BUCKETS - 1) && (latencyUs >= limitUs))
+  {
+    bucket++;
+    limitUs *= 10;
+  }
+
+  stats = &queueStats[task];
+
+  portENTER_CRITICAL(&queueMux);
+  stats->latency[bucket]++;
+  if (latencyUs > stats->latencyMaxUs)
+  {
+    stats->latencyMaxUs = latencyUs;
+  }
+  portEXIT_CRITICAL(&queueMux);
+}
+
+void telemetryQueueStats(telemetryTask_t task, telemetryQueueStats_t *stats)
+{
+  if (task < e_tel_count)
+  {
+    portENTER_CRITICAL(&queueMux);
+    *stats = queueStats[task];
+    portEXIT_CRITICAL(&queueMux);
+  }
+}
+
+void telemetryWakeup(telemetryTask_t task)
+{
+  if (task < e_tel_count)
+  {
+    wakeups[task]++;
+    wakeupUs[task] = telemetryStamp();
+    awake[task] = true;
+  }
+}
+
+// right before the task blocks
+void telemetrySleep(telemetryTask_t task)
+{
+  if ((task < e_tel_count) && awake[task])
+  {
+    busyUs[task] += telemetryStamp() - wakeupUs[task];
+    awake[task] = false;
+  }
+}
+
+// stack never used by the task, bytes (ESP-IDF stack type is a byte)
+static uint32_t stackFree(telemetryTask_t task)
+{
+  return (taskHandles[task] != NULL) ? uxTaskGetStackHighWaterMark(taskHandles[task]) : 0;
+}
+
+// log per task : wakeups/s & busy share since the previous report, stack and
+// queue counters since boot. Then the idle share per CPU.
+void telemetryReport(void)
+{
+  TickType_t ticks = xTaskGetTickCount();
+  TickType_t elapsed = ticks - reportedTicks;
+  uint32_t nowUs = telemetryStamp();
+  uint32_t elapsedUs = nowUs - reportedUs;
+  uint32_t total = 0;
+  telemetryQueueStats_t stats;
+  char line[128];
+  int length;
+
+  if ((elapsed == 0) || (elapsedUs == 0))
+  {
+    return;
+  }
+
+  for (uint8_t i = 0; i < e_tel_count; i++)
+  {
+    telemetryTask_t task = (telemetryTask_t)i;
+    uint32_t count = wakeups[i];
+    uint32_t busy = busyUs[i];
+    uint32_t perSecond_x10 = (uint64_t)(count - reportedWakeups[i]) * 10 * configTICK_RATE_HZ / elapsed;
+    uint32_t busy_x10 = (uint64_t)(busy - reportedBusyUs[i]) * 1000 / elapsedUs;
+
+    reportedWakeups[i] = count;
+    reportedBusyUs[i] = busy;
+    total += perSecond_x10;
+
+    ESP_LOGI(LOG_TAG, "%-5s : wakeups/s=%u.%u busy=%u.%u%% stack-free=%u B", taskNames[i],
+             (unsigned)(perSecond_x10 / 10), (unsigned)(perSecond_x10 % 10), (unsigned)(busy_x10 / 10), (unsigned)(busy_x10 % 10), (unsigned)stackFree(task));
+    if ((taskHandles[i] != NULL) && (stackFree(task) < CFG_TELEMETRY_STACK_WARN))
+    {
+      ESP_LOGW(LOG_TAG, "%-5s : stack-free %u B, below %u B : raise its stack size", taskNames[i], (unsigned)stackFree(task), CFG_TELEMETRY_STACK_WARN);
+    }
+
+    telemetryQueueStats(task, &stats);
+    if (stats.sent + stats.failed == 0)
+    {
+      continue;
+    }
+
+#if (CFG_TELEMETRY_LATENCY == true)
+    length = 0;
+    for (uint8_t bucket = 0; bucket < TELEMETRY_LATENCY_BUCKETS; bucket++)
+    {
+      length += snprintf(&line[length], sizeof(line) - length, " %u", (unsigned)stats.latency[bucket]);
+    }
+    ESP_LOGI(LOG_TAG, "%-5s   queue : sent=%u failed=%u depth=%u/%u latency(<0.1,<1,<10,<100,<1000,>=1000 ms)=%s max=%u us", taskNames[i],
+             (unsigned)stats.sent, (unsigned)stats.failed, stats.highWater, stats.length, line, (unsigned)stats.latencyMaxUs);
+#else
+    ESP_LOGI(LOG_TAG, "%-5s   queue : sent=%u failed=%u depth=%u/%u", taskNames[i],
+             (unsigned)stats.sent, (unsigned)stats.failed, stats.highWater, stats.length);
+#endif
+
+    if (stats.failed != 0)
+    {
+      length = 0;
+      for (uint8_t type = 0; type < TELEMETRY_MESG_TYPES; type++)
+      {
+        if (failedPerType[i][type] != 0)
+        {
+          length += snprintf(&line[length], sizeof(line) - length, " %u:%u", type, failedPerType[i][type]);
+        }
+      }
+      ESP_LOGI(LOG_TAG, "%-5s   failed (type:count) :%s", taskNames[i], line);
+    }
+  }
+
+  ESP_LOGI(LOG_TAG, "wakeups/s total=%u.%u", (unsigned)(total / 10), (unsigned)(total % 10));
+
+#if (TELEMETRY_IDLE_MEASURED == true)
+  // not clamped : a share above 100% means the two clocks disagree
+  for (uint8_t cpu = 0; cpu < portNUM_PROCESSORS; cpu++)
+  {
+    uint32_t idleUs = idleRunTimeUs(cpu);
+    uint32_t permille = (uint64_t)(idleUs - reportedIdleUs[cpu]) * 1000 / elapsedUs;
+
+    reportedIdleUs[cpu] = idleUs;
+    idlePermille[cpu] = (permille > INT16_MAX) ? INT16_MAX : permille;
+    ESP_LOGI(LOG_TAG, "idle cpu%d : %u.%u%%", cpu, (unsigned)(permille / 10), (unsigned)(permille % 10));
+  }
+#endif
+
+  reportedTicks = ticks;
+  reportedUs = nowUs;
+}
+
+// one line for the display status bar : idle share (of the last report),
+// worst queue latency, queue send failures and smallest free stack
+int telemetrySummary(char *line, size_t size)
+{
+  telemetryQueueStats_t stats;
+  uint32_t latencyMaxUs = 0;
+  uint32_t failed = 0;
+  uint32_t minStack = UINT32_MAX;
+  int length;
+
+  for (uint8_t i = 0; i < e_tel_count; i++)
+  {
+    telemetryQueueStats((telemetryTask_t)i, &stats);
+    failed += stats.failed;
+    if (stats.latencyMaxUs > latencyMaxUs)
+    {
+      latencyMaxUs = stats.latencyMaxUs;
+    }
+    if ((taskHandles[i] != NULL) && (stackFree((telemetryTask_t)i) < minStack))
+    {
+      minStack = stackFree((telemetryTask_t)i);
+    }
+  }
+
+  length = snprintf(line, size, "idle");
+  for (uint8_t cpu = 0; cpu < portNUM_PROCESSORS; cpu++)
+  {
+    if (idlePermille[cpu] == TELEMETRY_IDLE_UNKNOWN)
+    {
+      length += snprintf(&line[length], size - length, "%s-", (cpu == 0) ? " " : "/");
+    }
+    else
+    {
+      length += snprintf(&line[length], size - length, "%s%u", (cpu == 0) ? " " : "/", (unsigned)((idlePermille[cpu] + 5) / 10));
+    }
+  }
+#if (CFG_TELEMETRY_LATENCY == true)
+  length += snprintf(&line[length], size - length, "%% lat %ums fail %u stack %uB",
+                     (unsigned)((latencyMaxUs + 999) / 1000), (unsigned)failed, (unsigned)((minStack == UINT32_MAX) ? 0 : minStack));
+#else
+  length += snprintf(&line[length], size - length, "%% fail %u stack %uB", (unsigned)failed, (unsigned)((minStack == UINT32_MAX) ? 0 : minStack));
+#endif
+
+  return length;
+}
+
+void initTelemetry(void)
+{
+  ESP_LOGI(LOG_TAG, "init");
+
+  reportedTicks = xTaskGetTickCount();
+  reportedUs = telemetryStamp();
+
+  for (uint8_t cpu = 0; cpu < portNUM_PROCESSORS; cpu++)
+  {
+    idlePermille[cpu] = TELEMETRY_IDLE_UNKNOWN;
+#if (TELEMETRY_IDLE_MEASURED == true)
+    reportedIdleUs[cpu] = idleRunTimeUs(cpu);
+#endif
+  }
+#if (TELEMETRY_IDLE_MEASURED == false)
+  ESP_LOGW(LOG_TAG, "idle share not measured : needs FreeRTOS run-time statistics on esp_timer");
+#endif
+}
+
+// end of file
@@ -0,0 +1,38 @@
+//
+// bench : time base for the host benchmarks
+//
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+
+// CPU cycles (time stamp counter) on x86, nanoseconds elsewhere. Only for
+// comparisons on the same host : the absolute numbers do not carry over to
+// the ESP32-S3.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT    "cycles"
+
+static inline uint64_t benchNow(void)
+{
+  return __rdtsc();
+}
+#else
+#include <time.h>
+#define BENCH_UNIT    "ns"
+
+static inline uint64_t benchNow(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+// keeps a result alive, so the benchmarked code is not optimised away
+static volatile int benchSink;
+
+#endif
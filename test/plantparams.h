@@ -0,0 +1,27 @@
+//
+// plantparams : fermentation chamber model of the simulation sensor
+//
+
+#ifndef __PLANTPARAMS_H__
+#define __PLANTPARAMS_H__
+
+#include "thermalplant.h"
+
+// config.h defaults (CFG_SIM_*) : 20 kg wort, 150 W compressor, 60 W heater,
+// ambient 20 degrees
+static const thermalPlantParams_t testPlantParams =
+{
+  20.0f,      // wortKg
+  20000.0f,   // chamberJPerK
+  8.0f,       // wortChamberWPerK
+  1.5f,       // chamberAmbientWPerK
+  20.0f,      // ambientC
+  150.0f,     // coolingW
+  60.0f,      // heatingW
+  120.0f,     // compressorTauS
+  30.0f,      // heaterTauS
+  3.0f,       // fermentationW
+  0.05f       // sensorNoiseC
+};
+
+#endif
@@ -0,0 +1,155 @@
+//
+// smoothref : reference filter for the Smooth tests and benchmarks
+//
+
+#ifndef __SMOOTHREF_H__
+#define __SMOOTHREF_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Smooth<> before the incremental median (qsort of a copy of the window on
+// every sample), with its two bugs fixed, otherwise the output is undefined :
+// the copy starts at index 0 (it skipped _samplesSorted[0]) and the compare
+// function reads int (it read long).
+
+template <int SAMPLE_WINDOW> class SmoothQsort
+{
+
+private:
+
+  int _samples[SAMPLE_WINDOW];
+  int _samplesSorted[SAMPLE_WINDOW];
+  int _sampleCount;
+  int _state;
+  int _maxDeviation;
+  int _value;
+  int _outputValid;
+
+  static int compare_int(const void *a, const void *b)
+  {
+    int a_val = *((const int *)a);
+    int b_val = *((const int *)b);
+
+    return (a_val > b_val) - (a_val < b_val);
+  }
+
+public:
+
+  SmoothQsort()
+  {
+    _sampleCount = 0;
+    _state = 0;
+    _maxDeviation = 1;
+    _outputValid = false;
+    _value = 0;
+  }
+
+  void setValue(int value)
+  {
+    int median;
+    long deviation;
+    long sumSamples;
+    int numValidSamples;
+
+    if (_state == 0)
+    {
+      _samples[_sampleCount] = value;
+      _sampleCount++;
+      if (_sampleCount == SAMPLE_WINDOW)
+      {
+        _sampleCount = 0;
+        _state = 1;
+      }
+      return;
+    }
+
+    for (int i = 1; i < SAMPLE_WINDOW; i++)
+    {
+      _samples[i - 1] = _samples[i];
+    }
+    _samples[SAMPLE_WINDOW - 1] = value;
+
+    for (int i = 0; i < SAMPLE_WINDOW; i++)
+    {
+      _samplesSorted[i] = _samples[i];
+    }
+    qsort(_samplesSorted, SAMPLE_WINDOW, sizeof(int), compare_int);
+
+    median = _samplesSorted[SAMPLE_WINDOW / 2];
+
+    sumSamples = 0;
+    numValidSamples = 0;
+    for (int i = 0; i < SAMPLE_WINDOW; i++)
+    {
+      deviation = _samples[i] - median;
+      if (labs(deviation) < _maxDeviation)
+      {
+        sumSamples += _samples[i];
+        numValidSamples++;
+      }
+    }
+
+    _outputValid = (numValidSamples > 0);
+    _value = (numValidSamples > 0) ? sumSamples / numValidSamples : 0;
+  }
+
+  void setMaxDeviation(int maxDeviation)
+  {
+    _maxDeviation = maxDeviation;
+  }
+
+  bool isValid(void)
+  {
+    return _outputValid;
+  }
+
+  int getValue(void)
+  {
+    return _value;
+  }
+};
+
+// temperature-like test signal (degree * 10) : random walk with plateaus
+// (equal values) and spikes (outliers), deterministic
+class SmoothSignal
+{
+
+private:
+
+  uint32_t _state;
+  int _level;
+
+public:
+
+  SmoothSignal(uint32_t seed = 1)
+  {
+    _state = seed;
+    _level = 200;
+  }
+
+  uint32_t random(void)
+  {
+    _state ^= _state << 13;
+    _state ^= _state >> 17;
+    _state ^= _state << 5;
+    return _state;
+  }
+
+  int next(void)
+  {
+    uint32_t r = random();
+
+    if ((r & 7) == 0)
+    {
+      _level += (int)((r >> 3) % 5) - 2;
+    }
+    if ((r >> 8) % 50 == 0)
+    {
+      return _level + (int)((r >> 16) % 400) - 200;   // spike
+    }
+    return _level + (int)((r >> 16) % 3) - 1;         // noise
+  }
+};
+
+#endif
@@ -0,0 +1,160 @@
+//
+// Relay auto-tuner : limit cycles of the plant models, tuned PID
+//
+
+#include <unity.h>
+#include <math.h>
+#include "autotune.h"
+#include "pid.h"
+#include "ssr.h"
+#include "../plantparams.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// config.h defaults
+#define HYSTERESIS_X10      2
+#define MAX_DEVIATION_X10   50
+#define MAX_CYCLES          12
+#define TOLERANCE_PERCENT   10
+#define COOL_ON_DELAY_MS    200000UL
+#define PID_PERIOD_MS       2000
+#define SSR_MIN_PULSE_MS    20
+
+// 25 l kettle, 2 x 2500 W elements (see test_pid)
+static const thermalPlantParams_t kettleParams = {25.0f, 2000.0f, 300.0f, 8.0f, 20.0f, 0.0f, 5000.0f, 60.0f, 20.0f, 0.0f, 0.05f};
+
+// Fermentation chamber, the compressor relay on the chamber sensor. The relay
+// never switches on within the compressor delay, the experiment converges.
+static void test_chamber_cooling(void)
+{
+  const autoTuneParams_t params = {HYSTERESIS_X10, MAX_DEVIATION_X10, COOL_ON_DELAY_MS, 24UL * 3600 * 1000, MAX_CYCLES, TOLERANCE_PERCENT};
+  ThermalPlant plant(testPlantParams, 18.0f, 1);
+  RelayAutoTune autoTune(params);
+  uint32_t nowMs = 0;
+  uint32_t offMs = 0;
+  uint32_t minOffMs = UINT32_MAX;
+  bool relay = false;
+  float ku;
+  float tuMs;
+  char message[128];
+
+  autoTune.start(nowMs, 180, true);
+  while (autoTune.getState() == e_autotune_running)
+  {
+    bool previous = relay;
+
+    relay = autoTune.update(nowMs, plant.getChamberSensor_x10());
+    if (relay && !previous && (nowMs - offMs < minOffMs))
+    {
+      minOffMs = nowMs - offMs;
+    }
+    if (!relay && previous)
+    {
+      offMs = nowMs;
+    }
+    plant.step(THERMAL_PLANT_STEP_MS, relay, false);
+    nowMs += THERMAL_PLANT_STEP_MS;
+  }
+
+  TEST_ASSERT_EQUAL(e_autotune_done, autoTune.getState());
+  TEST_ASSERT_TRUE(autoTune.getUltimate(ku, tuMs));
+  snprintf(message, sizeof(message), "chamber : %u cycles in %.1f h, Ku=%.1f Tu=%.0f s, min off %u s",
+           autoTune.getCycles(), nowMs / 3.6e6, ku, tuMs / 1000, (unsigned)(minOffMs / 1000));
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_TRUE(minOffMs >= COOL_ON_DELAY_MS);
+  TEST_ASSERT_FALSE(relay);
+  TEST_ASSERT_TRUE(ku > 0);
+  TEST_ASSERT_TRUE(tuMs > COOL_ON_DELAY_MS);
+}
+
+// Kettle with a heating relay : the tuned gains heat 20 -> 65 degrees
+// through the SSR window with little overshoot
+static void test_kettle_heating(void)
+{
+  const autoTuneParams_t params = {HYSTERESIS_X10, MAX_DEVIATION_X10, 0, 4UL * 3600 * 1000, MAX_CYCLES, TOLERANCE_PERCENT};
+  ThermalPlant tunePlant(kettleParams, 64.0f, 1);
+  ThermalPlant plant(kettleParams, 20.0f, 2);
+  RelayAutoTune autoTune(params);
+  uint32_t nowMs = 0;
+  float kp;
+  float ki;
+  float kd;
+  double maxC = 0;
+  double sumSquares = 0;
+  uint32_t samples = 0;
+  char message[160];
+
+  autoTune.start(nowMs, 650, false);
+  while (autoTune.getState() == e_autotune_running)
+  {
+    bool relay = autoTune.update(nowMs, tunePlant.getWortSensor_x10());
+
+    tunePlant.step(PID_PERIOD_MS, false, relay);
+    nowMs += PID_PERIOD_MS;
+  }
+  TEST_ASSERT_EQUAL(e_autotune_done, autoTune.getState());
+  TEST_ASSERT_TRUE(autoTune.getGains(PID_PERIOD_MS, kp, ki, kd));
+
+  pidParams_t pidParams = {PID_Q16(kp), PID_Q16(ki), PID_Q16(kd), 0, PID_OUTPUT_MAX, 4};
+  Pid pid(pidParams);
+
+  for (uint32_t t = 0; t < 3 * 3600; t += PID_PERIOD_MS / 1000)
+  {
+    uint32_t onMs = ssrOnTimeUs(pid.update(650, plant.getWortSensor_x10()), PID_PERIOD_MS * 1000, SSR_MIN_PULSE_MS * 1000) / 1000;
+
+    plant.step(onMs, false, true);
+    plant.step(PID_PERIOD_MS - onMs, false, false);
+    maxC = (plant.getWortC() > maxC) ? plant.getWortC() : maxC;
+    if (t > 3600)
+    {
+      sumSquares += (plant.getWortC() - 65.0) * (plant.getWortC() - 65.0);
+      samples++;
+    }
+  }
+
+  snprintf(message, sizeof(message), "kettle : %u cycles in %u min, kp=%.1f ki=%.3f kd=%.1f; 20 -> 65 overshoot %.2f C, steady RMS %.3f C",
+           autoTune.getCycles(), (unsigned)(nowMs / 60000), kp, ki, kd, maxC - 65.0, sqrt(sumSquares / samples));
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_TRUE(maxC - 65.0 < 0.5);
+  TEST_ASSERT_TRUE(sqrt(sumSquares / samples) < 0.15);
+}
+
+// the experiment fails when the temperature runs away or takes too long
+static void test_abort(void)
+{
+  const autoTuneParams_t params = {HYSTERESIS_X10, MAX_DEVIATION_X10, 0, 3600UL * 1000, MAX_CYCLES, TOLERANCE_PERCENT};
+  RelayAutoTune autoTune(params);
+  float kp;
+  float ki;
+  float kd;
+
+  // heater without effect : temperature sinks below the limit
+  autoTune.start(0, 650, false);
+  TEST_ASSERT_TRUE(autoTune.update(1000, 640));
+  TEST_ASSERT_TRUE(autoTune.update(2000, 601));
+  TEST_ASSERT_FALSE(autoTune.update(3000, 599));
+  TEST_ASSERT_EQUAL(e_autotune_failed, autoTune.getState());
+  TEST_ASSERT_FALSE(autoTune.getGains(PID_PERIOD_MS, kp, ki, kd));
+
+  // no cycle within the maximum duration
+  autoTune.start(0, 650, false);
+  TEST_ASSERT_FALSE(autoTune.update(1000, 650));
+  TEST_ASSERT_FALSE(autoTune.update(3600UL * 1000 + 1, 650));
+  TEST_ASSERT_EQUAL(e_autotune_failed, autoTune.getState());
+
+  autoTune.stop();
+  TEST_ASSERT_EQUAL(e_autotune_idle, autoTune.getState());
+  TEST_ASSERT_FALSE(autoTune.update(1000, 600));
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_chamber_cooling);
+  RUN_TEST(test_kettle_heating);
+  RUN_TEST(test_abort);
+  return UNITY_END();
+}
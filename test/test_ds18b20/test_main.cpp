@@ -0,0 +1,278 @@
+//
+// DS18B20 : pipelined conversions against a simulated probe
+//
+
+#include <unity.h>
+#include <string.h>
+#include "ds18b20.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Simulated probe, at the command level. The scratchpad is updated at the
+// end of a conversion, a read during a conversion returns the previous
+// result (power-on value 85 degrees). The conversion takes a fraction of the
+// datasheet maximum, the temperature is sampled at the end of it.
+class Ds18b20Sim
+{
+private:
+  uint8_t scratchPad[9];
+  uint32_t convertEndMs;
+  bool converting;
+  double convertFraction;
+  uint8_t noise;
+
+  void setTemperature(double celcius)
+  {
+    uint8_t bits = DS18B20_MIN_RESOLUTION + ((scratchPad[4] >> 5) & 3);
+    int16_t value = (int16_t)(celcius * 16.0 + ((celcius < 0) ? -0.5 : 0.5));
+
+    // the bits below the resolution are undefined : garbage
+    noise = noise * 37 + 11;
+    value = (value & ~((1 << (DS18B20_MAX_RESOLUTION - bits)) - 1)) | (noise & ((1 << (DS18B20_MAX_RESOLUTION - bits)) - 1));
+    scratchPad[0] = value & 0xFF;
+    scratchPad[1] = (value >> 8) & 0xFF;
+    scratchPad[8] = oneWireCrc8(scratchPad, 8);
+  }
+
+public:
+  double (*temperature)(uint32_t nowMs);
+  bool connected;
+
+  Ds18b20Sim(double (*probeTemperature)(uint32_t), double fraction)
+  {
+    static const uint8_t powerOn[9] = {0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0x00};
+
+    memcpy(scratchPad, powerOn, sizeof(scratchPad));
+    scratchPad[8] = oneWireCrc8(scratchPad, 8);
+    temperature = probeTemperature;
+    convertFraction = fraction;
+    converting = false;
+    connected = true;
+    noise = 0;
+  }
+
+  void poll(uint32_t nowMs)
+  {
+    if (converting && ((int32_t)(nowMs - convertEndMs) >= 0))
+    {
+      setTemperature(temperature(convertEndMs));
+      converting = false;
+    }
+  }
+
+  void writeScratchpad(uint8_t th, uint8_t tl, uint8_t config)
+  {
+    scratchPad[2] = th;
+    scratchPad[3] = tl;
+    scratchPad[4] = config;
+    scratchPad[8] = oneWireCrc8(scratchPad, 8);
+  }
+
+  void convert(uint32_t nowMs)
+  {
+    uint8_t bits = DS18B20_MIN_RESOLUTION + ((scratchPad[4] >> 5) & 3);
+
+    poll(nowMs);
+    if (!converting)
+    {
+      convertEndMs = nowMs + (uint32_t)(ds18b20ConversionMs(bits) * convertFraction);
+      converting = true;
+    }
+  }
+
+  // a released bus reads all ones
+  void readScratchpad(uint32_t nowMs, uint8_t *data)
+  {
+    poll(nowMs);
+    if (connected)
+    {
+      memcpy(data, scratchPad, sizeof(scratchPad));
+    }
+    else
+    {
+      memset(data, 0xFF, sizeof(scratchPad));
+    }
+  }
+};
+
+// slow ramp, 1 degree per minute
+static double rampTemperature(uint32_t nowMs)
+{
+  return 18.0 + nowMs / 60000.0;
+}
+
+static void test_conversion_time(void)
+{
+  TEST_ASSERT_EQUAL(93, ds18b20ConversionMs(9));
+  TEST_ASSERT_EQUAL(187, ds18b20ConversionMs(10));
+  TEST_ASSERT_EQUAL(375, ds18b20ConversionMs(11));
+  TEST_ASSERT_EQUAL(750, ds18b20ConversionMs(12));
+}
+
+// highest resolution that fits, never above the maximum
+static void test_resolution_for_period(void)
+{
+  for (uint16_t periodMs = 10; periodMs < 3000; periodMs += 7)
+  {
+    for (uint8_t maxBits = DS18B20_MIN_RESOLUTION; maxBits <= DS18B20_MAX_RESOLUTION; maxBits++)
+    {
+      uint8_t bits = ds18b20ResolutionForPeriod(periodMs, maxBits);
+
+      TEST_ASSERT_TRUE(bits >= DS18B20_MIN_RESOLUTION);
+      TEST_ASSERT_TRUE(bits <= maxBits);
+      if (bits > DS18B20_MIN_RESOLUTION)
+      {
+        TEST_ASSERT_TRUE(ds18b20ConversionMs(bits) < periodMs);
+      }
+      if (bits < maxBits)
+      {
+        TEST_ASSERT_TRUE(ds18b20ConversionMs(bits + 1) >= periodMs);
+      }
+    }
+  }
+}
+
+// datasheet table 1 : temperature / data output
+static void test_decode_datasheet(void)
+{
+  static const struct
+  {
+    uint16_t data;
+    double celcius;
+  } table[] =
+  {
+    {0x07D0, 125.0}, {0x0550, 85.0}, {0x0191, 25.0625}, {0x00A2, 10.125}, {0x0008, 0.5},
+    {0x0000, 0.0}, {0xFFF8, -0.5}, {0xFF5E, -10.125}, {0xFE6F, -25.0625}, {0xFC90, -55.0}
+  };
+  uint8_t scratchPad[9] = {0, 0, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0};
+  int32_t raw;
+
+  for (unsigned i = 0; i < sizeof(table) / sizeof(table[0]); i++)
+  {
+    scratchPad[0] = table[i].data & 0xFF;
+    scratchPad[1] = table[i].data >> 8;
+    scratchPad[8] = oneWireCrc8(scratchPad, 8);
+    TEST_ASSERT_TRUE(ds18b20DecodeScratchpad(scratchPad, raw));
+    TEST_ASSERT_EQUAL((int32_t)(table[i].celcius * 128), raw);
+  }
+
+  // 9 bits : the three undefined low bits are ignored
+  scratchPad[0] = 0x97;
+  scratchPad[1] = 0x01;
+  scratchPad[4] = ds18b20ConfigByte(9);
+  scratchPad[8] = oneWireCrc8(scratchPad, 8);
+  TEST_ASSERT_TRUE(ds18b20DecodeScratchpad(scratchPad, raw));
+  TEST_ASSERT_EQUAL(25 * 128, raw);
+  scratchPad[0] = 0x6F;
+  scratchPad[1] = 0xFE;
+  scratchPad[4] = ds18b20ConfigByte(11);
+  scratchPad[8] = oneWireCrc8(scratchPad, 8);
+  TEST_ASSERT_TRUE(ds18b20DecodeScratchpad(scratchPad, raw));
+  TEST_ASSERT_EQUAL((int32_t)(-25.125 * 128), raw);
+}
+
+// CRC error, all zero (pulled down bus) and all ones (no probe) are rejected
+static void test_decode_rejects(void)
+{
+  uint8_t scratchPad[9] = {0x91, 0x01, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0};
+  int32_t raw;
+
+  scratchPad[8] = oneWireCrc8(scratchPad, 8);
+  TEST_ASSERT_TRUE(ds18b20DecodeScratchpad(scratchPad, raw));
+
+  for (uint8_t bit = 0; bit < 72; bit++)
+  {
+    scratchPad[bit / 8] ^= (1 << (bit % 8));
+    TEST_ASSERT_FALSE(ds18b20DecodeScratchpad(scratchPad, raw));
+    scratchPad[bit / 8] ^= (1 << (bit % 8));
+  }
+
+  memset(scratchPad, 0, sizeof(scratchPad));
+  TEST_ASSERT_FALSE(ds18b20DecodeScratchpad(scratchPad, raw));
+  memset(scratchPad, 0xFF, sizeof(scratchPad));
+  TEST_ASSERT_FALSE(ds18b20DecodeScratchpad(scratchPad, raw));
+}
+
+// Pipeline of the sensors task : every period the result of the conversion
+// started one period ago is read, then the next conversion is started. With
+// the resolution chosen for the period every read is the fresh result of the
+// previous period, within the resolution step.
+static void checkPipeline(uint16_t periodMs, double convertFraction)
+{
+  Ds18b20Sim probe(rampTemperature, convertFraction);
+  uint8_t bits = ds18b20ResolutionForPeriod(periodMs, DS18B20_MAX_RESOLUTION);
+  uint8_t scratchPad[9];
+  int32_t raw;
+  double expected;
+  double step = (1 << (DS18B20_MAX_RESOLUTION - bits)) / 16.0;
+  char message[64];
+
+  probe.writeScratchpad(0x4B, 0x46, ds18b20ConfigByte(bits));
+  probe.convert(0);
+
+  for (uint32_t k = 1; k <= 200; k++)
+  {
+    uint32_t nowMs = k * periodMs;
+
+    snprintf(message, sizeof(message), "period %u ms, sample %u", periodMs, k);
+    probe.readScratchpad(nowMs, scratchPad);
+    TEST_ASSERT_TRUE_MESSAGE(ds18b20DecodeScratchpad(scratchPad, raw), message);
+    TEST_ASSERT_EQUAL_MESSAGE(ds18b20ConfigByte(bits), scratchPad[4], message);
+
+    // sampled at the end of the conversion started one period ago
+    expected = rampTemperature((k - 1) * periodMs + (uint32_t)(ds18b20ConversionMs(bits) * convertFraction));
+    TEST_ASSERT_TRUE_MESSAGE(raw / 128.0 > expected - step, message);
+    TEST_ASSERT_TRUE_MESSAGE(raw / 128.0 < expected + step, message);
+    TEST_ASSERT_EQUAL_MESSAGE(0, raw % (int32_t)(step * 128), message);
+
+    probe.convert(nowMs);
+  }
+}
+
+static void test_pipeline_fresh(void)
+{
+  static const uint16_t periods[] = {100, 150, 188, 200, 376, 500, 751, 1000, 2000, 5000};
+
+  for (unsigned i = 0; i < sizeof(periods) / sizeof(periods[0]); i++)
+  {
+    checkPipeline(periods[i], 1.0);
+    checkPipeline(periods[i], 0.6);
+  }
+}
+
+// A probe that drops off reads as failed, and recovers with the next conversion
+static void test_pipeline_disconnect(void)
+{
+  Ds18b20Sim probe(rampTemperature, 1.0);
+  uint8_t scratchPad[9];
+  int32_t raw;
+
+  probe.writeScratchpad(0x4B, 0x46, ds18b20ConfigByte(12));
+  probe.convert(0);
+  probe.readScratchpad(1000, scratchPad);
+  TEST_ASSERT_TRUE(ds18b20DecodeScratchpad(scratchPad, raw));
+  probe.convert(1000);
+
+  probe.connected = false;
+  probe.readScratchpad(2000, scratchPad);
+  TEST_ASSERT_FALSE(ds18b20DecodeScratchpad(scratchPad, raw));
+  probe.convert(2000);
+
+  probe.connected = true;
+  probe.readScratchpad(3000, scratchPad);
+  TEST_ASSERT_TRUE(ds18b20DecodeScratchpad(scratchPad, raw));
+  TEST_ASSERT_TRUE(raw / 128.0 > rampTemperature(2750) - 1.0 / 16);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_conversion_time);
+  RUN_TEST(test_resolution_for_period);
+  RUN_TEST(test_decode_datasheet);
+  RUN_TEST(test_decode_rejects);
+  RUN_TEST(test_pipeline_fresh);
+  RUN_TEST(test_pipeline_disconnect);
+  return UNITY_END();
+}
@@ -0,0 +1,240 @@
+//
+// Fallback thermostat : rules, and a backend outage against the plant model
+//
+
+#include <unity.h>
+#include <math.h>
+#include "fallback.h"
+#include "relayengine.h"
+#include "../plantparams.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define COOL        0x01
+#define HEAT        0x02
+
+// config.h defaults
+#define HYSTERESIS_X10      5
+#define TIMEOUT_S           300
+#define API_INTERVAL_S      30
+#define COOL_ON_DELAY_S     200
+
+static void test_rules(void)
+{
+  FallbackThermostat fallback(HYSTERESIS_X10, COOL, HEAT);
+  int16_t setPoint_x10;
+
+  // no set-point : all off
+  fallback.takeOver(COOL);
+  TEST_ASSERT_FALSE(fallback.getSetPoint(setPoint_x10));
+  TEST_ASSERT_EQUAL(0, fallback.update(250, true));
+
+  fallback.setSetPoint(180);
+  TEST_ASSERT_EQUAL(COOL, fallback.update(185, true));
+  TEST_ASSERT_EQUAL(COOL, fallback.update(181, true));      // keeps cooling down to the set-point
+  TEST_ASSERT_EQUAL(0, fallback.update(180, true));
+  TEST_ASSERT_EQUAL(0, fallback.update(184, true));         // dead band
+  TEST_ASSERT_EQUAL(0, fallback.update(176, true));
+  TEST_ASSERT_EQUAL(HEAT, fallback.update(175, true));
+  TEST_ASSERT_EQUAL(HEAT, fallback.update(179, true));
+  TEST_ASSERT_EQUAL(0, fallback.update(180, true));
+
+  // invalid temperature : all off
+  fallback.update(200, true);
+  TEST_ASSERT_EQUAL(0, fallback.update(200, false));
+}
+
+// takeover continues from the relays the backend left, never both
+static void test_takeover(void)
+{
+  FallbackThermostat fallback(HYSTERESIS_X10, COOL, HEAT);
+
+  fallback.setSetPoint(180);
+  TEST_ASSERT_FALSE(fallback.isActive());
+
+  fallback.takeOver(COOL | 0x04);
+  TEST_ASSERT_TRUE(fallback.isActive());
+  TEST_ASSERT_EQUAL(COOL, fallback.update(182, true));       // inside the band : keeps cooling
+
+  fallback.takeOver(COOL | HEAT);
+  TEST_ASSERT_EQUAL(0, fallback.update(182, true));
+
+  fallback.handBack();
+  TEST_ASSERT_FALSE(fallback.isActive());
+}
+
+// relays above the first eight (IO-expander, CFG_RELAY_COUNT up to 16)
+static void test_high_relays(void)
+{
+  FallbackThermostat fallback(HYSTERESIS_X10, 0x0200, 0x8000);
+
+  fallback.setSetPoint(180);
+  fallback.takeOver(0x0200 | 0x0001);
+  TEST_ASSERT_EQUAL(0x0200, fallback.update(182, true));
+  TEST_ASSERT_EQUAL(0, fallback.update(180, true));
+  TEST_ASSERT_EQUAL(0x8000, fallback.update(175, true));
+}
+
+// Outage of the backend from 3 h to 8 h, on a 12 h run. The backend runs a
+// 0.3 degree thermostat every API call; during the outage its responses are
+// invalid (or it is silent and the watchdog fires). The compressor relay goes
+// through the actuators relay engine (on delay).
+typedef struct
+{
+  int32_t takeoverS;            // after the outage started
+  int32_t handBackS;            // after the outage ended
+  double rmsC;                  // during the outage, after 30 minutes
+  double maxErrorC;
+  uint32_t compressorStarts;
+  uint32_t minOffS;
+  bool bothOn;
+} outageResult_t;
+
+static outageResult_t runOutage(bool silent)
+{
+  const int16_t setPoint_x10 = 180;
+  const uint32_t outageStartS = 3 * 3600;
+  const uint32_t outageEndS = 8 * 3600;
+  const relayTiming_t timing[2] = {{COOL_ON_DELAY_S * 1000, 0}, {0, 0}};
+  ThermalPlant plant(testPlantParams, 20.0f, 1);
+  FallbackThermostat fallback(HYSTERESIS_X10, COOL, HEAT);
+  RelayEngine relays(timing, 2, 0);
+  outageResult_t result = {-1, -1, 0, 0, 0, UINT32_MAX, false};
+  uint16_t backendRequest = 0;
+  uint16_t actuators = 0;
+  uint16_t output = 0;
+  uint32_t lastValidS = 0;
+  uint32_t offS = 0;
+  double sumSquares = 0;
+  uint32_t samples = 0;
+
+  for (uint32_t t = 0; t < 12 * 3600; t++)
+  {
+    int16_t temperature_x10 = plant.getWortSensor_x10();
+    bool online = (t < outageStartS) || (t >= outageEndS);
+    uint16_t previous = output;
+
+    if (t % API_INTERVAL_S == 0)
+    {
+      if (online)
+      {
+        if (temperature_x10 >= setPoint_x10 + 3)
+        {
+          backendRequest = COOL;
+        }
+        else if (temperature_x10 <= setPoint_x10 - 3)
+        {
+          backendRequest = HEAT;
+        }
+        else if (((backendRequest == COOL) && (temperature_x10 <= setPoint_x10)) ||
+                 ((backendRequest == HEAT) && (temperature_x10 >= setPoint_x10)))
+        {
+          backendRequest = 0;
+        }
+
+        // backendValid() : set-point kept, control handed back
+        fallback.setSetPoint(setPoint_x10);
+        lastValidS = t;
+        if (fallback.isActive())
+        {
+          fallback.handBack();
+          result.handBackS = (int32_t)(t - outageEndS);
+        }
+        actuators = backendRequest;
+      }
+      else if (!silent && !fallback.isActive())
+      {
+        // backendLost("invalid response")
+        fallback.takeOver(actuators);
+        result.takeoverS = (int32_t)(t - outageStartS);
+      }
+    }
+
+    // e_job_backend watchdog
+    if (!fallback.isActive() && (t - lastValidS >= TIMEOUT_S))
+    {
+      fallback.takeOver(actuators);
+      result.takeoverS = (int32_t)(t - outageStartS);
+    }
+
+    if (fallback.isActive())
+    {
+      actuators = fallback.update(temperature_x10, true);
+    }
+
+    output = relays.update(t * 1000, actuators);
+    if ((output & COOL) && !(previous & COOL))
+    {
+      result.compressorStarts++;
+      if ((result.compressorStarts > 1) && (t - offS < result.minOffS))
+      {
+        result.minOffS = t - offS;
+      }
+    }
+    if (!(output & COOL) && (previous & COOL))
+    {
+      offS = t;
+    }
+    result.bothOn = result.bothOn || ((output & (COOL | HEAT)) == (COOL | HEAT));
+
+    plant.step(THERMAL_PLANT_STEP_MS, output & COOL, output & HEAT);
+
+    if ((t >= outageStartS + 1800) && (t < outageEndS))
+    {
+      double error = plant.getWortC() - setPoint_x10 / 10.0;
+
+      sumSquares += error * error;
+      samples++;
+      if (fabs(error) > result.maxErrorC)
+      {
+        result.maxErrorC = fabs(error);
+      }
+    }
+  }
+  result.rmsC = sqrt(sumSquares / samples);
+
+  return result;
+}
+
+static void checkOutage(bool silent)
+{
+  outageResult_t result = runOutage(silent);
+  char message[160];
+
+  snprintf(message, sizeof(message), "%s : takeover after %d s, hand back %d s after return, RMS %.2f C, max %.2f C, %u compressor starts, min off %u s",
+           silent ? "silent backend" : "invalid responses", (int)result.takeoverS, (int)result.handBackS, result.rmsC, result.maxErrorC,
+           (unsigned)result.compressorStarts, (unsigned)result.minOffS);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_TRUE(result.takeoverS >= 0);
+  TEST_ASSERT_TRUE(result.takeoverS <= (silent ? TIMEOUT_S : API_INTERVAL_S));
+  TEST_ASSERT_TRUE(result.handBackS >= 0);
+  TEST_ASSERT_TRUE(result.handBackS <= API_INTERVAL_S);
+  TEST_ASSERT_TRUE(result.rmsC < 0.5);
+  TEST_ASSERT_TRUE(result.maxErrorC < 1.0);
+  TEST_ASSERT_TRUE(result.compressorStarts > 1);
+  TEST_ASSERT_TRUE(result.minOffS >= COOL_ON_DELAY_S);
+  TEST_ASSERT_FALSE(result.bothOn);
+}
+
+static void test_outage_invalid_responses(void)
+{
+  checkOutage(false);
+}
+
+static void test_outage_silent_backend(void)
+{
+  checkOutage(true);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_rules);
+  RUN_TEST(test_takeover);
+  RUN_TEST(test_high_relays);
+  RUN_TEST(test_outage_invalid_responses);
+  RUN_TEST(test_outage_silent_backend);
+  return UNITY_END();
+}
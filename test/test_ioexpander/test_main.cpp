@@ -0,0 +1,181 @@
+//
+// I/O expander shadow register against a fake TCA9555
+//
+
+#include <unity.h>
+#include "ioexpander.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// TCA9555 output registers as seen on the bus : a write16 is one transaction
+// (address, command 0x02, port 0, port 1). A reset brings the power-on
+// value back (all high).
+class FakeTca9555
+{
+public:
+  uint16_t outputs;
+  uint32_t transactions;
+  uint32_t busBytes;
+  bool fail;
+
+  FakeTca9555(void)
+  {
+    outputs = 0xFFFF;
+    transactions = 0;
+    busBytes = 0;
+    fail = false;
+  }
+
+  bool write16(uint16_t value)
+  {
+    transactions++;
+    busBytes += 4;
+    if (fail)
+    {
+      return false;             // NACK
+    }
+    outputs = value;
+    return true;
+  }
+
+  void reset(void)
+  {
+    outputs = 0xFFFF;
+  }
+};
+
+#define RELAY_PINS      0x0003
+
+// relays on pins 0 and 1, active low : the first flush writes, unchanged
+// shadows are skipped, both relays switch in one transaction
+static void test_batch(void)
+{
+  FakeTca9555 tca;
+  IoExpanderShadow<FakeTca9555> expander(tca, RELAY_PINS);
+  ioExpanderStats_t stats;
+
+  expander.set(0, true);
+  expander.set(1, true);
+  TEST_ASSERT_TRUE(expander.flush());
+  TEST_ASSERT_EQUAL(1, tca.transactions);
+  TEST_ASSERT_EQUAL_HEX16(0xFFFF, tca.outputs);
+
+  TEST_ASSERT_TRUE(expander.flush());
+  TEST_ASSERT_EQUAL(1, tca.transactions);
+
+  expander.set(0, false);
+  expander.set(1, false);
+  TEST_ASSERT_TRUE(expander.flush());
+  TEST_ASSERT_EQUAL(2, tca.transactions);
+  TEST_ASSERT_EQUAL_HEX16(0xFFFC, tca.outputs);
+
+  // same value again : no bus traffic
+  expander.set(1, false);
+  TEST_ASSERT_TRUE(expander.flush());
+  TEST_ASSERT_EQUAL(2, tca.transactions);
+  TEST_ASSERT_EQUAL_HEX16(0xFFFC, expander.getShadow());
+
+  expander.getStats(stats);
+  TEST_ASSERT_EQUAL(2, stats.writes);
+  TEST_ASSERT_EQUAL(0, stats.failed);
+  TEST_ASSERT_EQUAL(2, stats.skipped);
+  TEST_ASSERT_EQUAL(2 + 2, stats.pinWrites);
+}
+
+// a NACK leaves the register unknown, the next flush repeats the write
+static void test_failed_write(void)
+{
+  FakeTca9555 tca;
+  IoExpanderShadow<FakeTca9555> expander(tca, RELAY_PINS);
+  ioExpanderStats_t stats;
+
+  expander.set(0, false);
+  TEST_ASSERT_TRUE(expander.flush());
+
+  tca.fail = true;
+  expander.set(1, false);
+  TEST_ASSERT_FALSE(expander.flush());
+  TEST_ASSERT_EQUAL_HEX16(0xFFFE, tca.outputs);
+
+  tca.fail = false;
+  TEST_ASSERT_TRUE(expander.flush());
+  TEST_ASSERT_EQUAL_HEX16(0xFFFC, tca.outputs);
+  TEST_ASSERT_EQUAL(3, tca.transactions);
+
+  expander.getStats(stats);
+  TEST_ASSERT_EQUAL(3, stats.writes);
+  TEST_ASSERT_EQUAL(1, stats.failed);
+  TEST_ASSERT_EQUAL(0, stats.skipped);
+}
+
+// after an expander reset the shadow no longer matches : force rewrites it
+static void test_force(void)
+{
+  FakeTca9555 tca;
+  IoExpanderShadow<FakeTca9555> expander(tca, RELAY_PINS);
+
+  expander.set(0, false);
+  TEST_ASSERT_TRUE(expander.flush());
+  tca.reset();
+
+  TEST_ASSERT_TRUE(expander.flush());
+  TEST_ASSERT_EQUAL_HEX16(0xFFFF, tca.outputs);
+  TEST_ASSERT_TRUE(expander.flush(true));
+  TEST_ASSERT_EQUAL_HEX16(0xFFFE, tca.outputs);
+  TEST_ASSERT_EQUAL(2, tca.transactions);
+}
+
+// A day of relay traffic on 16 relays, the actuators task flushing once per
+// update : bus transactions against writing pin by pin
+static void test_traffic(void)
+{
+  FakeTca9555 tca;
+  IoExpanderShadow<FakeTca9555> expander(tca, 0xFFFF);
+  ioExpanderStats_t stats;
+  uint32_t seed = 1;
+  uint32_t updates = 0;
+  char message[128];
+
+  TEST_ASSERT_TRUE(expander.flush(true));
+  for (uint32_t t = 0; t < 86400; t += 10)
+  {
+    // a few relays switch together now and then (cool / heat / pumps)
+    seed = seed * 1103515245 + 12345;
+    if ((seed >> 16) % 8 == 0)
+    {
+      uint16_t relays = (seed >> 8) & 0xFFFF;
+
+      for (uint8_t pin = 0; pin < 16; pin++)
+      {
+        if ((relays >> pin) & 1)
+        {
+          expander.set(pin, !((expander.getShadow() >> pin) & 1));
+        }
+      }
+    }
+    TEST_ASSERT_TRUE(expander.flush());
+    TEST_ASSERT_EQUAL_HEX16(expander.getShadow(), tca.outputs);
+    updates++;
+  }
+
+  expander.getStats(stats);
+  snprintf(message, sizeof(message), "%u updates : %u transactions (%u bus bytes), pin by pin %u",
+           (unsigned)updates, (unsigned)tca.transactions, (unsigned)tca.busBytes, (unsigned)stats.pinWrites);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_EQUAL(stats.writes, tca.transactions);
+  TEST_ASSERT_EQUAL(updates + 1, stats.writes + stats.skipped);
+  TEST_ASSERT_TRUE(tca.transactions < updates / 4);
+  TEST_ASSERT_TRUE(stats.pinWrites > 4 * tca.transactions);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_batch);
+  RUN_TEST(test_failed_write);
+  RUN_TEST(test_force);
+  RUN_TEST(test_traffic);
+  return UNITY_END();
+}
@@ -0,0 +1,344 @@
+//
+// Lanes & mailbox : backpressure policies under a message flood
+//
+
+#include <unity.h>
+#include <deque>
+#include "lanes.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Message classes like those of the controller
+enum
+{
+  CLASS_ACTUATOR,               // safety lane, block
+  CLASS_SETUP,                  // normal lane, block
+  CLASS_HYDRO,                  // normal lane, drop-oldest (pool slot to free)
+  CLASS_TEMPERATURE,            // bulk lane, coalesce per sensor
+  CLASS_WIFI,                   // bulk lane, coalesce
+  CLASS_BUTTON,                 // normal lane, drop-newest
+  CLASS_COUNT
+};
+
+enum
+{
+  LANE_SAFETY,
+  LANE_NORMAL,
+  LANE_BULK,
+  LANE_COUNT
+};
+
+static const laneClass_t classes[CLASS_COUNT] = {
+    {LANE_SAFETY, e_policy_block},
+    {LANE_NORMAL, e_policy_block},
+    {LANE_NORMAL, e_policy_drop_oldest},
+    {LANE_BULK, e_policy_coalesce},
+    {LANE_BULK, e_policy_coalesce},
+    {LANE_NORMAL, e_policy_drop_newest},
+};
+
+typedef struct
+{
+  uint8_t classIndex;
+  uint8_t number;
+  uint32_t sequence;
+} testItem_t;
+
+// Fake queues (FreeRTOS semantics, without waiting). A blocked send gives the
+// receiver the chance to take messages : onBlock is called before the retry.
+class FakePort
+{
+public:
+  std::deque<testItem_t> queues[LANE_COUNT];
+  uint8_t lengths[LANE_COUNT];
+  uint32_t discarded;
+  uint32_t waits;
+  uint32_t locks;
+  void (*onBlock)(void);
+
+  FakePort(void)
+  {
+    lengths[LANE_SAFETY] = 4;
+    lengths[LANE_NORMAL] = 6;
+    lengths[LANE_BULK] = 4;
+    discarded = 0;
+    waits = 0;
+    locks = 0;
+    onBlock = NULL;
+  }
+
+  bool send(uint8_t lane, const testItem_t &item, uint32_t waitTicks)
+  {
+    if ((queues[lane].size() >= lengths[lane]) && (waitTicks > 0))
+    {
+      waits++;
+      if (onBlock != NULL)
+      {
+        onBlock();
+      }
+    }
+    if (queues[lane].size() >= lengths[lane])
+    {
+      return false;
+    }
+    queues[lane].push_back(item);
+    return true;
+  }
+
+  bool sendToFront(uint8_t lane, const testItem_t &item)
+  {
+    if (queues[lane].size() >= lengths[lane])
+    {
+      return false;
+    }
+    queues[lane].push_front(item);
+    return true;
+  }
+
+  bool receive(uint8_t lane, testItem_t &item)
+  {
+    if (queues[lane].empty())
+    {
+      return false;
+    }
+    item = queues[lane].front();
+    queues[lane].pop_front();
+    return true;
+  }
+
+  bool peek(uint8_t lane, testItem_t &item)
+  {
+    if (queues[lane].empty())
+    {
+      return false;
+    }
+    item = queues[lane].front();
+    return true;
+  }
+
+  uint8_t waiting(uint8_t lane)
+  {
+    return queues[lane].size();
+  }
+
+  void lock(void)
+  {
+    locks++;
+  }
+
+  void unlock(void)
+  {
+    locks--;
+  }
+
+  laneClass_t classify(const testItem_t &item, uint8_t &classIndex)
+  {
+    classIndex = item.classIndex;
+    return classes[item.classIndex];
+  }
+
+  uint8_t number(const testItem_t &item)
+  {
+    return item.number;
+  }
+
+  void discard(const testItem_t &)
+  {
+    discarded++;
+  }
+};
+
+typedef Lanes<testItem_t, FakePort, LANE_COUNT, 12> TestLanes;
+
+static bool sendItem(TestLanes &lanes, uint8_t classIndex, uint8_t number, uint32_t sequence)
+{
+  testItem_t item = {classIndex, number, sequence};
+  uint8_t index;
+
+  return lanes.send(item, 10, index);
+}
+
+// latest wins per class & number, a full mailbox refuses
+static void test_mailbox(void)
+{
+  Mailbox<testItem_t, 3> mailbox;
+  testItem_t item = {CLASS_TEMPERATURE, 0, 1};
+
+  TEST_ASSERT_EQUAL(e_mailbox_added, mailbox.put(LANE_BULK, CLASS_TEMPERATURE, 0, item));
+  item.sequence = 2;
+  TEST_ASSERT_EQUAL(e_mailbox_replaced, mailbox.put(LANE_BULK, CLASS_TEMPERATURE, 0, item));
+  TEST_ASSERT_EQUAL(e_mailbox_added, mailbox.put(LANE_BULK, CLASS_TEMPERATURE, 1, item));
+  item.classIndex = CLASS_WIFI;
+  TEST_ASSERT_EQUAL(e_mailbox_added, mailbox.put(LANE_NORMAL, CLASS_WIFI, 0, item));
+  TEST_ASSERT_EQUAL(e_mailbox_full, mailbox.put(LANE_BULK, CLASS_TEMPERATURE, 2, item));
+  TEST_ASSERT_EQUAL(3, mailbox.waiting());
+
+  TEST_ASSERT_TRUE(mailbox.take(LANE_NORMAL, item));
+  TEST_ASSERT_EQUAL(CLASS_WIFI, item.classIndex);
+  TEST_ASSERT_FALSE(mailbox.take(LANE_NORMAL, item));
+  TEST_ASSERT_TRUE(mailbox.take(LANE_BULK, item));
+  TEST_ASSERT_EQUAL(2, item.sequence);
+  TEST_ASSERT_TRUE(mailbox.take(LANE_BULK, item));
+  TEST_ASSERT_FALSE(mailbox.take(LANE_BULK, item));
+  TEST_ASSERT_EQUAL(0, mailbox.waiting());
+}
+
+// Flood without a receiver : 1000 temperatures of 4 sensors, hydrometer
+// readings, WiFi status and actuator commands. The actuator commands all
+// arrive and go first, temperatures collapse to the latest per sensor, every
+// hydrometer reading is either received or its pool slot freed.
+static void test_flood(void)
+{
+  FakePort port;
+  TestLanes lanes(port);
+  testItem_t item;
+  laneStats_t stats;
+  uint32_t sentActuators = 0;
+  uint32_t sentHydro = 0;
+  uint32_t latest[4] = {0};
+  uint32_t received = 0;
+  uint32_t actuators = 0;
+  uint32_t temperatures = 0;
+  uint32_t hydro = 0;
+  bool safetyFirst = true;
+
+  for (uint32_t i = 0; i < 1000; i++)
+  {
+    TEST_ASSERT_TRUE(sendItem(lanes, CLASS_TEMPERATURE, i % 4, i));
+    latest[i % 4] = i;
+    if (i % 20 == 0)
+    {
+      sendItem(lanes, CLASS_HYDRO, 0, i);
+      sentHydro++;
+    }
+    if (i % 50 == 0)
+    {
+      TEST_ASSERT_TRUE(sendItem(lanes, CLASS_WIFI, 0, i));
+    }
+    if (i % 333 == 0)
+    {
+      TEST_ASSERT_TRUE(sendItem(lanes, CLASS_ACTUATOR, i % 2, i));
+      sentActuators++;
+    }
+  }
+  TEST_ASSERT_EQUAL(0, port.locks);
+  TEST_ASSERT_EQUAL(0, port.waits);
+
+  while (lanes.receive(item))
+  {
+    received++;
+    switch (item.classIndex)
+    {
+    case CLASS_ACTUATOR:
+      actuators++;
+      safetyFirst = safetyFirst && (received == actuators);
+      break;
+    case CLASS_TEMPERATURE:
+      temperatures++;
+      TEST_ASSERT_EQUAL(latest[item.number], item.sequence);
+      break;
+    case CLASS_HYDRO:
+      hydro++;
+      break;
+    default:
+      break;
+    }
+  }
+
+  TEST_ASSERT_EQUAL(4, sentActuators);
+  TEST_ASSERT_EQUAL(sentActuators, actuators);
+  TEST_ASSERT_TRUE(safetyFirst);
+  TEST_ASSERT_EQUAL(4, temperatures);
+  TEST_ASSERT_EQUAL(6, hydro);
+  TEST_ASSERT_EQUAL(sentHydro, hydro + port.discarded);
+
+  lanes.getStats(LANE_BULK, stats);
+  TEST_ASSERT_EQUAL(1000 + 20, stats.sent);
+  TEST_ASSERT_EQUAL(0, stats.dropped);
+  TEST_ASSERT_EQUAL(1000 + 20 - 5, stats.coalesced);
+  TEST_ASSERT_EQUAL(0, stats.highWater);
+  lanes.getStats(LANE_NORMAL, stats);
+  TEST_ASSERT_EQUAL(port.discarded, stats.dropped);
+  TEST_ASSERT_EQUAL(6, stats.highWater);
+}
+
+// Drop-oldest never discards a message of a class that must be delivered :
+// with set-up messages at the head of the lane the new message is dropped.
+static void test_drop_oldest_keeps_blocking(void)
+{
+  FakePort port;
+  TestLanes lanes(port);
+  testItem_t item;
+
+  for (uint32_t i = 0; i < 6; i++)
+  {
+    TEST_ASSERT_TRUE(sendItem(lanes, CLASS_SETUP, 0, i));
+  }
+  TEST_ASSERT_FALSE(sendItem(lanes, CLASS_HYDRO, 0, 100));
+  TEST_ASSERT_EQUAL(0, port.discarded);
+  TEST_ASSERT_FALSE(sendItem(lanes, CLASS_BUTTON, 0, 101));
+
+  for (uint32_t i = 0; i < 6; i++)
+  {
+    TEST_ASSERT_TRUE(lanes.receive(item));
+    TEST_ASSERT_EQUAL(CLASS_SETUP, item.classIndex);
+    TEST_ASSERT_EQUAL(i, item.sequence);
+  }
+  TEST_ASSERT_FALSE(lanes.receive(item));
+}
+
+// Block : the sender waits, and gets in when the receiver makes room
+static TestLanes *blockLanes;
+static uint32_t blockTaken;
+
+static void receiveOne(void)
+{
+  testItem_t item;
+
+  if (blockLanes->receive(item))
+  {
+    blockTaken++;
+  }
+}
+
+static void test_block(void)
+{
+  FakePort port;
+  TestLanes lanes(port);
+  laneStats_t stats;
+
+  for (uint32_t i = 0; i < 4; i++)
+  {
+    TEST_ASSERT_TRUE(sendItem(lanes, CLASS_ACTUATOR, 0, i));
+  }
+
+  // nobody takes a message : dropped after the wait
+  TEST_ASSERT_FALSE(sendItem(lanes, CLASS_ACTUATOR, 0, 4));
+
+  blockLanes = &lanes;
+  blockTaken = 0;
+  port.onBlock = receiveOne;
+  for (uint32_t i = 5; i < 100; i++)
+  {
+    TEST_ASSERT_TRUE(sendItem(lanes, CLASS_ACTUATOR, 0, i));
+  }
+  TEST_ASSERT_EQUAL(95, blockTaken);
+
+  lanes.getStats(LANE_SAFETY, stats);
+  TEST_ASSERT_EQUAL(4 + 95, stats.sent);
+  TEST_ASSERT_EQUAL(1, stats.dropped);
+  TEST_ASSERT_EQUAL(96, stats.blocked);
+  TEST_ASSERT_EQUAL(96, port.waits);
+  TEST_ASSERT_EQUAL(4, stats.highWater);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_mailbox);
+  RUN_TEST(test_flood);
+  RUN_TEST(test_drop_oldest_keeps_blocking);
+  RUN_TEST(test_block);
+  return UNITY_END();
+}
@@ -0,0 +1,227 @@
+//
+// Compressor MPC : identification and control of the chamber model,
+// against the hysteresis thermostat
+//
+
+#include <unity.h>
+#include <math.h>
+#include "mpc.h"
+#include "fallback.h"
+#include "relayengine.h"
+#include "../plantparams.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// config.h defaults : 10 s samples, 120 s steps, 80 minute horizon
+#define SAMPLE_S            10
+#define STEP_S              120
+#define COOL_ON_DELAY_S     200
+#define MIN_ON_S            180
+#define SET_POINT_X10       180
+#define DAYS                5
+
+static const mpcParams_t mpcParams = {STEP_S / SAMPLE_S, 40, (MIN_ON_S + STEP_S - 1) / STEP_S, (COOL_ON_DELAY_S + STEP_S - 1) / STEP_S,
+                                      6 * 3600 / STEP_S, 3, 0.998f, 300.0f};
+
+typedef struct
+{
+  double startsPerDay;
+  double rmsC;
+  double underC;                // largest error below the set-point
+  double overC;
+  uint32_t minOnS;              // of the request
+  uint32_t minOffS;
+} chamberResult_t;
+
+// The controller decides every sample, the compressor goes through the
+// actuators relay engine (on delay). Results over the days after the first.
+template <class Control> static chamberResult_t runChamber(Control &control, float ambientC)
+{
+  thermalPlantParams_t params = testPlantParams;
+  const relayTiming_t timing[1] = {{COOL_ON_DELAY_S * 1000, 0}};
+  RelayEngine relays(timing, 1, 0);
+  chamberResult_t result = {0, 0, 0, 0, UINT32_MAX, UINT32_MAX};
+  bool request = false;
+  uint32_t switchS = 0;
+  uint16_t output = 0;
+  uint32_t starts = 0;
+  double sumSquares = 0;
+  uint32_t samples = 0;
+
+  params.ambientC = ambientC;
+  ThermalPlant plant(params, 22.0f, 7);
+
+  for (uint32_t t = 0; t < DAYS * 86400; t++)
+  {
+    uint16_t previous = output;
+
+    if (t % SAMPLE_S == 0)
+    {
+      bool newRequest = control.sample(plant.getWortSensor_x10());
+
+      if (newRequest != request)
+      {
+        if (request && (t - switchS < result.minOnS))
+        {
+          result.minOnS = t - switchS;
+        }
+        if (!request && (switchS > 0) && (t - switchS < result.minOffS))
+        {
+          result.minOffS = t - switchS;
+        }
+        request = newRequest;
+        switchS = t;
+      }
+    }
+
+    output = relays.update(t * 1000, request ? 1 : 0);
+    if ((output & 1) && !(previous & 1) && (t >= 86400))
+    {
+      starts++;
+    }
+    plant.step(THERMAL_PLANT_STEP_MS, output & 1, false);
+
+    if (t >= 86400)
+    {
+      double error = plant.getWortC() - SET_POINT_X10 / 10.0;
+
+      sumSquares += error * error;
+      samples++;
+      result.underC = (error < result.underC) ? error : result.underC;
+      result.overC = (error > result.overC) ? error : result.overC;
+    }
+  }
+
+  result.startsPerDay = starts / (DAYS - 1.0);
+  result.rmsC = sqrt(sumSquares / samples);
+  return result;
+}
+
+class ThermostatControl
+{
+public:
+  FallbackThermostat thermostat;
+
+  ThermostatControl(void) : thermostat(5, 1, 0)
+  {
+    thermostat.setSetPoint(SET_POINT_X10);
+    thermostat.takeOver(0);
+  }
+
+  bool sample(int16_t temperature_x10)
+  {
+    return thermostat.update(temperature_x10, true) & 1;
+  }
+};
+
+class MpcControl
+{
+public:
+  CompressorMpc mpc;
+  bool relay;
+
+  MpcControl(void) : mpc(mpcParams)
+  {
+    relay = false;
+  }
+
+  bool sample(int16_t temperature_x10)
+  {
+    if (mpc.sample(temperature_x10, true))
+    {
+      relay = mpc.step(SET_POINT_X10, true);
+    }
+    return relay;
+  }
+};
+
+static void reportChamber(const char *name, float ambientC, const chamberResult_t &result)
+{
+  char message[160];
+
+  snprintf(message, sizeof(message), "ambient %.0f C, %s : %.1f starts/day, RMS %.3f C, %+.2f .. %+.2f C, min on %u s, min off %u s",
+           ambientC, name, result.startsPerDay, result.rmsC, result.underC, result.overC, (unsigned)result.minOnS, (unsigned)result.minOffS);
+  TEST_MESSAGE(message);
+}
+
+// At several ambient temperatures the MPC identifies the chamber and keeps
+// the wort much closer to the set-point than the 0.5 degree thermostat,
+// without short cycles
+static void test_chamber(void)
+{
+  static const float ambients[] = {22.0f, 26.0f, 30.0f};
+
+  for (unsigned i = 0; i < sizeof(ambients) / sizeof(ambients[0]); i++)
+  {
+    ThermostatControl thermostat;
+    MpcControl mpc;
+    chamberResult_t thermostatResult = runChamber(thermostat, ambients[i]);
+    chamberResult_t mpcResult = runChamber(mpc, ambients[i]);
+    float coolRate_x10;
+    uint8_t dead;
+
+    reportChamber("thermostat", ambients[i], thermostatResult);
+    reportChamber("mpc       ", ambients[i], mpcResult);
+
+    TEST_ASSERT_TRUE(mpc.mpc.isIdentified());
+    mpc.mpc.getModel(coolRate_x10, dead);
+    TEST_ASSERT_TRUE(coolRate_x10 > 0);
+    TEST_ASSERT_TRUE(dead < MPC_MAX_DEAD_STEPS);
+
+    TEST_ASSERT_TRUE(mpcResult.rmsC < thermostatResult.rmsC / 2);
+    TEST_ASSERT_TRUE(mpcResult.underC > -0.4);
+    TEST_ASSERT_TRUE(mpcResult.overC < 0.4);
+    TEST_ASSERT_TRUE(mpcResult.startsPerDay < 24);
+    TEST_ASSERT_TRUE(mpcResult.minOnS >= MIN_ON_S);
+    TEST_ASSERT_TRUE(mpcResult.minOffS >= COOL_ON_DELAY_S);
+  }
+}
+
+// one model step of readings
+static bool stepMpc(CompressorMpc &mpc, int16_t temperature_x10, bool valid, bool setPointValid)
+{
+  for (uint8_t i = 0; i < mpcParams.samplesPerStep - 1; i++)
+  {
+    TEST_ASSERT_FALSE(mpc.sample(temperature_x10, valid));
+  }
+  TEST_ASSERT_TRUE(mpc.sample(temperature_x10, valid));
+  return mpc.step(SET_POINT_X10, setPointValid);
+}
+
+// After boot the relay stays off for its minimum off time. Without a
+// set-point or without valid readings it goes off, after its minimum on time.
+static void test_relay_off(void)
+{
+  CompressorMpc mpc(mpcParams);
+  uint16_t steps;
+
+  // thermostat phase : far above the set-point
+  for (steps = 0; !stepMpc(mpc, 250, true, true); steps++)
+  {
+  }
+  TEST_ASSERT_EQUAL(mpcParams.minOffSteps, steps);
+
+  for (steps = 1; stepMpc(mpc, 250, true, false); steps++)
+  {
+  }
+  TEST_ASSERT_EQUAL(mpcParams.minOnSteps, steps);
+
+  // on again, then the sensor fails
+  while (!stepMpc(mpc, 250, true, true))
+  {
+  }
+  for (steps = 1; stepMpc(mpc, 0, false, true); steps++)
+  {
+  }
+  TEST_ASSERT_EQUAL(mpcParams.minOnSteps, steps);
+  TEST_ASSERT_FALSE(stepMpc(mpc, 0, false, true));
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_chamber);
+  RUN_TEST(test_relay_off);
+  return UNITY_END();
+}
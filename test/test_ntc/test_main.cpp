@@ -0,0 +1,127 @@
+//
+// NtcLut : compile time table against the Steinhart-Hart equation in double
+//
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include "ntc.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// 10K NTC, 10K series resistor (config.h defaults)
+struct testProbe
+{
+  static constexpr double A = 1.009249522e-3;
+  static constexpr double B = 2.378405444e-4;
+  static constexpr double C = 2.019202697e-7;
+  static constexpr double seriesOhm = 10000.0;
+};
+
+static double celcius(uint16_t ratio16)
+{
+  double ratio = ratio16 / 65536.0;
+  double lnR = log(testProbe::seriesOhm * ratio / (1.0 - ratio));
+
+  return 1.0 / (testProbe::A + testProbe::B * lnR + testProbe::C * lnR * lnR * lnR) - 273.15;
+}
+
+// compile time logarithm
+static void test_ln(void)
+{
+  static const double x[] = {1e-3, 0.5, 1.0, 1.5, 2.0, 10000.0, 1e6};
+
+  for (unsigned i = 0; i < sizeof(x) / sizeof(x[0]); i++)
+  {
+    TEST_ASSERT_TRUE(fabs(ntcLn(x[i]) - log(x[i])) < 1e-12 * (1.0 + fabs(log(x[i]))));
+  }
+}
+
+// table entries : the equation at the segment boundaries, rounded
+static void test_table(void)
+{
+  typedef NtcTable<testProbe, 64, NtcMakeIndexList<65>::type> table;
+
+  // middle of the table : NTC = series resistor, about 25 degrees
+  static_assert((table::values[32] > 240) && (table::values[32] < 260), "10K NTC at 25 degrees");
+
+  for (int i = 1; i < 64; i++)
+  {
+    TEST_ASSERT_TRUE(fabs(table::values[i] - 10.0 * celcius(i * 1024)) <= 0.5);
+  }
+}
+
+// Largest error from -20 to 110 degrees over all ratios, includes the
+// rounding to 0.1 degree. Returns the error in 0.001 degree.
+template <int SEGMENTS_LOG2> static int maxError(void)
+{
+  double error = 0.0;
+  int16_t temperature;
+
+  for (uint32_t r = 0; r < 65536; r++)
+  {
+    double expected = celcius(r);
+
+    if (NtcLut<testProbe, SEGMENTS_LOG2>::temperature_x10(r, temperature) && (expected >= -20.0) && (expected <= 110.0))
+    {
+      error = fmax(error, fabs(temperature / 10.0 - expected));
+    }
+  }
+  return (int)(error * 1000.0);
+}
+
+static void test_accuracy(void)
+{
+  char line[96];
+  int error5 = maxError<5>();
+  int error6 = maxError<6>();
+  int error7 = maxError<7>();
+
+  snprintf(line, sizeof(line), "max error -20..110 C : %d / %d / %d mC (32 / 64 / 128 segments)", error5, error6, error7);
+  TEST_MESSAGE(line);
+
+  TEST_ASSERT_TRUE(error5 < 1000);
+  TEST_ASSERT_TRUE(error6 < 300);
+  TEST_ASSERT_TRUE(error7 < 150);   // CFG_NTC_LUT_SEGMENTS_LOG2 default
+}
+
+// higher ratio : higher NTC resistance : lower temperature
+static void test_monotonic(void)
+{
+  int16_t previous = INT16_MAX;
+  int16_t temperature;
+
+  for (uint32_t r = 0; r < 65536; r++)
+  {
+    if (NtcLut<testProbe, 7>::temperature_x10(r, temperature))
+    {
+      TEST_ASSERT_TRUE(temperature <= previous);
+      previous = temperature;
+    }
+  }
+}
+
+// first and last segment : short / open circuit
+static void test_short_open(void)
+{
+  int16_t temperature;
+
+  TEST_ASSERT_FALSE((NtcLut<testProbe, 7>::temperature_x10(0, temperature)));
+  TEST_ASSERT_FALSE((NtcLut<testProbe, 7>::temperature_x10(511, temperature)));
+  TEST_ASSERT_TRUE((NtcLut<testProbe, 7>::temperature_x10(512, temperature)));
+  TEST_ASSERT_TRUE((NtcLut<testProbe, 7>::temperature_x10(65535 - 512, temperature)));
+  TEST_ASSERT_FALSE((NtcLut<testProbe, 7>::temperature_x10(65535 - 511, temperature)));
+  TEST_ASSERT_FALSE((NtcLut<testProbe, 7>::temperature_x10(65535, temperature)));
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_ln);
+  RUN_TEST(test_table);
+  RUN_TEST(test_accuracy);
+  RUN_TEST(test_monotonic);
+  RUN_TEST(test_short_open);
+  return UNITY_END();
+}
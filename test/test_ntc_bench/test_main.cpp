@@ -0,0 +1,75 @@
+//
+// NtcLut benchmark : time per conversion against Steinhart-Hart with log()
+//
+// pio test -e native -f test_ntc_bench -v   (prints the result)
+//
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include "ntc.h"
+#include "../bench.h"
+
+#define BENCH_ROUNDS    50
+
+void setUp(void) {}
+void tearDown(void) {}
+
+struct testProbe
+{
+  static constexpr double A = 1.009249522e-3;
+  static constexpr double B = 2.378405444e-4;
+  static constexpr double C = 2.019202697e-7;
+  static constexpr double seriesOhm = 10000.0;
+};
+
+// what the LUT replaces : float math at runtime
+static bool steinhartHart_x10(uint16_t ratio16, int16_t &temperature)
+{
+  float ratio = ratio16 / 65536.0f;
+  float lnR = logf((float)testProbe::seriesOhm * ratio / (1.0f - ratio));
+
+  temperature = (int16_t)(10.0f / ((float)testProbe::A + (float)testProbe::B * lnR + (float)testProbe::C * lnR * lnR * lnR) - 2731.5f);
+  return true;
+}
+
+template <bool (*CONVERT)(uint16_t, int16_t &)> static uint64_t perConversion(void)
+{
+  uint64_t start;
+  uint64_t stop;
+  int16_t temperature;
+  int sum = 0;
+
+  start = benchNow();
+  for (int k = 0; k < BENCH_ROUNDS; k++)
+  {
+    for (uint32_t r = 1; r < 65535; r++)
+    {
+      CONVERT(r, temperature);
+      sum += temperature;
+    }
+  }
+  stop = benchNow();
+  benchSink = sum;
+
+  return (stop - start) * 100 / (BENCH_ROUNDS * 65534ULL);
+}
+
+static void test_bench_conversion(void)
+{
+  uint64_t lut = perConversion<NtcLut<testProbe, 7>::temperature_x10>();
+  uint64_t reference = perConversion<steinhartHart_x10>();
+  char line[96];
+
+  snprintf(line, sizeof(line), "NtcLut %u.%02u, logf %u.%02u %s/conversion",
+           (unsigned)(lut / 100), (unsigned)(lut % 100), (unsigned)(reference / 100), (unsigned)(reference % 100), BENCH_UNIT);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_TRUE(lut < reference);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_bench_conversion);
+  return UNITY_END();
+}
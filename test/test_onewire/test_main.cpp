@@ -0,0 +1,349 @@
+//
+// 1-Wire RMT symbols : encoder, decoder & CRC against a simulated wire
+//
+
+#include <unity.h>
+#include <string.h>
+#include "onewire_rmt.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Simulated devices, at the slot level. A device samples a write slot 30 us
+// after the falling edge, and answers a read slot by holding the wire low.
+// The wire is a wired AND : the RX channel sees the longest low pulse.
+// Timing of the devices varies within the datasheet limits.
+
+static uint32_t seed = 1;
+
+static uint32_t simRandom(uint32_t range)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed % range;
+}
+
+class SimDevice
+{
+private:
+  enum { IDLE, ROM, MATCH, FUNCTION, READ } state;
+  uint8_t byteIn;
+  uint8_t bitsIn;
+  uint8_t matched;
+  bool selected;
+  uint8_t out[9];
+  uint8_t outBit;
+
+  void receive(uint8_t value)
+  {
+    switch (state)
+    {
+    case ROM:
+      if (value == 0xCC)
+      {
+        selected = true;
+        state = FUNCTION;
+      }
+      else if (value == 0x55)
+      {
+        matched = 0;
+        selected = true;
+        state = MATCH;
+      }
+      else
+      {
+        state = IDLE;
+      }
+      break;
+    case MATCH:
+      selected = selected && (value == rom[matched]);
+      if (++matched == 8)
+      {
+        state = selected ? FUNCTION : IDLE;
+      }
+      break;
+    case FUNCTION:
+      if (value == 0xBE)
+      {
+        memcpy(out, scratchPad, sizeof(out));
+        outBit = 0;
+        state = READ;
+      }
+      else
+      {
+        state = IDLE;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+public:
+  uint8_t rom[8];
+  uint8_t scratchPad[9];
+  bool present;
+
+  SimDevice(void)
+  {
+    state = IDLE;
+    present = true;
+  }
+
+  // reset : presence pulse length (us), 0 when absent
+  uint16_t reset(void)
+  {
+    state = present ? ROM : IDLE;
+    byteIn = 0;
+    bitsIn = 0;
+    return present ? 60 + simRandom(181) : 0;
+  }
+
+  // slot : low time (us) this device holds the wire from the falling edge
+  uint16_t slot(const oneWireSymbol_t &symbol)
+  {
+    uint16_t holdUs = 0;
+
+    if (state == READ)
+    {
+      if (outBit < 72)
+      {
+        if (!((out[outBit / 8] >> (outBit % 8)) & 1))
+        {
+          holdUs = 15 + simRandom(46);
+        }
+        outBit++;
+      }
+      return holdUs;
+    }
+
+    if (state != IDLE)
+    {
+      byteIn |= ((symbol.lowUs < 30) ? 1 : 0) << bitsIn;
+      if (++bitsIn == 8)
+      {
+        receive(byteIn);
+        byteIn = 0;
+        bitsIn = 0;
+      }
+    }
+    return 0;
+  }
+};
+
+#define SIM_DEVICES 3
+
+static SimDevice devices[SIM_DEVICES];
+
+// What OneWireRMT::transfer() returns : the low pulses the RX channel records
+static void simTransfer(const oneWireSymbol_t *symbols, uint8_t count, uint16_t *lowUs, uint8_t &numLow)
+{
+  numLow = 0;
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    uint16_t wireUs = symbols[i].lowUs + simRandom(3);   // rise time
+    uint16_t presenceUs = 0;
+
+    for (uint8_t d = 0; d < SIM_DEVICES; d++)
+    {
+      if (symbols[i].lowUs == OW_RESET_LOW_US)
+      {
+        uint16_t pulseUs = devices[d].reset();
+        presenceUs = (pulseUs > presenceUs) ? pulseUs : presenceUs;
+      }
+      else
+      {
+        uint16_t holdUs = devices[d].slot(symbols[i]);
+        wireUs = (holdUs > wireUs) ? holdUs : wireUs;
+      }
+    }
+
+    lowUs[numLow++] = wireUs;
+    if (presenceUs > 0)
+    {
+      lowUs[numLow++] = presenceUs;
+    }
+  }
+}
+
+// bus operations built like OneWireRMT
+static bool simReset(void)
+{
+  oneWireSymbol_t symbol;
+  uint16_t lowUs[4];
+  uint8_t numLow;
+
+  oneWireEncodeReset(&symbol);
+  simTransfer(&symbol, 1, lowUs, numLow);
+  return oneWireDecodePresence(lowUs, numLow);
+}
+
+static void simWrite(uint8_t value)
+{
+  oneWireSymbol_t symbols[8];
+  uint16_t lowUs[8];
+  uint8_t numLow;
+
+  oneWireEncodeByte(value, symbols);
+  simTransfer(symbols, 8, lowUs, numLow);
+}
+
+static bool simRead(uint8_t &value)
+{
+  oneWireSymbol_t symbols[8];
+  uint16_t lowUs[8];
+  uint8_t numLow;
+
+  oneWireEncodeByte(0xFF, symbols);
+  simTransfer(symbols, 8, lowUs, numLow);
+  return oneWireDecodeBits(lowUs, numLow, 8, value);
+}
+
+static void initDevices(void)
+{
+  for (uint8_t d = 0; d < SIM_DEVICES; d++)
+  {
+    devices[d] = SimDevice();
+    devices[d].rom[0] = 0x28;
+    for (uint8_t i = 1; i < 7; i++)
+    {
+      devices[d].rom[i] = simRandom(256);
+    }
+    devices[d].rom[7] = oneWireCrc8(devices[d].rom, 7);
+  }
+}
+
+// slot timing within the 1-Wire standard speed limits
+static void test_encode_timing(void)
+{
+  oneWireSymbol_t symbol;
+  oneWireSymbol_t symbols[8];
+
+  oneWireEncodeReset(&symbol);
+  TEST_ASSERT_TRUE(symbol.lowUs >= 480);
+  TEST_ASSERT_TRUE(symbol.releaseUs >= 480);
+  // longest presence (wait 60 + pulse 240) ends inside the window, the rest
+  // of the window is long enough to end the receive
+  TEST_ASSERT_TRUE(symbol.releaseUs >= 60 + OW_PRESENCE_MAX_US + OW_RX_IDLE_US);
+
+  for (uint8_t bit = 0; bit < 2; bit++)
+  {
+    oneWireEncodeBit(bit, &symbol);
+    TEST_ASSERT_TRUE(symbol.lowUs + symbol.releaseUs >= 60 + 1);
+    TEST_ASSERT_TRUE(symbol.lowUs + symbol.releaseUs <= 120 + 10);
+    TEST_ASSERT_TRUE(symbol.releaseUs >= 1);
+    // released time inside a byte does not end the receive
+    TEST_ASSERT_TRUE(symbol.releaseUs < OW_RX_IDLE_US);
+  }
+  oneWireEncodeBit(1, &symbol);
+  TEST_ASSERT_TRUE(symbol.lowUs >= 1 && symbol.lowUs < OW_READ_THRESHOLD_US);
+  oneWireEncodeBit(0, &symbol);
+  TEST_ASSERT_TRUE(symbol.lowUs >= 60);
+
+  oneWireEncodeByte(0xA5, symbols);
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    oneWireEncodeBit((0xA5 >> i) & 1, &symbol);
+    TEST_ASSERT_EQUAL(symbol.lowUs, symbols[i].lowUs);
+  }
+}
+
+static void test_decode(void)
+{
+  const uint16_t presence[] = {480, 120};
+  const uint16_t noPresence[] = {480};
+  const uint16_t shortPulse[] = {480, 20};
+  const uint16_t bits[] = {6, 40, 8, 16, 60, 7, 14, 30};
+  uint8_t value;
+
+  TEST_ASSERT_TRUE(oneWireDecodePresence(presence, 2));
+  TEST_ASSERT_FALSE(oneWireDecodePresence(noPresence, 1));
+  TEST_ASSERT_FALSE(oneWireDecodePresence(shortPulse, 2));
+
+  TEST_ASSERT_TRUE(oneWireDecodeBits(bits, 8, 8, value));
+  TEST_ASSERT_EQUAL_HEX8(0x65, value);
+  TEST_ASSERT_TRUE(oneWireDecodeBits(bits, 2, 2, value));
+  TEST_ASSERT_EQUAL_HEX8(0x01, value);
+  // a lost or extra pulse is an error, not a shifted value
+  TEST_ASSERT_FALSE(oneWireDecodeBits(bits, 7, 8, value));
+}
+
+// Maxim application note 27 example ROM, and the CRC property of a valid ROM
+static void test_crc8(void)
+{
+  const uint8_t rom[8] = {0x02, 0x1C, 0xB8, 0x01, 0x00, 0x00, 0x00, 0xA2};
+
+  TEST_ASSERT_EQUAL_HEX8(0xA2, oneWireCrc8(rom, 7));
+  TEST_ASSERT_EQUAL_HEX8(0x00, oneWireCrc8(rom, 8));
+  TEST_ASSERT_EQUAL_HEX8(0x00, oneWireCrc8(rom, 0));
+}
+
+// Read the scratchpad of each device by ROM address, with device timing
+// jitter : every byte arrives intact
+static void test_read_scratchpad(void)
+{
+  uint8_t scratchPad[9];
+  uint32_t errors = 0;
+
+  initDevices();
+
+  for (uint32_t n = 0; n < 3000; n++)
+  {
+    uint8_t d = n % SIM_DEVICES;
+
+    for (uint8_t i = 0; i < 8; i++)
+    {
+      devices[d].scratchPad[i] = simRandom(256);
+    }
+    devices[d].scratchPad[8] = oneWireCrc8(devices[d].scratchPad, 8);
+
+    TEST_ASSERT_TRUE(simReset());
+    simWrite(0x55);
+    for (uint8_t i = 0; i < 8; i++)
+    {
+      simWrite(devices[d].rom[i]);
+    }
+    simWrite(0xBE);
+    for (uint8_t i = 0; i < 9; i++)
+    {
+      TEST_ASSERT_TRUE(simRead(scratchPad[i]));
+    }
+
+    if ((memcmp(scratchPad, devices[d].scratchPad, 9) != 0) || (oneWireCrc8(scratchPad, 8) != scratchPad[8]))
+    {
+      errors++;
+    }
+  }
+  TEST_ASSERT_EQUAL(0, errors);
+}
+
+// nobody answers : no presence, reads are all ones
+static void test_empty_bus(void)
+{
+  uint8_t value;
+
+  initDevices();
+  for (uint8_t d = 0; d < SIM_DEVICES; d++)
+  {
+    devices[d].present = false;
+  }
+
+  TEST_ASSERT_FALSE(simReset());
+  simWrite(0xCC);
+  simWrite(0xBE);
+  TEST_ASSERT_TRUE(simRead(value));
+  TEST_ASSERT_EQUAL_HEX8(0xFF, value);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_encode_timing);
+  RUN_TEST(test_decode);
+  RUN_TEST(test_crc8);
+  RUN_TEST(test_read_scratchpad);
+  RUN_TEST(test_empty_bus);
+  return UNITY_END();
+}
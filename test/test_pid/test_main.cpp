@@ -0,0 +1,171 @@
+//
+// PID & SSR window : controller rules, and heating a kettle model
+//
+
+#include <unity.h>
+#include <math.h>
+#include "pid.h"
+#include "ssr.h"
+#include "thermalplant.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// config.h defaults : 2 s period (one SSR window), gains per sample
+#define PERIOD_MS       2000
+#define MIN_PULSE_MS    20
+
+static const pidParams_t defaultParams = {PID_Q16(40.0f), PID_Q16(0.2f), PID_Q16(100.0f), 0, PID_OUTPUT_MAX, 4};
+
+// 25 l kettle, 2 x 2500 W elements (20 s lag), 8 W/K losses, no cooling
+static const thermalPlantParams_t kettleParams =
+{
+  25.0f,      // wortKg
+  2000.0f,    // chamberJPerK : element & wall
+  300.0f,     // wortChamberWPerK : element -> water
+  8.0f,       // chamberAmbientWPerK
+  20.0f,      // ambientC
+  0.0f,       // coolingW
+  5000.0f,    // heatingW
+  60.0f,      // compressorTauS
+  20.0f,      // heaterTauS
+  0.0f,       // fermentationW
+  0.05f       // sensorNoiseC
+};
+
+static void test_proportional(void)
+{
+  pidParams_t params = {PID_Q16(10.0f), 0, 0, 0, PID_OUTPUT_MAX, 0};
+  Pid pid(params);
+
+  TEST_ASSERT_EQUAL(200, pid.update(650, 630));
+  TEST_ASSERT_EQUAL(0, pid.update(650, 650));
+  TEST_ASSERT_EQUAL(0, pid.update(650, 700));               // clamped at the minimum
+  TEST_ASSERT_EQUAL(PID_OUTPUT_MAX, pid.update(650, 200));  // and the maximum
+}
+
+// the integral does not wind up while the output is saturated
+static void test_anti_windup(void)
+{
+  pidParams_t params = {PID_Q16(10.0f), PID_Q16(1.0f), 0, 0, PID_OUTPUT_MAX, 0};
+  Pid pid(params);
+  int16_t output;
+
+  for (int i = 0; i < 1000; i++)
+  {
+    TEST_ASSERT_EQUAL(PID_OUTPUT_MAX, pid.update(650, 200));
+  }
+
+  // just above the set-point the output drops at once, not after 1000 samples
+  output = pid.update(650, 655);
+  TEST_ASSERT_TRUE(output < PID_OUTPUT_MAX);
+}
+
+// derivative on the measurement : a set-point step gives no kick
+static void test_setpoint_step(void)
+{
+  pidParams_t params = {0, 0, PID_Q16(100.0f), -PID_OUTPUT_MAX, PID_OUTPUT_MAX, 0};
+  Pid pid(params);
+
+  pid.update(650, 640);
+  TEST_ASSERT_EQUAL(0, pid.update(720, 640));
+  TEST_ASSERT_EQUAL(-100, pid.update(720, 641));
+}
+
+static void test_bumpless_reset(void)
+{
+  pidParams_t params = {0, PID_Q16(1.0f), 0, 0, PID_OUTPUT_MAX, 0};
+  Pid pid(params);
+
+  pid.reset(400);
+  TEST_ASSERT_EQUAL(400, pid.update(650, 650));
+}
+
+static void test_ssr_window(void)
+{
+  const uint32_t windowUs = PERIOD_MS * 1000;
+  const uint32_t minPulseUs = MIN_PULSE_MS * 1000;
+
+  TEST_ASSERT_EQUAL(0, ssrOnTimeUs(0, windowUs, minPulseUs));
+  TEST_ASSERT_EQUAL(0, ssrOnTimeUs(9, windowUs, minPulseUs));           // 18 ms : skipped
+  TEST_ASSERT_EQUAL(20000, ssrOnTimeUs(10, windowUs, minPulseUs));
+  TEST_ASSERT_EQUAL(1000000, ssrOnTimeUs(500, windowUs, minPulseUs));
+  TEST_ASSERT_EQUAL(1978000, ssrOnTimeUs(989, windowUs, minPulseUs));
+  TEST_ASSERT_EQUAL(windowUs, ssrOnTimeUs(990, windowUs, minPulseUs));  // 20 ms off : stays on
+  TEST_ASSERT_EQUAL(windowUs, ssrOnTimeUs(SSR_DUTY_MAX, windowUs, minPulseUs));
+}
+
+// Heat 20 -> 65 degrees, then a set-point step to 72 at 1.5 h. One PID
+// update per SSR window, the window on-time as the firmware computes it.
+static void test_kettle(void)
+{
+  ThermalPlant plant(kettleParams, 20.0f, 1);
+  Pid pid(defaultParams);
+  int16_t setPoint_x10 = 650;
+  int32_t reachedS = -1;
+  double maxC = 0;
+  double maxStepC = 0;
+  double sumSquares = 0;
+  uint32_t samples = 0;
+  char message[160];
+
+  for (uint32_t t = 0; t < 3 * 3600; t += PERIOD_MS / 1000)
+  {
+    uint16_t duty;
+    uint32_t onMs;
+    double wortC;
+
+    if (t == 5400)
+    {
+      setPoint_x10 = 720;
+    }
+
+    duty = pid.update(setPoint_x10, plant.getWortSensor_x10());
+    onMs = ssrOnTimeUs(duty, PERIOD_MS * 1000, MIN_PULSE_MS * 1000) / 1000;
+    plant.step(onMs, false, true);
+    plant.step(PERIOD_MS - onMs, false, false);
+
+    wortC = plant.getWortC();
+    if (t < 5400)
+    {
+      maxC = (wortC > maxC) ? wortC : maxC;
+      if ((reachedS < 0) && (fabs(wortC - 65.0) < 0.3))
+      {
+        reachedS = t;
+      }
+      if (t > 3600)
+      {
+        sumSquares += (wortC - 65.0) * (wortC - 65.0);
+        samples++;
+      }
+    }
+    else
+    {
+      maxStepC = (wortC > maxStepC) ? wortC : maxStepC;
+    }
+  }
+
+  snprintf(message, sizeof(message), "20 -> 65 reached at %d s, overshoot %.2f C, steady RMS %.3f C; 65 -> 72 overshoot %.2f C, final %.2f C",
+           (int)reachedS, maxC - 65.0, sqrt(sumSquares / samples), maxStepC - 72.0, plant.getWortC());
+  TEST_MESSAGE(message);
+
+  // full power needs about 15 minutes for 45 degrees
+  TEST_ASSERT_TRUE(reachedS > 0);
+  TEST_ASSERT_TRUE(reachedS < 1500);
+  TEST_ASSERT_TRUE(maxC - 65.0 < 0.5);
+  TEST_ASSERT_TRUE(sqrt(sumSquares / samples) < 0.1);
+  TEST_ASSERT_TRUE(maxStepC - 72.0 < 0.5);
+  TEST_ASSERT_TRUE(fabs(plant.getWortC() - 72.0) < 0.2);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_proportional);
+  RUN_TEST(test_anti_windup);
+  RUN_TEST(test_setpoint_step);
+  RUN_TEST(test_bumpless_reset);
+  RUN_TEST(test_ssr_window);
+  RUN_TEST(test_kettle);
+  return UNITY_END();
+}
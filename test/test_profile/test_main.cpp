@@ -0,0 +1,257 @@
+//
+// Profile : step timing, ramp interpolation, override and resume
+//
+
+#include <unity.h>
+#include <string.h>
+#include "profile.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define MINUTE_MS       60000UL
+
+// config.h default (CFG_TEMP_SAMPLE_PERIOD_MS)
+#define TICK_MS         1000
+
+static void addStep(profile_t &profile, profileStepType_t type, int16_t target_x10, uint32_t durationS, uint16_t sg_x1000 = 0)
+{
+  profileStep_t *s = &profile.steps[profile.numSteps++];
+
+  s->type = type;
+  s->target_x10 = target_x10;
+  s->durationS = durationS;
+  s->sg_x1000 = sg_x1000;
+}
+
+// hold 18.0 10 min, ramp to 21.0 in 30 min, hold 21.0 20 min
+static void aleProfile(profile_t &profile)
+{
+  memset(&profile, 0, sizeof(profile));
+  strcpy(profile.name, "ale");
+  addStep(profile, e_profile_hold, 180, 600);
+  addStep(profile, e_profile_ramp, 210, 1800);
+  addStep(profile, e_profile_hold, 210, 1200);
+}
+
+static void test_start_rejects(void)
+{
+  ProfileExecutor executor;
+  profile_t profile;
+
+  memset(&profile, 0, sizeof(profile));
+  TEST_ASSERT_FALSE(executor.start(profile, 0, 200));
+  aleProfile(profile);
+  TEST_ASSERT_FALSE(executor.start(profile, 0, 200, 3));
+  TEST_ASSERT_FALSE(executor.isRunning());
+  TEST_ASSERT_FALSE(executor.tick(1000, 0, false));
+  TEST_ASSERT_TRUE(executor.start(profile, 0, 200, 2));
+  TEST_ASSERT_EQUAL(210, executor.getSetPoint());
+}
+
+// Transitions on the tick that reaches the end of a step, also across a wrap
+// of millis(). With a tick that does not divide the step the excess counts
+// for the next step : the schedule does not drift.
+static void test_step_timing(void)
+{
+  static const uint32_t ticks[] = {TICK_MS, 7000, 45000};
+  static const uint32_t startMs[] = {0, UINT32_MAX - 20 * MINUTE_MS};
+  ProfileExecutor executor;
+  profile_t profile;
+  char message[64];
+
+  aleProfile(profile);
+  for (unsigned t = 0; t < sizeof(ticks) / sizeof(ticks[0]); t++)
+  {
+    for (unsigned s = 0; s < sizeof(startMs) / sizeof(startMs[0]); s++)
+    {
+      uint32_t elapsedMs = 0;
+      uint32_t transitionMs[3];
+      uint8_t transitions = 0;
+
+      snprintf(message, sizeof(message), "tick %u ms, start %u", (unsigned)ticks[t], (unsigned)startMs[s]);
+      TEST_ASSERT_TRUE(executor.start(profile, startMs[s], 200));
+      while (executor.isRunning())
+      {
+        elapsedMs += ticks[t];
+        if (executor.tick(startMs[s] + elapsedMs, 0, false))
+        {
+          TEST_ASSERT_TRUE_MESSAGE(transitions < 3, message);
+          transitionMs[transitions++] = elapsedMs;
+        }
+      }
+
+      TEST_ASSERT_EQUAL_MESSAGE(3, transitions, message);
+      TEST_ASSERT_TRUE_MESSAGE(transitionMs[0] >= 10 * MINUTE_MS, message);
+      TEST_ASSERT_TRUE_MESSAGE(transitionMs[0] < 10 * MINUTE_MS + ticks[t], message);
+      TEST_ASSERT_TRUE_MESSAGE(transitionMs[1] >= 40 * MINUTE_MS, message);
+      TEST_ASSERT_TRUE_MESSAGE(transitionMs[1] < 40 * MINUTE_MS + ticks[t], message);
+      TEST_ASSERT_TRUE_MESSAGE(transitionMs[2] >= 60 * MINUTE_MS, message);
+      TEST_ASSERT_TRUE_MESSAGE(transitionMs[2] < 60 * MINUTE_MS + ticks[t], message);
+      TEST_ASSERT_EQUAL_MESSAGE(210, executor.getSetPoint(), message);
+    }
+  }
+}
+
+// steps shorter than a tick pass in the same tick
+static void test_short_steps(void)
+{
+  ProfileExecutor executor;
+  profile_t profile;
+
+  memset(&profile, 0, sizeof(profile));
+  addStep(profile, e_profile_hold, 180, 60);
+  addStep(profile, e_profile_hold, 190, 1);
+  addStep(profile, e_profile_hold, 200, 1);
+  addStep(profile, e_profile_hold, 210, 600);
+
+  TEST_ASSERT_TRUE(executor.start(profile, 0, 180));
+  TEST_ASSERT_FALSE(executor.tick(59000, 0, false));
+  TEST_ASSERT_TRUE(executor.tick(65000, 0, false));
+  TEST_ASSERT_EQUAL(3, executor.getStep());
+  TEST_ASSERT_EQUAL(3000, executor.getStepElapsedMs());
+  TEST_ASSERT_EQUAL(210, executor.getSetPoint());
+}
+
+// A ramp moves linearly from the target of the step before, or from the
+// start set-point for the first step
+static void test_ramp(void)
+{
+  ProfileExecutor executor;
+  profile_t profile;
+  int16_t last;
+
+  aleProfile(profile);
+  TEST_ASSERT_TRUE(executor.start(profile, 0, 200));
+  TEST_ASSERT_EQUAL(180, executor.getSetPoint());
+  executor.tick(10 * MINUTE_MS, 0, false);
+  TEST_ASSERT_EQUAL(1, executor.getStep());
+  TEST_ASSERT_EQUAL(180, executor.getSetPoint());
+
+  last = executor.getSetPoint();
+  for (uint32_t nowMs = 10 * MINUTE_MS + TICK_MS; nowMs < 40 * MINUTE_MS; nowMs += TICK_MS)
+  {
+    executor.tick(nowMs, 0, false);
+    TEST_ASSERT_TRUE(executor.getSetPoint() >= last);
+    TEST_ASSERT_EQUAL(180 + (int32_t)30 * (nowMs - 10 * MINUTE_MS) / (30 * MINUTE_MS), executor.getSetPoint());
+    last = executor.getSetPoint();
+  }
+  executor.tick(40 * MINUTE_MS, 0, false);
+  TEST_ASSERT_EQUAL(2, executor.getStep());
+  TEST_ASSERT_EQUAL(210, executor.getSetPoint());
+
+  // first step a ramp down, from the start set-point
+  memset(&profile, 0, sizeof(profile));
+  addStep(profile, e_profile_ramp, 20, 1000);
+  TEST_ASSERT_TRUE(executor.start(profile, 0, 200));
+  TEST_ASSERT_EQUAL(200, executor.getSetPoint());
+  executor.tick(250000, 0, false);
+  TEST_ASSERT_EQUAL(155, executor.getSetPoint());
+  executor.tick(500000, 0, false);
+  TEST_ASSERT_EQUAL(110, executor.getSetPoint());
+  TEST_ASSERT_TRUE(executor.tick(1000000, 0, false));
+  TEST_ASSERT_FALSE(executor.isRunning());
+  TEST_ASSERT_EQUAL(20, executor.getSetPoint());
+}
+
+// wait-sg : on the gravity, or the time-out
+static void test_wait_sg(void)
+{
+  ProfileExecutor executor;
+  profile_t profile;
+
+  memset(&profile, 0, sizeof(profile));
+  addStep(profile, e_profile_wait_sg, 190, 3600, 1012);
+  addStep(profile, e_profile_hold, 20, 600);
+
+  TEST_ASSERT_TRUE(executor.start(profile, 0, 180));
+  TEST_ASSERT_FALSE(executor.tick(60000, 1013, true));
+  TEST_ASSERT_FALSE(executor.tick(120000, 1000, false));
+  TEST_ASSERT_TRUE(executor.tick(180000, 1012, true));
+  TEST_ASSERT_EQUAL(1, executor.getStep());
+  TEST_ASSERT_EQUAL(20, executor.getSetPoint());
+
+  TEST_ASSERT_TRUE(executor.start(profile, 0, 180));
+  TEST_ASSERT_FALSE(executor.tick(3599000, 1050, true));
+  TEST_ASSERT_TRUE(executor.tick(3600000, 1050, true));
+  TEST_ASSERT_EQUAL(1, executor.getStep());
+}
+
+// A backend set-point holds until the next step transition, the step timing
+// continues meanwhile
+static void test_override(void)
+{
+  ProfileExecutor executor;
+  profile_t profile;
+
+  aleProfile(profile);
+  TEST_ASSERT_TRUE(executor.start(profile, 0, 200));
+  executor.tick(11 * MINUTE_MS, 0, false);
+  executor.override(250);
+  TEST_ASSERT_TRUE(executor.isOverridden());
+  TEST_ASSERT_EQUAL(250, executor.getSetPoint());
+
+  for (uint32_t nowMs = 11 * MINUTE_MS + TICK_MS; nowMs < 40 * MINUTE_MS; nowMs += TICK_MS)
+  {
+    TEST_ASSERT_FALSE(executor.tick(nowMs, 0, false));
+    TEST_ASSERT_EQUAL(250, executor.getSetPoint());
+  }
+  TEST_ASSERT_EQUAL(1, executor.getStep());
+  TEST_ASSERT_EQUAL(30 * MINUTE_MS - TICK_MS, executor.getStepElapsedMs());
+
+  TEST_ASSERT_TRUE(executor.tick(40 * MINUTE_MS, 0, false));
+  TEST_ASSERT_FALSE(executor.isOverridden());
+  TEST_ASSERT_EQUAL(2, executor.getStep());
+  TEST_ASSERT_EQUAL(210, executor.getSetPoint());
+}
+
+// Resume after a reboot (step and elapsed time saved every CFG_PROFILE_SAVE_S) :
+// the same set-points and transitions as an uninterrupted run, the ramp
+// continues from where it was
+static void test_resume(void)
+{
+  ProfileExecutor reference;
+  ProfileExecutor resumed;
+  profile_t profile;
+  const uint32_t rebootMs = 25 * MINUTE_MS;
+  const uint32_t bootMs = 7000;                   // uptime of the resumed run
+  uint32_t nowMs;
+
+  aleProfile(profile);
+  TEST_ASSERT_TRUE(reference.start(profile, 0, 200));
+  for (nowMs = TICK_MS; nowMs <= rebootMs; nowMs += TICK_MS)
+  {
+    reference.tick(nowMs, 0, false);
+  }
+  TEST_ASSERT_EQUAL(1, reference.getStep());
+  TEST_ASSERT_EQUAL(15 * MINUTE_MS, reference.getStepElapsedMs());
+  TEST_ASSERT_EQUAL(195, reference.getSetPoint());
+
+  // the start set-point of the resumed run is not used, the ramp starts from
+  // the target of step 1
+  TEST_ASSERT_TRUE(resumed.start(profile, bootMs, 0, reference.getStep(), reference.getStepElapsedMs()));
+  TEST_ASSERT_EQUAL(reference.getSetPoint(), resumed.getSetPoint());
+
+  for (; nowMs <= 70 * MINUTE_MS; nowMs += TICK_MS)
+  {
+    bool transition = reference.tick(nowMs, 0, false);
+
+    TEST_ASSERT_EQUAL(transition, resumed.tick(nowMs - rebootMs + bootMs, 0, false));
+    TEST_ASSERT_EQUAL(reference.getSetPoint(), resumed.getSetPoint());
+    TEST_ASSERT_EQUAL(reference.isRunning(), resumed.isRunning());
+  }
+  TEST_ASSERT_FALSE(resumed.isRunning());
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_start_rejects);
+  RUN_TEST(test_step_timing);
+  RUN_TEST(test_short_steps);
+  RUN_TEST(test_ramp);
+  RUN_TEST(test_wait_sg);
+  RUN_TEST(test_override);
+  RUN_TEST(test_resume);
+  return UNITY_END();
+}
@@ -0,0 +1,146 @@
+//
+// Retained relay state : compressor delay over a warm reset
+//
+
+#include <unity.h>
+#include <string.h>
+#include "relayretain.h"
+#include "relayengine.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define COOL            0x01
+#define HEAT            0x02
+
+// config.h defaults
+#define COOL_ON_DELAY_MS    200000UL
+
+static const relayTiming_t timing[2] = {{COOL_ON_DELAY_MS, 0}, {0, 0}};
+
+// esp_rom_crc32_le(0, "123456789", 9)
+static void test_crc(void)
+{
+  TEST_ASSERT_EQUAL_HEX32(0xCBF43926, relayRetainCrc((const uint8_t *)"123456789", 9));
+  TEST_ASSERT_EQUAL_HEX32(0, relayRetainCrc(NULL, 0));
+}
+
+// power-on : RTC memory holds garbage, or the reset was not a warm one
+static void test_cold(void)
+{
+  RelayRetained<2> retained;
+  uint32_t offMs[2];
+
+  memset(&retained, 0xA5, sizeof(retained));
+  TEST_ASSERT_FALSE(retained.valid());
+  TEST_ASSERT_EQUAL(0, retained.restore(true, 1000000, offMs));
+
+  retained.recordSwitch(0, COOL | HEAT, 0);
+  TEST_ASSERT_TRUE(retained.valid());
+  TEST_ASSERT_EQUAL(0, retained.restore(false, 1000000, offMs));
+
+  // a bit flipped in the record
+  retained.switchUs[0] ^= 0x100;
+  TEST_ASSERT_FALSE(retained.valid());
+  TEST_ASSERT_EQUAL(0, retained.restore(true, 1000000, offMs));
+}
+
+// only relays that were off have a known off time, not a clock that went back
+static void test_restore(void)
+{
+  RelayRetained<2> retained;
+  uint32_t offMs[2] = {0, 0};
+
+  retained.recordSwitch(0, COOL | HEAT, 0);
+  retained.recordSwitch(COOL, COOL, 10000000);
+  retained.recordSwitch(0, COOL, 30000000);
+  TEST_ASSERT_EQUAL(COOL | HEAT, retained.restore(true, 150000000, offMs));
+  TEST_ASSERT_EQUAL(120000, offMs[0]);
+  TEST_ASSERT_EQUAL(150000, offMs[1]);
+
+  retained.recordSwitch(HEAT, HEAT, 140000000);
+  TEST_ASSERT_EQUAL(COOL, retained.restore(true, 150000000, offMs));
+
+  TEST_ASSERT_EQUAL(0, retained.restore(true, 20000000, offMs));
+}
+
+// The compressor switches off, the firmware restarts 150 s later (OTA, crash)
+// and cooling is requested right after the boot : the compressor starts 200 s
+// after it stopped, not 200 s after the boot. A relay that was on at the reset
+// gets the full delay.
+static uint32_t compressorStartMs(bool retain, uint16_t outputsAtReset)
+{
+  RelayRetained<2> retained;
+  uint32_t offMs[2];
+  const uint64_t rtcBootUs = 3600000000ULL;               // RTC time of the reset
+  const uint32_t bootMs = 2000;                           // uptime when the engine starts
+  uint16_t restored;
+
+  // before the reset : the last compressor switch 150 s before it (to off,
+  // or to outputsAtReset)
+  memset(&retained, 0x5A, sizeof(retained));
+  retained.recordSwitch(COOL, COOL | HEAT, rtcBootUs - 1800000000ULL);
+  retained.recordSwitch(outputsAtReset, COOL, rtcBootUs - 150000000ULL);
+
+  // the reset : the record and the RTC timer survive, uptime starts over
+  RelayEngine engine(timing, 2, bootMs);
+  restored = retained.restore(retain, rtcBootUs + bootMs * 1000ULL, offMs);
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    if ((restored >> i) & 1)
+    {
+      engine.restoreOff(i, offMs[i], bootMs);
+    }
+  }
+
+  for (uint32_t nowMs = bootMs; nowMs < bootMs + 2 * COOL_ON_DELAY_MS; nowMs += 100)
+  {
+    if (engine.update(nowMs, COOL) & COOL)
+    {
+      return nowMs - bootMs;
+    }
+  }
+  return UINT32_MAX;
+}
+
+static void test_warm_reset(void)
+{
+  uint32_t warmMs = compressorStartMs(true, 0);
+  uint32_t coldMs = compressorStartMs(false, 0);
+  uint32_t wasOnMs = compressorStartMs(true, COOL);
+  char message[128];
+
+  snprintf(message, sizeof(message), "compressor after boot : warm %u ms, cold %u ms, on at the reset %u ms",
+           (unsigned)warmMs, (unsigned)coldMs, (unsigned)wasOnMs);
+  TEST_MESSAGE(message);
+
+  // off 150 s + 2 s of boot : 48 s left
+  TEST_ASSERT_EQUAL(COOL_ON_DELAY_MS - 152000, warmMs);
+  TEST_ASSERT_EQUAL(COOL_ON_DELAY_MS, coldMs);
+  TEST_ASSERT_EQUAL(COOL_ON_DELAY_MS, wasOnMs);
+}
+
+// off longer than the delay : cooling starts at once
+static void test_long_off(void)
+{
+  RelayRetained<2> retained;
+  RelayEngine engine(timing, 2, 0);
+  uint32_t offMs[2];
+
+  retained.recordSwitch(0, COOL | HEAT, 0);
+  TEST_ASSERT_EQUAL(COOL | HEAT, retained.restore(true, 86400000000ULL, offMs));
+  engine.restoreOff(0, offMs[0], 0);
+  TEST_ASSERT_EQUAL(COOL, engine.update(0, COOL));
+  TEST_ASSERT_EQUAL(RELAY_ENGINE_NO_EVENT, engine.nextEventMs(0));
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_crc);
+  RUN_TEST(test_cold);
+  RUN_TEST(test_restore);
+  RUN_TEST(test_warm_reset);
+  RUN_TEST(test_long_off);
+  return UNITY_END();
+}
@@ -0,0 +1,147 @@
+//
+// ReportPolicy : rules, and sensor traffic before / after on the chamber model
+//
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "reportpolicy.h"
+#include "smoothbank.h"
+#include "../plantparams.h"
+
+// config.h defaults
+#define TEST_DEADBAND     1
+#define TEST_MIN_INTERVAL 1000
+#define TEST_HEARTBEAT    30000
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_first_report(void)
+{
+  ReportPolicy<2> policy(TEST_DEADBAND, TEST_MIN_INTERVAL, TEST_HEARTBEAT);
+
+  TEST_ASSERT_TRUE(policy.check(0, 200, true, 0));
+  TEST_ASSERT_TRUE(policy.check(1, 0, false, 0));
+  TEST_ASSERT_FALSE(policy.check(0, 200, true, 1000));
+
+  policy.reset();
+  TEST_ASSERT_TRUE(policy.check(0, 200, true, 2000));
+}
+
+// a change of the deadband or more is sent, not faster than the minimum interval
+static void test_deadband(void)
+{
+  ReportPolicy<1> policy(2, TEST_MIN_INTERVAL, TEST_HEARTBEAT);
+
+  TEST_ASSERT_TRUE(policy.check(0, 200, true, 0));
+  TEST_ASSERT_FALSE(policy.check(0, 201, true, 1000));
+  TEST_ASSERT_FALSE(policy.check(0, 199, true, 2000));
+  TEST_ASSERT_TRUE(policy.check(0, 198, true, 3000));
+  TEST_ASSERT_FALSE(policy.check(0, 210, true, 3500));   // minimum interval
+  TEST_ASSERT_TRUE(policy.check(0, 210, true, 4000));
+  TEST_ASSERT_TRUE(policy.check(0, -32768, true, 5000)); // no overflow
+  TEST_ASSERT_TRUE(policy.check(0, 32767, true, 6000));
+}
+
+// valid-flag changes are sent at once, invalid values do not count as a change
+static void test_valid_change(void)
+{
+  ReportPolicy<1> policy(TEST_DEADBAND, TEST_MIN_INTERVAL, TEST_HEARTBEAT);
+
+  TEST_ASSERT_TRUE(policy.check(0, 200, true, 0));
+  TEST_ASSERT_TRUE(policy.check(0, 0, false, 100));
+  TEST_ASSERT_FALSE(policy.check(0, 50, false, 2000));
+  TEST_ASSERT_TRUE(policy.check(0, 200, true, 2100));
+}
+
+// unchanged values every heartbeat, also across a clock wrap
+static void test_heartbeat(void)
+{
+  ReportPolicy<1> policy(TEST_DEADBAND, TEST_MIN_INTERVAL, TEST_HEARTBEAT);
+  uint32_t start = UINT32_MAX - 45000;
+  uint32_t sent = 0;
+
+  for (uint32_t t = 0; t <= 120000; t += 1000)
+  {
+    if (policy.check(0, 200, true, start + t))
+    {
+      TEST_ASSERT_EQUAL_UINT32(sent * TEST_HEARTBEAT, t);
+      sent++;
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(5, sent);
+}
+
+// 24 hours of the chamber model, 1 s samples, smoothing as in sensorsTask
+// and a cooling thermostat on the wort (12.0 +/- 0.5 degrees). Before : every
+// sample is sent. After : the reporting policy. Every controller message
+// of sensor 0 is one display redraw (label & chart point).
+static void test_traffic(void)
+{
+  ThermalPlant plant(testPlantParams, 20.0f, 1);
+  SmoothBank<2, 7> smooth;
+  ReportPolicy<2> policy(TEST_DEADBAND, TEST_MIN_INTERVAL, TEST_HEARTBEAT);
+  int16_t values[2];
+  bool valid[2] = {true, true};
+  int16_t reported[2] = {0, 0};
+  uint32_t reportedMs[2] = {0, 0};
+  uint32_t before[2] = {0, 0};
+  uint32_t after[2] = {0, 0};
+  bool cool = false;
+  char line[96];
+
+  smooth.setMaxDeviation(10);
+
+  for (uint32_t nowMs = 0; nowMs < 24 * 3600 * 1000UL; nowMs += 1000)
+  {
+    plant.step(1000, cool, false);
+    values[0] = plant.getWortSensor_x10();
+    values[1] = plant.getChamberSensor_x10();
+    smooth.setValues(values, valid);
+
+    for (uint8_t c = 0; c < 2; c++)
+    {
+      if (!smooth.isValid(c))
+      {
+        continue;
+      }
+      before[c]++;
+      if (policy.check(c, smooth.getValue(c), true, nowMs))
+      {
+        after[c]++;
+        reported[c] = smooth.getValue(c);
+        reportedMs[c] = nowMs;
+      }
+
+      // the shown value never lags more than the deadband, and is
+      // refreshed at least every heartbeat
+      TEST_ASSERT_TRUE(abs(smooth.getValue(c) - reported[c]) < TEST_DEADBAND);
+      TEST_ASSERT_TRUE(nowMs - reportedMs[c] < TEST_HEARTBEAT);
+    }
+
+    if (smooth.isValid(0))
+    {
+      cool = (smooth.getValue(0) > 125) ? true : (smooth.getValue(0) < 115) ? false : cool;
+    }
+  }
+
+  snprintf(line, sizeof(line), "messages/h wort : %u -> %u, chamber : %u -> %u",
+           (unsigned)(before[0] / 24), (unsigned)(after[0] / 24), (unsigned)(before[1] / 24), (unsigned)(after[1] / 24));
+  TEST_MESSAGE(line);
+  snprintf(line, sizeof(line), "display redraws/h : %u -> %u", (unsigned)(before[0] / 24), (unsigned)(after[0] / 24));
+  TEST_MESSAGE(line);
+
+  TEST_ASSERT_TRUE(after[0] * 5 < before[0]);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_first_report);
+  RUN_TEST(test_deadband);
+  RUN_TEST(test_valid_change);
+  RUN_TEST(test_heartbeat);
+  RUN_TEST(test_traffic);
+  return UNITY_END();
+}
@@ -0,0 +1,213 @@
+//
+// Scheduler : deadline order, coalescing, skipped periods, millis wrap
+//
+
+#include <unity.h>
+#include <stdlib.h>
+#include "scheduler.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// config.h default
+#define COALESCE_MS     10
+
+enum
+{
+  JOB_NTP,
+  JOB_TIME,
+  JOB_IOTAPI,
+  JOB_DUMP,
+  JOB_COUNT
+};
+
+typedef Scheduler<JOB_COUNT> TestScheduler;
+
+// run everything due at nowMs, returns the jobs as a bit mask
+static uint32_t runDue(TestScheduler &scheduler, uint32_t nowMs)
+{
+  uint32_t ran = 0;
+  uint8_t id;
+
+  while (scheduler.popDue(nowMs, id))
+  {
+    TEST_ASSERT_FALSE((ran >> id) & 1);
+    ran |= (1 << id);
+  }
+  return ran;
+}
+
+static void test_one_shot(void)
+{
+  TestScheduler scheduler(0);
+  uint8_t id;
+
+  TEST_ASSERT_EQUAL(SCHEDULER_IDLE, scheduler.msUntilNext(0));
+  scheduler.schedule(JOB_NTP, 100, 500);
+  TEST_ASSERT_TRUE(scheduler.isScheduled(JOB_NTP));
+  TEST_ASSERT_EQUAL(500, scheduler.msUntilNext(100));
+  TEST_ASSERT_FALSE(scheduler.popDue(599, id));
+  TEST_ASSERT_EQUAL(0, scheduler.msUntilNext(600));
+  TEST_ASSERT_TRUE(scheduler.popDue(600, id));
+  TEST_ASSERT_EQUAL(JOB_NTP, id);
+  TEST_ASSERT_FALSE(scheduler.isScheduled(JOB_NTP));
+  TEST_ASSERT_EQUAL(SCHEDULER_IDLE, scheduler.msUntilNext(600));
+}
+
+// re-schedule replaces the deadline, cancel removes the job
+static void test_reschedule_cancel(void)
+{
+  TestScheduler scheduler(0);
+  uint8_t order[JOB_COUNT];
+
+  scheduler.schedule(JOB_NTP, 0, 1000);
+  scheduler.schedule(JOB_TIME, 0, 2000);
+  scheduler.schedule(JOB_IOTAPI, 0, 3000);
+  scheduler.schedule(JOB_IOTAPI, 0, 500);
+  TEST_ASSERT_EQUAL(3, scheduler.getPending(order));
+  TEST_ASSERT_EQUAL(JOB_IOTAPI, order[0]);
+  TEST_ASSERT_EQUAL(JOB_NTP, order[1]);
+  TEST_ASSERT_EQUAL(JOB_TIME, order[2]);
+
+  scheduler.schedule(JOB_IOTAPI, 0, 5000);
+  scheduler.cancel(JOB_NTP);
+  scheduler.cancel(JOB_NTP);
+  TEST_ASSERT_EQUAL(2, scheduler.getPending(order));
+  TEST_ASSERT_EQUAL(JOB_TIME, order[0]);
+  TEST_ASSERT_EQUAL(JOB_IOTAPI, order[1]);
+  TEST_ASSERT_EQUAL(2000, scheduler.msUntilNext(0));
+}
+
+// jobs due within the coalesce window run in one wakeup, the next one waits
+static void test_coalesce(void)
+{
+  TestScheduler scheduler(COALESCE_MS);
+
+  scheduler.schedule(JOB_NTP, 0, 1000);
+  scheduler.schedule(JOB_TIME, 0, 1005);
+  scheduler.schedule(JOB_IOTAPI, 0, 1010);
+  scheduler.schedule(JOB_DUMP, 0, 1011);
+
+  TEST_ASSERT_EQUAL(0, runDue(scheduler, 989));
+  TEST_ASSERT_EQUAL((1 << JOB_NTP) | (1 << JOB_TIME) | (1 << JOB_IOTAPI), runDue(scheduler, 1000));
+  TEST_ASSERT_EQUAL(11, scheduler.msUntilNext(1000));
+  TEST_ASSERT_EQUAL(1 << JOB_DUMP, runDue(scheduler, 1001));
+}
+
+// Periodic jobs keep their phase : a late run does not shift the next
+// deadline, a busy task skips whole periods and counts them
+static void test_periodic_skip(void)
+{
+  TestScheduler scheduler(0);
+  schedulerJobStats_t stats;
+
+  scheduler.setName(JOB_TIME, "time");
+  scheduler.schedule(JOB_TIME, 0, 1000, 1000);
+
+  TEST_ASSERT_EQUAL(1 << JOB_TIME, runDue(scheduler, 1300));
+  TEST_ASSERT_EQUAL(700, scheduler.msUntilNext(1300));
+
+  // busy from 2000 to 5500 : 2000 runs, 3000 .. 5000 are skipped
+  TEST_ASSERT_EQUAL(1 << JOB_TIME, runDue(scheduler, 5500));
+  TEST_ASSERT_EQUAL(500, scheduler.msUntilNext(5500));
+  TEST_ASSERT_EQUAL(1 << JOB_TIME, runDue(scheduler, 6000));
+
+  scheduler.getStats(JOB_TIME, stats);
+  TEST_ASSERT_EQUAL_STRING("time", stats.name);
+  TEST_ASSERT_EQUAL(1000, stats.periodMs);
+  TEST_ASSERT_EQUAL(7000, stats.dueMs);
+  TEST_ASSERT_EQUAL(3, stats.runs);
+  TEST_ASSERT_EQUAL(3, stats.skipped);
+}
+
+// millis() wraps after 49.7 days : deadlines across the wrap keep their order
+static void test_wrap(void)
+{
+  TestScheduler scheduler(0);
+  const uint32_t startMs = UINT32_MAX - 1500;
+  uint8_t order[JOB_COUNT];
+  uint32_t runs = 0;
+
+  scheduler.schedule(JOB_NTP, startMs, 3000);
+  scheduler.schedule(JOB_TIME, startMs, 1000, 1000);
+  scheduler.schedule(JOB_IOTAPI, startMs, 500);
+  TEST_ASSERT_EQUAL(3, scheduler.getPending(order));
+  TEST_ASSERT_EQUAL(JOB_IOTAPI, order[0]);
+  TEST_ASSERT_EQUAL(JOB_TIME, order[1]);
+  TEST_ASSERT_EQUAL(JOB_NTP, order[2]);
+  TEST_ASSERT_EQUAL(500, scheduler.msUntilNext(startMs));
+
+  TEST_ASSERT_EQUAL(1 << JOB_IOTAPI, runDue(scheduler, startMs + 500));
+  TEST_ASSERT_EQUAL(1 << JOB_TIME, runDue(scheduler, startMs + 1000));
+  TEST_ASSERT_EQUAL(1000, scheduler.msUntilNext(startMs + 1000));
+  TEST_ASSERT_EQUAL(0, runDue(scheduler, startMs + 1999));
+  TEST_ASSERT_EQUAL(1 << JOB_TIME, runDue(scheduler, startMs + 2000));
+  TEST_ASSERT_EQUAL((1 << JOB_NTP) | (1 << JOB_TIME), runDue(scheduler, startMs + 3000));
+  TEST_ASSERT_TRUE(startMs + 3000 < startMs);
+
+  for (uint32_t nowMs = startMs + 3001; nowMs != startMs + 13001; nowMs++)
+  {
+    runs += (runDue(scheduler, nowMs) != 0);
+  }
+  TEST_ASSERT_EQUAL(10, runs);
+}
+
+// Random schedule, reschedule and cancel against a brute force model : the
+// job popped is always one with the earliest deadline
+static void test_heap_order(void)
+{
+  Scheduler<16> scheduler(0);
+  uint32_t due[16];
+  bool pending[16] = {false};
+  uint32_t nowMs = UINT32_MAX - 100000;
+  uint8_t id;
+
+  srand(1);
+  for (uint32_t i = 0; i < 20000; i++)
+  {
+    uint8_t job = rand() % 16;
+
+    switch (rand() % 4)
+    {
+    case 0:
+    case 1:
+      due[job] = nowMs + rand() % 5000;
+      pending[job] = true;
+      scheduler.schedule(job, nowMs, due[job] - nowMs);
+      break;
+    case 2:
+      pending[job] = false;
+      scheduler.cancel(job);
+      break;
+    default:
+      nowMs += rand() % 200;
+      while (scheduler.popDue(nowMs, id))
+      {
+        TEST_ASSERT_TRUE(pending[id]);
+        TEST_ASSERT_TRUE((int32_t)(due[id] - nowMs) <= 0);
+        for (uint8_t j = 0; j < 16; j++)
+        {
+          TEST_ASSERT_FALSE(pending[j] && ((int32_t)(due[j] - due[id]) < 0));
+        }
+        pending[id] = false;
+      }
+      break;
+    }
+    for (uint8_t j = 0; j < 16; j++)
+    {
+      TEST_ASSERT_EQUAL(pending[j], scheduler.isScheduled(j));
+    }
+  }
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_one_shot);
+  RUN_TEST(test_reschedule_cancel);
+  RUN_TEST(test_coalesce);
+  RUN_TEST(test_periodic_skip);
+  RUN_TEST(test_wrap);
+  RUN_TEST(test_heap_order);
+  return UNITY_END();
+}
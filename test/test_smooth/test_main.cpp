@@ -0,0 +1,201 @@
+//
+// Smooth<> : output equal to the qsort reference (smoothref.h)
+//
+
+#include <unity.h>
+#include "smooth.h"
+#include "../smoothref.h"
+
+#define TEST_SAMPLES  5000
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// every sample : same validity and value as the reference
+template <int SAMPLE_WINDOW> static void checkEqual(int maxDeviation, uint32_t seed)
+{
+  Smooth<SAMPLE_WINDOW> smooth;
+  SmoothQsort<SAMPLE_WINDOW> reference;
+  SmoothSignal signal(seed);
+  char message[64];
+
+  smooth.setMaxDeviation(maxDeviation);
+  reference.setMaxDeviation(maxDeviation);
+
+  for (int i = 0; i < TEST_SAMPLES; i++)
+  {
+    int value = signal.next();
+
+    smooth.setValue(value);
+    reference.setValue(value);
+
+    snprintf(message, sizeof(message), "window %d, max deviation %d, sample %d", SAMPLE_WINDOW, maxDeviation, i);
+    TEST_ASSERT_EQUAL_MESSAGE(reference.isValid(), smooth.isValid(), message);
+    TEST_ASSERT_EQUAL_MESSAGE(reference.getValue(), smooth.getValue(), message);
+  }
+}
+
+template <int SAMPLE_WINDOW> static void checkWindow(void)
+{
+  const int maxDeviations[] = {0, 1, 2, 5, 20, 1000};
+
+  for (unsigned d = 0; d < sizeof(maxDeviations) / sizeof(maxDeviations[0]); d++)
+  {
+    checkEqual<SAMPLE_WINDOW>(maxDeviations[d], 1 + d);
+  }
+}
+
+// sorting network windows (SMOOTH_NETWORK_MAX_WINDOW and below)
+static void test_network_window_3(void)
+{
+  checkWindow<3>();
+}
+
+static void test_network_window_5(void)
+{
+  checkWindow<5>();
+}
+
+static void test_network_window_7(void)
+{
+  checkWindow<7>();
+}
+
+static void test_network_window_9(void)
+{
+  checkWindow<9>();
+}
+
+static void test_network_window_15(void)
+{
+  checkWindow<15>();
+}
+
+// network and ordered window, same samples : same median and valid sum
+template <int SAMPLE_WINDOW> static void checkNetworkOrdered(void)
+{
+  SmoothNetworkWindow<SAMPLE_WINDOW> network;
+  SmoothOrderedWindow<SAMPLE_WINDOW> ordered;
+  SmoothSignal signal(SAMPLE_WINDOW);
+  long networkSum;
+  long orderedSum;
+  int networkValid;
+  int orderedValid;
+
+  for (int i = 0; i < SAMPLE_WINDOW; i++)
+  {
+    int value = signal.next();
+
+    network.fill(i, value);
+    ordered.fill(i, value);
+  }
+
+  for (int i = 0; i < TEST_SAMPLES; i++)
+  {
+    int value = signal.next();
+    int maxDeviation = i % 7;
+
+    network.replace(value);
+    ordered.replace(value);
+
+    TEST_ASSERT_EQUAL(ordered.median(), network.median());
+    networkSum = network.sumValid(network.median(), maxDeviation, networkValid);
+    orderedSum = ordered.sumValid(ordered.median(), maxDeviation, orderedValid);
+    TEST_ASSERT_EQUAL(orderedValid, networkValid);
+    TEST_ASSERT_EQUAL(orderedSum, networkSum);
+  }
+}
+
+static void test_network_equals_ordered(void)
+{
+  checkNetworkOrdered<3>();
+  checkNetworkOrdered<5>();
+  checkNetworkOrdered<7>();
+  checkNetworkOrdered<9>();
+  checkNetworkOrdered<15>();
+}
+
+static void test_ordered_window_16(void)
+{
+  checkWindow<16>();
+}
+
+static void test_ordered_window_31(void)
+{
+  checkWindow<31>();
+}
+
+static void test_ordered_window_64(void)
+{
+  checkWindow<64>();
+}
+
+static void test_ordered_window_255(void)
+{
+  checkWindow<255>();
+}
+
+// negative values, all equal values
+static void test_ordered_window_special(void)
+{
+  Smooth<31> smooth;
+  SmoothQsort<31> reference;
+
+  smooth.setMaxDeviation(3);
+  reference.setMaxDeviation(3);
+  for (int i = 0; i < 200; i++)
+  {
+    int value = (i < 100) ? -550 + (i % 7) : 42;
+
+    smooth.setValue(value);
+    reference.setValue(value);
+    TEST_ASSERT_EQUAL(reference.isValid(), smooth.isValid());
+    TEST_ASSERT_EQUAL(reference.getValue(), smooth.getValue());
+  }
+  TEST_ASSERT_EQUAL(42, smooth.getValue());
+}
+
+// a steady ramp (values in arrival order) must not degenerate the tree
+static void test_ordered_window_depth(void)
+{
+  SmoothOrderedWindow<255> ramp;
+  SmoothOrderedWindow<255> noise;
+  SmoothSignal signal;
+  int maxRamp = 0;
+  int maxNoise = 0;
+
+  for (int i = 0; i < 255; i++)
+  {
+    ramp.fill(i, i);
+    noise.fill(i, signal.next());
+  }
+  for (int i = 255; i < 20000; i++)
+  {
+    ramp.replace(i);
+    noise.replace(signal.next());
+    maxRamp = (ramp.depth() > maxRamp) ? ramp.depth() : maxRamp;
+    maxNoise = (noise.depth() > maxNoise) ? noise.depth() : maxNoise;
+  }
+
+  // random binary search tree of 255 nodes : expected depth ~ 4.3 ln N = 24
+  TEST_ASSERT_LESS_OR_EQUAL(30, maxRamp);
+  TEST_ASSERT_LESS_OR_EQUAL(30, maxNoise);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_network_window_3);
+  RUN_TEST(test_network_window_5);
+  RUN_TEST(test_network_window_7);
+  RUN_TEST(test_network_window_9);
+  RUN_TEST(test_network_window_15);
+  RUN_TEST(test_network_equals_ordered);
+  RUN_TEST(test_ordered_window_16);
+  RUN_TEST(test_ordered_window_31);
+  RUN_TEST(test_ordered_window_64);
+  RUN_TEST(test_ordered_window_255);
+  RUN_TEST(test_ordered_window_special);
+  RUN_TEST(test_ordered_window_depth);
+  return UNITY_END();
+}
@@ -0,0 +1,140 @@
+//
+// Smooth<> benchmark : time per sample against the qsort reference,
+// SmoothBank against separate Smooth<> per channel
+//
+// pio test -e native -f test_smooth_bench -v   (prints the table)
+//
+
+#include <unity.h>
+#include <stdio.h>
+#include "smooth.h"
+#include "smoothbank.h"
+#include "../smoothref.h"
+#include "../bench.h"
+
+#define BENCH_SAMPLES   200000
+
+void setUp(void) {}
+void tearDown(void) {}
+
+template <class FILTER> static uint64_t perSample(void)
+{
+  static FILTER filter;
+  static int input[BENCH_SAMPLES];
+  SmoothSignal signal;
+  uint64_t start;
+  uint64_t stop;
+
+  for (int i = 0; i < BENCH_SAMPLES; i++)
+  {
+    input[i] = signal.next();
+  }
+
+  filter.setMaxDeviation(10);
+  start = benchNow();
+  for (int i = 0; i < BENCH_SAMPLES; i++)
+  {
+    filter.setValue(input[i]);
+  }
+  stop = benchNow();
+  benchSink = filter.getValue();
+
+  return (stop - start) / BENCH_SAMPLES;
+}
+
+template <int SAMPLE_WINDOW> static void benchWindow(void)
+{
+  uint64_t smooth = perSample<Smooth<SAMPLE_WINDOW> >();
+  uint64_t reference = perSample<SmoothQsort<SAMPLE_WINDOW> >();
+  char line[96];
+
+  snprintf(line, sizeof(line), "window %3d : Smooth %5u, qsort %6u %s/sample", SAMPLE_WINDOW,
+           (unsigned)smooth, (unsigned)reference, BENCH_UNIT);
+  TEST_MESSAGE(line);
+}
+
+// sorting network (SMOOTH_NETWORK_MAX_WINDOW and below)
+static void test_bench_network(void)
+{
+  benchWindow<3>();
+  benchWindow<5>();
+  benchWindow<7>();
+  benchWindow<9>();
+  benchWindow<15>();
+}
+
+static void test_bench_ordered(void)
+{
+  benchWindow<31>();
+  benchWindow<63>();
+  benchWindow<127>();
+  benchWindow<255>();
+}
+
+// one scan of CHANNELS values : SmoothBank against CHANNELS separate Smooth
+template <int CHANNELS, int SAMPLE_WINDOW> static void benchBank(void)
+{
+  static SmoothBank<CHANNELS, SAMPLE_WINDOW> bank;
+  static Smooth<SAMPLE_WINDOW> smooth[CHANNELS];
+  static int16_t input[BENCH_SAMPLES / CHANNELS][CHANNELS];
+  SmoothSignal signal;
+  bool valid[CHANNELS];
+  uint64_t start;
+  uint64_t bankCycles;
+  uint64_t smoothCycles;
+  char line[96];
+
+  for (int i = 0; i < BENCH_SAMPLES / CHANNELS; i++)
+  {
+    for (int c = 0; c < CHANNELS; c++)
+    {
+      input[i][c] = signal.next();
+    }
+  }
+  for (int c = 0; c < CHANNELS; c++)
+  {
+    valid[c] = true;
+    smooth[c].setMaxDeviation(10);
+  }
+  bank.setMaxDeviation(10);
+
+  start = benchNow();
+  for (int i = 0; i < BENCH_SAMPLES / CHANNELS; i++)
+  {
+    bank.setValues(input[i], valid);
+  }
+  bankCycles = benchNow() - start;
+  benchSink = bank.getValue(0);
+
+  start = benchNow();
+  for (int i = 0; i < BENCH_SAMPLES / CHANNELS; i++)
+  {
+    for (int c = 0; c < CHANNELS; c++)
+    {
+      smooth[c].setValue(input[i][c]);
+    }
+  }
+  smoothCycles = benchNow() - start;
+  benchSink = smooth[0].getValue();
+
+  snprintf(line, sizeof(line), "%2d channels, window %2d : SmoothBank %5u, %d x Smooth %5u %s/scan", CHANNELS, SAMPLE_WINDOW,
+           (unsigned)(bankCycles * CHANNELS / BENCH_SAMPLES), CHANNELS, (unsigned)(smoothCycles * CHANNELS / BENCH_SAMPLES), BENCH_UNIT);
+  TEST_MESSAGE(line);
+}
+
+static void test_bench_bank(void)
+{
+  benchBank<1, 7>();
+  benchBank<8, 7>();
+  benchBank<16, 7>();
+  benchBank<16, 15>();
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_bench_network);
+  RUN_TEST(test_bench_ordered);
+  RUN_TEST(test_bench_bank);
+  return UNITY_END();
+}
@@ -0,0 +1,116 @@
+//
+// SmoothBank : every channel equal to a separate Smooth<>
+//
+
+#include <unity.h>
+#include "smoothbank.h"
+#include "../smoothref.h"
+
+#define TEST_CHANNELS 16
+#define TEST_SAMPLES  3000
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// all inputs valid : same validity & value as Smooth, from the first sample
+template <int SAMPLE_WINDOW> static void checkBank(void)
+{
+  static SmoothBank<TEST_CHANNELS, SAMPLE_WINDOW> bank;
+  static Smooth<SAMPLE_WINDOW> smooth[TEST_CHANNELS];
+  SmoothSignal signal[TEST_CHANNELS];
+  int16_t values[TEST_CHANNELS];
+  bool valid[TEST_CHANNELS];
+  char message[64];
+
+  bank = SmoothBank<TEST_CHANNELS, SAMPLE_WINDOW>();
+  for (int c = 0; c < TEST_CHANNELS; c++)
+  {
+    smooth[c] = Smooth<SAMPLE_WINDOW>();
+    signal[c] = SmoothSignal(c + 1);
+    bank.setMaxDeviation(c, c % 6);
+    smooth[c].setMaxDeviation(c % 6);
+    valid[c] = true;
+  }
+
+  for (int i = 0; i < TEST_SAMPLES; i++)
+  {
+    for (int c = 0; c < TEST_CHANNELS; c++)
+    {
+      values[c] = signal[c].next();
+      smooth[c].setValue(values[c]);
+    }
+    bank.setValues(values, valid);
+
+    for (int c = 0; c < TEST_CHANNELS; c++)
+    {
+      snprintf(message, sizeof(message), "window %d, channel %d, sample %d", SAMPLE_WINDOW, c, i);
+      TEST_ASSERT_EQUAL_MESSAGE(smooth[c].isValid(), bank.isValid(c), message);
+      TEST_ASSERT_EQUAL_MESSAGE(smooth[c].getValue(), bank.getValue(c), message);
+    }
+  }
+}
+
+static void test_bank_equals_smooth(void)
+{
+  checkBank<3>();
+  checkBank<7>();
+  checkBank<15>();
+}
+
+// first output after SAMPLE_WINDOW samples, like Smooth
+static void test_bank_fill(void)
+{
+  SmoothBank<2, 7> bank;
+  int16_t values[2] = {200, 300};
+  bool valid[2] = {true, true};
+
+  bank.setMaxDeviation(5);
+  for (int i = 0; i < 7; i++)
+  {
+    bank.setValues(values, valid);
+    TEST_ASSERT_FALSE(bank.isValid(0));
+    TEST_ASSERT_FALSE(bank.isValid(1));
+  }
+  bank.setValues(values, valid);
+  TEST_ASSERT_TRUE(bank.isValid(0));
+  TEST_ASSERT_EQUAL(200, bank.getValue(0));
+  TEST_ASSERT_EQUAL(300, bank.getValue(1));
+}
+
+// invalid input : no output for that channel and scan, the other channel
+// is not affected, the window keeps the previous sample
+static void test_bank_invalid_input(void)
+{
+  SmoothBank<2, 3> bank;
+  int16_t values[2] = {200, 300};
+  bool valid[2] = {true, true};
+
+  bank.setMaxDeviation(5);
+  for (int i = 0; i < 4; i++)
+  {
+    bank.setValues(values, valid);
+  }
+  TEST_ASSERT_TRUE(bank.isValid(0));
+
+  values[0] = -1270;
+  valid[0] = false;
+  bank.setValues(values, valid);
+  TEST_ASSERT_FALSE(bank.isValid(0));
+  TEST_ASSERT_TRUE(bank.isValid(1));
+  TEST_ASSERT_EQUAL(300, bank.getValue(1));
+
+  values[0] = 202;
+  valid[0] = true;
+  bank.setValues(values, valid);
+  TEST_ASSERT_TRUE(bank.isValid(0));
+  TEST_ASSERT_EQUAL(200, bank.getValue(0));    // 200 200 202
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_bank_equals_smooth);
+  RUN_TEST(test_bank_fill);
+  RUN_TEST(test_bank_invalid_input);
+  return UNITY_END();
+}
@@ -0,0 +1,221 @@
+//
+// Task wakeups per second, before / after blocking task loops : a host model
+//
+// pio test -e native -f test_wakeups -v   (prints the table)
+//
+// One hour of quiet fermentation (chamber model, cooling thermostat, no
+// hydrometer, backend offline) on a 1 ms clock. The message traffic is the
+// same for both loop structures:
+// - sensors : a scan every second, reports through ReportPolicy
+// - controller jobs : time (5 s), IoT API (60 s, retry interval when the
+//   backend does not answer), PRO API (CFG_COMM_PROAPI_INTERVAL), telemetry
+//   (60 s). An API call is a message to comms, its answer a message back.
+// - a thermostat change is a message to actuators, a temperature of sensor 0
+//   and the time are notifications to the display
+//
+// Before : every task waits on its queue with a fixed timeout (controller
+// 10 ms, comms / hydro / display 100 ms, actuators 1 s). After : the
+// controller waits until a message or the first job deadline, comms and
+// hydro until a message, actuators until a message or the end of a relay
+// delay (RelayEngine), the display until a notification or the next LVGL
+// deadline (CFG_DISPLAY_LVGL_PERIOD_MS while LVGL has work).
+//
+// This counts wakeups of the application tasks only. WiFi, lwIP, esp_timer
+// and the tick itself are not modelled, and neither is the idle share : both
+// need the telemetry log on the target.
+
+#include <unity.h>
+#include <stdio.h>
+#include "reportpolicy.h"
+#include "relayengine.h"
+#include "smoothbank.h"
+#include "../plantparams.h"
+
+#define SIM_HOUR_MS       (3600 * 1000UL)
+#define SIM_NEVER         UINT32_MAX
+
+void setUp(void) {}
+void tearDown(void) {}
+
+enum { t_ctrl, t_comms, t_hydro, t_disp, t_acts, t_sens, t_count };
+
+static const char *names[t_count] = {"ctrl", "comms", "hydro", "disp", "acts", "sens"};
+
+// queue wait with timeout (before) : wakes at the timeout after the last wakeup
+static const uint32_t pollMs[t_count] = {10, 100, 100, 100, 1000, 1000};
+
+typedef struct
+{
+  uint32_t pending;           // messages / notifications
+  uint32_t deadlineMs;        // timeout of the wait
+  uint32_t wakeups;
+} simTask_t;
+
+typedef struct
+{
+  uint32_t dueMs;
+  uint32_t periodMs;
+} simJob_t;
+
+enum { j_time, j_iotapi, j_proapi, j_telemetry, j_count };
+
+static void simulate(bool blocking, uint32_t *wakeups)
+{
+  static const relayTiming_t timing[2] = {{200000, 0}, {0, 0}};
+  ThermalPlant plant(testPlantParams, 12.0f, 1);
+  SmoothBank<2, 7> smooth;
+  ReportPolicy<2> policy(1, 1000, 30000);
+  RelayEngine engine(timing, 2, 0);
+  simTask_t tasks[t_count] = {};
+  simJob_t jobs[j_count] = {{5000, 5000}, {5000, 60000}, {10000, 60000}, {60000, 60000}};
+  uint32_t apiAnswers = 0;
+  uint32_t temperatures = 0;  // reports of sensor 0 waiting for the controller
+  uint16_t request = 0;
+  int16_t values[2];
+  bool valid[2] = {true, true};
+  bool cool = false;
+
+  smooth.setMaxDeviation(10);
+
+  for (uint32_t nowMs = 0; nowMs < SIM_HOUR_MS; nowMs++)
+  {
+    // sensors : fixed rate in both
+    if (nowMs % 1000 == 0)
+    {
+      tasks[t_sens].wakeups++;
+      plant.step(1000, engine.getActual() & 1, false);
+      values[0] = plant.getWortSensor_x10();
+      values[1] = plant.getChamberSensor_x10();
+      smooth.setValues(values, valid);
+      for (uint8_t c = 0; c < 2; c++)
+      {
+        if (smooth.isValid(c) && policy.check(c, smooth.getValue(c), true, nowMs))
+        {
+          tasks[t_ctrl].pending++;
+          temperatures += (c == 0);
+        }
+      }
+    }
+
+    // controller
+    if ((tasks[t_ctrl].pending > 0) || (nowMs >= tasks[t_ctrl].deadlineMs))
+    {
+      uint32_t nextJobMs = SIM_NEVER;
+
+      tasks[t_ctrl].wakeups++;
+      tasks[t_ctrl].pending = 0;
+
+      // a temperature of sensor 0 : display & thermostat
+      if (temperatures > 0)
+      {
+        temperatures = 0;
+        bool newCool = (smooth.getValue(0) > 125) ? true : (smooth.getValue(0) < 115) ? false : cool;
+
+        tasks[t_disp].pending++;
+        if (newCool != cool)
+        {
+          cool = newCool;
+          request = cool ? 1 : 0;
+          tasks[t_acts].pending++;
+        }
+      }
+
+      for (uint8_t j = 0; j < j_count; j++)
+      {
+        if (nowMs >= jobs[j].dueMs)
+        {
+          jobs[j].dueMs += jobs[j].periodMs;
+          if (j == j_time)
+          {
+            tasks[t_disp].pending++;
+          }
+          if ((j == j_iotapi) || (j == j_proapi))
+          {
+            tasks[t_comms].pending++;
+          }
+        }
+        nextJobMs = (jobs[j].dueMs < nextJobMs) ? jobs[j].dueMs : nextJobMs;
+      }
+      tasks[t_ctrl].deadlineMs = blocking ? nextJobMs : nowMs + pollMs[t_ctrl];
+    }
+
+    // communication : an API call, answered in the same millisecond
+    if ((tasks[t_comms].pending > 0) || (nowMs >= tasks[t_comms].deadlineMs))
+    {
+      tasks[t_comms].wakeups++;
+      apiAnswers += tasks[t_comms].pending;
+      tasks[t_ctrl].pending += tasks[t_comms].pending;
+      tasks[t_comms].pending = 0;
+      tasks[t_comms].deadlineMs = blocking ? SIM_NEVER : nowMs + pollMs[t_comms];
+    }
+
+    // hydrometer : no brick, no messages
+    if (nowMs >= tasks[t_hydro].deadlineMs)
+    {
+      tasks[t_hydro].wakeups++;
+      tasks[t_hydro].deadlineMs = blocking ? SIM_NEVER : nowMs + pollMs[t_hydro];
+    }
+
+    // display : LVGL has a refresh timer, so it always has a next deadline
+    if ((tasks[t_disp].pending > 0) || (nowMs >= tasks[t_disp].deadlineMs))
+    {
+      tasks[t_disp].wakeups++;
+      tasks[t_disp].pending = 0;
+      tasks[t_disp].deadlineMs = nowMs + (blocking ? 100 : pollMs[t_disp]);
+    }
+
+    // actuators
+    if ((tasks[t_acts].pending > 0) || (nowMs >= tasks[t_acts].deadlineMs))
+    {
+      uint32_t waitMs;
+
+      tasks[t_acts].wakeups++;
+      tasks[t_acts].pending = 0;
+      engine.update(nowMs, request);
+      waitMs = engine.nextEventMs(nowMs);
+      tasks[t_acts].deadlineMs = !blocking ? nowMs + pollMs[t_acts] : (waitMs == RELAY_ENGINE_NO_EVENT) ? SIM_NEVER : nowMs + waitMs;
+    }
+  }
+
+  for (uint8_t i = 0; i < t_count; i++)
+  {
+    wakeups[i] = tasks[i].wakeups;
+  }
+  TEST_ASSERT_TRUE(apiAnswers > 0);
+}
+
+static void test_wakeups(void)
+{
+  uint32_t before[t_count];
+  uint32_t after[t_count];
+  uint32_t totalBefore = 0;
+  uint32_t totalAfter = 0;
+  char line[96];
+
+  simulate(false, before);
+  simulate(true, after);
+
+  for (uint8_t i = 0; i < t_count; i++)
+  {
+    snprintf(line, sizeof(line), "%-5s : %6.2f -> %6.2f wakeups/s", names[i], before[i] / 3600.0, after[i] / 3600.0);
+    TEST_MESSAGE(line);
+    totalBefore += before[i];
+    totalAfter += after[i];
+    TEST_ASSERT_TRUE(after[i] <= before[i]);
+  }
+  snprintf(line, sizeof(line), "total : %6.2f -> %6.2f wakeups/s", totalBefore / 3600.0, totalAfter / 3600.0);
+  TEST_MESSAGE(line);
+
+  // only the display (LVGL) and the sensor scan remain periodic
+  TEST_ASSERT_TRUE(after[t_ctrl] < 3600);
+  TEST_ASSERT_TRUE(after[t_comms] < 3600 / 10);
+  TEST_ASSERT_TRUE(after[t_hydro] <= 1);   // task start
+  TEST_ASSERT_TRUE(after[t_acts] < 3600 / 10);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_wakeups);
+  return UNITY_END();
+}